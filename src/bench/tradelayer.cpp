@@ -0,0 +1,360 @@
+#include <bench/bench.h>
+
+#include <tradelayer/ce.h>
+#include <tradelayer/consensushash.h>
+#include <tradelayer/fees.h>
+#include <tradelayer/mdex.h>
+#include <tradelayer/register.h>
+#include <tradelayer/sp.h>
+#include <tradelayer/statewriter.h>
+#include <tradelayer/tally.h>
+#include <tradelayer/tradelayer.h>
+#include <tradelayer/tx.h>
+
+#include <chainparams.h>
+#include <fs.h>
+#include <primitives/block.h>
+#include <serialize.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <uint256.h>
+#include <util/system.h>
+#include <version.h>
+
+#include <assert.h>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+using namespace mastercore;
+
+// The sizes of the synthetic states can be changed with the following arguments:
+//   -tlbookdepth=<n>  number of resting orders in the order books (default: 100)
+//   -tlaccounts=<n>   number of addresses with balances (default: 10000)
+//   -tlpositions=<n>  number of open contract positions (default: 1000)
+
+static const int64_t DEFAULT_BENCH_BOOK_DEPTH = 100;
+static const int64_t DEFAULT_BENCH_ACCOUNTS = 10000;
+static const int64_t DEFAULT_BENCH_POSITIONS = 1000;
+
+//! Block height used for synthetic orders and positions
+static const int BENCH_BLOCK = 200;
+
+static std::string BenchAddress(int64_t n)
+{
+    return strprintf("tlbench%08d", n);
+}
+
+namespace {
+/**
+ * Trade Layer state on regtest, with the data directory and databases in a
+ * temporary directory.
+ *
+ * The in-memory state, used by the benchmarks, is cleared on construction
+ * and destruction.
+ */
+class TradeLayerSetup
+{
+private:
+    fs::path path;
+
+    static void ClearState()
+    {
+        clear_tally_map();
+        clear_register_map();
+        clear_metadex();
+        contractdex.clear();
+        oraclePrices.clear();
+        clearOracleTwapCache();
+        g_fees->native_fees.clear();
+        g_fees->oracle_fees.clear();
+    }
+
+public:
+    TradeLayerSetup()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        path = fs::temp_directory_path() / fs::unique_path("tl_bench_%%%%%%%%");
+        fs::create_directories(path);
+
+        // keep the trade layer log out of the default data directory
+        gArgs.ForceSetArg("-datadir", path.string());
+        ClearDatadirCache();
+
+        p_txlistdb = new CMPTxList(path / "OCL_txlist", true);
+        _my_sps = new CMPSPInfo(path / "OCL_spinfo", true);
+        _my_cds = new CDInfo(path / "OCL_cdinfo", true);
+        p_TradeTXDB = new CtlTransactionDB(path / "OCL_TXDB", true);
+        t_tradelistdb = new CMPTradeList(path / "OCL_tradelist", true);
+
+        ClearState();
+    }
+
+    ~TradeLayerSetup()
+    {
+        ClearState();
+
+        delete t_tradelistdb; t_tradelistdb = nullptr;
+        delete p_TradeTXDB; p_TradeTXDB = nullptr;
+        delete _my_cds; _my_cds = nullptr;
+        delete _my_sps; _my_sps = nullptr;
+        delete p_txlistdb; p_txlistdb = nullptr;
+
+        fs::remove_all(path);
+    }
+
+    /** Registers an oracle contract, collateralized in ALL, with a stable oracle price. */
+    uint32_t AddContract(int64_t price)
+    {
+        CDInfo::Entry cd;
+        cd.issuer = BenchAddress(0);
+        cd.prop_type = ALL_PROPERTY_TYPE_ORACLE_CONTRACT;
+        cd.name = "Bench Contract";
+        cd.notional_size = COIN;
+        cd.collateral_currency = TL_PROPERTY_ALL;
+        cd.margin_requirement = COIN;
+        cd.init_block = 1;
+        cd.blocks_until_expiration = 1000000;
+
+        const uint32_t contractId = _my_cds->putCD(cd);
+
+        for (int block = BENCH_BLOCK - 3; block <= BENCH_BLOCK; ++block) {
+            oracledata data;
+            data.high = price;
+            data.low = price;
+            data.close = price;
+            data.contractId = contractId;
+            oraclePrices[contractId][block] = data;
+        }
+        invalidateOracleTwap(contractId);
+
+        return contractId;
+    }
+};
+} // namespace
+
+//! Sweeps a MetaDEx book, which is rebuilt before each sweep
+static void TLMetaDExTrade(benchmark::State& state)
+{
+    TradeLayerSetup setup;
+    const int64_t depth = gArgs.GetArg("-tlbookdepth", DEFAULT_BENCH_BOOK_DEPTH);
+    const uint32_t propertyForSale = 4;
+    const uint32_t propertyDesired = 5;
+    const std::string taker = BenchAddress(depth);
+
+    uint32_t nTx = 0;
+    while (state.KeepRunning()) {
+        clear_metadex();
+
+        // one order per price level, each slightly more expensive
+        int64_t totalDesired = 0;
+        for (int64_t n = 0; n < depth; ++n) {
+            const int64_t amountForSale = 1000 * COIN;
+            const int64_t amountDesired = (1000 + n) * COIN;
+            CMPMetaDEx order(BenchAddress(n), BENCH_BLOCK, propertyForSale, amountForSale, propertyDesired, amountDesired,
+                             ArithToUint256(arith_uint256(++nTx)), 1, CMPTransaction::ADD);
+            const bool fInserted = MetaDEx_INSERT(order);
+            assert(fInserted);
+            update_tally_map(BenchAddress(n), propertyForSale, amountForSale, METADEX_RESERVE);
+            totalDesired += amountDesired;
+        }
+
+        // a taker, which takes the whole book
+        CMPMetaDEx order(taker, BENCH_BLOCK, propertyDesired, totalDesired, propertyForSale, depth * 1000 * COIN,
+                         ArithToUint256(arith_uint256(++nTx)), 1, CMPTransaction::ADD);
+        update_tally_map(taker, propertyDesired, totalDesired, BALANCE);
+        x_Trade(&order);
+    }
+}
+
+//! Sweeps one side of a ContractDex book, which is rebuilt before each sweep
+static void TLContractDexTrade(benchmark::State& state)
+{
+    TradeLayerSetup setup;
+    const int64_t depth = gArgs.GetArg("-tlbookdepth", DEFAULT_BENCH_BOOK_DEPTH);
+    const uint32_t contractId = setup.AddContract(100 * COIN);
+    const std::string taker = BenchAddress(depth);
+
+    for (int64_t n = 0; n <= depth; ++n) {
+        update_tally_map(BenchAddress(n), TL_PROPERTY_ALL, 1000000 * COIN, BALANCE);
+    }
+
+    uint32_t nTx = 0;
+    while (state.KeepRunning()) {
+        contractdex.clear();
+        clear_register_map();
+
+        for (int64_t n = 0; n <= depth; ++n) {
+            update_register_map(BenchAddress(n), contractId, 1, LEVERAGE);
+        }
+
+        for (int64_t n = 0; n < depth; ++n) {
+            const uint64_t price = (100 + n) * COIN;
+            CMPContractDex order(BenchAddress(n), BENCH_BLOCK, contractId, 10, 0, 0,
+                                 ArithToUint256(arith_uint256(++nTx)), 1, CMPTransaction::ADD, price, sell, 0, false);
+            const bool fInserted = ContractDex_INSERT(order);
+            assert(fInserted);
+        }
+
+        const uint64_t limit = (100 + depth) * COIN;
+        CMPContractDex order(taker, BENCH_BLOCK, contractId, depth * 10, 0, 0,
+                             ArithToUint256(arith_uint256(++nTx)), 1, CMPTransaction::ADD, limit, buy, 0, false);
+        x_Trade(&order);
+    }
+}
+
+//! Moves balances between addresses, like the transfers of a busy block
+static void TLUpdateTally(benchmark::State& state)
+{
+    TradeLayerSetup setup;
+    const int64_t accounts = gArgs.GetArg("-tlaccounts", DEFAULT_BENCH_ACCOUNTS);
+
+    std::vector<std::string> addresses;
+    for (int64_t n = 0; n < accounts; ++n) {
+        addresses.push_back(BenchAddress(n));
+        update_tally_map(addresses.back(), TL_PROPERTY_ALL, COIN, BALANCE);
+    }
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        const std::string& from = addresses[n % addresses.size()];
+        const std::string& to = addresses[(n * 7919 + 1) % addresses.size()];
+        update_tally_map(from, TL_PROPERTY_ALL, -1, BALANCE);
+        update_tally_map(to, TL_PROPERTY_ALL, 1, BALANCE);
+        ++n;
+    }
+}
+
+//! Hashes a large state, after a small part of it changed, like after each block
+static void HashChangedState(benchmark::State& state, uint256 (*hashState)())
+{
+    TradeLayerSetup setup;
+    const int64_t accounts = gArgs.GetArg("-tlaccounts", DEFAULT_BENCH_ACCOUNTS);
+    const uint32_t contractId = setup.AddContract(100 * COIN);
+
+    for (int64_t n = 0; n < accounts; ++n) {
+        const std::string address = BenchAddress(n);
+        update_tally_map(address, TL_PROPERTY_ALL, (n + 1) * COIN, BALANCE);
+        update_tally_map(address, 4, n + 1, BALANCE);
+        if (n % 10 == 0) {
+            update_register_map(address, contractId, (n % 20 == 0) ? 10 : -10, CONTRACT_POSITION);
+        }
+    }
+
+    int64_t round = 0;
+    while (state.KeepRunning()) {
+        for (int64_t n = round % 100; n < accounts; n += 100) {
+            update_tally_map(BenchAddress(n), TL_PROPERTY_ALL, 1, BALANCE);
+        }
+        ++round;
+
+        uint256 hash = hashState();
+        assert(!hash.IsNull());
+    }
+}
+
+static void TLConsensusHash(benchmark::State& state)
+{
+    HashChangedState(state, GetConsensusHash);
+}
+
+static void TLStateHash(benchmark::State& state)
+{
+    HashChangedState(state, GetStateHash);
+}
+
+//! Classifies the transactions of a mainnet block, which has no Trade Layer transactions
+static void TLEncodingClasses(benchmark::State& state)
+{
+    TradeLayerSetup setup;
+    // transactions are only examined closely on the test networks
+    SelectParams(CBaseChainParams::MAIN);
+
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    std::vector<int> vClasses;
+    while (state.KeepRunning()) {
+        GetEncodingClasses(block, BENCH_BLOCK, vClasses);
+        assert(vClasses.size() == block.vtx.size());
+    }
+}
+
+//! Renders the balance and register state files, writes them like each block does, and loads them back
+static void TLStateFileRoundTrip(benchmark::State& state)
+{
+    TradeLayerSetup setup;
+    const int64_t accounts = gArgs.GetArg("-tlaccounts", DEFAULT_BENCH_ACCOUNTS);
+    const int64_t positions = gArgs.GetArg("-tlpositions", DEFAULT_BENCH_POSITIONS);
+    const uint32_t contractId = setup.AddContract(100 * COIN);
+    const fs::path dir = GetDataDir();
+    const int stateFiles[] = { FILETYPE_BALANCES, FILE_TYPE_REGISTER };
+
+    for (int64_t n = 0; n < accounts; ++n) {
+        update_tally_map(BenchAddress(n), TL_PROPERTY_ALL, (n + 1) * COIN, BALANCE);
+    }
+    for (int64_t n = 0; n < positions; ++n) {
+        update_register_map(BenchAddress(n), contractId, (n % 2 == 0) ? 10 : -10, CONTRACT_POSITION);
+        insert_entry(BenchAddress(n), contractId, 10, 100 * COIN);
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<StateFile> files;
+        for (const int what : stateFiles) {
+            StateFile file;
+            file.path = dir / strprintf("bench-%d.dat", what);
+            const int result = write_state_file(what, file.data);
+            assert(result == 0);
+            files.push_back(file);
+        }
+
+        QueueStateFiles(files, std::function<void()>());
+        WaitForStateFiles();
+
+        for (const int what : stateFiles) {
+            const int result = msc_file_load((dir / strprintf("bench-%d.dat", what)).string(), what, true);
+            assert(result == 0);
+        }
+    }
+
+    StopStateWriter();
+}
+
+//! Runs the liquidation engine over healthy positions, so no order is submitted
+static void TLLiquidationEngine(benchmark::State& state)
+{
+    TradeLayerSetup setup;
+    const int64_t positions = gArgs.GetArg("-tlpositions", DEFAULT_BENCH_POSITIONS);
+    const int64_t price = 100 * COIN;
+    const uint32_t contractId = setup.AddContract(price);
+
+    for (int64_t n = 0; n < positions; ++n) {
+        const std::string address = BenchAddress(n);
+        const int64_t amount = (n % 2 == 0) ? 10 : -10;
+        update_register_map(address, contractId, amount, CONTRACT_POSITION);
+        insert_entry(address, contractId, 10, price);
+        update_tally_map(address, TL_PROPERTY_ALL, 1000000 * COIN, CONTRACTDEX_RESERVE);
+    }
+
+    while (state.KeepRunning()) {
+        LiquidationEngine(BENCH_BLOCK);
+    }
+}
+
+BENCHMARK(TLMetaDExTrade, 20);
+BENCHMARK(TLContractDexTrade, 20);
+BENCHMARK(TLUpdateTally, 500000);
+BENCHMARK(TLConsensusHash, 20);
+BENCHMARK(TLStateHash, 20);
+BENCHMARK(TLEncodingClasses, 500);
+BENCHMARK(TLStateFileRoundTrip, 50);
+BENCHMARK(TLLiquidationEngine, 50);
@@ -0,0 +1,55 @@
+#include <tradelayer/accounts.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mastercore
+{
+//! Guards the interning table, which is shared by state with different locks
+static std::mutex cs_accounts;
+//! Account id by address
+static std::unordered_map<std::string, AccountId> mapAccountIds;
+//! Address by account id
+static std::deque<std::string> vAccountAddresses;
+
+AccountId InternAddress(const std::string& address)
+{
+    std::lock_guard<std::mutex> lock(cs_accounts);
+    std::unordered_map<std::string, AccountId>::const_iterator it = mapAccountIds.find(address);
+    if (it != mapAccountIds.end()) {
+        return it->second;
+    }
+
+    const AccountId id = vAccountAddresses.size();
+    vAccountAddresses.push_back(address);
+    mapAccountIds.insert(std::make_pair(address, id));
+
+    return id;
+}
+
+bool FindAccountId(const std::string& address, AccountId& id)
+{
+    std::lock_guard<std::mutex> lock(cs_accounts);
+    std::unordered_map<std::string, AccountId>::const_iterator it = mapAccountIds.find(address);
+    if (it == mapAccountIds.end()) {
+        return false;
+    }
+    id = it->second;
+
+    return true;
+}
+
+std::string GetAccountAddress(AccountId id)
+{
+    std::lock_guard<std::mutex> lock(cs_accounts);
+    return (id < vAccountAddresses.size()) ? vAccountAddresses[id] : std::string();
+}
+
+size_t GetAccountCount()
+{
+    std::lock_guard<std::mutex> lock(cs_accounts);
+    return vAccountAddresses.size();
+}
+}
@@ -0,0 +1,150 @@
+#ifndef TRADELAYER_ACCOUNTS_H
+#define TRADELAYER_ACCOUNTS_H
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mastercore
+{
+//! Compact id of an address, valid for the lifetime of the process
+typedef uint32_t AccountId;
+
+/** Returns the id of an address, a new one is assigned on first use. */
+AccountId InternAddress(const std::string& address);
+
+/** Looks up the id of an address, without assigning one. */
+bool FindAccountId(const std::string& address, AccountId& id);
+
+/** Returns the address of an id, or an empty string, if it was never assigned. */
+std::string GetAccountAddress(AccountId id);
+
+/** Returns the number of addresses, which were assigned an id. */
+size_t GetAccountCount();
+
+/** State by address, stored in a flat array indexed by account id.
+ *
+ * The address is hashed once, to resolve its id, after which the entry is
+ * reached by indexing. Callers, which hold the id, reach the entry without
+ * hashing, and without the lock of the interning table. Entries are kept in
+ * insertion order, and references to them stay valid until the map is cleared.
+ *
+ * The interface mirrors the one of std::unordered_map, so entries are pairs
+ * of address and state.
+ */
+template<typename T>
+class AccountMap
+{
+public:
+    typedef std::pair<const std::string, T> value_type;
+    typedef typename std::deque<value_type>::iterator iterator;
+    typedef typename std::deque<value_type>::const_iterator const_iterator;
+
+private:
+    //! Entries in insertion order
+    std::deque<value_type> entries;
+    //! Position of the entry plus one by account id, 0 if there is none
+    std::vector<uint32_t> slots;
+
+    size_t slotOf(AccountId id) const
+    {
+        return (id < slots.size()) ? slots[id] : 0;
+    }
+
+    iterator append(AccountId id, const value_type& value)
+    {
+        entries.push_back(value);
+        if (id >= slots.size()) {
+            slots.resize(id + 1, 0);
+        }
+        slots[id] = entries.size();
+
+        return entries.end() - 1;
+    }
+
+public:
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    iterator find(AccountId id)
+    {
+        const size_t slot = slotOf(id);
+        return (slot != 0) ? entries.begin() + (slot - 1) : entries.end();
+    }
+
+    const_iterator find(AccountId id) const
+    {
+        const size_t slot = slotOf(id);
+        return (slot != 0) ? entries.begin() + (slot - 1) : entries.end();
+    }
+
+    iterator find(const std::string& address)
+    {
+        AccountId id;
+        return FindAccountId(address, id) ? find(id) : entries.end();
+    }
+
+    const_iterator find(const std::string& address) const
+    {
+        AccountId id;
+        return FindAccountId(address, id) ? find(id) : entries.end();
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        const AccountId id = InternAddress(value.first);
+        iterator it = find(id);
+        if (it != entries.end()) {
+            return std::make_pair(it, false);
+        }
+
+        return std::make_pair(append(id, value), true);
+    }
+
+    /** Returns the entry of an account, an empty one is inserted, if there is none. */
+    iterator findOrInsert(AccountId id)
+    {
+        iterator it = find(id);
+        if (it == entries.end()) {
+            it = append(id, value_type(GetAccountAddress(id), T()));
+        }
+
+        return it;
+    }
+
+    /** Returns the state of an account, an empty one is inserted, if there is none. */
+    T& operator[](AccountId id)
+    {
+        return findOrInsert(id)->second;
+    }
+
+    /** Returns the entry of an address, an empty one is inserted, if there is none. */
+    T& operator[](const std::string& address)
+    {
+        const AccountId id = InternAddress(address);
+        iterator it = find(id);
+        if (it == entries.end()) {
+            it = append(id, value_type(address, T()));
+        }
+
+        return it->second;
+    }
+
+    size_t count(const std::string& address) const { return (find(address) != entries.end()) ? 1 : 0; }
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    void clear()
+    {
+        entries.clear();
+        slots.clear();
+    }
+};
+}
+
+#endif // TRADELAYER_ACCOUNTS_H
@@ -0,0 +1,196 @@
+#include <tradelayer/blockprefetch.h>
+
+#include <tradelayer/log.h>
+#include <tradelayer/tradelayer.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <sync.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <uint256.h>
+#include <util/threadnames.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mastercore
+{
+/**
+ * Looks up a transaction in the mempool or the transaction index.
+ *
+ * Unlike GetTransaction() this doesn't lock cs_main. Transactions, which can
+ * only be found by scanning blocks, are left to the parser.
+ */
+static bool FindPrevTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBlock)
+{
+    AssertLockNotHeld(cs_main);
+
+    txOut = mempool.get(hash);
+    if (txOut) {
+        hashBlock.SetNull();
+        return true;
+    }
+
+    if (!fTxIndex || !pblocktree) {
+        return false;
+    }
+
+    CDiskTxPos postx;
+    if (!pblocktree->ReadTxIndex(hash, postx)) {
+        return false;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (const std::exception&) {
+        return false;
+    }
+    hashBlock = header.GetHash();
+
+    return txOut->GetHash() == hash;
+}
+
+/**
+ * Looks up the coins spent by the transactions with marker.
+ *
+ * The same lookup is done by the parser for coins missing in the cache, so
+ * the result is only a head start and may be incomplete.
+ */
+static void PrefetchInputs(PrefetchedBlock& prefetched)
+{
+    AssertLockNotHeld(cs_main);
+
+    prefetched.inputs = std::make_shared<std::map<COutPoint, Coin>>();
+
+    for (size_t n = 0; n < prefetched.block.vtx.size(); ++n)
+    {
+        if (prefetched.vClasses[n] == NO_MARKER) continue;
+
+        for (const CTxIn& txIn : prefetched.block.vtx[n]->vin)
+        {
+            CTransactionRef txPrev;
+            uint256 hashBlock;
+            if (!FindPrevTransaction(txIn.prevout.hash, txPrev, hashBlock)) {
+                continue;
+            }
+            if (txIn.prevout.n >= txPrev->vout.size()) {
+                continue;
+            }
+
+            Coin coin;
+            coin.out = txPrev->vout[txIn.prevout.n];
+            prefetched.inputs->emplace(txIn.prevout, std::move(coin));
+            prefetched.inputBlocks.emplace(txIn.prevout, hashBlock);
+        }
+    }
+}
+
+BlockPrefetcher::BlockPrefetcher(const std::vector<CBlockIndex*>& blocks, size_t nThreads, size_t nWindowIn) :
+    vBlocks(blocks), nWindow(std::max<size_t>(1, nWindowIn)), nNextRead(0), nNextOut(0), fStop(false)
+{
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pblockindex : vBlocks) {
+            vPositions.push_back(pblockindex->GetBlockPos());
+        }
+    }
+
+    for (size_t n = 0; n < std::max<size_t>(1, nThreads); ++n) {
+        workers.emplace_back(&BlockPrefetcher::workerLoop, this);
+    }
+}
+
+BlockPrefetcher::~BlockPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_prefetch);
+        fStop = true;
+        cond_prefetch.notify_all();
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void BlockPrefetcher::workerLoop()
+{
+    util::ThreadRename("tl-prefetch");
+    AssertLockNotHeld(cs_main);
+
+    std::unique_lock<std::mutex> lock(cs_prefetch);
+    while (true)
+    {
+        cond_prefetch.wait(lock, [this] {
+            return fStop || nNextRead >= vBlocks.size() || nNextRead < nNextOut + nWindow;
+        });
+        if (fStop || nNextRead >= vBlocks.size()) {
+            break;
+        }
+
+        const size_t pos = nNextRead++;
+        lock.unlock();
+
+        std::unique_ptr<PrefetchedBlock> prefetched(new PrefetchedBlock());
+        prefetched->pblockindex = vBlocks[pos];
+        prefetched->fRead = ReadBlockFromDisk(prefetched->block, vPositions[pos], Params().GetConsensus()) &&
+                            prefetched->block.GetHash() == prefetched->pblockindex->GetBlockHash();
+        if (prefetched->fRead) {
+            prefetched->nMarked = GetEncodingClasses(prefetched->block, prefetched->pblockindex->nHeight, prefetched->vClasses);
+            if (prefetched->nMarked > 0) {
+                PrefetchInputs(*prefetched);
+            }
+        }
+
+        lock.lock();
+        mReady[pos] = std::move(prefetched);
+        cond_prefetch.notify_all();
+    }
+}
+
+std::unique_ptr<PrefetchedBlock> BlockPrefetcher::next()
+{
+    std::unique_lock<std::mutex> lock(cs_prefetch);
+    if (nNextOut >= vBlocks.size()) {
+        return nullptr;
+    }
+
+    cond_prefetch.wait(lock, [this] { return mReady.count(nNextOut) > 0; });
+
+    std::unique_ptr<PrefetchedBlock> prefetched = std::move(mReady[nNextOut]);
+    mReady.erase(nNextOut);
+    ++nNextOut;
+    cond_prefetch.notify_all();
+    lock.unlock();
+
+    // the heights of the spent coins require cs_main, which the workers don't take
+    if (!prefetched->inputBlocks.empty()) {
+        LOCK(cs_main);
+        for (const auto& entry : prefetched->inputBlocks) {
+            BlockMap::iterator bit = mapBlockIndex.find(entry.second);
+            (*prefetched->inputs)[entry.first].nHeight = bit != mapBlockIndex.end() ? bit->second->nHeight : 1;
+        }
+    }
+
+    return prefetched;
+}
+}
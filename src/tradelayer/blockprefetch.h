@@ -0,0 +1,83 @@
+#ifndef TRADELAYER_BLOCKPREFETCH_H
+#define TRADELAYER_BLOCKPREFETCH_H
+
+#include <chain.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+namespace mastercore
+{
+/** A block, read from disk and classified ahead of being processed.
+ */
+struct PrefetchedBlock
+{
+    CBlockIndex* pblockindex;
+    CBlock block;
+    //! False, if the block could not be read from disk
+    bool fRead;
+    //! Encoding class of each transaction
+    std::vector<int> vClasses;
+    //! Number of transactions with Trade Layer marker
+    unsigned int nMarked;
+    //! Coins spent by the transactions with marker, as far as they were found
+    std::shared_ptr<std::map<COutPoint, Coin>> inputs;
+    //! Blocks of the coins spent, their heights are filled in by BlockPrefetcher::next()
+    std::map<COutPoint, uint256> inputBlocks;
+
+    PrefetchedBlock() : pblockindex(nullptr), fRead(false), nMarked(0) {}
+};
+
+/**
+ * Reads and classifies the blocks of a scan on worker threads.
+ *
+ * The workers stay at most nWindow blocks ahead of the consumer, which takes
+ * the blocks strictly in order. State is only changed by the consumer.
+ *
+ * The workers never lock cs_main, so the consumer may hold it: the block
+ * positions are resolved up front, and everything else, which requires it,
+ * is done by the consumer.
+ */
+class BlockPrefetcher
+{
+private:
+    const std::vector<CBlockIndex*> vBlocks;
+    //! Position of each block on disk, resolved before the workers start
+    std::vector<CDiskBlockPos> vPositions;
+    const size_t nWindow;
+
+    std::mutex cs_prefetch;
+    std::condition_variable cond_prefetch;
+    //! Blocks ready to be taken, by position, guarded by cs_prefetch
+    std::map<size_t, std::unique_ptr<PrefetchedBlock>> mReady;
+    //! Position of the next block to read, guarded by cs_prefetch
+    size_t nNextRead;
+    //! Position of the next block to hand out, guarded by cs_prefetch
+    size_t nNextOut;
+    bool fStop;
+
+    std::vector<std::thread> workers;
+
+    void workerLoop();
+
+public:
+    BlockPrefetcher(const std::vector<CBlockIndex*>& blocks, size_t nThreads, size_t nWindow);
+
+    /** Stops and joins the workers, blocks not taken are discarded. */
+    ~BlockPrefetcher();
+
+    /** Waits for the next block, returns nullptr, once all blocks were taken. */
+    std::unique_ptr<PrefetchedBlock> next();
+};
+}
+
+#endif // TRADELAYER_BLOCKPREFETCH_H
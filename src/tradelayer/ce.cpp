@@ -87,7 +87,7 @@ void CDInfo::Entry::print() const
 	// 	 category, subcategory, url, data);
 }
 
-CDInfo::CDInfo(const fs::path& path, bool fWipe)
+CDInfo::CDInfo(const fs::path& path, bool fWipe) : cache_hits(0), cache_misses(0), cache_generation(0)
 {
   leveldb::Status status = Open(path, fWipe);
   PrintToLog("Loading contracts database: %s\n", status.ToString());
@@ -96,13 +96,18 @@ CDInfo::CDInfo(const fs::path& path, bool fWipe)
 
 CDInfo::~CDInfo()
 {
-  if (msc_debug_persistence) PrintToLog("CDInfo closed\n");
+  if (msc_debug_persistence) PrintToLog("CDInfo closed (cache hits: %d, misses: %d)\n", cache_hits, cache_misses);
 }
 
 void CDInfo::Clear()
 {
   // wipe database via parent class
   CDBBase::Clear();
+  {
+      LOCK(cs_cache);
+      cache.clear();
+      ++cache_generation;
+  }
   init();
 }
 
@@ -155,6 +160,8 @@ bool CDInfo::updateCD(uint32_t contractId, const Entry& info)
     return false;
   }
 
+  cacheEntry(contractId, ssSpValue);
+
   PrintToLog("%s(): updated entry for CD %d successfully\n", __func__, contractId);
   return true;
 }
@@ -204,6 +211,8 @@ uint32_t CDInfo::putCD(const Entry& info)
 
     if (!status.ok()) {
         PrintToLog("%s(): ERROR for CD %d: %s\n", __func__, contractId, status.ToString());
+    } else {
+        cacheEntry(contractId, ssSpValue);
     }
 
     return contractId;
@@ -211,6 +220,19 @@ uint32_t CDInfo::putCD(const Entry& info)
 
 bool CDInfo::getCD(uint32_t contractId, Entry& info) const
 {
+    uint64_t generation = 0;
+    {
+        LOCK(cs_cache);
+        std::map<uint32_t, Entry>::const_iterator it = cache.find(contractId);
+        if (it != cache.end()) {
+            ++cache_hits;
+            info = it->second;
+            return true;
+        }
+        ++cache_misses;
+        generation = cache_generation;
+    }
+
     // DB key for property entry
     CDataStream ssSpKey(SER_DISK, CLIENT_VERSION);
     ssSpKey << std::make_pair('s', contractId);
@@ -234,6 +256,12 @@ bool CDInfo::getCD(uint32_t contractId, Entry& info) const
         return false;
     }
 
+    // a rollback or an update in the meantime may have made the value stale
+    LOCK(cs_cache);
+    if (generation == cache_generation) {
+        cache.insert(std::make_pair(contractId, info));
+    }
+
     return true;
 }
 
@@ -356,9 +384,47 @@ int64_t CDInfo::popBlock(const uint256& block_hash)
         return -4;
     }
 
+    // rolled back entries are reloaded from the database on demand
+    {
+        LOCK(cs_cache);
+        cache.clear();
+        ++cache_generation;
+    }
+
     return remainingSPs;
 }
 
+void CDInfo::cacheEntry(uint32_t id, CDataStream ssValue)
+{
+    // decode the persisted form, so cached and loaded entries can't differ
+    Entry info;
+    try {
+        ssValue >> info;
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): ERROR: %s\n", __func__, e.what());
+        LOCK(cs_cache);
+        cache.erase(id);
+        ++cache_generation;
+        return;
+    }
+
+    LOCK(cs_cache);
+    cache[id] = info;
+    ++cache_generation;
+}
+
+uint64_t CDInfo::getCacheHits() const
+{
+    LOCK(cs_cache);
+    return cache_hits;
+}
+
+uint64_t CDInfo::getCacheMisses() const
+{
+    LOCK(cs_cache);
+    return cache_misses;
+}
+
 void CDInfo::printAll() const
 {
     // print off the hard coded ALL and TALL entries
@@ -0,0 +1,160 @@
+#include <tradelayer/changeset.h>
+
+#include <tradelayer/log.h>
+#include <tradelayer/register.h>
+#include <tradelayer/tally.h>
+#include <tradelayer/tradelayer.h>
+
+#include <sync.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace mastercore
+{
+//! A balance or record, as it would be after the changes so far
+struct PendingValue
+{
+    AccountId account;
+    uint32_t id;
+    int type;
+    int64_t value;
+};
+
+//! Sets are small, so the values are searched linearly
+static PendingValue* findPending(std::vector<PendingValue>& values, AccountId account, uint32_t id, int type)
+{
+    for (PendingValue& pending : values) {
+        if (pending.account == account && pending.id == id && pending.type == type) return &pending;
+    }
+
+    return nullptr;
+}
+
+void ChangeSet::addTally(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
+    addTally(InternAddress(who), propertyId, amount, ttype);
+}
+
+void ChangeSet::addTally(AccountId account, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
+    TallyChange change = { account, propertyId, amount, ttype };
+    vTally.push_back(change);
+}
+
+void ChangeSet::addRegister(const std::string& who, uint32_t contractId, int64_t amount, RecordType ttype)
+{
+    addRegister(InternAddress(who), contractId, amount, ttype);
+}
+
+void ChangeSet::addRegister(AccountId account, uint32_t contractId, int64_t amount, RecordType ttype)
+{
+    RegisterChange change = { account, contractId, amount, ttype };
+    vRegister.push_back(change);
+}
+
+bool ChangeSet::checkLocked() const
+{
+    AssertLockHeld(cs_register);
+    AssertLockHeld(cs_tally);
+
+    std::vector<PendingValue> balances;
+    balances.reserve(vTally.size());
+
+    for (const auto& change : vTally)
+    {
+        if (0 == change.amount || change.ttype >= TALLY_TYPE_COUNT) {
+            PrintToLog("%s(%s, %u, %+d, ttype=%d) ERROR: invalid change\n", __func__, GetAccountAddress(change.account), change.propertyId, change.amount, change.ttype);
+            return false;
+        }
+
+        PendingValue* pending = findPending(balances, change.account, change.propertyId, change.ttype);
+        if (pending == nullptr) {
+            AccountMap<CMPTally>::const_iterator itTally = mp_tally_map.find(change.account);
+            const int64_t balance = (itTally != mp_tally_map.end()) ? itTally->second.getMoney(change.propertyId, change.ttype) : 0;
+            PendingValue value = { change.account, change.propertyId, change.ttype, balance };
+            balances.push_back(value);
+            pending = &balances.back();
+        }
+
+        if (isOverflow(pending->value, change.amount)) {
+            PrintToLog("%s(%s, %u, %+d, ttype=%d) ERROR: arithmetic overflow\n", __func__, GetAccountAddress(change.account), change.propertyId, change.amount, change.ttype);
+            return false;
+        }
+        if (PENDING != change.ttype && CONTRACT_BALANCE != change.ttype && (pending->value + change.amount) < 0) {
+            PrintToLog("%s(%s, %u, %+d, ttype=%d) ERROR: insufficient balance (=%d)\n", __func__, GetAccountAddress(change.account), change.propertyId, change.amount, change.ttype, pending->value);
+            return false;
+        }
+        pending->value += change.amount;
+    }
+
+    std::vector<PendingValue> records;
+    records.reserve(vRegister.size());
+
+    for (const auto& change : vRegister)
+    {
+        if ((0 == change.amount && PNL != change.ttype) || change.ttype >= RECORD_TYPE_COUNT) {
+            PrintToLog("%s(%s, %u, %+d, ttype=%d) ERROR: invalid change\n", __func__, GetAccountAddress(change.account), change.contractId, change.amount, change.ttype);
+            return false;
+        }
+
+        PendingValue* pending = findPending(records, change.account, change.contractId, change.ttype);
+        if (pending == nullptr) {
+            AccountMap<Register>::const_iterator itReg = mp_register_map.find(change.account);
+            const int64_t record = (itReg != mp_register_map.end()) ? itReg->second.getRecord(change.contractId, change.ttype) : 0;
+            PendingValue value = { change.account, change.contractId, change.ttype, record };
+            records.push_back(value);
+            pending = &records.back();
+        }
+
+        // same as Register::updateRecord(), which replaces the PNL, and only checks it for overflows
+        if (PNL == change.ttype) {
+            if (isOverflow(pending->value, change.amount)) {
+                PrintToLog("%s(%s, %u, %+d, ttype=%d) ERROR: arithmetic overflow\n", __func__, GetAccountAddress(change.account), change.contractId, change.amount, change.ttype);
+                return false;
+            }
+            pending->value = change.amount;
+        } else {
+            pending->value = static_cast<int64_t>(static_cast<uint64_t>(pending->value) + static_cast<uint64_t>(change.amount));
+        }
+    }
+
+    return true;
+}
+
+bool ChangeSet::check() const
+{
+    LOCK2(cs_register, cs_tally);
+
+    return checkLocked();
+}
+
+bool ChangeSet::apply()
+{
+    // same order as the liquidation engine, which updates balances while holding cs_register
+    LOCK2(cs_register, cs_tally);
+
+    if (!checkLocked()) {
+        return false;
+    }
+
+    for (const auto& change : vTally) {
+        AccountMap<CMPTally>::iterator it = mp_tally_map.findOrInsert(change.account);
+        const bool fUpdated = update_money_onmap(it->first, it->second, change.propertyId, change.amount, change.ttype);
+        assert(fUpdated);
+    }
+    for (const auto& change : vRegister) {
+        AccountMap<Register>::iterator it = mp_register_map.findOrInsert(change.account);
+        const bool fUpdated = update_record_onmap(it->first, it->second, change.contractId, change.amount, change.ttype);
+        assert(fUpdated);
+    }
+
+    if (msc_debug_tally) {
+        PrintToLog("%s(): applied %d balance and %d register changes\n", __func__, vTally.size(), vRegister.size());
+    }
+
+    return true;
+}
+}
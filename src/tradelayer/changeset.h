@@ -0,0 +1,90 @@
+#ifndef TRADELAYER_CHANGESET_H
+#define TRADELAYER_CHANGESET_H
+
+#include <tradelayer/accounts.h>
+#include <tradelayer/register.h>
+#include <tradelayer/tally.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace mastercore
+{
+/** Balance and register changes of a single transaction, which are applied together.
+ *
+ * Handlers collect the changes first, which are then checked against the
+ * current state and applied in one step, while holding the register and
+ * tally locks. A set, which can't be applied as a whole, leaves the state
+ * untouched, so a handler, which fails mid-way, simply discards it.
+ *
+ * Applied changes go through update_money_onmap() and update_record_onmap(),
+ * so the supply and position indexes, the state hash and the state files
+ * see them like any other update.
+ */
+class ChangeSet
+{
+public:
+    struct TallyChange
+    {
+        AccountId account;
+        uint32_t propertyId;
+        int64_t amount;
+        TallyType ttype;
+    };
+
+    struct RegisterChange
+    {
+        AccountId account;
+        uint32_t contractId;
+        int64_t amount;
+        RecordType ttype;
+    };
+
+private:
+    std::vector<TallyChange> vTally;
+    std::vector<RegisterChange> vRegister;
+
+    bool checkLocked() const;
+
+public:
+    /** Adds a change of a balance, same as update_tally_map(). */
+    void addTally(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype);
+    void addTally(AccountId account, uint32_t propertyId, int64_t amount, TallyType ttype);
+
+    /** Adds a change of a contract record, same as update_register_map(). */
+    void addRegister(const std::string& who, uint32_t contractId, int64_t amount, RecordType ttype);
+    void addRegister(AccountId account, uint32_t contractId, int64_t amount, RecordType ttype);
+
+    /**
+     * Checks, whether all changes, in the order they were added, can be applied.
+     *
+     * Changes are rejected, if they are zero or of an unknown type, or if they
+     * overflow. A debit, which exceeds a balance, is rejected, except for
+     * pending and contract balances, which may become negative.
+     * PNL records are replaced, all other records are added to.
+     */
+    bool check() const;
+
+    /**
+     * Applies all changes, in the order they were added, or none, if they
+     * don't pass check().
+     *
+     * @return True, if the changes were applied
+     */
+    bool apply();
+
+    const std::vector<TallyChange>& getTallyChanges() const { return vTally; }
+    const std::vector<RegisterChange>& getRegisterChanges() const { return vRegister; }
+
+    bool empty() const { return vTally.empty() && vRegister.empty(); }
+
+    void clear()
+    {
+        vTally.clear();
+        vRegister.clear();
+    }
+};
+}
+
+#endif // TRADELAYER_CHANGESET_H
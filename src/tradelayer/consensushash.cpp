@@ -14,14 +14,20 @@
 #include <tradelayer/persistence.h>
 #include <tradelayer/register.h>
 #include <tradelayer/sp.h>
+#include <tradelayer/statechanges.h>
 #include <tradelayer/fees.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/tradelayer_matrices.h>
 
 #include <arith_uint256.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+#include <hash.h>
 #include <uint256.h>
 
 #include <algorithm>
+#include <map>
+#include <set>
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -148,146 +154,167 @@ std::string GenerateConsensusString(const mastercore::FeatureActivation& feat)
     return strprintf("%d|%d|%d|%s|%s", feat.featureId, feat.activationBlock, feat.minClientVersion, feat.featureName, status);
 }
 
-/**
-* Obtains a hash of the active state to use for consensus verification and checkpointing.
-*
-* For increased flexibility, so other implementations like Trade Layer Wallet can
-* also apply this methodology without necessarily using the same exact data types (which
-* would be needed to hash the data bytes directly), create a string in the following
-* format for each entry to use for hashing:
-*
-* ---STAGE 1 - BALANCES---
-* Format specifiers & placeholders:
-*   "%s|%d|%d|%d|%d|%d" - "address|propertyid|balance|selloffer_reserve|accept_reserve|metadex_reserve"
-*
-* ---STAGE 2 - CONTRACT REGISTERS---
-* Format specifiers & placeholders:
-*   "%s|%d|%d|%d|%d|%d|%d" - "address|contractid|entry_price|position|BANKRUPTCY_PRICE|upnl|margin|leverage"
-*
-* Note: empty balance records and the pending tally are ignored. Addresses are sorted based
-* on lexicographical order, and balance records are sorted by the property identifiers.
-*
-* ---STAGE 2 - DEX SELL OFFERS---
-* Format specifiers & placeholders:
-*   "%s|%s|%d|%d|%d|%d|%d" - "txid|address|propertyid|offeramount|btcdesired|minfee|timelimit"
-*
-* Note: ordered ascending by txid.
-*
-* ---STAGE 3 - DEX ACCEPTS---
-* Format specifiers & placeholders:
-*   "%s|%s|%d|%d|%d" - "matchedselloffertxid|buyer|acceptamount|acceptamountremaining|acceptblock"
-*
-* Note: ordered ascending by matchedselloffertxid followed by buyer.
-*
-* ---STAGE 4 - METADEX TRADES---
-* Format specifiers & placeholders:
-*   "%s|%s|%d|%d|%d|%d|%d" - "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining"
-*
-* Note: ordered ascending by txid.
-*
-* ---STAGE 5 - CONTRACTDEX TRADES---
-* Format specifiers & placeholders:
-*   "%s|%s|%d|%d|%d|%d|%d" - "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining"
-*
-* Note: ordered ascending by txid.
-*
-* ---STAGE 6 - PROPERTIES---
-* Format specifiers & placeholders:
-*   "%d|%s" - "propertyid|issueraddress"
-*
-* ---STAGE 7 - CONTRACTS---
-* Format specifiers & placeholders:
-*   "%d|%s" - "contractid|adminaddress"
-*
-* ---STAGE 8 - TRADE CHANNELS---
-* Format specifiers & placeholders:
-*   "%s|%s|%s|%s|%d|%d" - "multisigaddress|multisigaddress|firstaddress|secondaddress|expiryheight|lastexchangeblock"
-*
-* ---STAGE 9 - KYC LIST---
-* Format specifiers & placeholders:
-*   "%s|%s|%s|%d|%d" - "address|name|website|block|kycid"
-*
-* ---STAGE 10 - ATTESTATION LIST---
-* Format specifiers & placeholders:
-*   "%s|%s|%s|%s|%d|%d" - "multisigaddress|multisigaddress|firstaddress|secondaddress|expiryheight|lastexchangeblock"
-*
-* ---STAGE 11 - FEE CACHE NATIVES---
-* Format specifiers & placeholders:
-*   "%d|%d" - "propertyId|amountaccumulated"
-*
-* ---STAGE 12 - FEE CACHE ORACLES---
-* Format specifiers & placeholders:
-*   "%d|%d" - "propertyId|amountaccumulated"
-*
-* ---STAGE 13 - VESTING ADDRESSES---
-* Format specifiers & placeholders:
-*   "%s" - "address"
-*
-* ---STAGE 14 - FEATURES ACTIVATIONS---
-* Format specifiers & placeholders:
-*   "%d|%d|%d|%s" - "featureid|activationblock|minclientversion|featurename"
-*
-* Note: ordered by property ID.
-*
-* The byte order is important, and we assume:
-*   SHA256("abc") = "ad1500f261ff10b49c7a1796a36103b02322ae5dde404141eacf018fbf1678ba"
-*
-*/
-
-uint256 GetConsensusHash()
+/** Digests of entries by key, combined into a tree of fixed shape.
+ *
+ * Keys are spread over buckets by their hash, the buckets are grouped into
+ * nodes, and the nodes are hashed into the root. A changed entry only hashes
+ * its bucket, its node and the root again. Empty buckets and nodes hash to
+ * zero, so the root depends on the entries only, and not on their history.
+ */
+class EntryHashTree
 {
-    CSHA256 hasher;
+private:
+    static const size_t BUCKETS_PER_NODE = 64;
+    static const size_t NODE_COUNT = 64;
+
+    std::vector<std::map<std::string, uint256> > buckets;
+    std::vector<uint256> bucketHashes;
+    std::vector<uint256> nodeHashes;
+    //! Buckets changed since the root was last computed
+    std::set<size_t> changed;
+    uint256 root;
+
+    static size_t GetBucket(const std::string& key)
+    {
+        const uint256 hash = Hash(key.begin(), key.end());
+        return ReadLE32(hash.begin()) % (BUCKETS_PER_NODE * NODE_COUNT);
+    }
 
-    LOCK(cs_tally);
+    // Hashes the children of a node, which is zero, if all of them are zero
+    static uint256 HashChildren(const uint256* children, size_t count)
+    {
+        uint256 result;
+        if (std::all_of(children, children + count, [](const uint256& child) { return child.IsNull(); })) {
+            return result;
+        }
 
-    if (msc_debug_consensus_hash) PrintToLog("Beginning generation of current consensus hash...\n");
+        CSHA256 hasher;
+        for (size_t n = 0; n < count; ++n) {
+            hasher.Write(children[n].begin(), children[n].size());
+        }
+        hasher.Finalize(result.begin());
 
-    // Balances - loop through the tally map, updating the sha context with the data from each balance and tally type
-    // Placeholders:  "address|propertyid|balance|selloffer_reserve|accept_reserve|metadex_reserve"
-    // Sort alphabetically first
-    std::map<std::string, CMPTally> tallyMapSorted;
-    for (std::unordered_map<string, CMPTally>::iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit)
-    {
-        tallyMapSorted.insert(std::make_pair(uoit->first,uoit->second));
+        return result;
     }
 
-    for (std::map<string, CMPTally>::iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it)
+public:
+    EntryHashTree() { clear(); }
+
+    void clear()
     {
-        const std::string& address = my_it->first;
-        CMPTally& tally = my_it->second;
-        tally.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = (tally.next())))
-        {
-            std::string dataStr = GenerateConsensusString(tally, address, propertyId);
-            if (dataStr.empty()) continue; // skip empty balances
-            if (msc_debug_consensus_hash) PrintToLog("Adding balance data to consensus hash: %s\n", dataStr);
-            hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
-        }
+        buckets.assign(BUCKETS_PER_NODE * NODE_COUNT, std::map<std::string, uint256>());
+        bucketHashes.assign(BUCKETS_PER_NODE * NODE_COUNT, uint256());
+        nodeHashes.assign(NODE_COUNT, uint256());
+        changed.clear();
+        root.SetNull();
     }
 
+    void set(const std::string& key, const uint256& digest)
+    {
+        const size_t n = GetBucket(key);
+        buckets[n][key] = digest;
+        changed.insert(n);
+    }
 
-    std::map<std::string, Register> registerMapSorted;
-    for (std::unordered_map<string, Register>::iterator uit = mp_register_map.begin(); uit != mp_register_map.end(); ++uit)
+    void erase(const std::string& key)
     {
-        registerMapSorted.insert(std::make_pair(uit->first,uit->second));
+        const size_t n = GetBucket(key);
+        if (buckets[n].erase(key)) changed.insert(n);
     }
 
-    for (std::map<string, Register>::iterator my_it = registerMapSorted.begin(); my_it != registerMapSorted.end(); ++my_it)
+    /** Returns the root, and hashes the changed buckets and their nodes. */
+    const uint256& getRoot()
     {
-        const std::string& address = my_it->first;
-        Register& reg = my_it->second;
-        reg.init();
-        uint32_t contractId = 0;
-        while (0 != (contractId = (reg.next())))
+        if (changed.empty()) return root;
+
+        std::set<size_t> changedNodes;
+        for (const size_t n : changed)
         {
-            std::string dataStr = GenerateConsensusString(reg, address, contractId);
-            if (dataStr.empty()) continue; // skip empty balances
-            if (msc_debug_consensus_hash) PrintToLog("Adding contract register data to consensus hash: %s\n", dataStr);
+            bucketHashes[n].SetNull();
+            if (!buckets[n].empty()) {
+                CSHA256 hasher;
+                for (const auto& p : buckets[n]) {
+                    unsigned char size[4];
+                    WriteLE32(size, p.first.size());
+                    hasher.Write(size, sizeof(size));
+                    hasher.Write((const unsigned char*)p.first.data(), p.first.size());
+                    hasher.Write(p.second.begin(), p.second.size());
+                }
+                hasher.Finalize(bucketHashes[n].begin());
+            }
+            changedNodes.insert(n / BUCKETS_PER_NODE);
+        }
+
+        for (const size_t node : changedNodes) {
+            nodeHashes[node] = HashChildren(&bucketHashes[node * BUCKETS_PER_NODE], BUCKETS_PER_NODE);
+        }
+        root = HashChildren(&nodeHashes[0], NODE_COUNT);
+        changed.clear();
+
+        return root;
+    }
+};
+
+/** Consensus strings and their digests of the balances or registers of all addresses.
+ */
+struct HashedEntries
+{
+    //! Consensus strings by address, in the order they are hashed
+    std::map<std::string, std::vector<std::string> > strings;
+    //! Digests of the strings of each address
+    EntryHashTree tree;
+};
+
+static HashedEntries hashedBalances;
+static HashedEntries hashedRegisters;
+
+// Formats and hashes the entries of changed addresses only, requires cs_tally
+template <typename Container>
+static void RefreshConsensusStrings(Container& state, const ChangedAddresses& pending, HashedEntries& hashed)
+{
+    if (pending.fCleared) {
+        hashed.strings.clear();
+        hashed.tree.clear();
+    }
+
+    for (const std::string& address : pending.addresses)
+    {
+        std::vector<std::string> strings;
+
+        auto it = state.find(address);
+        if (it != state.end()) {
+            auto& obj = it->second;
+            obj.init();
+            uint32_t id = 0;
+            while (0 != (id = obj.next()))
+            {
+                std::string dataStr = GenerateConsensusString(obj, address, id);
+                if (dataStr.empty()) continue; // skip empty balances
+                strings.push_back(dataStr);
+            }
+        }
+
+        if (strings.empty()) {
+            hashed.strings.erase(address);
+            hashed.tree.erase(address);
+            continue;
+        }
+
+        CSHA256 hasher;
+        for (const auto& dataStr : strings) {
             hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
         }
+        uint256 digest;
+        hasher.Finalize(digest.begin());
+
+        hashed.tree.set(address, digest);
+        hashed.strings[address].swap(strings);
     }
+}
 
+// Adds the stages after the contract registers to the hash, see GetConsensusHash()
+static void WriteRemainingStages(CSHA256& hasher)
+{
     // DEx sell offers - loop through the DEx and add each sell offer to the consensus hash (ordered by txid)
     // Placeholders: "txid|address|propertyid|offeramount|btcdesired|minfee|timelimit"
     std::vector<std::pair<arith_uint256, std::string> > vecDExOffers;
@@ -360,10 +387,12 @@ uint256 GetConsensusHash()
     std::vector<std::pair<arith_uint256, std::string> > vecContractDexTrades;
     for (cd_PropertiesMap::const_iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
     {
-        const cd_PricesMap& prices = my_it->second;
+      for (const uint8_t action : {buy, sell})
+      {
+        const cd_PricesMap& prices = my_it->second.getSide(action);
         for (cd_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it)
         {
-            const cd_Set& indexes = it->second;
+            const cd_Set& indexes = it->second.orders;
             for (cd_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
             {
 	              const CMPContractDex& obj = *it;
@@ -371,6 +400,7 @@ uint256 GetConsensusHash()
 	              vecContractDexTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
             }
         }
+      }
     }
 
     std::sort (vecContractDexTrades.begin(), vecContractDexTrades.end());
@@ -526,6 +556,128 @@ uint256 GetConsensusHash()
         if (msc_debug_consensus_hash) PrintToLog("Adding Completed features activations entry to consensus hash: %s\n", dataStr);
         hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
+}
+
+/**
+* Obtains a hash of the active state to use for consensus verification and checkpointing.
+*
+* For increased flexibility, so other implementations like Trade Layer Wallet can
+* also apply this methodology without necessarily using the same exact data types (which
+* would be needed to hash the data bytes directly), create a string in the following
+* format for each entry to use for hashing:
+*
+* ---STAGE 1 - BALANCES---
+* Format specifiers & placeholders:
+*   "%s|%d|%d|%d|%d|%d" - "address|propertyid|balance|selloffer_reserve|accept_reserve|metadex_reserve"
+*
+* ---STAGE 2 - CONTRACT REGISTERS---
+* Format specifiers & placeholders:
+*   "%s|%d|%d|%d|%d|%d|%d" - "address|contractid|entry_price|position|BANKRUPTCY_PRICE|upnl|margin|leverage"
+*
+* Note: empty balance records and the pending tally are ignored. Addresses are sorted based
+* on lexicographical order, and balance records are sorted by the property identifiers.
+*
+* ---STAGE 2 - DEX SELL OFFERS---
+* Format specifiers & placeholders:
+*   "%s|%s|%d|%d|%d|%d|%d" - "txid|address|propertyid|offeramount|btcdesired|minfee|timelimit"
+*
+* Note: ordered ascending by txid.
+*
+* ---STAGE 3 - DEX ACCEPTS---
+* Format specifiers & placeholders:
+*   "%s|%s|%d|%d|%d" - "matchedselloffertxid|buyer|acceptamount|acceptamountremaining|acceptblock"
+*
+* Note: ordered ascending by matchedselloffertxid followed by buyer.
+*
+* ---STAGE 4 - METADEX TRADES---
+* Format specifiers & placeholders:
+*   "%s|%s|%d|%d|%d|%d|%d" - "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining"
+*
+* Note: ordered ascending by txid.
+*
+* ---STAGE 5 - CONTRACTDEX TRADES---
+* Format specifiers & placeholders:
+*   "%s|%s|%d|%d|%d|%d|%d" - "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining"
+*
+* Note: ordered ascending by txid.
+*
+* ---STAGE 6 - PROPERTIES---
+* Format specifiers & placeholders:
+*   "%d|%s" - "propertyid|issueraddress"
+*
+* ---STAGE 7 - CONTRACTS---
+* Format specifiers & placeholders:
+*   "%d|%s" - "contractid|adminaddress"
+*
+* ---STAGE 8 - TRADE CHANNELS---
+* Format specifiers & placeholders:
+*   "%s|%s|%s|%s|%d|%d" - "multisigaddress|multisigaddress|firstaddress|secondaddress|expiryheight|lastexchangeblock"
+*
+* ---STAGE 9 - KYC LIST---
+* Format specifiers & placeholders:
+*   "%s|%s|%s|%d|%d" - "address|name|website|block|kycid"
+*
+* ---STAGE 10 - ATTESTATION LIST---
+* Format specifiers & placeholders:
+*   "%s|%s|%s|%s|%d|%d" - "multisigaddress|multisigaddress|firstaddress|secondaddress|expiryheight|lastexchangeblock"
+*
+* ---STAGE 11 - FEE CACHE NATIVES---
+* Format specifiers & placeholders:
+*   "%d|%d" - "propertyId|amountaccumulated"
+*
+* ---STAGE 12 - FEE CACHE ORACLES---
+* Format specifiers & placeholders:
+*   "%d|%d" - "propertyId|amountaccumulated"
+*
+* ---STAGE 13 - VESTING ADDRESSES---
+* Format specifiers & placeholders:
+*   "%s" - "address"
+*
+* ---STAGE 14 - FEATURES ACTIVATIONS---
+* Format specifiers & placeholders:
+*   "%d|%d|%d|%s" - "featureid|activationblock|minclientversion|featurename"
+*
+* Note: ordered by property ID.
+*
+* The byte order is important, and we assume:
+*   SHA256("abc") = "ad1500f261ff10b49c7a1796a36103b02322ae5dde404141eacf018fbf1678ba"
+*
+*/
+
+uint256 GetConsensusHash()
+{
+    CSHA256 hasher;
+
+    LOCK(cs_tally);
+
+    if (msc_debug_consensus_hash) PrintToLog("Beginning generation of current consensus hash...\n");
+
+    // Balances - loop through the tally map, updating the sha context with the data from each balance and tally type
+    // Placeholders:  "address|propertyid|balance|selloffer_reserve|accept_reserve|metadex_reserve"
+    // Sort alphabetically first; only tallies changed since the last call are formatted again
+    RefreshConsensusStrings(mp_tally_map, TakeChangedBalances(CHANGES_STATE_HASH), hashedBalances);
+
+    for (const auto& p : hashedBalances.strings)
+    {
+        for (const auto& dataStr : p.second)
+        {
+            if (msc_debug_consensus_hash) PrintToLog("Adding balance data to consensus hash: %s\n", dataStr);
+            hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
+        }
+    }
+
+    RefreshConsensusStrings(mp_register_map, TakeChangedRegisters(CHANGES_STATE_HASH), hashedRegisters);
+
+    for (const auto& p : hashedRegisters.strings)
+    {
+        for (const auto& dataStr : p.second)
+        {
+            if (msc_debug_consensus_hash) PrintToLog("Adding contract register data to consensus hash: %s\n", dataStr);
+            hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
+        }
+    }
+
+    WriteRemainingStages(hasher);
 
     // extract the final result and return the hash
     uint256 consensusHash;
@@ -535,6 +687,38 @@ uint256 GetConsensusHash()
     return consensusHash;
 }
 
+/**
+ * Obtains a hash of the same state as GetConsensusHash(), to compare states block by block.
+ *
+ * Balances and contract registers are not streamed, instead the strings of each address
+ * are hashed into a digest, and the digests are combined in a tree, which only rehashes
+ * the addresses changed since the last call. The roots of both trees replace stage 1 and
+ * stage 2, all other stages are the same. The result differs from the consensus hash, and
+ * can't be used for checkpoints.
+ */
+uint256 GetStateHash()
+{
+    CSHA256 hasher;
+
+    LOCK(cs_tally);
+
+    RefreshConsensusStrings(mp_tally_map, TakeChangedBalances(CHANGES_STATE_HASH), hashedBalances);
+    RefreshConsensusStrings(mp_register_map, TakeChangedRegisters(CHANGES_STATE_HASH), hashedRegisters);
+
+    const uint256& balancesRoot = hashedBalances.tree.getRoot();
+    const uint256& registersRoot = hashedRegisters.tree.getRoot();
+    hasher.Write(balancesRoot.begin(), balancesRoot.size());
+    hasher.Write(registersRoot.begin(), registersRoot.size());
+
+    WriteRemainingStages(hasher);
+
+    uint256 stateHash;
+    hasher.Finalize(stateHash.begin());
+    if (msc_debug_consensus_hash) PrintToLog("Finished generation of state hash.  Result: %s\n", stateHash.GetHex());
+
+    return stateHash;
+}
+
 uint256 GetMetaDExHash(const uint32_t propertyId)
 {
     CSHA256 hasher;
@@ -543,7 +727,7 @@ uint256 GetMetaDExHash(const uint32_t propertyId)
 
     std::vector<std::pair<arith_uint256, std::string> > vecMetaDExTrades;
     for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        if (propertyId == 0 || propertyId == my_it->first) {
+        if (propertyId == 0 || propertyId == my_it->first.first) {
             const md_PricesMap& prices = my_it->second;
             for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
                 const md_Set& indexes = it->second;
@@ -575,26 +759,21 @@ uint256 GetBalancesHash(const uint32_t hashPropertyId)
 
     LOCK(cs_tally);
 
-    std::map<std::string, CMPTally> tallyMapSorted;
-    for (std::unordered_map<string, CMPTally>::iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit)
+    std::map<std::string, const CMPTally*> tallyMapSorted;
+    for (AccountMap<CMPTally>::const_iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit)
     {
-        tallyMapSorted.insert(std::make_pair(uoit->first,uoit->second));
+        tallyMapSorted.insert(std::make_pair(uoit->first, &(uoit->second)));
     }
 
-    for (std::map<string, CMPTally>::iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it)
+    for (std::map<string, const CMPTally*>::const_iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it)
     {
         const std::string& address = my_it->first;
-        CMPTally& tally = my_it->second;
-        tally.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = (tally.next())))
-        {
-            if (propertyId != hashPropertyId) continue;
-            std::string dataStr = GenerateConsensusString(tally, address, propertyId);
-            if (dataStr.empty()) continue;
-            if (msc_debug_consensus_hash) PrintToLog("Adding data to balances hash: %s\n", dataStr);
-            hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
-        }
+        const CMPTally& tally = *(my_it->second);
+        if (!tally.hasProperty(hashPropertyId)) continue;
+        std::string dataStr = GenerateConsensusString(tally, address, hashPropertyId);
+        if (dataStr.empty()) continue;
+        if (msc_debug_consensus_hash) PrintToLog("Adding data to balances hash: %s\n", dataStr);
+        hasher.Write((unsigned char*)dataStr.c_str(), dataStr.length());
     }
 
     uint256 balancesHash;
@@ -3,12 +3,18 @@
 
 #include <uint256.h>
 
+#include <string>
+#include <vector>
+
 namespace mastercore
 {
 
 /** Obtains a hash of all balances to use for consensus verification and checkpointing. */
 uint256 GetConsensusHash();
 
+/** Obtains a hash of the same state, which hashes only balances and registers changed since the last call. */
+uint256 GetStateHash();
+
 std::string kycGenerateConsensusString(const std::vector<std::string>& vstr);
 std::string attGenerateConsensusString(const std::vector<std::string>& vstr);
 
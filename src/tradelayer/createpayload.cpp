@@ -24,21 +24,12 @@
     vector.insert(vector.end(), reinterpret_cast<unsigned char *>((ptr)),\
     reinterpret_cast<unsigned char *>((ptr)) + (size));
 
-static void push_back_compressed(int value, std::vector<std::vector<uint8_t>>& auxVec)
-{
-    std::vector<uint8_t> vecNum = CompressInteger((uint64_t) value);
-    auxVec.push_back(vecNum);
-}
-
-static void payload_insert(const std::vector<uint8_t>& value, std::vector<unsigned char>& payload)
-{
-    payload.insert(payload.end(), value.begin(), value.end());
-}
-
+/**
+ * Appends a compressed integer to the end of a payload.
+ */
 static std::vector<uint8_t>& operator<<(std::vector<uint8_t>& payload, uint64_t value)
 {
-    auto v = CompressInteger(value);
-    payload.insert(payload.end(), v.begin(), v.end());
+    CompressInteger(value, payload);
     return payload;
 }
 
@@ -49,15 +40,7 @@ std::vector<unsigned char> CreatePayload_SimpleSend(uint32_t propertyId, uint64_
     uint64_t messageType = 0;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -81,13 +64,7 @@ std::vector<unsigned char> CreatePayload_SendVestingTokens(uint64_t amount)
     uint64_t messageType = 5;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << amount;
 
     return payload;
 }
@@ -99,11 +76,7 @@ std::vector<unsigned char> CreatePayload_SendAll()
     uint64_t messageType = 4;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
 
     return payload;
 }
@@ -111,36 +84,24 @@ std::vector<unsigned char> CreatePayload_SendAll()
 std::vector<unsigned char> CreatePayload_IssuanceFixed(uint16_t propertyType, uint32_t previousPropertyId, std::string& name, std::string& url, std::string& data, uint64_t amount, std::vector<int>& kycVec)
 {
     std::vector<unsigned char> payload;
-    std::vector<std::vector<uint8_t>> auxVec;
 
     uint64_t messageType = 50;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyType = CompressInteger((uint64_t)propertyType);
-    std::vector<uint8_t> vecPrevPropertyId = CompressInteger((uint64_t)previousPropertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    for_each(kycVec.begin(), kycVec.end(), [&auxVec](int elem) { push_back_compressed(elem, auxVec); });
-
     if (name.size() > 255) name = name.substr(0,255);
     if (url.size() > 255) url = url.substr(0,255);
     if (data.size() > 255) data = data.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyType.begin(), vecPropertyType.end());
-    payload.insert(payload.end(), vecPrevPropertyId.begin(), vecPrevPropertyId.end());
+    payload << messageVer << messageType << (uint64_t)propertyType << (uint64_t)previousPropertyId;
     payload.insert(payload.end(), name.begin(), name.end());
     payload.push_back('\0');
     payload.insert(payload.end(), url.begin(), url.end());
     payload.push_back('\0');
     payload.insert(payload.end(), data.begin(), data.end());
     payload.push_back('\0');
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << amount;
 
-    for_each(auxVec.begin(), auxVec.end(), [&payload] (const std::vector<uint8_t>& value) { payload_insert(value, payload); });
+    for_each(kycVec.begin(), kycVec.end(), [&payload](int elem) { payload << (uint64_t) elem; });
 
     return payload;
 }
@@ -148,27 +109,15 @@ std::vector<unsigned char> CreatePayload_IssuanceFixed(uint16_t propertyType, ui
 std::vector<unsigned char> CreatePayload_IssuanceManaged(uint16_t propertyType, uint32_t previousPropertyId, std::string& name, std::string& url, std::string& data, std::vector<int>& kycVec)
 {
     std::vector<unsigned char> payload;
-    std::vector<std::vector<uint8_t>> auxVec;
 
     uint64_t messageType = 54;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyType = CompressInteger((uint64_t)propertyType);
-    std::vector<uint8_t> vecPrevPropertyId = CompressInteger((uint64_t)previousPropertyId);
-
-    for_each(kycVec.begin(), kycVec.end(), [&auxVec](int elem) { push_back_compressed(elem, auxVec); });
-
-
     if (name.size() > 255) name = name.substr(0,255);
     if (url.size() > 255) url = url.substr(0,255);
     if (data.size() > 255) data = data.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyType.begin(), vecPropertyType.end());
-    payload.insert(payload.end(), vecPrevPropertyId.begin(), vecPrevPropertyId.end());
+    payload << messageVer << messageType << (uint64_t)propertyType << (uint64_t)previousPropertyId;
     payload.insert(payload.end(), name.begin(), name.end());
     payload.push_back('\0');
     payload.insert(payload.end(), url.begin(), url.end());
@@ -176,7 +125,7 @@ std::vector<unsigned char> CreatePayload_IssuanceManaged(uint16_t propertyType,
     payload.insert(payload.end(), data.begin(), data.end());
     payload.push_back('\0');
 
-    for_each(auxVec.begin(), auxVec.end(), [&payload] (const std::vector<uint8_t>& value) { payload_insert(value, payload); });
+    for_each(kycVec.begin(), kycVec.end(), [&payload](int elem) { payload << (uint64_t) elem; });
 
     return payload;
 }
@@ -188,15 +137,7 @@ std::vector<unsigned char> CreatePayload_Grant(uint32_t propertyId, uint64_t amo
     uint64_t messageType = 55;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -208,15 +149,7 @@ std::vector<unsigned char> CreatePayload_Revoke(uint32_t propertyId, uint64_t am
     uint64_t messageType = 56;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -228,13 +161,7 @@ std::vector<unsigned char> CreatePayload_ChangeIssuer(uint32_t propertyId)
     uint64_t messageType = 70;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
+    payload << messageVer << messageType << (uint64_t)propertyId;
 
     return payload;
 }
@@ -246,13 +173,7 @@ std::vector<unsigned char> CreatePayload_DeactivateFeature(uint16_t featureId)
     uint64_t messageVer = 0;
     uint64_t messageType = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecFeatureId = CompressInteger((uint64_t)featureId);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecFeatureId.begin(), vecFeatureId.end());
+    payload << messageVer << messageType << (uint64_t)featureId;
 
     return payload;
 }
@@ -264,17 +185,7 @@ std::vector<unsigned char> CreatePayload_ActivateFeature(uint16_t featureId, uin
     uint64_t messageVer = 0;
     uint64_t messageType = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecFeatureId = CompressInteger((uint64_t)featureId);
-    std::vector<uint8_t> vecActivationBlock = CompressInteger((uint64_t)activationBlock);
-    std::vector<uint8_t> vecMinClientVer = CompressInteger((uint64_t)minClientVersion);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecFeatureId.begin(), vecFeatureId.end());
-    payload.insert(payload.end(), vecActivationBlock.begin(), vecActivationBlock.end());
-    payload.insert(payload.end(), vecMinClientVer.begin(), vecMinClientVer.end());
+    payload << messageVer << messageType << (uint64_t)featureId << (uint64_t)activationBlock << (uint64_t)minClientVersion;
 
     return payload;
 }
@@ -286,15 +197,7 @@ std::vector<unsigned char> CreatePayload_TradeLayerAlert(uint16_t alertType, uin
     uint64_t messageType = 65535;
     uint64_t messageVer = 65535;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecAlertType = CompressInteger((uint64_t)alertType);
-    std::vector<uint8_t> vecExpiryValue = CompressInteger((uint64_t)expiryValue);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecAlertType.begin(), vecAlertType.end());
-    payload.insert(payload.end(), vecExpiryValue.begin(), vecExpiryValue.end());
+    payload << messageVer << messageType << (uint64_t)alertType << (uint64_t)expiryValue;
     payload.insert(payload.end(), alertMessage.begin(), alertMessage.end());
     payload.push_back('\0');
 
@@ -304,37 +207,17 @@ std::vector<unsigned char> CreatePayload_TradeLayerAlert(uint16_t alertType, uin
 std::vector<unsigned char> CreatePayload_CreateContract(uint32_t num, uint32_t den, std::string& name, uint32_t blocks_until_expiration, uint32_t notional_size, uint32_t collateral_currency, uint64_t margin_requirement, uint8_t inverse, std::vector<int>& kycVec)
 {
     std::vector<unsigned char> payload;
-    std::vector<std::vector<uint8_t>> auxVec;
 
     uint64_t messageType = 40;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecNum = CompressInteger((uint64_t)num);
-    std::vector<uint8_t> vecDen = CompressInteger((uint64_t)den);
-    std::vector<uint8_t> vecBlocksUntilExpiration = CompressInteger((uint64_t)blocks_until_expiration);
-    std::vector<uint8_t> vecNotionalSize = CompressInteger((uint64_t)notional_size);
-    std::vector<uint8_t> vecCollateralCurrency = CompressInteger((uint64_t)collateral_currency);
-    std::vector<uint8_t> vecMarginRequirement = CompressInteger(margin_requirement);
-    std::vector<uint8_t> vecInverse = CompressInteger((uint64_t)inverse);
-
-    for_each(kycVec.begin(), kycVec.end(), [&auxVec](int elem) { push_back_compressed(elem, auxVec); });
-
     if ((name).size() > 255) name = name.substr(0,255);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecNum.begin(), vecNum.end());
-    payload.insert(payload.end(), vecDen.begin(), vecDen.end());
+    payload << messageVer << messageType << (uint64_t)num << (uint64_t)den;
     payload.insert(payload.end(), name.begin(), name.end());
     payload.push_back('\0');
-    payload.insert(payload.end(), vecBlocksUntilExpiration.begin(), vecBlocksUntilExpiration.end());
-    payload.insert(payload.end(), vecNotionalSize.begin(), vecNotionalSize.end());
-    payload.insert(payload.end(), vecCollateralCurrency.begin(), vecCollateralCurrency.end());
-    payload.insert(payload.end(), vecMarginRequirement.begin(), vecMarginRequirement.end());
-    payload.insert(payload.end(), vecInverse.begin(), vecInverse.end());
+    payload << (uint64_t)blocks_until_expiration << (uint64_t)notional_size << (uint64_t)collateral_currency << margin_requirement << (uint64_t)inverse;
 
-    for_each(auxVec.begin(), auxVec.end(), [&payload] (const std::vector<uint8_t>& value) { payload_insert(value, payload); });
+    for_each(kycVec.begin(), kycVec.end(), [&payload](int elem) { payload << (uint64_t) elem; });
 
     return payload;
 }
@@ -346,23 +229,12 @@ std::vector<unsigned char> CreatePayload_ContractDexTrade(std::string& name_trad
     uint64_t messageVer = 0;
     uint64_t messageType = 29;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecAmountForSale = CompressInteger(amountForSale);
-    std::vector<uint8_t> vecEffectivePrice = CompressInteger(effective_price);
-    std::vector<uint8_t> vecTradingAction = CompressInteger((uint64_t)trading_action);
-    std::vector<uint8_t> vecLeverage = CompressInteger(leverage);
-
     if ((name_traded).size() > 255) name_traded = name_traded.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
     payload.insert(payload.end(), name_traded.begin(), name_traded.end());
     payload.push_back('\0');
-    payload.insert(payload.end(), vecAmountForSale.begin(), vecAmountForSale.end());
-    payload.insert(payload.end(), vecEffectivePrice.begin(), vecEffectivePrice.end());
-    payload.insert(payload.end(), vecTradingAction.begin(), vecTradingAction.end());
-    payload.insert(payload.end(), vecLeverage.begin(), vecLeverage.end());
+    payload << amountForSale << effective_price << (uint64_t)trading_action << leverage;
 
     return payload;
 }
@@ -374,12 +246,7 @@ std::vector<unsigned char> CreatePayload_ContractDexCancelAll(uint32_t contractI
     uint64_t messageType = 32;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
+    payload << messageVer << messageType << (uint64_t)contractId;
 
     return payload;
 }
@@ -391,12 +258,7 @@ std::vector<unsigned char> CreatePayload_ContractDexClosePosition(uint32_t contr
     uint64_t messageType = 33;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
+    payload << messageVer << messageType << (uint64_t)contractId;
 
     return payload;
 }
@@ -408,14 +270,7 @@ std::vector<unsigned char> CreatePayload_ContractDexCancelOrderByTxId(int block,
     uint64_t messageType = 34;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecBlock = CompressInteger((uint64_t)block);
-    std::vector<uint8_t> vecIdx = CompressInteger((uint64_t)idx);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecBlock.begin(), vecBlock.end());
-    payload.insert(payload.end(), vecIdx.begin(), vecIdx.end());
+    payload << messageVer << messageType << (uint64_t)block << (uint64_t)idx;
 
     return payload;
 }
@@ -427,23 +282,11 @@ std::vector<unsigned char> CreatePayload_IssuancePegged(uint16_t propertyType, u
     uint64_t messageType = 100;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyType = CompressInteger((uint64_t)propertyType);
-    std::vector<uint8_t> vecPrevPropertyId = CompressInteger((uint64_t)previousPropertyId);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
     if (name.size() > 255) name = name.substr(0,255);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyType.begin(), vecPropertyType.end());
-    payload.insert(payload.end(), vecPrevPropertyId.begin(), vecPrevPropertyId.end());
+    payload << messageVer << messageType << (uint64_t)propertyType << (uint64_t)previousPropertyId;
     payload.insert(payload.end(), name.begin(), name.end());
     payload.push_back('\0');
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << (uint64_t)propertyId << (uint64_t)contractId << amount;
 
     return payload;
 }
@@ -455,14 +298,7 @@ std::vector<unsigned char> CreatePayload_SendPeggedCurrency(uint32_t propertyId,
     uint64_t messageType = 102;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -474,16 +310,7 @@ std::vector<unsigned char> CreatePayload_RedemptionPegged(uint32_t propertyId, u
     uint64_t messageType = 101;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << (uint64_t)contractId << amount;
 
     return payload;
 
@@ -496,22 +323,7 @@ std::vector<unsigned char> CreatePayload_DExSell(uint32_t propertyId, uint64_t a
     uint64_t messageType = 20;
     uint64_t messageVer = 1;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmountForSale = CompressInteger(amountForSale);
-    std::vector<uint8_t> vecAmountDesired = CompressInteger(amountDesired);
-    std::vector<uint8_t> vecTimeLimit = CompressInteger((uint64_t)timeLimit);
-    std::vector<uint8_t> vecMinFee = CompressInteger(minFee);
-    std::vector<uint8_t> vecSubAction = CompressInteger((uint64_t)subAction);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmountForSale.begin(), vecAmountForSale.end());
-    payload.insert(payload.end(), vecAmountDesired.begin(), vecAmountDesired.end());
-    payload.insert(payload.end(), vecTimeLimit.begin(), vecTimeLimit.end());
-    payload.insert(payload.end(), vecMinFee.begin(), vecMinFee.end());
-    payload.insert(payload.end(), vecSubAction.begin(), vecSubAction.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amountForSale << amountDesired << (uint64_t)timeLimit << minFee << (uint64_t)subAction;
 
     return payload;
 }
@@ -523,22 +335,7 @@ std::vector<unsigned char> CreatePayload_DEx(uint32_t propertyId, uint64_t amoun
     uint64_t messageType = 21;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmountForSale = CompressInteger(amount);
-    std::vector<uint8_t> vecPrice = CompressInteger(price);
-    std::vector<uint8_t> vecTimeLimit = CompressInteger((uint64_t)timeLimit);
-    std::vector<uint8_t> vecMinFee = CompressInteger(minFee);
-    std::vector<uint8_t> vecSubAction = CompressInteger((uint64_t)subAction);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmountForSale.begin(), vecAmountForSale.end());
-    payload.insert(payload.end(), vecPrice.begin(), vecPrice.end());
-    payload.insert(payload.end(), vecTimeLimit.begin(), vecTimeLimit.end());
-    payload.insert(payload.end(), vecMinFee.begin(), vecMinFee.end());
-    payload.insert(payload.end(), vecSubAction.begin(), vecSubAction.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount << price << (uint64_t)timeLimit << minFee << (uint64_t)subAction;
 
     return payload;
 }
@@ -550,14 +347,7 @@ std::vector<unsigned char> CreatePayload_DExAccept(uint32_t propertyId, uint64_t
     uint64_t messageType = 22;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -569,18 +359,7 @@ std::vector<unsigned char> CreatePayload_MetaDExTrade(uint32_t propertyIdForSale
     uint64_t messageType = 25;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyIdForSale = CompressInteger((uint64_t)propertyIdForSale);
-    std::vector<uint8_t> vecAmountForSale = CompressInteger(amountForSale);
-    std::vector<uint8_t> vecPropertyIdDesired = CompressInteger((uint64_t)propertyIdDesired);
-    std::vector<uint8_t> vecAmountDesired = CompressInteger(amountDesired);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyIdForSale.begin(), vecPropertyIdForSale.end());
-    payload.insert(payload.end(), vecAmountForSale.begin(), vecAmountForSale.end());
-    payload.insert(payload.end(), vecPropertyIdDesired.begin(), vecPropertyIdDesired.end());
-    payload.insert(payload.end(), vecAmountDesired.begin(), vecAmountDesired.end());
+    payload << messageVer << messageType << (uint64_t)propertyIdForSale << amountForSale << (uint64_t)propertyIdDesired << amountDesired;
 
     return payload;
 }
@@ -590,33 +369,17 @@ std::vector<unsigned char> CreatePayload_MetaDExTrade(uint32_t propertyIdForSale
 std::vector<unsigned char> CreatePayload_CreateOracleContract(std::string& name, uint32_t blocks_until_expiration, uint32_t notional_size, uint32_t collateral_currency, uint64_t margin_requirement, uint8_t inverse, std::vector<int>& kycVec)
 {
     std::vector<unsigned char> payload;
-    std::vector<std::vector<uint8_t>> auxVec;
 
     uint64_t messageType = 103;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecBlocksUntilExpiration = CompressInteger((uint64_t)blocks_until_expiration);
-    std::vector<uint8_t> vecNotionalSize = CompressInteger((uint64_t)notional_size);
-    std::vector<uint8_t> vecCollateralCurrency = CompressInteger((uint64_t)collateral_currency);
-    std::vector<uint8_t> vecMarginRequirement = CompressInteger(margin_requirement);
-    std::vector<uint8_t> vecInverse = CompressInteger((uint64_t)inverse);
-
-    for_each(kycVec.begin(), kycVec.end(), [&auxVec](int elem) { push_back_compressed(elem, auxVec); });
-
     if ((name).size() > 255) name = name.substr(0,255);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
     payload.insert(payload.end(), name.begin(), name.end());
     payload.push_back('\0');
-    payload.insert(payload.end(), vecBlocksUntilExpiration.begin(), vecBlocksUntilExpiration.end());
-    payload.insert(payload.end(), vecNotionalSize.begin(), vecNotionalSize.end());
-    payload.insert(payload.end(), vecCollateralCurrency.begin(), vecCollateralCurrency.end());
-    payload.insert(payload.end(), vecMarginRequirement.begin(), vecMarginRequirement.end());
-    payload.insert(payload.end(), vecInverse.begin(), vecInverse.end());
+    payload << (uint64_t)blocks_until_expiration << (uint64_t)notional_size << (uint64_t)collateral_currency << margin_requirement << (uint64_t)inverse;
 
-    for_each(auxVec.begin(), auxVec.end(), [&payload] (const std::vector<uint8_t>& value) { payload_insert(value, payload); });
+    for_each(kycVec.begin(), kycVec.end(), [&payload](int elem) { payload << (uint64_t) elem; });
 
     return payload;
 }
@@ -629,13 +392,7 @@ std::vector<unsigned char> CreatePayload_Change_OracleAdm(uint32_t contractId)
     uint64_t messageType = 104;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
+    payload << messageVer << messageType << (uint64_t)contractId;
 
     return payload;
 }
@@ -648,19 +405,7 @@ std::vector<unsigned char> CreatePayload_Set_Oracle(uint32_t contractId, uint64_
     uint64_t messageType = 105;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-    std::vector<uint8_t> vecHigh = CompressInteger(high);
-    std::vector<uint8_t> vecLow = CompressInteger(low);
-    std::vector<uint8_t> vecClose = CompressInteger(close);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
-    payload.insert(payload.end(), vecHigh.begin(), vecHigh.end());
-    payload.insert(payload.end(), vecLow.begin(), vecLow.end());
-    payload.insert(payload.end(), vecClose.begin(), vecClose.end());
+    payload << messageVer << messageType << (uint64_t)contractId << high << low << close;
 
     return payload;
 }
@@ -672,13 +417,7 @@ std::vector<unsigned char> CreatePayload_OracleBackup(uint32_t contractId)
     uint64_t messageType = 106;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
+    payload << messageVer << messageType << (uint64_t)contractId;
 
     return payload;
 }
@@ -690,13 +429,7 @@ std::vector<unsigned char> CreatePayload_Close_Oracle(uint32_t contractId)
     uint64_t messageType = 107;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
+    payload << messageVer << messageType << (uint64_t)contractId;
 
     return payload;
 }
@@ -708,14 +441,7 @@ std::vector<unsigned char> CreatePayload_Commit_Channel(uint32_t propertyId, uin
     uint64_t messageType = 108;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -727,14 +453,7 @@ std::vector<unsigned char> CreatePayload_Withdrawal_FromChannel(uint32_t propert
     uint64_t messageType = 109;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -746,21 +465,7 @@ std::vector<unsigned char> CreatePayload_Instant_Trade(uint32_t propertyId, uint
     uint64_t messageType = 110;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    std::vector<uint8_t> vecBlock = CompressInteger((uint64_t)blockheight_expiry);
-    std::vector<uint8_t> vecPropertyDesired = CompressInteger((uint64_t)propertyDesired);
-    std::vector<uint8_t> vecAmountDesired = CompressInteger(amountDesired);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
-    payload.insert(payload.end(), vecBlock.begin(), vecBlock.end());
-    payload.insert(payload.end(), vecPropertyDesired.begin(), vecPropertyDesired.end());
-    payload.insert(payload.end(), vecAmountDesired.begin(), vecAmountDesired.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount << (uint64_t)blockheight_expiry << (uint64_t)propertyDesired << amountDesired;
 
     return payload;
 }
@@ -772,23 +477,7 @@ std::vector<unsigned char> CreatePayload_Contract_Instant_Trade(uint32_t contrac
     uint64_t messageType = 114;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecContractId = CompressInteger((uint64_t)contractId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    std::vector<uint8_t> vecBlock = CompressInteger((uint64_t)blockheight_expiry);
-    std::vector<uint8_t> vecPrice = CompressInteger(price);
-    std::vector<uint8_t> vecTrading = CompressInteger((uint64_t)trading_action);
-    std::vector<uint8_t> vecLeverage = CompressInteger(leverage);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecContractId.begin(), vecContractId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
-    payload.insert(payload.end(), vecBlock.begin(), vecBlock.end());
-    payload.insert(payload.end(), vecPrice.begin(), vecPrice.end());
-    payload.insert(payload.end(), vecTrading.begin(), vecTrading.end());
-    payload.insert(payload.end(), vecLeverage.begin(), vecLeverage.end());
+    payload << messageVer << messageType << (uint64_t)contractId << amount << (uint64_t)blockheight_expiry << price << (uint64_t)trading_action << leverage;
 
     return payload;
 }
@@ -800,17 +489,7 @@ std::vector<unsigned char> CreatePayload_PNL_Update(uint32_t propertyId, uint64_
     uint64_t messageType = 111;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    std::vector<uint8_t> vecBlock = CompressInteger((uint64_t)blockheight_expiry);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
-    payload.insert(payload.end(), vecBlock.begin(), vecBlock.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount << (uint64_t)blockheight_expiry;
 
     return payload;
 }
@@ -822,17 +501,7 @@ std::vector<unsigned char> CreatePayload_Transfer(uint8_t option, uint32_t prope
     uint64_t messageType = 112;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecOption = CompressInteger((uint64_t)option);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecOption.begin(), vecOption.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)option << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -844,19 +513,7 @@ std::vector<unsigned char> CreatePayload_Instant_LTC_Trade(uint32_t propertyId,
     uint64_t messageType = 113;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-    std::vector<uint8_t> vecTotalPrice = CompressInteger(totalPrice);
-    std::vector<uint8_t> vecBlockExpiry = CompressInteger((uint64_t)blockheight_expiry);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
-    payload.insert(payload.end(), vecTotalPrice.begin(), vecTotalPrice.end());
-    payload.insert(payload.end(), vecBlockExpiry.begin(), vecBlockExpiry.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount << totalPrice << (uint64_t)blockheight_expiry;
 
     return payload;
 }
@@ -868,14 +525,10 @@ std::vector<unsigned char> CreatePayload_New_Id_Registration(std::string& websit
     uint64_t messageType = 115;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
     if ((website).size() > 255) website = website.substr(0,255);
     if ((name).size() > 255) name = name.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
     payload.insert(payload.end(), website.begin(), website.end());
     payload.push_back('\0');
     payload.insert(payload.end(), name.begin(), name.end());
@@ -891,11 +544,7 @@ std::vector<unsigned char> CreatePayload_Update_Id_Registration()
     uint64_t messageType = 116;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
 
     return payload;
 }
@@ -907,11 +556,7 @@ std::vector<unsigned char> CreatePayload_DEx_Payment()
     uint64_t messageType = 117;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
 
     return payload;
 }
@@ -923,13 +568,9 @@ std::vector<unsigned char> CreatePayload_Attestation(std::string& hash)
     uint64_t messageType = 118;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
     if ((hash).size() > 255) hash = hash.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
     payload.insert(payload.end(), hash.begin(), hash.end());
     payload.push_back('\0');
 
@@ -943,11 +584,7 @@ std::vector<unsigned char> CreatePayload_Revoke_Attestation()
   uint64_t messageType = 119;
   uint64_t messageVer = 0;
 
-  std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-  std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-  payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-  payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+  payload << messageVer << messageType;
 
   return payload;
 }
@@ -959,11 +596,7 @@ std::vector<unsigned char> CreatePayload_MetaDExCancelAll()
     uint64_t messageType = 26;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
 
     return payload;
 }
@@ -975,20 +608,15 @@ std::vector<unsigned char> CreatePayload_ContractDExCancel(std::string& hash)
     uint64_t messageType = 31;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
     if ((hash).size() > 255) hash = hash.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
     payload.insert(payload.end(), hash.begin(), hash.end());
     payload.push_back('\0');
 
     return payload;
 }
 
-
 std::vector<unsigned char> CreatePayload_DExCancel(std::string& hash)
 {
     std::vector<unsigned char> payload;
@@ -996,13 +624,9 @@ std::vector<unsigned char> CreatePayload_DExCancel(std::string& hash)
     uint64_t messageType = 35;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
     if ((hash).size() > 255) hash = hash.substr(0,255);
 
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+    payload << messageVer << messageType;
     payload.insert(payload.end(), hash.begin(), hash.end());
     payload.push_back('\0');
 
@@ -1017,15 +641,7 @@ std::vector<unsigned char> CreatePayload_MetaDExCancelPair(uint32_t propertyIdFo
   uint64_t messageType = 36;
   uint64_t messageVer = 0;
 
-  std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-  std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-  std::vector<uint8_t> vecPropertyIdForSale = CompressInteger((uint64_t)propertyIdForSale);
-  std::vector<uint8_t> vecPropertyIdDesired = CompressInteger((uint64_t)propertyIdDesired);
-
-  payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-  payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-  payload.insert(payload.end(), vecPropertyIdForSale.begin(), vecPropertyIdForSale.end());
-  payload.insert(payload.end(), vecPropertyIdDesired.begin(), vecPropertyIdDesired.end());
+  payload << messageVer << messageType << (uint64_t)propertyIdForSale << (uint64_t)propertyIdDesired;
 
   return payload;
 }
@@ -1037,19 +653,7 @@ std::vector<unsigned char>CreatePayload_MetaDExCancelPrice(uint32_t propertyIdFo
   uint64_t messageType = 37;
   uint64_t messageVer = 0;
 
-  std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-  std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-  std::vector<uint8_t> vecPropertyIdForSale = CompressInteger((uint64_t)propertyIdForSale);
-  std::vector<uint8_t> vecAmountForSale = CompressInteger(amountForSale);
-  std::vector<uint8_t> vecPropertyIdDesired = CompressInteger((uint64_t)propertyIdDesired);
-  std::vector<uint8_t> vecAmountDesired = CompressInteger(amountDesired);
-
-  payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-  payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-  payload.insert(payload.end(), vecPropertyIdForSale.begin(), vecPropertyIdForSale.end());
-  payload.insert(payload.end(), vecAmountForSale.begin(), vecAmountForSale.end());
-  payload.insert(payload.end(), vecPropertyIdDesired.begin(), vecPropertyIdDesired.end());
-  payload.insert(payload.end(), vecAmountDesired.begin(), vecAmountDesired.end());
+  payload << messageVer << messageType << (uint64_t)propertyIdForSale << amountForSale << (uint64_t)propertyIdDesired << amountDesired;
 
   return payload;
 }
@@ -1061,11 +665,7 @@ std::vector<unsigned char>CreatePayload_Close_Channel()
   uint64_t messageType = 120;
   uint64_t messageVer = 0;
 
-  std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-  std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-  payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-  payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+  payload << messageVer << messageType;
 
   return payload;
 }
@@ -1077,11 +677,7 @@ std::vector<unsigned char>CreatePayload_SubmitNodeAddress()
   uint64_t messageType = 121;
   uint64_t messageVer = 0;
 
-  std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-  std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-  payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-  payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+  payload << messageVer << messageType;
 
   return payload;
 }
@@ -1093,11 +689,7 @@ std::vector<unsigned char>CreatePayload_ClaimNodeReward()
   uint64_t messageType = 122;
   uint64_t messageVer = 0;
 
-  std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-  std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-
-  payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-  payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
+  payload << messageVer << messageType;
 
   return payload;
 }
@@ -1109,15 +701,7 @@ std::vector<unsigned char> CreatePayload_SendDonation(uint32_t propertyId, uint6
     uint64_t messageType = 123;
     uint64_t messageVer = 0;
 
-    std::vector<uint8_t> vecMessageType = CompressInteger(messageType);
-    std::vector<uint8_t> vecMessageVer = CompressInteger(messageVer);
-    std::vector<uint8_t> vecPropertyId = CompressInteger((uint64_t)propertyId);
-    std::vector<uint8_t> vecAmount = CompressInteger(amount);
-
-    payload.insert(payload.end(), vecMessageVer.begin(), vecMessageVer.end());
-    payload.insert(payload.end(), vecMessageType.begin(), vecMessageType.end());
-    payload.insert(payload.end(), vecPropertyId.begin(), vecPropertyId.end());
-    payload.insert(payload.end(), vecAmount.begin(), vecAmount.end());
+    payload << messageVer << messageType << (uint64_t)propertyId << amount;
 
     return payload;
 }
@@ -0,0 +1,227 @@
+#include <tradelayer/dbrecord.h>
+
+#include <uint256.h>
+#include <util/strencodings.h>
+
+#include <leveldb/slice.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const unsigned char RECORD_MAGIC = 0xfe;
+static const unsigned char FLAG_BYTE = 0x80;
+static const unsigned char FLAG_MORE = 0x40;
+static const unsigned char BITS_MASK = 0x3f;
+
+DBRecordWriter::DBRecordWriter(uint8_t type, uint8_t version)
+{
+    data.push_back(RECORD_MAGIC);
+    data.push_back(FLAG_BYTE | type);
+    data.push_back(FLAG_BYTE | version);
+}
+
+void DBRecordWriter::writeUInt(uint64_t value)
+{
+    while (value > BITS_MASK) {
+        data.push_back(FLAG_BYTE | FLAG_MORE | (value & BITS_MASK));
+        value >>= 6;
+    }
+    data.push_back(FLAG_BYTE | value);
+}
+
+void DBRecordWriter::writeInt(int64_t value)
+{
+    // zigzag, so small negative numbers stay short
+    writeUInt((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void DBRecordWriter::writeString(const std::string& value)
+{
+    writeUInt(value.size());
+    data.append(value);
+}
+
+void DBRecordWriter::writeUint256(const uint256& value)
+{
+    // 32 bytes in 6 bit groups
+    const unsigned char* p = value.begin();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        acc |= uint32_t(p[i]) << bits;
+        bits += 8;
+        while (bits >= 6) {
+            data.push_back(FLAG_BYTE | (acc & BITS_MASK));
+            acc >>= 6;
+            bits -= 6;
+        }
+    }
+    if (bits > 0) data.push_back(FLAG_BYTE | (acc & BITS_MASK));
+}
+
+DBRecordReader::DBRecordReader(const leveldb::Slice& value) :
+    pos(reinterpret_cast<const unsigned char*>(value.data())),
+    end(reinterpret_cast<const unsigned char*>(value.data()) + value.size()),
+    type(0), version(0), fGood(IsRecord(value))
+{
+    if (fGood) {
+        type = pos[1] & ~FLAG_BYTE;
+        version = pos[2] & ~FLAG_BYTE;
+        pos += 3;
+    }
+}
+
+bool DBRecordReader::IsRecord(const leveldb::Slice& value)
+{
+    return value.size() >= 3 && static_cast<unsigned char>(value[0]) == RECORD_MAGIC;
+}
+
+uint64_t DBRecordReader::readUInt()
+{
+    uint64_t value = 0;
+    for (int shift = 0; fGood; shift += 6) {
+        if (pos == end || shift > 63) {
+            fGood = false;
+            break;
+        }
+        const unsigned char c = *pos++;
+        value |= uint64_t(c & BITS_MASK) << shift;
+        if (!(c & FLAG_MORE)) return value;
+    }
+
+    return 0;
+}
+
+int64_t DBRecordReader::readInt()
+{
+    const uint64_t value = readUInt();
+
+    return static_cast<int64_t>((value >> 1) ^ (0 - (value & 1)));
+}
+
+leveldb::Slice DBRecordReader::readString()
+{
+    const uint64_t size = readUInt();
+    if (!fGood || size > uint64_t(end - pos)) {
+        fGood = false;
+        return leveldb::Slice();
+    }
+
+    leveldb::Slice value(reinterpret_cast<const char*>(pos), size);
+    pos += size;
+
+    return value;
+}
+
+uint256 DBRecordReader::readUint256()
+{
+    uint256 value;
+    const size_t nGroups = (value.size() * 8 + 5) / 6;
+    if (!fGood || nGroups > size_t(end - pos)) {
+        fGood = false;
+        return value;
+    }
+
+    unsigned char* p = value.begin();
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < nGroups; ++i) {
+        acc |= uint32_t(pos[i] & BITS_MASK) << bits;
+        bits += 6;
+        if (bits >= 8 && n < value.size()) {
+            p[n++] = acc & 0xff;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    pos += nGroups;
+
+    return value;
+}
+
+ContractTradeRecord::ContractTradeRecord() :
+    effectivePrice(0), amountMaker(0), amountTaker(0), blockMaker(0), blockTaker(0),
+    makerLives(0), takerLives(0), contractId(0), amountTraded(0), amountOld(0), amountNew(0)
+{
+}
+
+std::string ContractTradeRecord::encode() const
+{
+    DBRecordWriter writer(DB_RECORD_CONTRACT_TRADE, VERSION);
+    writer.writeString(makerAddress);
+    writer.writeString(takerAddress);
+    writer.writeUInt(effectivePrice);
+    writer.writeUInt(amountMaker);
+    writer.writeUInt(amountTaker);
+    writer.writeInt(blockMaker);
+    writer.writeInt(blockTaker);
+    writer.writeString(makerStatus);
+    writer.writeString(takerStatus);
+    writer.writeInt(makerLives);
+    writer.writeInt(takerLives);
+    writer.writeUInt(contractId);
+    writer.writeUint256(makerTxid);
+    writer.writeUint256(takerTxid);
+    writer.writeInt(amountTraded);
+    writer.writeUInt(amountOld);
+    writer.writeUInt(amountNew);
+
+    return writer.str();
+}
+
+bool ContractTradeRecord::decode(const leveldb::Slice& value)
+{
+    DBRecordReader reader(value);
+    if (reader.getType() != DB_RECORD_CONTRACT_TRADE || reader.getVersion() > VERSION) {
+        return false;
+    }
+
+    makerAddress = reader.readString().ToString();
+    takerAddress = reader.readString().ToString();
+    effectivePrice = reader.readUInt();
+    amountMaker = reader.readUInt();
+    amountTaker = reader.readUInt();
+    blockMaker = reader.readInt();
+    blockTaker = reader.readInt();
+    makerStatus = reader.readString().ToString();
+    takerStatus = reader.readString().ToString();
+    makerLives = reader.readInt();
+    takerLives = reader.readInt();
+    contractId = reader.readUInt();
+    makerTxid = reader.readUint256();
+    takerTxid = reader.readUint256();
+    amountTraded = reader.readInt();
+    amountOld = reader.readUInt();
+    amountNew = reader.readUInt();
+
+    return reader.good();
+}
+
+bool ContractTradeRecord::parseText(const std::vector<std::string>& fields)
+{
+    if (fields.size() != 17) return false;
+
+    int32_t block1 = 0, block2 = 0;
+    if (!ParseUInt64(fields[2], &effectivePrice) || !ParseUInt64(fields[3], &amountMaker) ||
+            !ParseUInt64(fields[4], &amountTaker) || !ParseInt32(fields[5], &block1) ||
+            !ParseInt32(fields[6], &block2) || !ParseInt64(fields[9], &makerLives) ||
+            !ParseInt64(fields[10], &takerLives) || !ParseUInt32(fields[11], &contractId) ||
+            !IsHex(fields[12]) || !IsHex(fields[13]) || !ParseInt64(fields[14], &amountTraded) ||
+            !ParseUInt64(fields[15], &amountOld) || !ParseUInt64(fields[16], &amountNew)) {
+        return false;
+    }
+
+    makerAddress = fields[0];
+    takerAddress = fields[1];
+    blockMaker = block1;
+    blockTaker = block2;
+    makerStatus = fields[7];
+    takerStatus = fields[8];
+    makerTxid = uint256S(fields[12]);
+    takerTxid = uint256S(fields[13]);
+
+    return true;
+}
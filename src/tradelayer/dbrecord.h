@@ -0,0 +1,114 @@
+#ifndef TRADELAYER_DBRECORD_H
+#define TRADELAYER_DBRECORD_H
+
+#include <uint256.h>
+
+#include <leveldb/slice.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Binary encoding of database records.
+ *
+ * Records share their databases with the older text records, which are found by
+ * splitting values at ':'. The encoding therefore never produces a ':' byte:
+ *
+ *   header:   0xfe, 0x80 | record type, 0x80 | version
+ *   integers: 6 bits per byte, least significant first, each byte 0x80 | 0x40 (more) | bits
+ *   signed:   zigzag encoded integers
+ *   strings:  length as integer, followed by the raw characters (never contain ':')
+ *   bytes:    packed into 6 bit groups, like integers
+ */
+
+//! Record types of the binary encoding
+enum DBRecordType {
+    DB_RECORD_CONTRACT_TRADE = 1,
+};
+
+/** Appends fields to a binary record.
+ */
+class DBRecordWriter
+{
+private:
+    std::string data;
+
+public:
+    DBRecordWriter(uint8_t type, uint8_t version);
+
+    void writeUInt(uint64_t value);
+    void writeInt(int64_t value);
+    void writeString(const std::string& value);
+    void writeUint256(const uint256& value);
+
+    const std::string& str() const { return data; }
+};
+
+/** Reads the fields of a binary record, without copying strings out of the value.
+ */
+class DBRecordReader
+{
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+    uint8_t type;
+    uint8_t version;
+    bool fGood;
+
+public:
+    /** Checks the header, the value must outlive the reader. */
+    explicit DBRecordReader(const leveldb::Slice& value);
+
+    /** Returns true, if the value starts with the binary record header. */
+    static bool IsRecord(const leveldb::Slice& value);
+
+    uint8_t getType() const { return type; }
+    uint8_t getVersion() const { return version; }
+
+    /** Returns false, once a field was missing or malformed. */
+    bool good() const { return fGood; }
+
+    uint64_t readUInt();
+    int64_t readInt();
+    leveldb::Slice readString();
+    uint256 readUint256();
+};
+
+/** A matched contract trade, as stored in the trade database.
+ */
+struct ContractTradeRecord
+{
+    static const uint8_t VERSION = 1;
+
+    std::string makerAddress;
+    std::string takerAddress;
+    uint64_t effectivePrice;
+    uint64_t amountMaker;
+    uint64_t amountTaker;
+    int blockMaker;
+    int blockTaker;
+    std::string makerStatus;
+    std::string takerStatus;
+    int64_t makerLives;
+    int64_t takerLives;
+    uint32_t contractId;
+    uint256 makerTxid;
+    uint256 takerTxid;
+    int64_t amountTraded;
+    uint64_t amountOld;
+    uint64_t amountNew;
+
+    ContractTradeRecord();
+
+    std::string encode() const;
+
+    /** Decodes a binary record. */
+    bool decode(const leveldb::Slice& value);
+
+    /** Parses the fields of a text record, as written by older clients. */
+    bool parseText(const std::vector<std::string>& fields);
+};
+
+#endif // TRADELAYER_DBRECORD_H
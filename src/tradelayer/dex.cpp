@@ -33,8 +33,8 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 
-std::map<int, std::map<uint32_t,int64_t>> mastercore::MapLTCVolume;
-std::map<int, std::map<uint32_t,int64_t>> mastercore::MapTokenVolume;
+mastercore::VolumeMap mastercore::MapLTCVolume;
+mastercore::VolumeMap mastercore::MapTokenVolume;
 std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>> mastercore::tokenvwap;
 
 
@@ -562,7 +562,7 @@ int64_t calculateDExPurchase(const int64_t amountOffered, const int64_t amountDe
 
      // adding LTC volume added by this property
      PrintToLog("%s(): block: %d, propertyId: %d. amountPaid (LTC): %d\n",__func__, block, propertyId, amountPaid);
-     MapLTCVolume[block][propertyId] += amountPaid;
+     MapLTCVolume.add(block, propertyId, amountPaid);
 
      const arith_uint256 amountDesired256  = ConvertTo256(amountDesired);
      const arith_uint256 amountOffered256 = ConvertTo256(amountOffered);
@@ -577,7 +577,7 @@ int64_t calculateDExPurchase(const int64_t amountOffered, const int64_t amountDe
      tokenvwap[propertyId][block].push_back(std::make_pair(unitPrice, amountPurchased));
 
      // saving DEx token volume
-     MapTokenVolume[block][propertyId] += amountPurchased;
+     MapTokenVolume.add(block, propertyId, amountPurchased);
 
 
      // adding Last token/ ltc price
@@ -4,6 +4,7 @@
 #include <tradelayer/log.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/tx.h>
+#include <tradelayer/volume.h>
 
 #include <amount.h>
 #include <hash.h>
@@ -96,7 +97,7 @@ public:
      }
 
 
-    void saveOffer(std::ofstream& file, const std::string& address, CHash256& hasher) const
+    void saveOffer(std::ostream& file, const std::string& address, CHash256& hasher) const
     {
         std::string lineOut = strprintf("%s,%d,%d,%d,%d,%d,%d,%s,%d,%d",
                 address,
@@ -206,7 +207,7 @@ public:
         return bRet;
     }
 
-    void saveAccept(std::ofstream& file, CHash256& hasher, const std::string& address, const std::string& buyer) const
+    void saveAccept(std::ostream& file, CHash256& hasher, const std::string& address, const std::string& buyer) const
     {
         std::string lineOut = strprintf("%s,%d,%s,%d,%d,%d,%d,%d,%d,%s",
                 address,
@@ -235,9 +236,9 @@ typedef std::map<std::string, CMPOffer> OfferMap;
 typedef std::map<std::string, CMPAccept> AcceptMap;
 
 /** Map of LTC Volume in DEx**/
-extern std::map<int, std::map<uint32_t,int64_t>> MapLTCVolume;
+extern VolumeMap MapLTCVolume;
 /** Map of Token Volume in DEx**/
-extern std::map<int, std::map<uint32_t,int64_t>> MapTokenVolume;
+extern VolumeMap MapTokenVolume;
 
 //! Global map for token numerator VWAP (LTC) NOTE: it needs persistence
 extern std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>> tokenvwap;
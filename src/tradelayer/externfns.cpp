@@ -16,7 +16,6 @@
 #include <boost/math/constants/constants.hpp>
 #include <boost/multiprecision/cpp_dec_float.hpp>
 
-mutex map_vector_mtx;
 using mastercore::StrToInt64;
 typedef boost::multiprecision::cpp_dec_float_100 dec_float;
 
@@ -130,37 +129,6 @@ bool findTrueValue(bool a, bool b, bool c, bool d) { return ( a || b ) || ( c ||
 bool findConjTrueValue(bool a, bool b, bool c) { return ( a && b ) && c; }
 bool findConjTrueValue(bool a, bool b) { return a && b; }
 
-void threading(uint32_t keyid, int64_t valueid, std::string name_vec)
-{
-  if (name_vec == "cdex_volume")
-    {
-      map_vector_mtx.lock();
-      mapContractVolume[keyid].push_back(valueid);
-      map_vector_mtx.unlock();
-    }
-  else if (name_vec == "cdex_price")
-    {
-      map_vector_mtx.lock();
-      mapContractAmountTimesPrice[keyid].push_back(valueid);
-      map_vector_mtx.unlock();
-    }
-  else if (name_vec == "cdex_vwap")
-    {
-      map_vector_mtx.lock();
-      VWAPMapContracts[keyid]=valueid;
-      map_vector_mtx.unlock();
-    }
-}
-
-void vwap_num_den(std::vector<int64_t> vn, std::vector<int64_t> vd, int64_t &n, int64_t &d)
-{
-  for (unsigned int i = 0; i < vn.size(); i++)
-    {
-      n += vn[i];
-      d += vd[i];
-    }
-}
-
 namespace mastercore
 {
   int64_t DoubleToInt64(double d) { return mastercore::StrToInt64(boost::lexical_cast<std::string>(d), true); }
@@ -2,13 +2,17 @@
 
 #include <chainparamsbase.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/time.h>
 
 #include <assert.h>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <stdio.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 // Default log files
@@ -17,6 +21,9 @@ const std::string LOG_FILENAME    = "tradelayer.log";
 // Options
 static const long LOG_BUFFERSIZE  =  8000000; //  8 MB
 static const long LOG_SHRINKSIZE  = 50000000; // 50 MB
+static const size_t LOG_RING_SLOTS = 8192;    // messages queued per thread
+static const size_t LOG_SPARE_RINGS = 16;     // rings of exited threads kept for new ones
+static const int LOG_FLUSH_INTERVAL = 100;    // milliseconds between writes
 
 // Debug flags
 bool msc_debug_parser_data                      = 0;
@@ -130,12 +137,74 @@ bool msc_debug_interest_pegged                  = 0;
  * the mutex).
  */
 static std::once_flag debugLogInitFlag;
+
+/**
+ * Messages of a single thread, waiting to be written.
+ *
+ * Only the owning thread adds messages and only the log writer removes them,
+ * so both sides get along without a lock. If the writer falls behind, new
+ * messages are dropped instead of growing the queue.
+ */
+struct LogRing
+{
+    std::vector<std::string> slots;
+    //! Next slot to be read by the log writer
+    std::atomic<size_t> head;
+    //! Next slot to be filled by the owning thread
+    std::atomic<size_t> tail;
+    //! Number of messages, which didn't fit
+    std::atomic<uint64_t> dropped;
+    //! Set, once the owning thread is gone
+    std::atomic<bool> fClosed;
+
+    LogRing() : slots(LOG_RING_SLOTS), head(0), tail(0), dropped(0), fClosed(false) {}
+};
+
+//! Set, once the ring of a thread was released, e.g. for logging from later thread_local destructors
+static thread_local bool fThreadRingReleased = false;
+
+/** Releases the ring of a thread to the log writer, once the thread exits. */
+struct LogRingOwner
+{
+    LogRing* ring;
+
+    LogRingOwner() : ring(nullptr) {}
+    ~LogRingOwner()
+    {
+        // the ring may be handed to another thread, once it is closed
+        LogRing* released = ring;
+        ring = nullptr;
+        fThreadRingReleased = true;
+        if (released) released->fClosed = true;
+    }
+};
+
 /**
  * We use std::call_once() to make sure these are initialized
  * in a thread-safe manner the first time called:
  */
 static FILE* fileout = nullptr;
 static std::mutex* mutexDebugLog = nullptr;
+//! Guards fileout, held while writing to it and while the log file is shrunk
+static std::mutex* mutexLogFile = nullptr;
+//! Wakes the log writer and the threads waiting for it, guarded by mutexDebugLog
+static std::condition_variable* condDebugLog = nullptr;
+//! Rings of all threads, which have logged, guarded by mutexDebugLog
+static std::vector<LogRing*>* logRings = nullptr;
+//! Drained rings of exited threads, handed to new threads, guarded by mutexDebugLog
+static std::vector<LogRing*>* spareLogRings = nullptr;
+//! Number of requested and completed flushes, guarded by mutexDebugLog
+static uint64_t nFlushRequested = 0;
+static uint64_t nFlushCompleted = 0;
+//! The log writer, only started, if the log file could be opened
+static std::thread* logWriter = nullptr;
+//! Asks the log writer to write what is left and to exit, guarded by mutexDebugLog
+static bool fStopLogWriter = false;
+//! Set by the log writer, when it exits, after which messages are written right away
+static std::atomic<bool> fLogWriterExited(false);
+
+static thread_local LogRingOwner threadLogRing;
+static thread_local bool fThreadStartedNewLine = true;
 
 /** Flag to indicate, whether the Trade Layer log file should be reopened. */
 extern std::atomic<bool> fReopentradelayerLog;
@@ -161,6 +230,129 @@ static fs::path GetLogPath()
     return pathLogFile;
 }
 
+/**
+ * @return The current timestamp in the format: 2009-01-03 18:15:05
+ */
+ static std::string GetTimestamp()
+ {
+     return FormatISO8601DateTime(GetTime());
+ }
+
+/**
+ * Moves the queued messages of all threads into one buffer.
+ */
+static void DrainLogRings(std::string& batch)
+{
+    std::vector<LogRing*>::iterator it = logRings->begin();
+    while (it != logRings->end())
+    {
+        LogRing* ring = *it;
+        // read before draining, so nothing added before closing is missed
+        const bool fClosed = ring->fClosed;
+
+        const size_t tail = ring->tail.load(std::memory_order_acquire);
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        for (; head != tail; ++head) {
+            std::string& slot = ring->slots[head % LOG_RING_SLOTS];
+            batch.append(slot);
+            std::string().swap(slot);
+        }
+        ring->head.store(head, std::memory_order_release);
+
+        const uint64_t nDropped = ring->dropped.exchange(0);
+        if (nDropped > 0) {
+            batch.append(strprintf("%s %d log messages dropped, the log writer fell behind\n", GetTimestamp(), nDropped));
+        }
+
+        if (fClosed) {
+            // short-lived threads, such as workers, reuse the rings of earlier ones
+            if (spareLogRings->size() < LOG_SPARE_RINGS) {
+                spareLogRings->push_back(ring);
+            } else {
+                delete ring;
+            }
+            it = logRings->erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * Writes a batch of messages to the log file, and reopens it first, if requested.
+ */
+static void WriteLogBatch(std::string& batch)
+{
+    std::lock_guard<std::mutex> lock(*mutexLogFile);
+
+    // Reopen the log file, if requested
+    if (fReopenTradeLayerLog)
+    {
+        fReopenTradeLayerLog = false;
+        fs::path pathDebug = GetLogPath();
+        // the old stream is closed, even if the file can't be opened again
+        fileout = (fileout != nullptr) ? freopen(pathDebug.string().c_str(), "a", fileout) : fopen(pathDebug.string().c_str(), "a");
+        if (fileout == nullptr) {
+            PrintToConsole("Failed to reopen debug log file: %s\n", pathDebug.string());
+        }
+    }
+
+    // without a file, messages are dropped until the next reopen
+    if (!batch.empty() && fileout != nullptr) {
+        fwrite(batch.data(), 1, batch.size(), fileout);
+        fflush(fileout);
+    }
+    batch.clear();
+}
+
+/**
+ * Writes what is left in the rings together with a message, once the log writer is gone.
+ */
+static void WriteLogRemainder(const std::string& str)
+{
+    std::string batch;
+    {
+        std::lock_guard<std::mutex> lock(*mutexDebugLog);
+        DrainLogRings(batch);
+    }
+    batch.append(str);
+
+    WriteLogBatch(batch);
+}
+
+/**
+ * Writes the queued messages in batches, until it is stopped.
+ */
+static void LogWriterThread()
+{
+    util::ThreadRename("tl-logwriter");
+
+    std::string batch;
+    std::unique_lock<std::mutex> lock(*mutexDebugLog);
+    while (true)
+    {
+        if (!fStopLogWriter) {
+            condDebugLog->wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL));
+        }
+        const bool fStop = fStopLogWriter;
+        const uint64_t nFlush = nFlushRequested;
+
+        DrainLogRings(batch);
+
+        // write outside of the lock, so new threads can still register
+        lock.unlock();
+        WriteLogBatch(batch);
+        lock.lock();
+
+        nFlushCompleted = nFlush;
+        if (fStop) break;
+        condDebugLog->notify_all();
+    }
+
+    fLogWriterExited = true;
+    condDebugLog->notify_all();
+}
+
 /**
  * Opens debug log file.
  */
@@ -172,23 +364,19 @@ static void DebugLogInit()
     fs::path pathDebug = GetLogPath();
     fileout = fopen(pathDebug.string().c_str(), "a");
 
+    mutexDebugLog = new std::mutex();
+    mutexLogFile = new std::mutex();
+    condDebugLog = new std::condition_variable();
+    logRings = new std::vector<LogRing*>();
+    spareLogRings = new std::vector<LogRing*>();
+
     if (fileout) {
-        setbuf(fileout, nullptr); // Unbuffered
+        logWriter = new std::thread(LogWriterThread);
     } else {
         PrintToConsole("Failed to open debug log file: %s\n", pathDebug.string());
     }
-
-    mutexDebugLog = new std::mutex();
 }
 
-/**
- * @return The current timestamp in the format: 2009-01-03 18:15:05
- */
- static std::string GetTimestamp()
- {
-     return FormatISO8601DateTime(GetTime());
- }
-
 /**
  * Prints to log file.
  *
@@ -198,8 +386,12 @@ static void DebugLogInit()
  * If "-printtoconsole" is enabled, then the message is written to the standard
  * output, usually the console, instead of a log file.
  *
+ * Messages are queued per thread and written by a background thread. When the
+ * queue of a thread is full, the message is dropped. Once the background thread
+ * is stopped, messages are written right away.
+ *
  * @param str[in]  The message to log
- * @return The total number of characters written
+ * @return The total number of characters queued
  */
 int LogFilePrint(const std::string& str)
 {
@@ -209,39 +401,103 @@ int LogFilePrint(const std::string& str)
         ret = ConsolePrint(str);
 
     } else {
-        static bool fStartedNewLine = true;
         std::call_once(debugLogInitFlag, &DebugLogInit);
 
-        if (fileout == nullptr)
+        if (logWriter == nullptr)
         {
             return ret;
         }
 
-        std::lock_guard<std::mutex> lock(*mutexDebugLog);
+        // a thread, which is exiting, has no ring anymore, and writes right away
+        if (fLogWriterExited || fThreadRingReleased) {
+            std::string line = (fLogTimestamps && fThreadStartedNewLine) ? GetTimestamp() + " " + str : str;
+            ret = line.size();
+            fThreadStartedNewLine = (!str.empty() && str[str.size()-1] == '\n') ? true : false;
+            WriteLogRemainder(line);
+            return ret;
+        }
 
-        // Reopen the log file, if requested
-        if (fReopenTradeLayerLog)
-        {
-            fReopenTradeLayerLog = false;
-            fs::path pathDebug = GetLogPath();
-            if (freopen(pathDebug.string().c_str(), "a", fileout) != nullptr)
-                setbuf(fileout, nullptr); // Unbuffered
+        LogRing* ring = threadLogRing.ring;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> lock(*mutexDebugLog);
+            if (!spareLogRings->empty()) {
+                ring = spareLogRings->back();
+                spareLogRings->pop_back();
+                ring->fClosed = false;
+            } else {
+                ring = new LogRing();
+            }
+            logRings->push_back(ring);
+            threadLogRing.ring = ring;
+        }
+
+        const size_t tail = ring->tail.load(std::memory_order_relaxed);
+        if (tail - ring->head.load(std::memory_order_acquire) >= LOG_RING_SLOTS) {
+            ++ring->dropped;
+            return ret;
+        }
+
+        std::string& slot = ring->slots[tail % LOG_RING_SLOTS];
 
-         }
+        // Printing log timestamps can be useful for profiling
+        if (fLogTimestamps && fThreadStartedNewLine) {
+            slot = GetTimestamp() + " ";
+        }
+        slot.append(str);
+        ret = slot.size();
 
-         // Printing log timestamps can be useful for profiling
-         if (fLogTimestamps && fStartedNewLine) {
-           ret += fprintf(fileout, "%s ", GetTimestamp().c_str());
-         }
+        fThreadStartedNewLine = (!str.empty() && str[str.size()-1] == '\n') ? true : false;
 
-         fStartedNewLine = (!str.empty() && str[str.size()-1] == '\n') ? true : false;
+        ring->tail.store(tail + 1, std::memory_order_release);
 
-         ret += fwrite(str.data(), 1, str.size(), fileout);
+        // don't wait for the next interval, if the ring fills up quickly
+        if (tail + 1 - ring->head.load(std::memory_order_relaxed) == LOG_RING_SLOTS / 2) {
+            condDebugLog->notify_all();
+        }
     }
 
     return ret;
 }
 
+/**
+ * Blocks until all messages logged so far are written.
+ */
+void FlushDebugLog()
+{
+    if (logWriter == nullptr) return;
+
+    {
+        std::unique_lock<std::mutex> lock(*mutexDebugLog);
+        const uint64_t nFlush = ++nFlushRequested;
+        condDebugLog->notify_all();
+        condDebugLog->wait(lock, [nFlush] { return nFlushCompleted >= nFlush || fLogWriterExited; });
+    }
+
+    if (fLogWriterExited) {
+        WriteLogRemainder("");
+    }
+}
+
+/**
+ * Writes all queued messages and stops the log writer.
+ */
+void StopDebugLog()
+{
+    if (logWriter == nullptr) return;
+
+    {
+        std::lock_guard<std::mutex> lock(*mutexDebugLog);
+        if (fStopLogWriter) return;
+        fStopLogWriter = true;
+        condDebugLog->notify_all();
+    }
+
+    logWriter->join();
+
+    // messages queued while the writer was finishing
+    WriteLogRemainder("");
+}
+
 
 /**
  * Prints to the standard output, usually the console.
@@ -346,6 +602,15 @@ void InitDebugLogLevels()
  */
 void ShrinkDebugLog()
 {
+    // nothing queued should end up in front of the kept part
+    FlushDebugLog();
+
+    // and the log writer has to wait, until the file is rewritten
+    std::unique_lock<std::mutex> fileLock;
+    if (mutexLogFile != nullptr) {
+        fileLock = std::unique_lock<std::mutex>(*mutexLogFile);
+    }
+
     fs::path pathLog = GetLogPath();
     FILE* file = fopen(pathLog.string().c_str(), "r");
 
@@ -9,6 +9,12 @@
 /** Prints to the log file. */
 int LogFilePrint(const std::string& str);
 
+/** Blocks until all queued log messages are written. */
+void FlushDebugLog();
+
+/** Writes all queued log messages and stops the log writer; later messages are written right away. */
+void StopDebugLog();
+
 /** Prints to the console. */
 int ConsolePrint(const std::string& str);
 
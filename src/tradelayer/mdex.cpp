@@ -1,4 +1,5 @@
 #include <tradelayer/ce.h>
+#include <tradelayer/changeset.h>
 #include <tradelayer/mdex.h>
 #include <tradelayer/errors.h>
 #include <tradelayer/externfns.h>
@@ -25,11 +26,15 @@
 #include <assert.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <map>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
@@ -45,23 +50,23 @@ using namespace mastercore;
 //! Global map for price and order data
 md_PropertiesMap mastercore::metadex;
 //! Global map for  tokens volume
-std::map<int, std::map<uint32_t,int64_t>> mastercore::metavolume;
+VolumeMap mastercore::metavolume;
 //! Global map for last contract price
 std::map<uint32_t, std::map<int,std::vector<int64_t>>> mastercore::cdexlastprice;
 
 extern MatrixTLS *pt_ndatabase;
 
 
-md_PricesMap* mastercore::get_Prices(uint32_t prop)
+md_PricesMap* mastercore::get_Prices(uint32_t prop, uint32_t desprop)
 {
-    md_PropertiesMap::iterator it = metadex.find(prop);
+    md_PropertiesMap::iterator it = metadex.find(std::make_pair(prop, desprop));
 
     if (it != metadex.end()) return &(it->second);
 
     return static_cast<md_PricesMap*>(nullptr);
 }
 
-md_Set* mastercore::get_Indexes(md_PricesMap* p, rational_t price)
+md_Set* mastercore::get_Indexes(md_PricesMap* p, const MetaDExPrice& price)
 {
     md_PricesMap::iterator it = p->find(price);
 
@@ -71,42 +76,421 @@ md_Set* mastercore::get_Indexes(md_PricesMap* p, rational_t price)
 
 }
 
+//! Orders of each address in the MetaDEx, sorted like a scan of the books
+static AccountMap<std::set<md_OrderKey>> metadex_addresses;
+//! Orders of the MetaDEx by the transaction, which placed them
+static md_TxidOrders metadex_txids;
+
+//! Contract and price of each resting contract order, by the transaction, which placed it
+static std::unordered_multimap<uint256, std::pair<uint32_t, uint64_t>, TxidHasher> contractdex_txids;
+
+static md_OrderKey MetaDEx_getKey(const CMPMetaDEx& obj)
+{
+    return std::make_tuple(std::make_pair(obj.getProperty(), obj.getDesProperty()), obj.unitPrice(), obj.getBlock(), obj.getIdx());
+}
+
+//! Adds an order, which was inserted into the books, to the indexes
+static void MetaDEx_index(const CMPMetaDEx& obj)
+{
+    const md_OrderKey key = MetaDEx_getKey(obj);
+
+    metadex_addresses[obj.getAccount()].insert(key);
+    metadex_txids.insert(std::make_pair(obj.getHash(), key));
+}
+
+//! Removes an order, which is erased from the books, from the indexes
+static void MetaDEx_unindex(const CMPMetaDEx& obj)
+{
+    const md_OrderKey key = MetaDEx_getKey(obj);
+
+    AccountMap<std::set<md_OrderKey>>::iterator itAddr = metadex_addresses.find(obj.getAccount());
+    if (itAddr != metadex_addresses.end()) itAddr->second.erase(key);
+
+    const std::pair<md_TxidOrders::iterator, md_TxidOrders::iterator> range = metadex_txids.equal_range(obj.getHash());
+    for (md_TxidOrders::iterator itTx = range.first; itTx != range.second; ++itTx) {
+        if (itTx->second == key) {
+            metadex_txids.erase(itTx);
+            break;
+        }
+    }
+}
+
+//! Finds an order in the books by its position, returns the price level holding it, or nullptr if there is none
+static md_Set* MetaDEx_find(const md_OrderKey& key, md_Set::iterator& it)
+{
+    const md_PropertyPair& market = std::get<0>(key);
+    md_PricesMap* const prices = get_Prices(market.first, market.second);
+    if (!prices) return nullptr;
+
+    md_Set* const indexes = get_Indexes(prices, std::get<1>(key));
+    if (!indexes) return nullptr;
+
+    // orders are sorted by block and index only
+    const CMPMetaDEx probe(std::string(), std::get<2>(key), 0, 0, 0, 0, uint256(), std::get<3>(key), 0);
+    it = indexes->find(probe);
+
+    return (it != indexes->end()) ? indexes : nullptr;
+}
+
+//! Orders of an address, sorted like a scan of the books
+static std::vector<md_OrderKey> MetaDEx_getOrders(const std::string& address)
+{
+    std::vector<md_OrderKey> keys;
+
+    AccountMap<std::set<md_OrderKey>>::const_iterator it = metadex_addresses.find(address);
+    if (it != metadex_addresses.end()) keys.assign(it->second.begin(), it->second.end());
+
+    return keys;
+}
+
+void mastercore::clear_metadex()
+{
+    metadex.clear();
+    metadex_addresses.clear();
+    metadex_txids.clear();
+}
+
+const CMPMetaDEx* mastercore::MetaDEx_RetrieveTrade(const uint256& txid)
+{
+    const std::pair<md_TxidOrders::const_iterator, md_TxidOrders::const_iterator> range = metadex_txids.equal_range(txid);
+    for (md_TxidOrders::const_iterator itTx = range.first; itTx != range.second; ++itTx) {
+        md_Set::iterator it;
+        if (MetaDEx_find(itTx->second, it) && it->getHash() == txid) return &(*it);
+    }
+
+    return nullptr;
+}
+
+//! Contracts with resting orders of a transaction, in ascending order
+static std::set<uint32_t> ContractDex_getContracts(const uint256& txid)
+{
+    std::set<uint32_t> contracts;
+
+    const auto range = contractdex_txids.equal_range(txid);
+    for (auto it = range.first; it != range.second; ++it) {
+        contracts.insert(it->second.first);
+    }
+
+    return contracts;
+}
+
+const CMPContractDex* mastercore::ContractDex_RetrieveTrade(const uint256& txid)
+{
+    for (const uint32_t contractId : ContractDex_getContracts(txid)) {
+        const cd_Book* const pbook = get_BookCd(contractId);
+        if (!pbook) continue;
+
+        const std::pair<cd_TxidOrders::const_iterator, cd_TxidOrders::const_iterator> range = pbook->getOrders(txid);
+        if (range.first != range.second) return &(*range.first->second.order);
+    }
+
+    return nullptr;
+}
+
 cd_PropertiesMap mastercore::contractdex;
 
-cd_PricesMap *mastercore::get_PricesCd(uint32_t prop)
+cd_Book *mastercore::get_BookCd(uint32_t prop)
 {
     cd_PropertiesMap::iterator it = contractdex.find(prop);
 
     if (it != contractdex.end()) return &(it->second);
 
-    return static_cast<cd_PricesMap*>(nullptr);
+    return static_cast<cd_Book*>(nullptr);
 }
 
-cd_Set *mastercore::get_IndexesCd(cd_PricesMap *p, uint64_t price)
+//! Removes an order of a book from the global index by transaction
+static void ContractDex_unlist(const uint256& txid, uint32_t contractId, uint64_t price)
 {
-    cd_PricesMap::iterator it = p->find(price);
+    const auto range = contractdex_txids.equal_range(txid);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == std::make_pair(contractId, price)) {
+            contractdex_txids.erase(it);
+            break;
+        }
+    }
+}
 
-    if (it != p->end()) return &(it->second);
+cd_Book::~cd_Book()
+{
+    // the orders leave the global index together with the book
+    for (cd_TxidOrders::const_iterator it = byTxid.begin(); it != byTxid.end(); ++it) {
+        ContractDex_unlist(it->first, contractId, it->second.level->first);
+    }
+}
 
-    return static_cast<cd_Set*>(nullptr);
+cd_PricesMap& cd_Book::getSide(uint8_t tradingAction)
+{
+    return (tradingAction == buy) ? bids : asks;
+}
+
+const cd_PricesMap& cd_Book::getSide(uint8_t tradingAction) const
+{
+    return (tradingAction == buy) ? bids : asks;
 }
 
-void mastercore::LoopBiDirectional(cd_PricesMap* const ppriceMap, uint8_t trdAction, MatchReturnType& NewReturn, CMPContractDex* const pnew, const uint32_t propertyForSale)
+cd_LevelIndex& cd_Book::getLevels(uint8_t tradingAction)
 {
-    if (trdAction == buy)
-        for (auto fwd = ppriceMap->begin(); fwd != ppriceMap->end(); ++fwd) {
-            auto sellerPrice = fwd->first;
-            if (!(pnew->getEffectivePrice() < sellerPrice)) {
-                x_TradeBidirectional(fwd->second, trdAction, pnew, sellerPrice, propertyForSale, NewReturn);
+    return (tradingAction == buy) ? bidLevels : askLevels;
+}
+
+const cd_LevelIndex& cd_Book::getLevels(uint8_t tradingAction) const
+{
+    return (tradingAction == buy) ? bidLevels : askLevels;
+}
+
+void cd_Book::updateLevel(uint8_t tradingAction, uint64_t price, int64_t before, int64_t after)
+{
+    uint64_t& best = (tradingAction == buy) ? bestBid : bestAsk;
+
+    if (0 < after) {
+        if (best == 0 || (tradingAction == buy && price > best) || (tradingAction != buy && price < best)) best = price;
+        return;
+    }
+
+    if (0 == before || price != best) return;
+
+    // the best level ran out of amount: look for the next one with something for sale
+    best = 0;
+    const cd_PricesMap& prices = getSide(tradingAction);
+    if (tradingAction == buy) {
+        cd_PricesMap::const_iterator it = getLevels(tradingAction).at(price);
+        while (it != prices.begin()) {
+            --it;
+            if (0 < it->second.amount) {
+                best = it->first;
+                break;
             }
         }
-    if (trdAction == sell)
-        for (auto bwd = ppriceMap->rbegin(); bwd != ppriceMap->rend(); ++bwd) {
-            auto sellerPrice = bwd->first;
-            if (!(pnew->getEffectivePrice() > sellerPrice)) {
-                x_TradeBidirectional(bwd->second, trdAction, pnew, sellerPrice, propertyForSale, NewReturn);
+    } else {
+        for (cd_PricesMap::const_iterator it = std::next(getLevels(tradingAction).at(price)); it != prices.end(); ++it) {
+            if (0 < it->second.amount) {
+                best = it->first;
+                break;
             }
         }
+    }
+}
+
+cd_OrderKey cd_Handle::getKey() const
+{
+    return std::make_tuple(order->getTradingAction(), level->first, order->getBlock(), order->getIdx());
+}
+
+void cd_Book::addHandle(const cd_Handle& handle)
+{
+    byAddress[handle.order->getAccount()].insert(std::make_pair(handle.getKey(), handle));
+    byTxid.insert(std::make_pair(handle.order->getHash(), handle));
+    contractdex_txids.insert(std::make_pair(handle.order->getHash(), std::make_pair(contractId, handle.level->first)));
+}
+
+void cd_Book::removeHandle(const cd_Handle& handle)
+{
+    const cd_OrderKey key = handle.getKey();
+
+    AccountMap<cd_AddressOrders>::iterator itAddr = byAddress.find(handle.order->getAccount());
+    if (itAddr != byAddress.end()) itAddr->second.erase(key);
+
+    const std::pair<cd_TxidOrders::iterator, cd_TxidOrders::iterator> range = byTxid.equal_range(handle.order->getHash());
+    for (cd_TxidOrders::iterator itTx = range.first; itTx != range.second; ++itTx) {
+        if (itTx->second.getKey() == key) {
+            byTxid.erase(itTx);
+            break;
+        }
+    }
+
+    ContractDex_unlist(handle.order->getHash(), contractId, handle.level->first);
+}
+
+bool cd_Book::insert(const CMPContractDex& obj)
+{
+    cd_LevelIndex& levels = getLevels(obj.getTradingAction());
+    cd_LevelIndex::iterator itLevel = levels.find(obj.getEffectivePrice());
+    if (itLevel == levels.end()) {
+        cd_PricesMap& prices = getSide(obj.getTradingAction());
+        itLevel = levels.insert(std::make_pair(obj.getEffectivePrice(), prices.insert(std::make_pair(obj.getEffectivePrice(), cd_Level())).first)).first;
+    }
+    cd_PricesMap::iterator level = itLevel->second;
+
+    const std::pair<cd_Set::iterator, bool> inserted = level->second.orders.insert(obj);
+    if (!inserted.second) return false;
+
+    const int64_t before = level->second.amount;
+    level->second.amount += obj.getAmountForSale();
+    updateLevel(obj.getTradingAction(), obj.getEffectivePrice(), before, level->second.amount);
+
+    const cd_Handle handle = { level, inserted.first };
+    addHandle(handle);
+
+    return true;
+}
+
+cd_Set::iterator cd_Book::erase(cd_PricesMap::iterator level, cd_Set::iterator it)
+{
+    const cd_Handle handle = { level, it };
+    removeHandle(handle);
+
+    const uint8_t tradingAction = it->getTradingAction();
+    const int64_t before = level->second.amount;
+    level->second.amount -= it->getAmountForSale();
+
+    cd_Set::iterator next = level->second.orders.erase(it);
+    updateLevel(tradingAction, level->first, before, level->second.amount);
+
+    return next;
+}
+
+cd_Set::iterator cd_Book::amend(cd_PricesMap::iterator level, cd_Set::iterator it, const CMPContractDex& replacement)
+{
+    // the replacement sorts the same as the order, so it takes its position
+    assert(replacement.getEffectivePrice() == level->first);
+    const int64_t before = level->second.amount;
+    level->second.amount += replacement.getAmountForSale() - it->getAmountForSale();
+
+    const cd_Handle handle = { level, it };
+    removeHandle(handle);
+
+    cd_Set::iterator next = level->second.orders.erase(it);
+    const cd_Handle updated = { level, level->second.orders.insert(next, replacement) };
+    addHandle(updated);
+    updateLevel(replacement.getTradingAction(), level->first, before, level->second.amount);
+
+    return next;
+}
+
+cd_PricesMap::iterator cd_Book::eraseLevelIfEmpty(uint8_t tradingAction, cd_PricesMap::iterator level)
+{
+    if (!level->second.orders.empty()) return level;
+
+    getLevels(tradingAction).erase(level->first);
+    return getSide(tradingAction).erase(level);
+}
+
+uint64_t cd_Book::getBestPrice(uint8_t tradingAction) const
+{
+    return (tradingAction == buy) ? bestBid : bestAsk;
+}
+
+int64_t cd_Book::getAmountAtPrice(uint8_t tradingAction, uint64_t price) const
+{
+    const cd_LevelIndex& levels = getLevels(tradingAction);
+    cd_LevelIndex::const_iterator it = levels.find(price);
+
+    return (it != levels.end()) ? it->second->second.amount : 0;
+}
+
+const cd_AddressOrders* cd_Book::getOrders(const std::string& address) const
+{
+    AccountMap<cd_AddressOrders>::const_iterator it = byAddress.find(address);
+
+    return (it != byAddress.end() && !it->second.empty()) ? &(it->second) : nullptr;
+}
+
+const cd_AddressOrders* cd_Book::getOrders(AccountId account) const
+{
+    AccountMap<cd_AddressOrders>::const_iterator it = byAddress.find(account);
+
+    return (it != byAddress.end() && !it->second.empty()) ? &(it->second) : nullptr;
+}
+
+std::pair<cd_TxidOrders::const_iterator, cd_TxidOrders::const_iterator> cd_Book::getOrders(const uint256& txid) const
+{
+    return byTxid.equal_range(txid);
+}
+
+/** Moves an amount between two balances of an account, both are updated, or none. */
+static bool moveBalance(AccountId account, uint32_t propertyId, int64_t amount, TallyType from, TallyType to)
+{
+    ChangeSet changes;
+    changes.addTally(account, propertyId, -amount, from);
+    changes.addTally(account, propertyId, amount, to);
+
+    return changes.apply();
+}
+
+/** Passes the margin of a closed position back to the balance, both are updated, or none. */
+static bool releaseMargin(AccountId account, uint32_t contractId, uint32_t collateral, int64_t margin)
+{
+    ChangeSet changes;
+    changes.addRegister(account, contractId, -margin, MARGIN);
+    changes.addTally(account, collateral, margin, BALANCE);
+
+    return changes.apply();
+}
+
+/** Releases the whole contract reserve of the taker, which ran into an order of its own. */
+static void refundSelfTrade(CMPContractDex* const pnew, const uint32_t propertyForSale)
+{
+    PrintToLog("%s(): trading with yourself is not allowed\n", __func__);
+
+    CDInfo::Entry cd;
+    _my_cds->getCD(propertyForSale, cd);
+    const uint32_t collateral = cd.collateral_currency;
+
+    const int64_t amountReserved = getMPbalance(pnew->getAccount(), collateral, CONTRACTDEX_RESERVE);
+
+    PrintToLog("%s(): amountReserved: %d, collateral: %d\n", __func__, amountReserved, collateral);
+
+    if (0 < amountReserved) {
+        moveBalance(pnew->getAccount(), collateral, amountReserved, CONTRACTDEX_RESERVE, BALANCE);
+    }
+
+    pnew->setAmountForsale(0, "no_remaining");
+}
+
+/** Whether the taker has an order of its own among the crossing orders of the opposite side. */
+static bool crossesOwnOrder(const cd_Book& book, const CMPContractDex* const pnew, const uint32_t propertyForSale)
+{
+    const cd_AddressOrders* orders = book.getOrders(pnew->getAccount());
+    if (orders == nullptr) return false;
+
+    for (cd_AddressOrders::const_iterator it = orders->begin(); it != orders->end(); ++it)
+    {
+        const CMPContractDex& pold = *(it->second.order);
+        if (pold.getProperty() != propertyForSale || pold.getTradingAction() == pnew->getTradingAction()) continue;
+
+        const bool crossing = (pnew->getTradingAction() == buy) ? !(pnew->getEffectivePrice() < pold.getEffectivePrice())
+                                                                : !(pnew->getEffectivePrice() > pold.getEffectivePrice());
+        if (crossing) return true;
+    }
+
+    return false;
+}
+
+void mastercore::LoopBiDirectional(cd_Book& book, uint8_t trdAction, MatchReturnType& NewReturn, CMPContractDex* const pnew, const uint32_t propertyForSale)
+{
+    // a buy order only crosses the asks, a sell order only the bids
+    const uint8_t makerAction = (trdAction == buy) ? sell : buy;
+    cd_PricesMap& prices = book.getSide(makerAction);
+
+    if (trdAction == buy) {
+        cd_PricesMap::iterator fwd = prices.begin();
+        while (fwd != prices.end() && 0 < pnew->getAmountForSale()) {
+            const uint64_t sellerPrice = fwd->first;
+            if (pnew->getEffectivePrice() < sellerPrice) break;
+
+            cd_PricesMap::iterator level = fwd++;
+            x_TradeBidirectional(book, level, trdAction, pnew, sellerPrice, propertyForSale, NewReturn);
+            book.eraseLevelIfEmpty(makerAction, level);
+        }
+    }
+
+    if (trdAction == sell) {
+        cd_PricesMap::iterator bwd = prices.end();
+        while (bwd != prices.begin() && 0 < pnew->getAmountForSale()) {
+            cd_PricesMap::iterator level = std::prev(bwd);
+            const uint64_t sellerPrice = level->first;
+            if (pnew->getEffectivePrice() > sellerPrice) break;
+
+            x_TradeBidirectional(book, level, trdAction, pnew, sellerPrice, propertyForSale, NewReturn);
+            bwd = book.eraseLevelIfEmpty(makerAction, level);
+        }
+    }
+
+    // the walk stops once the taker is filled, but an order of its own further
+    // down the crossing levels still releases its reserve, as a full scan would
+    if (0 >= pnew->getAmountForSale() && crossesOwnOrder(book, pnew, propertyForSale)) {
+        refundSelfTrade(pnew, propertyForSale);
+    }
 }
 
 // it needs more work (separate fee from margin)!
@@ -115,7 +499,7 @@ void mastercore::takeMargin(int64_t amount, uint32_t contract_traded, const CDIn
     // taking more margin
     const uint64_t& allreserved = elem->getAmountReserved();
     const uint32_t& colateral = cd.collateral_currency;
-    const int64_t leverage = getContractRecord(elem->getAddr(), contract_traded, LEVERAGE);
+    const int64_t leverage = getContractRecord(elem->getAccount(), contract_traded, LEVERAGE);
     PrintToLog("%s(): leverage: %d, amount_of_contracts: %d\n",__func__, leverage, amount);
     const arith_uint256 aMarginRequirement = ConvertTo256(cd.margin_requirement);
     const arith_uint256 aAmount = ConvertTo256(amount);
@@ -127,16 +511,14 @@ void mastercore::takeMargin(int64_t amount, uint32_t contract_traded, const CDIn
     PrintToLog("%s(): amountOfMoney: %d\n",__func__, amountOfMoney);
 
     // if we need more margin, we add the difference.
-    // updating amount reserved for the order
-    if(!update_tally_map(elem->getAddr(), colateral, -amountOfMoney, BALANCE)){
-        elem->updateAmountReserved(amountOfMoney);
-    } else {
-        PrintToLog("%s(): updating amount reserved for the order Failed\n",__func__);
-    }
-
-    // passing colateral to margin position
-    if(!update_register_map(elem->getAddr(), contract_traded, amountOfMoney, MARGIN))
+    // passing colateral to margin position, both are updated or none
+    ChangeSet margin;
+    margin.addTally(elem->getAccount(), colateral, -amountOfMoney, BALANCE);
+    margin.addRegister(elem->getAccount(), contract_traded, amountOfMoney, MARGIN);
+    if (!margin.apply())
     {
+        // updating amount reserved for the order
+        elem->updateAmountReserved(amountOfMoney);
         PrintToLog("%s(): passing colateral to margin position Failed\n",__func__);
         return;
     }
@@ -155,13 +537,13 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
     {
         PrintToLog("%s() open position, nCouldBuy: %d\n",__func__, nCouldBuy);
         // updating entries (amount of contracts , price)
-        insert_entry(elem->getAddr(), contract_traded, nCouldBuy, elem->getEffectivePrice());
+        insert_entry(elem->getAccount(), contract_traded, nCouldBuy, elem->getEffectivePrice());
         //taking margin
         takeMargin(nCouldBuy, contract_traded, cd, elem);
 
         // here we need to save the bankruptcy price
-        const int64_t initMargin = getMPbalance(elem->getAddr(), cd.collateral_currency, CONTRACTDEX_RESERVE);
-        set_bankruptcy_price_onmap(elem->getAddr(), contract_traded, cd.notional_size, initMargin);
+        const int64_t initMargin = getMPbalance(elem->getAccount(), cd.collateral_currency, CONTRACTDEX_RESERVE);
+        set_bankruptcy_price_onmap(elem->getAccount(), contract_traded, cd.notional_size, initMargin);
 
     // same position
     } else if (signOld == signNew) {
@@ -171,14 +553,14 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
         {
             PrintToLog("%s() increasing position, nCouldBuy: %d\n",__func__, nCouldBuy);
             // updating entries (amount of contracts , price)
-            insert_entry(elem->getAddr(), contract_traded, nCouldBuy, elem->getEffectivePrice());
+            insert_entry(elem->getAccount(), contract_traded, nCouldBuy, elem->getEffectivePrice());
             //taking margin
             takeMargin(nCouldBuy, contract_traded, cd, elem);
 
         // decreasing -> delete some contracts in entry
         } else {
 
-            if(!decrease_entry(elem->getAddr(), contract_traded, nCouldBuy, elem->getEffectivePrice(), cd.isInverseQuoted(), cd.collateral_currency)){
+            if(!decrease_entry(elem->getAccount(), contract_traded, nCouldBuy, elem->getEffectivePrice(), cd.isInverseQuoted(), cd.collateral_currency)){
                 PrintToLog("%s() decreasing position Failed\n",__func__);
             }
         }
@@ -186,53 +568,52 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
     // closing position
    } else if (signOld != 0 && signNew == 0) {
        //releasing margin
-       const int64_t remainingMargin = getContractRecord(elem->getAddr(), contract_traded, MARGIN);
+       const int64_t remainingMargin = getContractRecord(elem->getAccount(), contract_traded, MARGIN);
 
        // resetting the LEVERAGE
-       if(!reset_leverage_register(elem->getAddr(), contract_traded)){
+       if(!reset_leverage_register(elem->getAccount(), contract_traded)){
             PrintToLog("%s() resetting Leverage Failed\n",__func__);
        }
 
        // resetting PNL
-       if(!update_register_map(elem->getAddr(), contract_traded, 0, PNL)){
+       if(!update_register_map(elem->getAccount(), contract_traded, 0, PNL)){
            PrintToLog("%s() resetting PNL Failed\n",__func__);
        }
 
        // passing  from margin to balance
-       update_register_map(elem->getAddr(), contract_traded, -remainingMargin, MARGIN);
-       update_tally_map(elem->getAddr(), cd.collateral_currency, remainingMargin, BALANCE);
+       releaseMargin(elem->getAccount(), contract_traded, cd.collateral_currency, remainingMargin);
 
-       decrease_entry(elem->getAddr(), contract_traded, nCouldBuy, elem->getEffectivePrice(), cd.isInverseQuoted(), cd.collateral_currency);
+       decrease_entry(elem->getAccount(), contract_traded, nCouldBuy, elem->getEffectivePrice(), cd.isInverseQuoted(), cd.collateral_currency);
 
      // closing position and opening another from different side
    } else if (signOld != signNew && (signOld != 0 && signNew != 0)) {
 
          PrintToLog("%s() closing position and opening another from different side\n",__func__);
-         decrease_entry(elem->getAddr(), contract_traded, nCouldBuy, elem->getEffectivePrice(), cd.isInverseQuoted(), cd.collateral_currency);
+         decrease_entry(elem->getAccount(), contract_traded, nCouldBuy, elem->getEffectivePrice(), cd.isInverseQuoted(), cd.collateral_currency);
 
-         const int64_t remainingMargin = getContractRecord(elem->getAddr(), contract_traded, MARGIN);
+         const int64_t remainingMargin = getContractRecord(elem->getAccount(), contract_traded, MARGIN);
 
          // passing  from margin to balance
-         update_register_map(elem->getAddr(), contract_traded, -remainingMargin, MARGIN);
-         update_tally_map(elem->getAddr(), cd.collateral_currency, remainingMargin, BALANCE);
+         releaseMargin(elem->getAccount(), contract_traded, cd.collateral_currency, remainingMargin);
 
          //here we adapt the margin to the new position
          const int64_t newAmount = abs(newPosition);
          takeMargin(newAmount, contract_traded, cd, elem);
 
          // here we need to include the bankruptcy price
-         const int64_t initMargin = getMPbalance(elem->getAddr(), cd.collateral_currency, CONTRACTDEX_RESERVE);
-         set_bankruptcy_price_onmap(elem->getAddr(), contract_traded, cd.notional_size, initMargin);
+         const int64_t initMargin = getMPbalance(elem->getAccount(), cd.collateral_currency, CONTRACTDEX_RESERVE);
+         set_bankruptcy_price_onmap(elem->getAccount(), contract_traded, cd.notional_size, initMargin);
    }
 
  }
 
- void mastercore::x_TradeBidirectional(cd_Set& offerSet, uint8_t trdAction, CMPContractDex* const pnew, const uint64_t sellerPrice, const uint32_t propertyForSale, MatchReturnType& NewReturn)
+ void mastercore::x_TradeBidirectional(cd_Book& book, cd_PricesMap::iterator level, uint8_t trdAction, CMPContractDex* const pnew, const uint64_t sellerPrice, const uint32_t propertyForSale, MatchReturnType& NewReturn)
  {
      /** At good (single) price level and property iterate over offers looking at all parameters to find the match */
+     cd_Set& offerSet = level->second.orders;
      cd_Set::iterator offerIt = offerSet.begin();
 
-     while (offerIt != offerSet.end()) /** Specific price, check all properties */
+     while (offerIt != offerSet.end() && 0 < pnew->getAmountForSale()) /** Specific price, check all properties */
      {
          const CMPContractDex* const pold = &(*offerIt);
 
@@ -243,25 +624,10 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          /** Match Conditions */
          bool boolProperty = pold->getProperty() != propertyForSale;
          bool boolTrdAction = pold->getTradingAction() == pnew->getTradingAction();
-         bool boolAddresses = pold->getAddr() != pnew->getAddr();
+         bool boolAddresses = pold->getAccount() != pnew->getAccount();
 
          if (!boolAddresses && !boolProperty && !boolTrdAction) {
-             PrintToLog("%s(): trading with yourself is not allowed\n", __func__);
-
-             CDInfo::Entry cd;
-             _my_cds->getCD(propertyForSale, cd);
-             const uint32_t collateral = cd.collateral_currency;
-
-             const int64_t amountReserved = getMPbalance(pnew->getAddr(), collateral, CONTRACTDEX_RESERVE);
-
-             PrintToLog("%s(): amountReserved: %d, collateral: %d\n", __func__, amountReserved, collateral);
-
-             if (0 < amountReserved) {
-                 update_tally_map(pnew->getAddr(), collateral, amountReserved, BALANCE);
-                 update_tally_map(pnew->getAddr(), collateral, -amountReserved, CONTRACTDEX_RESERVE);
-             }
-
-             pnew->setAmountForsale(0, "no_remaining");
+             refundSelfTrade(pnew, propertyForSale);
              return;
          }
 
@@ -303,8 +669,8 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
              PrintToLog("amountpnew %d, amountpold: %d\n", amountpnew, amountpold);
          }
 
-         const int64_t poldBalance = getContractRecord(pold->getAddr(), property_traded, CONTRACT_POSITION);
-         const int64_t pnewBalance = getContractRecord(pnew->getAddr(), property_traded, CONTRACT_POSITION);
+         const int64_t poldBalance = getContractRecord(pold->getAccount(), property_traded, CONTRACT_POSITION);
+         const int64_t pnewBalance = getContractRecord(pnew->getAccount(), property_traded, CONTRACT_POSITION);
 
          int64_t poldPositiveBalanceB = 0;
          int64_t pnewPositiveBalanceB = 0;
@@ -337,8 +703,8 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          int64_t seller_amount = (pold->getTradingAction() == sell) ? abs(pold->getAmountForSale()) : abs(pnew->getAmountForSale());
          int64_t buyer_amount = (pold->getTradingAction() == sell) ? abs(pnew->getAmountForSale()) : abs(pold->getAmountForSale());
 
-         const std::string& seller_address = (pold->getTradingAction() == sell) ? pold->getAddr() : pnew->getAddr();
-         const std::string& buyer_address = (pold->getTradingAction() == sell) ? pnew->getAddr() : pold->getAddr();
+         const AccountId seller_account = (pold->getTradingAction() == sell) ? pold->getAccount() : pnew->getAccount();
+         const AccountId buyer_account = (pold->getTradingAction() == sell) ? pnew->getAccount() : pold->getAccount();
 
          int64_t nCouldBuy = (buyer_amount < seller_amount) ? buyer_amount : seller_amount;
 
@@ -369,35 +735,25 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          arith_uint256 numVWAP256_t = mastercore::ConvertTo256(sellerPrice) * mastercore::ConvertTo256(Volume64_t) / COIN;
          int64_t numVWAP64_t = mastercore::ConvertTo64(numVWAP256_t);
 
-         threading(property_traded, numVWAP64_t, "cdex_price");
-         threading(property_traded, Volume64_t, "cdex_volume");
-
-         std::vector<int64_t> numVWAPpriceContract(mapContractAmountTimesPrice[property_traded].end() -
-                                                       std::min(int(mapContractAmountTimesPrice[property_traded].size()), volumeToVWAP),
-                                                   mapContractAmountTimesPrice[property_traded].end());
-         std::vector<int64_t> denVWAPpriceContract(mapContractVolume[property_traded].end() -
-                                                       std::min(int(mapContractVolume[property_traded].size()), volumeToVWAP),
-                                                   mapContractVolume[property_traded].end());
-         int64_t numVWAPriceh = 0, denVWAPriceh = 0;
-
-         int vwaplength = denVWAPpriceContract.size();
-         for (int i = 0; i < vwaplength; i++) {
-             numVWAPriceh += numVWAPpriceContract[i];
-             denVWAPriceh += denVWAPpriceContract[i];
-         }
+         VWAPWindow& contractVWAP = contractVWAPWindows[property_traded];
+         contractVWAP.add(numVWAP64_t, Volume64_t);
 
-         rational_t vwapPricehRat(numVWAPriceh, denVWAPriceh);
+         rational_t vwapPricehRat(contractVWAP.getNumerator(), contractVWAP.getDenominator());
          int64_t vwapPriceh64_t = mastercore::RationalToInt64(vwapPricehRat);
-         threading(property_traded, vwapPriceh64_t, "cdex_vwap");
+         VWAPMapContracts[property_traded] = vwapPriceh64_t;
 
          if (boolAddresses) {
-             update_register_map(seller_address, property_traded, -nCouldBuy, CONTRACT_POSITION);
-             update_register_map(buyer_address, property_traded, nCouldBuy, CONTRACT_POSITION);
+             ChangeSet positions;
+             positions.addRegister(seller_account, property_traded, -nCouldBuy, CONTRACT_POSITION);
+             positions.addRegister(buyer_account, property_traded, nCouldBuy, CONTRACT_POSITION);
+             if (!positions.apply()) {
+                 PrintToLog("%s(): ERROR: positions of %s and %s not updated\n", __func__, pold->getHash().ToString(), pnew->getHash().ToString());
+             }
          }
 
          // bringing back new positions
-         const int64_t poldNBalance = getContractRecord(pold->getAddr(), property_traded, CONTRACT_POSITION);
-         const int64_t pnewNBalance = getContractRecord(pnew->getAddr(), property_traded, CONTRACT_POSITION);
+         const int64_t poldNBalance = getContractRecord(pold->getAccount(), property_traded, CONTRACT_POSITION);
+         const int64_t pnewNBalance = getContractRecord(pnew->getAccount(), property_traded, CONTRACT_POSITION);
 
          //------------------------------------------------------------------------
          CMPContractDex contract_replacement = *pold;
@@ -435,7 +791,7 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          int64_t creplNegativeBalance = 0;
          int64_t creplPositiveBalance = 0;
 
-         const int64_t creplBalance = getContractRecord(contract_replacement.getAddr(), property_traded, CONTRACT_POSITION);
+         const int64_t creplBalance = getContractRecord(contract_replacement.getAccount(), property_traded, CONTRACT_POSITION);
 
          if (creplBalance > 0) {
              creplPositiveBalance = creplBalance;
@@ -535,7 +891,7 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          if (countClosedBuyer < 0) countClosedBuyer = 0;
          /********************************************************/
          std::string Status_maker = "", Status_taker = "";
-         if (pold->getAddr() == seller_address) {
+         if (pold->getAccount() == seller_account) {
              Status_maker = Status_s;
              Status_taker = Status_b;
          } else {
@@ -1017,7 +1373,7 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          v_livesc.push_back(lives_maker3);
          v_livesc.push_back(lives_taker3);
 
-         if (pold->getAddr() == seller_address) {
+         if (pold->getAccount() == seller_account) {
              v_status.push_back(Status_s);
              v_status.push_back(Status_b);
              v_status.push_back(Status_s1);
@@ -1041,7 +1397,7 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          Status_maker0 = Status_maker;
          Status_taker0 = Status_taker;
 
-         if (pold->getAddr() == seller_address) {
+         if (pold->getAccount() == seller_account) {
              Status_maker1 = Status_s1;
              Status_taker1 = Status_b1;
              Status_maker2 = Status_s2;
@@ -1120,9 +1476,7 @@ void mastercore::updateAllEntry(int64_t oldPosition, int64_t newPosition, int64_
          // t_tradelistdb->recordForUPNL(pnew->getHash(),pnew->getAddr(),property_traded,pold->getEffectivePrice());
 
          // if(msc_debug_x_trade_bidirectional) PrintToLog("++ erased old: %s\n", offerIt->ToString());
-         offerSet.erase(offerIt++);
-
-         if (0 < remaining) offerSet.insert(contract_replacement);
+         offerIt = (0 < remaining) ? book.amend(level, offerIt, contract_replacement) : book.erase(level, offerIt);
      }
  }
 
@@ -1214,8 +1568,8 @@ bool mastercore::ContractDex_Fees(const CMPContractDex* maker, const CMPContract
           // 0.5 basis point to feecache
           g_fees->native_fees[cd.collateral_currency] += cacheFee;
 
-          const int64_t reserveMaker =  getMPbalance(maker->getAddr(), cd.collateral_currency, CONTRACTDEX_RESERVE);
-          const int64_t reserveTaker =  getMPbalance(taker->getAddr(), cd.collateral_currency, CONTRACTDEX_RESERVE);
+          const int64_t reserveMaker =  getMPbalance(maker->getAccount(), cd.collateral_currency, CONTRACTDEX_RESERVE);
+          const int64_t reserveTaker =  getMPbalance(taker->getAccount(), cd.collateral_currency, CONTRACTDEX_RESERVE);
 
 
           if (msc_debug_contractdex_fees) PrintToLog("%s: natives takerFee: %d, natives makerFee: %d, cacheFee: %d, reserveMaker: %d, reserveTaker: %d\n",__func__, takerFee, makerFee, cacheFee, reserveMaker, reserveTaker);
@@ -1223,8 +1577,12 @@ bool mastercore::ContractDex_Fees(const CMPContractDex* maker, const CMPContract
     }
 
     // - to taker, + to maker ( do we need to take fee when positions are decreasing?)
-    update_tally_map(taker->getAddr(), cd.collateral_currency, -takerFee, CONTRACTDEX_RESERVE);
-    update_tally_map(maker->getAddr(), cd.collateral_currency, makerFee, BALANCE);
+    ChangeSet fees;
+    if (takerFee != 0) fees.addTally(taker->getAccount(), cd.collateral_currency, -takerFee, CONTRACTDEX_RESERVE);
+    if (makerFee != 0) fees.addTally(maker->getAccount(), cd.collateral_currency, makerFee, BALANCE);
+    if (!fees.empty() && !fees.apply()) {
+        PrintToLog("%s(): ERROR: fees of %s not paid\n", __func__, taker->getHash().ToString());
+    }
 
 
     return true;
@@ -1305,8 +1663,12 @@ bool mastercore::MetaDEx_Fees(const CMPMetaDEx *pnew,const CMPMetaDEx *pold, int
     // -% to taker, +% to maker
     if(cacheFee != 0)
     {
-         update_tally_map(pnew->getAddr(), pnew->getDesProperty(), -takerFee, BALANCE);
-         update_tally_map(pold->getAddr(), pold->getProperty(), makerFee, BALANCE);
+         ChangeSet fees;
+         if (takerFee != 0) fees.addTally(pnew->getAccount(), pnew->getDesProperty(), -takerFee, BALANCE);
+         if (makerFee != 0) fees.addTally(pold->getAccount(), pold->getProperty(), makerFee, BALANCE);
+         if (!fees.empty() && !fees.apply()) {
+             PrintToLog("%s(): ERROR: fees of %s not paid\n", __func__, pnew->getHash().ToString());
+         }
          g_fees->native_fees[pnew->getProperty()] += cacheFee;
          return true;
     }
@@ -1316,45 +1678,43 @@ bool mastercore::MetaDEx_Fees(const CMPMetaDEx *pnew,const CMPMetaDEx *pold, int
 }
 
 /**
- * Scans the orderbook for an specific metadex order.
+ * Cancels an order of an address, given the hash of the transaction, which placed it.
  */
  int mastercore::MetaDEx_CANCEL(const uint256& txid, const std::string& sender_addr, unsigned int block, const std::string& hash)
  {
      int rc = METADEX_ERROR -40;
      bool bValid = false;
 
-     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-         // uint32_t prop = my_it->first;
-
-         // if(msc_debug_contract_cancel) PrintToLog(" ## property: %d\n", prop);
-         md_PricesMap &prices = my_it->second;
-
-         for (md_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt)
-         {
-             // uint64_t price = it->first;
-             md_Set &indexes = itt->second;
-
-             for (md_Set::iterator it = indexes.begin(); it != indexes.end();)
-             {
+     // the first order of the transaction in the books, which belongs to the sender
+     bool bFound = false;
+     md_OrderKey first;
+     const std::pair<md_TxidOrders::const_iterator, md_TxidOrders::const_iterator> range = metadex_txids.equal_range(uint256S(hash));
+     for (md_TxidOrders::const_iterator itTx = range.first; itTx != range.second; ++itTx)
+     {
+         md_Set::iterator it;
+         if (!MetaDEx_find(itTx->second, it) || it->getAddr() != sender_addr ||  it->getAmountForSale() == 0 || (it->getHash()).ToString() != hash) {
+             continue;
+         }
 
-                 if (it->getAddr() != sender_addr ||  it->getAmountForSale() == 0 || (it->getHash()).ToString() != hash) {
-                     ++it;
-                     continue;
-                 }
+         if (!bFound || itTx->second < first) first = itTx->second;
+         bFound = true;
+     }
 
-                 // move from reserve to main
-                 update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE);
-                 update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE);
+     md_Set::iterator it;
+     md_Set* const indexes = bFound ? MetaDEx_find(first, it) : nullptr;
 
+     if (indexes)
+     {
+         // move from reserve to main
+         moveBalance(it->getAccount(), it->getProperty(), it->getAmountRemaining(), METADEX_RESERVE, BALANCE);
 
-                 bValid = true;
-                 if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
-                 p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
-                 indexes.erase(it++);
-                 return 0;
-             }
 
-         }
+         bValid = true;
+         if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
+         p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
+         MetaDEx_unindex(*it);
+         indexes->erase(it);
+         return 0;
      }
 
      if (!bValid && msc_debug_contract_cancel)
@@ -1412,6 +1772,11 @@ std::string xToString(const rational_t& value)
     return strprintf("%s / %s", xToString(value.numerator()), xToString(value.denominator()));
 }
 
+std::string xToString(const MetaDExPrice& value)
+{
+  return xToString(value.toRational());
+}
+
 std::string xToString(const uint64_t &price)
 {
   return strprintf("%s", boost::lexical_cast<std::string>(price));
@@ -1457,7 +1822,8 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
     if (msc_debug_metadex1) PrintToLog("%s(%s: prop=%d, desprop=%d, desprice= %s);newo: %s\n",
         __FUNCTION__, pnew->getAddr(), propertyForSale, propertyDesired, xToString(pnew->inversePrice()), pnew->ToString());
 
-    md_PricesMap* const ppriceMap = get_Prices(propertyDesired);
+    // only orders selling the desired property for the property offered can match
+    md_PricesMap* const ppriceMap = get_Prices(propertyDesired, propertyForSale);
 
     // Nothing for the desired property exists in the market !!
     if (!ppriceMap) {
@@ -1468,13 +1834,14 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
     // Within the desired property map (given one property) iterate over the items looking at prices
     for (md_PricesMap::iterator priceIt = ppriceMap->begin(); priceIt != ppriceMap->end(); ++priceIt)
     { // check all prices
-        const rational_t sellersPrice = priceIt->first;
+        const MetaDExPrice& sellersPrice = priceIt->first;
         if (msc_debug_metadex2) PrintToLog("comparing prices: desprice %s needs to be GREATER THAN OR EQUAL TO %s\n",
           xToString(pnew->inversePrice()), xToString(sellersPrice));
 
         // Is the desired price check satisfied? The buyer's inverse price must be larger than that of the seller.
+        // Prices are ascending, so no later level can satisfy it either.
         if (pnew->inversePrice() < sellersPrice) {
-          continue;
+          break;
         }
 
         md_Set* const pofferSet = &(priceIt->second);
@@ -1490,12 +1857,6 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
   	        if (msc_debug_metadex1) PrintToLog("Looking at existing: %s (its prop= %d, its des prop= %d) = %s\n",
   	            xToString(sellersPrice), pold->getProperty(), pold->getDesProperty(), pold->ToString());
 
-    	      // does the desired property match?
-    	      if (pold->getDesProperty() != propertyForSale) {
-    	          ++offerIt;
-    	          continue;
-    	      }
-
     	      if (msc_debug_metadex1) PrintToLog("MATCH FOUND, Trade: %s = %s\n", xToString(sellersPrice), pold->ToString());
 
     	      // match found, execute trade now!
@@ -1553,7 +1914,7 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
           	// If the resulting adjusted unit price is higher than Alice' price, the
           	// orders shall not execute, and no representable fill is made
-          	const rational_t xEffectivePrice(nWouldPay, nCouldBuy);
+          	const MetaDExPrice xEffectivePrice(nWouldPay, nCouldBuy);
 
           	if (xEffectivePrice > pnew->inversePrice())
           	{
@@ -1628,48 +1989,22 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
           	  mastercore::ConvertTo256(market_priceToken2_Token1)*mastercore::ConvertTo256(seller_amountGot)/COIN;
           	const int64_t numVWAPMapToken2_Token1_64t = mastercore::ConvertTo64(numVWAPMapToken2_Token1_256t);
 
-          	numVWAPVector[pold->getProperty()][pold->getDesProperty()].push_back(numVWAPMapToken1_Token2_64t);
-          	denVWAPVector[pold->getProperty()][pold->getDesProperty()].push_back(buyer_amountGot);
+          	VWAPWindow& poldVWAP = tokenVWAPWindows[pold->getProperty()][pold->getDesProperty()];
+          	poldVWAP.add(numVWAPMapToken1_Token2_64t, buyer_amountGot);
 
-          	numVWAPVector[pnew->getProperty()][pnew->getDesProperty()].push_back(numVWAPMapToken2_Token1_64t);
-          	denVWAPVector[pnew->getProperty()][pnew->getDesProperty()].push_back(seller_amountGot);
+          	VWAPWindow& pnewVWAP = tokenVWAPWindows[pnew->getProperty()][pnew->getDesProperty()];
+          	pnewVWAP.add(numVWAPMapToken2_Token1_64t, seller_amountGot);
 
           	if(msc_debug_metadex2)
             {
-                PrintToLog("numVWAPVector[pold->getProperty()][pold->getDesProperty()].size() = %d",
-          		       numVWAPVector[pold->getProperty()][pold->getDesProperty()].size());
-          	    PrintToLog("numVWAPVector[pnew->getProperty()][pnew->getDesProperty()].size() = %d",
-          		       numVWAPVector[pnew->getProperty()][pnew->getDesProperty()].size());
+                PrintToLog("tokenVWAPWindows[pold->getProperty()][pold->getDesProperty()].size() = %d", poldVWAP.size());
+          	    PrintToLog("tokenVWAPWindows[pnew->getProperty()][pnew->getDesProperty()].size() = %d", pnewVWAP.size());
             }
 
-          	std::vector<int64_t> numVWAPpoldv(numVWAPVector[pold->getProperty()][pold->getDesProperty()].end()-
-          					  std::min(int(numVWAPVector[pold->getProperty()][pold->getDesProperty()].size()),
-          						   volumeToVWAP),
-          					  numVWAPVector[pold->getProperty()][pold->getDesProperty()].end());
-          	std::vector<int64_t> denVWAPpoldv(denVWAPVector[pold->getProperty()][pold->getDesProperty()].end()-
-          					  std::min(int(denVWAPVector[pold->getProperty()][pold->getDesProperty()].size()),
-          						   volumeToVWAP),
-          					  denVWAPVector[pold->getProperty()][pold->getDesProperty()].end());
-
-          	std::vector<int64_t> numVWAPpnewv(numVWAPVector[pnew->getProperty()][pnew->getDesProperty()].end()-
-          					  std::min(int(numVWAPVector[pnew->getProperty()][pnew->getDesProperty()].size()),
-          						   volumeToVWAP),
-          					  numVWAPVector[pnew->getProperty()][pnew->getDesProperty()].end());
-          	std::vector<int64_t> denVWAPpnewv(denVWAPVector[pnew->getProperty()][pnew->getDesProperty()].end()-
-          					  std::min(int(denVWAPVector[pnew->getProperty()][pnew->getDesProperty()].size()),
-          						   volumeToVWAP),
-          					  denVWAPVector[pnew->getProperty()][pnew->getDesProperty()].end());
-
-          	int64_t numVWAPpold = 0, denVWAPpold = 0;
-          	int64_t numVWAPpnew = 0, denVWAPpnew = 0;
-
-          	vwap_num_den(numVWAPpoldv, denVWAPpoldv, numVWAPpold, denVWAPpold);
-          	vwap_num_den(numVWAPpnewv, denVWAPpnewv, numVWAPpnew, denVWAPpnew);
-
-          	rational_t vwapPriceToken1_Token2RatV(numVWAPpold, denVWAPpold);
+          	rational_t vwapPriceToken1_Token2RatV(poldVWAP.getNumerator(), poldVWAP.getDenominator());
           	const int64_t vwapPriceToken1_Token2Int64V = mastercore::RationalToInt64(vwapPriceToken1_Token2RatV);
 
-          	rational_t vwapPriceToken2_Token1RatV(numVWAPpnew, denVWAPpnew);
+          	rational_t vwapPriceToken2_Token1RatV(pnewVWAP.getNumerator(), pnewVWAP.getDenominator());
           	const int64_t vwapPriceToken2_Token1Int64V = mastercore::RationalToInt64(vwapPriceToken2_Token1RatV);
 
           	VWAPMapSubVector[pold->getProperty()][pold->getDesProperty()]=vwapPriceToken1_Token2Int64V;
@@ -1686,8 +2021,8 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
             /***********************************************************************************************/
             // Adding token volume into Map
-            metavolume[pnew->getBlock()][pnew->getProperty()] = seller_amountGot;
-            metavolume[pnew->getBlock()][pnew->getDesProperty()] = buyer_amountGot;
+            metavolume.set(pnew->getBlock(), pnew->getProperty(), seller_amountGot);
+            metavolume.set(pnew->getBlock(), pnew->getDesProperty(), buyer_amountGot);
 
           	/***********************************************************************************************/
             // Adding volume in termos of LTC
@@ -1696,13 +2031,20 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
           	const int64_t& buyer_amountGotAfterFee = buyer_amountGot;
           	int64_t tradingFee = 0;
 
+          	// both legs of the fill are settled together
+          	ChangeSet fill;
+
           	// transfer the payment property from buyer to seller
-          	update_tally_map(pnew->getAddr(), pnew->getProperty(), -seller_amountGot, BALANCE);
-          	update_tally_map(pold->getAddr(), pold->getDesProperty(), seller_amountGot, BALANCE);
+          	fill.addTally(pnew->getAccount(), pnew->getProperty(), -seller_amountGot, BALANCE);
+          	fill.addTally(pold->getAccount(), pold->getDesProperty(), seller_amountGot, BALANCE);
 
           	// transfer the market (the one being sold) property from seller to buyer
-          	update_tally_map(pold->getAddr(), pold->getProperty(), -buyer_amountGot, METADEX_RESERVE);
-          	update_tally_map(pnew->getAddr(), pnew->getDesProperty(), buyer_amountGot, BALANCE);
+          	fill.addTally(pold->getAccount(), pold->getProperty(), -buyer_amountGot, METADEX_RESERVE);
+          	fill.addTally(pnew->getAccount(), pnew->getDesProperty(), buyer_amountGot, BALANCE);
+
+          	if (!fill.apply()) {
+          	    PrintToLog("%s(): ERROR: fill of %s and %s not settled\n", __func__, pold->getHash().ToString(), pnew->getHash().ToString());
+          	}
 
           	/**
           	 * Fees calculations for maker and taker.
@@ -1734,14 +2076,16 @@ MatchReturnType x_Trade(CMPMetaDEx* const pnew)
 
           	if (msc_debug_metadex3) PrintToLog("++ erased old: %s\n", offerIt->ToString());
           	// erase the old seller element
-          	pofferSet->erase(offerIt++);
+          	offerIt = pofferSet->erase(offerIt);
 
           	// insert the updated one in place of the old
           	if (0 < seller_replacement.getAmountRemaining())
           	  {
           	    PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
-          	    pofferSet->insert(seller_replacement);
+          	    pofferSet->insert(offerIt, seller_replacement);
           	  }
+          	else
+          	  MetaDEx_unindex(seller_replacement);
 
           	if (bBuyerSatisfied)
           	{
@@ -1763,15 +2107,15 @@ MatchReturnType x_Trade(CMPContractDex* const pnew)
     uint8_t trdAction = pnew->getTradingAction();
     MatchReturnType NewReturn = NOTHING;
 
-    cd_PricesMap* const ppriceMap = get_PricesCd(propertyForSale);
+    cd_Book* const pbook = get_BookCd(propertyForSale);
 
-    if (!ppriceMap)
+    if (!pbook)
     {
         PrintToLog("%s()=%d:%s NOT FOUND ON THE MARKET\n", __FUNCTION__, NewReturn, getTradeReturnType(NewReturn));
         return NewReturn;
     }
 
-    LoopBiDirectional(ppriceMap, trdAction, NewReturn, pnew, propertyForSale);
+    LoopBiDirectional(*pbook, trdAction, NewReturn, pnew, propertyForSale);
 
     return NewReturn;
 }
@@ -1805,10 +2149,10 @@ std::string CMPMetaDEx::displayUnitPrice() const
 {
      rational_t tmpDisplayPrice;
      if (getDesProperty() == TL_PROPERTY_ALL || getDesProperty() == TL_PROPERTY_TALL) {
-         tmpDisplayPrice = unitPrice();
+         tmpDisplayPrice = unitPrice().toRational();
          if (isPropertyDivisible(getProperty())) tmpDisplayPrice = tmpDisplayPrice * COIN;
      } else {
-         tmpDisplayPrice = inversePrice();
+         tmpDisplayPrice = inversePrice().toRational();
          if (isPropertyDivisible(getDesProperty())) tmpDisplayPrice = tmpDisplayPrice * COIN;
      }
 
@@ -1825,7 +2169,7 @@ std::string CMPMetaDEx::displayUnitPrice() const
 
 std::string CMPMetaDEx::displayFullUnitPrice() const
 {
-    rational_t tempUnitPrice = unitPrice();
+    rational_t tempUnitPrice = unitPrice().toRational();
 
     /* Matching types require no action (divisible/divisible or indivisible/indivisible)
        Non-matching types require adjustment for display purposes
@@ -1851,17 +2195,31 @@ std::string CMPContractDex::displayFullContractPrice() const
     return priceForsaleStr;
 }
 
-rational_t CMPMetaDEx::unitPrice() const
+MetaDExPrice::MetaDExPrice(int64_t n, int64_t d) : num(0), den(1)
 {
-    rational_t effectivePrice;
-    if (amount_forsale) effectivePrice = rational_t(amount_desired, amount_forsale);
-    return effectivePrice;
+    // a zero amount on either side results in a zero price
+    if (0 == n || 0 == d) return;
+
+    int64_t a = n, b = d;
+    while (b != 0) {
+        const int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    if (a < 0) a = -a;
+
+    num = n / a;
+    den = d / a;
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
 }
 
-rational_t CMPMetaDEx::inversePrice() const
+MetaDExPrice MetaDExPrice::inverse() const
 {
-    rational_t inversePrice;
-    if (amount_desired) inversePrice = rational_t(amount_forsale, amount_desired);
+    MetaDExPrice inversePrice;
+    if (num) inversePrice = MetaDExPrice(den, num);
     return inversePrice;
 }
 
@@ -1889,6 +2247,8 @@ void CMPMetaDEx::setAmountRemaining(int64_t amount, const std::string& label)
 
 void CMPMetaDEx::setAmountForsale(int64_t amount, const std::string& label)
 {
+    // the unit price is reduced once at construction; only contract orders
+    // are resized on fills, which trade at their effective price instead
     amount_forsale = amount;
     // PrintToLog("update remaining amount still up for sale (%ld %s):%s\n", amount, label, ToString());
 }
@@ -1927,7 +2287,7 @@ std::string CMPContractDex::ToString() const
         getProperty(), FormatMP(getProperty(), getAmountForSale()));
 }
 
-void CMPMetaDEx::saveOffer(std::ofstream& file, CHash256& hasher) const
+void CMPMetaDEx::saveOffer(std::ostream& file, CHash256& hasher) const
 {
     std::string lineOut = strprintf("%s,%d,%d,%d,%d,%d,%d,%d,%s,%d",
         addr,
@@ -1950,7 +2310,7 @@ void CMPMetaDEx::saveOffer(std::ofstream& file, CHash256& hasher) const
 }
 
 
-void CMPContractDex::saveOffer(std::ofstream& file, CHash256& hasher) const
+void CMPContractDex::saveOffer(std::ostream& file, CHash256& hasher) const
 {
     std::string lineOut = strprintf("%s,%d,%d,%d,%d,%d,%d,%d,%s,%d,%d,%d,%d",
         getAddr(),
@@ -2033,75 +2393,23 @@ bool ContractDex_compare::operator()(const CMPContractDex &lhs, const CMPContrac
 
 bool mastercore::MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx)
 {
-    // Create an empty price map (to use in case price map for this property does not already exist)
-    md_PricesMap temp_prices;
-    // Attempt to obtain the price map for the property
-    md_PricesMap *p_prices = get_Prices(objMetaDEx.getProperty());
-
-    // Create an empty set of metadex objects (to use in case no set currently exists at this price)
-    md_Set temp_indexes;
-    md_Set *p_indexes = nullptr;
-
-    // Prepare for return code
-    std::pair <md_Set::iterator, bool> ret;
-
-    // Attempt to obtain a set of metadex objects for this price from the price map
-    if (p_prices) p_indexes = get_Indexes(p_prices, objMetaDEx.unitPrice());
-    // See if the set was populated, if not no set exists at this price level, use the empty set that we created earlier
-    if (!p_indexes) p_indexes = &temp_indexes;
-
-    // Attempt to insert the metadex object into the set
-    ret = p_indexes->insert(objMetaDEx);
-    if (false == ret.second) return false;
-
-    // If a prices map did not exist for this property, set p_prices to the temp empty price map
-    if (!p_prices) p_prices = &temp_prices;
+    // Obtain the price level for the order (a new one if it does not exist) and insert the order in place
+    md_Set& indexes = metadex[std::make_pair(objMetaDEx.getProperty(), objMetaDEx.getDesProperty())][objMetaDEx.unitPrice()];
 
-    // Update the prices map with the new set at this price
-    (*p_prices)[objMetaDEx.unitPrice()] = *p_indexes;
+    if (!indexes.insert(objMetaDEx).second) return false;
 
-    // Set the metadex map for the property to the updated (or new if it didn't exist) price map
-    metadex[objMetaDEx.getProperty()] = *p_prices;
+    MetaDEx_index(objMetaDEx);
 
     return true;
 }
 
 bool mastercore::ContractDex_INSERT(const CMPContractDex &objContractDex)
 {
-    // Create an empty price map (to use in case price map for this property does not already exist)
-    cd_PricesMap temp_prices;
-
-    // Attempt to obtain the price map for the property
-    cd_PricesMap *cd_prices = get_PricesCd(objContractDex.getProperty());
-
-    // Create an empty set of contractdex objects (to use in case no set currently exists at this price)
-    cd_Set temp_indexes;
-    cd_Set *p_indexes = nullptr;
-
-    // Prepare for return code
-    std::pair <cd_Set::iterator, bool> ret;
-
-    // Attempt to obtain a set of contractdex objects for this price from the price map
-    if (cd_prices) p_indexes = get_IndexesCd(cd_prices, objContractDex.getEffectivePrice());
-
-    // See if the set was populated, if not no set exists at this price level, use the empty set that we created earlier
-    if (!p_indexes) p_indexes = &temp_indexes;
+    // Obtain the book for the contract (a new one if it does not exist) and insert the order at its price level
+    const uint32_t contractId = objContractDex.getProperty();
+    cd_Book& book = contractdex.emplace(std::piecewise_construct, std::forward_as_tuple(contractId), std::forward_as_tuple(contractId)).first->second;
 
-      // Attempt to insert the contractdex object into the set
-    ret = p_indexes->insert(objContractDex);
-
-    if (false == ret.second) return false;
-
-    // If a prices map did not exist for this property, set p_prices to the temp empty price map
-    if (!cd_prices) cd_prices = &temp_prices;
-
-    // Update the prices map with the new Set at this price
-    (*cd_prices)[objContractDex.getEffectivePrice()] = *p_indexes;
-
-    // Set the contractdex map for the property to the updated (or new if it didn't exist) price map
-    contractdex[objContractDex.getProperty()] = *cd_prices;
-
-    return true;
+    return book.insert(objContractDex);
 }
 
 // pretty much directly linked to the ADD TX21 command off the wire
@@ -2113,7 +2421,7 @@ int mastercore::MetaDEx_ADD(const std::string& sender_addr, uint32_t prop, int64
     if (msc_debug_metadex_add) PrintToLog("%s(); buyer obj: %s\n", __FUNCTION__, new_mdex.ToString());
 
     // Ensure this is not a badly priced trade (for example due to zero amounts)
-    if (0 == new_mdex.unitPrice()) return METADEX_ERROR -66;
+    if (new_mdex.unitPrice().isZero()) return METADEX_ERROR -66;
 
     // Match against existing trades, remainder of the order will be put into the order book
     // if (msc_debug_metadex_add) MetaDEx_debug_print();
@@ -2126,8 +2434,7 @@ int mastercore::MetaDEx_ADD(const std::string& sender_addr, uint32_t prop, int64
             return METADEX_ERROR -70;
         } else {
             // move tokens into reserve
-            update_tally_map(sender_addr, prop, -new_mdex.getAmountRemaining(), BALANCE);
-            update_tally_map(sender_addr, prop, new_mdex.getAmountRemaining(), METADEX_RESERVE);
+            moveBalance(new_mdex.getAccount(), prop, new_mdex.getAmountRemaining(), BALANCE, METADEX_RESERVE);
 
             if (msc_debug_metadex_add) PrintToLog("==== INSERTED: %s= %s\n", xToString(new_mdex.unitPrice()), new_mdex.ToString());
             // if (msc_debug_metadex_add) MetaDEx_debug_print();
@@ -2211,75 +2518,79 @@ int mastercore::ContractDex_ADD_MARKET_PRICE(const std::string& sender_addr, uin
     return rc;
 }
 
+//! Copies the handles of orders, which are about to be canceled, since canceling updates the index
+static std::vector<cd_Handle> getHandles(const cd_AddressOrders* orders)
+{
+    std::vector<cd_Handle> handles;
+    if (!orders) return handles;
+
+    handles.reserve(orders->size());
+    for (cd_AddressOrders::const_iterator it = orders->begin(); it != orders->end(); ++it) {
+        handles.push_back(it->second);
+    }
+
+    return handles;
+}
+
 int mastercore::ContractDex_CANCEL_EVERYTHING(const uint256& txid, unsigned int block, const std::string& sender_addr, uint32_t contractId)
 {
     int rc = METADEX_ERROR -40;
     bool bValid = false;
 
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
-    {
-        uint32_t prop = my_it->first;
-
-        if (msc_debug_contract_cancel_every) PrintToLog(" ## property: %d\n", prop);
-        cd_PricesMap &prices = my_it->second;
-
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            uint64_t price = it->first;
-            cd_Set &indexes = it->second;
+    if (msc_debug_contract_cancel_every) PrintToLog(" ## property: %d\n", contractId);
 
-            if (msc_debug_contract_cancel_every) PrintToLog("  # Price Level: %s\n", xToString(price));
+    // only the orders of the sender, bids first, then asks, by price, block and index
+    cd_Book* const pbook = get_BookCd(contractId);
+    const std::vector<cd_Handle> handles = getHandles(pbook ? pbook->getOrders(sender_addr) : nullptr);
 
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();)
-            {
-	              if (msc_debug_contract_cancel_every) PrintToLog("%s= %s\n", xToString(price), it->ToString());
+    for (const cd_Handle& handle : handles)
+    {
+        const uint8_t action = handle.order->getTradingAction();
+        cd_Set::iterator it = handle.order;
 
-	              if (it->getAddr() != sender_addr || it->getProperty() != contractId || it->getAmountForSale() == 0)
-                {
-	                  ++it;
-	                  continue;
-	              }
+        if (msc_debug_contract_cancel_every) PrintToLog("%s= %s\n", xToString(handle.level->first), it->ToString());
 
-	              rc = 0;
-	              if (msc_debug_contract_cancel_every) PrintToLog("%s(): REMOVING %s\n", __func__, it->ToString());
+        if (it->getAmountForSale() == 0) continue;
 
-	              CDInfo::Entry cd;
-	              assert(_my_cds->getCD(it->getProperty(), cd));
+        rc = 0;
+        if (msc_debug_contract_cancel_every) PrintToLog("%s(): REMOVING %s\n", __func__, it->ToString());
 
-	              uint32_t collateralCurrency = cd.collateral_currency;
+        CDInfo::Entry cd;
+        assert(_my_cds->getCD(it->getProperty(), cd));
 
-	              string addr = it->getAddr();
-                int64_t redeemed = it->getAmountReserved();
-	              int64_t amountForSale = it->getAmountForSale();
-                int64_t amountRemaining = it->getAmountRemaining();
-                // int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
+        uint32_t collateralCurrency = cd.collateral_currency;
 
-                if (msc_debug_contract_cancel_every)
-                {
-    	              PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
-    	              PrintToLog("amountForSale: %d\n",amountForSale);
-                    PrintToLog("amountRemaining: %d\n",amountRemaining);
-    	              PrintToLog("Address: %s\n",addr);
-    	              PrintToLog("--------------------------------------------\n");
-                }
+        string addr = it->getAddr();
 
+        const AccountId account = it->getAccount();
+        int64_t redeemed = it->getAmountReserved();
+        int64_t amountForSale = it->getAmountForSale();
+        int64_t amountRemaining = it->getAmountRemaining();
 
-                const int64_t orderReserve = getMPbalance(addr, collateralCurrency, CONTRACTDEX_RESERVE);
-                const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
+        if (msc_debug_contract_cancel_every)
+        {
+            PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
+            PrintToLog("amountForSale: %d\n",amountForSale);
+            PrintToLog("amountRemaining: %d\n",amountRemaining);
+            PrintToLog("Address: %s\n",addr);
+            PrintToLog("--------------------------------------------\n");
+        }
 
-	              // move from reserve to balance the collateral
-	              if (0 < newRedeemed)
-			          {
-	                  update_tally_map(addr, collateralCurrency, newRedeemed, BALANCE);
-	                  update_tally_map(addr, collateralCurrency, -newRedeemed, CONTRACTDEX_RESERVE);
-			          }
+        const int64_t orderReserve = getMPbalance(account, collateralCurrency, CONTRACTDEX_RESERVE);
+        const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
 
-	              bValid = true;
-	              // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-	              indexes.erase(it++);
-            }
+        // move from reserve to balance the collateral
+        if (0 < newRedeemed)
+        {
+            moveBalance(account, collateralCurrency, newRedeemed, CONTRACTDEX_RESERVE, BALANCE);
         }
+
+        bValid = true;
+        // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+        pbook->erase(handle.level, it);
+        pbook->eraseLevelIfEmpty(action, handle.level);
     }
+
     if (!bValid && msc_debug_contract_cancel_every)
       PrintToLog("You don't have active orders\n");
 
@@ -2292,62 +2603,57 @@ int mastercore::ContractDex_CANCEL_FOR_BLOCK(const uint256& txid,  int block,uns
     bool bValid = false;
     for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
     {
-        cd_PricesMap &prices = my_it->second;
+        cd_Book &book = my_it->second;
+        const std::vector<cd_Handle> handles = getHandles(book.getOrders(sender_addr));
 
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
+        for (const cd_Handle& handle : handles)
         {
-            // uint64_t price = it->first;
-            cd_Set &indexes = it->second;
-
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();)
+            cd_Set::iterator it = handle.order;
+            if (it->getBlock() != block || it->getIdx() != idx) continue;
+
+            const uint8_t action = it->getTradingAction();
+            string addr = it->getAddr();
+            const AccountId account = it->getAccount();
+
+            CDInfo::Entry cd;
+            uint32_t contractId = it->getProperty();
+            int64_t redeemed = it->getAmountReserved();
+            _my_cds->getCD(contractId, cd);
+
+            uint32_t collateralCurrency = cd.collateral_currency;
+            // int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
+            int64_t amountForSale = it->getAmountForSale();
+            if(msc_debug_contract_cancel_forblock)
             {
-	              string addr = it->getAddr();
- 	              if (addr != sender_addr || it->getBlock()!= block || it->getIdx()!= idx)
-                {
-	                  ++it;
-	                  continue;
-	              }
-
-	              CDInfo::Entry cd;
-	              uint32_t contractId = it->getProperty();
-                int64_t redeemed = it->getAmountReserved();
-	              _my_cds->getCD(contractId, cd);
 
-	              uint32_t collateralCurrency = cd.collateral_currency;
-	              // int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
-	              int64_t amountForSale = it->getAmountForSale();
-                if(msc_debug_contract_cancel_forblock)
-                {
-
-    	              PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
-    	              PrintToLog("amountForSale: %d\n", amountForSale);
-    	              PrintToLog("Address: %d\n", addr);
-                    // PrintToLog("balance in collateral: %d\n", balance);
-                }
+                PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
+                PrintToLog("amountForSale: %d\n", amountForSale);
+                PrintToLog("Address: %d\n", addr);
+                // PrintToLog("balance in collateral: %d\n", balance);
+            }
 
 
-                const int64_t orderReserve = getMPbalance(addr, collateralCurrency, CONTRACTDEX_RESERVE);
-                const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
+            const int64_t orderReserve = getMPbalance(account, collateralCurrency, CONTRACTDEX_RESERVE);
+            const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
 
-	              // std::string sgetback = FormatDivisibleMP(redeemed, false);
+            // std::string sgetback = FormatDivisibleMP(redeemed, false);
 
-	              if(msc_debug_contract_cancel_forblock) PrintToLog("amount returned to balance: %d\n", redeemed);
+            if(msc_debug_contract_cancel_forblock) PrintToLog("amount returned to balance: %d\n", redeemed);
 
-	              // move from reserve to balance the collateral
-	              if (0 < newRedeemed)
-			          {
-			              update_tally_map(addr, collateralCurrency, newRedeemed, BALANCE);
-	                  update_tally_map(addr, collateralCurrency,  -newRedeemed, CONTRACTDEX_RESERVE);
-	              }
+            // move from reserve to balance the collateral
+            if (0 < newRedeemed)
+            {
+                moveBalance(account, collateralCurrency, newRedeemed, CONTRACTDEX_RESERVE, BALANCE);
+            }
 
-	              // record the cancellation
-	              bValid = true;
-	              // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-	              indexes.erase(it++);
+            // record the cancellation
+            bValid = true;
+            // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+            book.erase(handle.level, it);
+            book.eraseLevelIfEmpty(action, handle.level);
 
-	              rc = 0;
-            }
-       }
+            rc = 0;
+        }
   }
   if (!bValid && msc_debug_contract_cancel_forblock){
     PrintToLog("Incorrect block or idx\n");
@@ -2358,39 +2664,14 @@ int mastercore::ContractDex_CANCEL_FOR_BLOCK(const uint256& txid,  int block,uns
 
 bool mastercore::ContractDex_CHECK_ORDERS(const std::string& sender_addr, uint32_t contractId)
 {
-    bool bValid = false;
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it)
-    {
-        cd_PricesMap &prices = my_it->second;
+    const cd_Book* const pbook = get_BookCd(contractId);
 
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
-        {
-            // uint64_t price = it->first;
-            cd_Set &indexes = it->second;
-
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();)
-            {
-	              string addr = it->getAddr();
-                uint32_t contract = it->getProperty();
- 	              if (addr != sender_addr || contract != contractId)
-                {
-	                  ++it;
-	                  continue;
-	              }
-
-	              bValid = true;
-                break;
-            }
-        }
-    }
-
-    return bValid;
+    return pbook && pbook->getOrders(sender_addr) != nullptr;
 }
 
 int mastercore::ContractDex_CANCEL_IN_ORDER(const std::string& sender_addr, uint32_t contractId)
 {
     int rc = METADEX_ERROR -40;
-    bool bValid = false;
 
     CDInfo::Entry cd;
     if(!_my_cds->getCD(contractId, cd))
@@ -2398,72 +2679,72 @@ int mastercore::ContractDex_CANCEL_IN_ORDER(const std::string& sender_addr, uint
 
     uint32_t collateralCurrency = cd.collateral_currency;
 
-    for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
-        unsigned int prop = my_it->first;
+    cd_Book* const pbook = get_BookCd(contractId);
+    const cd_AddressOrders* const orders = pbook ? pbook->getOrders(sender_addr) : nullptr;
 
-        if(msc_debug_contract_cancel_inorder) PrintToLog(" ## property: %u\n", prop);
-        cd_PricesMap &prices = my_it->second;
+    // the first order with something for sale in price order, no matter the side, then by block and index
+    const cd_Handle* first = nullptr;
+    if (orders) {
+        for (cd_AddressOrders::const_iterator itOrder = orders->begin(); itOrder != orders->end(); ++itOrder) {
+            const cd_Handle& handle = itOrder->second;
+            if (handle.order->getAmountForSale() == 0) continue;
 
-        for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            uint64_t price = it->first;
-            cd_Set &indexes = it->second;
-
-            for (cd_Set::iterator it = indexes.begin(); it != indexes.end();) {
-
-                if(msc_debug_contract_cancel_inorder)
-                {
-                    PrintToLog("%s= %s\n", xToString(price), it->ToString());
-                    PrintToLog("address: %d\n",it->getAddr());
-                    PrintToLog("propertyid: %d\n",it->getProperty());
-                    PrintToLog("amount for sale: %d\n",it->getAmountForSale());
-                }
-
-                if (it->getAddr() != sender_addr || it->getProperty() != contractId || it->getAmountForSale() == 0) {
-                    ++it;
-                    continue;
-                }
+            if (!first || handle.level->first < first->level->first ||
+                    (handle.level->first == first->level->first && ContractDex_compare()(*handle.order, *first->order))) {
+                first = &handle;
+            }
+        }
+    }
 
-                string addr = it->getAddr();
-                int64_t redeemed = it->getAmountReserved();
-                int64_t amountForSale = it->getAmountForSale();
-                // int64_t balance = getMPbalance(addr,collateralCurrency,BALANCE);
+    if (!first)
+    {
+       if (msc_debug_contract_cancel_inorder)
+       {
+           PrintToLog("CANCEL IN ORDER: You don't have active orders\n");
+           rc = 1;
+       }
+       return rc;
+    }
 
-                if(msc_debug_contract_cancel_inorder)
-                {
-                    PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
-                    PrintToLog("amountForSale: %d\n",amountForSale);
-                    PrintToLog("Address: %d\n",addr);
-                }
+    const uint8_t action = first->order->getTradingAction();
+    cd_PricesMap::iterator level = first->level;
+    cd_Set::iterator it = first->order;
 
-                if(msc_debug_contract_cancel_inorder) PrintToLog("redeemed: %d\n",redeemed);
+    if(msc_debug_contract_cancel_inorder)
+    {
+        PrintToLog("%s= %s\n", xToString(level->first), it->ToString());
+        PrintToLog("address: %d\n",it->getAddr());
+        PrintToLog("propertyid: %d\n",it->getProperty());
+        PrintToLog("amount for sale: %d\n",it->getAmountForSale());
+    }
 
+    string addr = it->getAddr();
 
-                const int64_t orderReserve = getMPbalance(addr, collateralCurrency, CONTRACTDEX_RESERVE);
-                const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
+    const AccountId account = it->getAccount();
+    int64_t redeemed = it->getAmountReserved();
+    int64_t amountForSale = it->getAmountForSale();
 
-                // move from reserve to balance the collateral
-                if (0 < newRedeemed) {
-                    update_tally_map(addr, collateralCurrency, newRedeemed, BALANCE);
-                    update_tally_map(addr, collateralCurrency, -newRedeemed, CONTRACTDEX_RESERVE);
-                // // record the cancellation
-                }
+    if(msc_debug_contract_cancel_inorder)
+    {
+        PrintToLog("collateral currency id of contract : %d\n",collateralCurrency);
+        PrintToLog("amountForSale: %d\n",amountForSale);
+        PrintToLog("Address: %d\n",addr);
+        PrintToLog("redeemed: %d\n",redeemed);
+    }
 
-                bValid = true;
-                if(msc_debug_contract_cancel_inorder) PrintToLog("CANCEL IN ORDER: order found!\n");
-                // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-                indexes.erase(it++);
-                rc = 0;
-                return rc;
-            }
+    const int64_t orderReserve = getMPbalance(account, collateralCurrency, CONTRACTDEX_RESERVE);
+    const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
 
-        }
+    // move from reserve to balance the collateral
+    if (0 < newRedeemed) {
+        moveBalance(account, collateralCurrency, newRedeemed, CONTRACTDEX_RESERVE, BALANCE);
     }
 
-    if (!bValid && msc_debug_contract_cancel_inorder)
-    {
-       PrintToLog("CANCEL IN ORDER: You don't have active orders\n");
-       rc = 1;
-    }
+    if(msc_debug_contract_cancel_inorder) PrintToLog("CANCEL IN ORDER: order found!\n");
+    // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+    pbook->erase(level, it);
+    pbook->eraseLevelIfEmpty(action, level);
+    rc = 0;
 
     return rc;
 }
@@ -2541,20 +2822,12 @@ uint64_t mastercore::edgeOrderbook(uint32_t contractId, uint8_t tradingAction)
 {
     uint64_t candPrice = (tradingAction == buy) ?  std::numeric_limits<uint64_t>::max() : 0;
 
-    cd_PricesMap* const ppriceMap = get_PricesCd(contractId); // checking the ask price of contract A
-    for (cd_PricesMap::iterator it = ppriceMap->begin(); it != ppriceMap->end(); ++it)
-    {
-        const cd_Set& indexes = it->second;
-        for (cd_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it)
-        {
-            const CMPContractDex& obj = *it;
-            if (obj.getTradingAction() == tradingAction || obj.getAmountForSale() == 0) continue;
-                uint64_t price = obj.getEffectivePrice();
-            if ((tradingAction == buy && price < candPrice) || (tradingAction == sell && price > candPrice))
-                candPrice = price;
-            if(msc_debug_sp) PrintToLog("%s(): choosen price: %d\n",__func__, price);
-        }
-    }
+    // buyers look at the lowest ask, sellers at the highest bid
+    const cd_Book* const pbook = get_BookCd(contractId);
+    const uint64_t bestPrice = pbook ? pbook->getBestPrice((tradingAction == buy) ? sell : buy) : 0;
+
+    if (bestPrice != 0) candPrice = bestPrice;
+    if (msc_debug_sp) PrintToLog("%s(): choosen price: %d\n",__func__, candPrice);
 
     // just for testing
     if (candPrice == 0 && RegTest()) candPrice = 1000 * COIN;
@@ -2567,7 +2840,11 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
 {
     bool bBuyerSatisfied = false;
 
-    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it)
+    // only the market of ALL for the offered property is searched
+    const md_PropertyPair market(ALL, propertyOffered);
+    const md_PropertiesMap::iterator end = metadex.upper_bound(market);
+
+    for (md_PropertiesMap::iterator my_it = metadex.lower_bound(market); my_it != end; ++my_it)
     {
         md_PricesMap &prices = my_it->second;
 
@@ -2621,13 +2898,15 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
                     continue;
                 }
 
-                // taking ALLs from seller
-                update_tally_map(it->getAddr(), it->getProperty(), -nCouldBuy, METADEX_RESERVE);
+                // taking ALLs from seller, and giving the tokens from cache
+                ChangeSet fill;
+                fill.addTally(it->getAccount(), it->getProperty(), -nCouldBuy, METADEX_RESERVE);
+                fill.addTally(it->getAccount(), it->getDesProperty(), nWouldPay, BALANCE);
+                if (!fill.apply()) {
+                    PrintToLog("%s(): ERROR: order %s not filled from the cache\n", __func__, it->getHash().ToString());
+                }
                 g_fees->oracle_fees[ALL] = nCouldBuy;
 
-                // giving the tokens from cache
-                update_tally_map(it->getAddr(), it->getDesProperty(), nWouldPay, BALANCE);
-
                 const int64_t seller_amountLeft = it->getAmountForSale() - nCouldBuy;
 
                 // postconditions
@@ -2641,13 +2920,15 @@ bool mastercore::MetaDEx_Search_ALL(uint64_t& amount, uint32_t propertyOffered)
                 seller_replacement.setAmountRemaining(seller_amountLeft, "seller_replacement");
 
                 // erase the old seller element
-                indexes.erase(it++);
+                it = indexes.erase(it);
 
                 // insert the updated one in place of the old
                 if (0 < seller_replacement.getAmountRemaining())
                 {
                     if (msc_debug_search_all) PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
-                    indexes.insert(seller_replacement);
+                    indexes.insert(it, seller_replacement);
+                } else {
+                    MetaDEx_unindex(seller_replacement);
                 }
 
             }
@@ -2677,38 +2958,28 @@ int mastercore::MetaDEx_CANCEL_EVERYTHING(const uint256& txid, unsigned int bloc
 {
     int rc = METADEX_ERROR -40;
 
-    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        unsigned int prop = my_it->first;
-
-        if (msc_debug_metadex2) PrintToLog(" ## property: %u\n", prop);
-        md_PricesMap& prices = my_it->second;
+    // only the orders of the sender, by market, price, block and index
+    const std::vector<md_OrderKey> keys = MetaDEx_getOrders(sender_addr);
 
-        for (md_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt) {
-            rational_t price = itt->first;
-            md_Set& indexes = itt->second;
+    for (const md_OrderKey& key : keys) {
+        md_Set::iterator it;
+        md_Set* const indexes = MetaDEx_find(key, it);
 
-            if (msc_debug_metadex2) PrintToLog("  # Price Level: %s\n", xToString(price));
+        if (!indexes || it->getAddr() != sender_addr) continue;
 
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end();) {
-                PrintToLog("%s= %s\n", xToString(price), it->ToString());
+        if (msc_debug_metadex2) PrintToLog(" ## property: %u\n", std::get<0>(key).first);
+        PrintToLog("%s= %s\n", xToString(std::get<1>(key)), it->ToString());
 
-                if (it->getAddr() != sender_addr) {
-                    ++it;
-                    continue;
-                }
+        rc = 0;
+        // move from reserve to balance
+        moveBalance(it->getAccount(), it->getProperty(), it->getAmountRemaining(), METADEX_RESERVE, BALANCE);
 
-                rc = 0;
-                // move from reserve to balance
-                update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE);
-                update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE);
+        //record the cancellation
+        bool bValid = true;
+        p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
 
-                //record the cancellation
-                bool bValid = true;
-                p_txlistdb->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
-
-                indexes.erase(it++);
-            }
-        }
+        MetaDEx_unindex(*it);
+        indexes->erase(it);
     }
 
     return rc;
@@ -2718,7 +2989,7 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 {
     int rc = METADEX_ERROR -20;
     CMPMetaDEx mdex(sender_addr, 0, prop, amount, property_desired, amount_desired, uint256(), 0, CMPTransaction::CANCEL_AT_PRICE);
-    md_PricesMap* prices = get_Prices(prop);
+    md_PricesMap* prices = get_Prices(prop, property_desired);
     const CMPMetaDEx* p_mdex = nullptr;
 
     if (!prices) {
@@ -2728,7 +2999,7 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 
     // within the desired property map (given one property) iterate over the items
     for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        rational_t sellers_price = my_it->first;
+        const MetaDExPrice& sellers_price = my_it->first;
 
         if (mdex.unitPrice() != sellers_price) continue;
 
@@ -2749,13 +3020,13 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
             PrintToLog("%s(): REMOVING %s\n", __func__, p_mdex->ToString());
 
             // move from reserve to main
-            update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE);
-            update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE);
+            moveBalance(p_mdex->getAccount(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), METADEX_RESERVE, BALANCE);
 
             // record the cancellation
             bool bValid = true;
             p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
 
+            MetaDEx_unindex(*iitt);
             indexes->erase(iitt++);
         }
     }
@@ -2766,7 +3037,7 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int block, const std::string& sender_addr, uint32_t prop, uint32_t property_desired)
 {
     int rc = METADEX_ERROR -30;
-    md_PricesMap* prices = get_Prices(prop);
+    md_PricesMap* prices = get_Prices(prop, property_desired);
     const CMPMetaDEx* p_mdex = nullptr;
 
     if (!prices) {
@@ -2792,13 +3063,13 @@ int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int bl
             PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
 
             // move from reserve to balance
-            update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE);
-            update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE);
+            moveBalance(p_mdex->getAccount(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), METADEX_RESERVE, BALANCE);
 
             // record the cancellation
             bool bValid = true;
             p_txlistdb->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
 
+            MetaDEx_unindex(*iitt);
             indexes->erase(iitt++);
         }
     }
@@ -2807,82 +3078,92 @@ int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int bl
 }
 
 /**
- * Scans the orderbook for an specific contract order.
+ * Cancels an order of an address, given the hash of the transaction, which placed it.
  */
  int mastercore::ContractDex_CANCEL(const std::string& sender_addr, const std::string& hash)
  {
      int rc = METADEX_ERROR -40;
      bool bValid = false;
+     const uint256 txid = uint256S(hash);
 
-     for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
-         uint32_t prop = my_it->first;
+     // only the contracts with orders of the transaction are visited
+     for (const uint32_t prop : ContractDex_getContracts(txid)) {
+         cd_Book* const pbook = get_BookCd(prop);
+         if (!pbook) continue;
 
          if(msc_debug_contract_cancel) PrintToLog(" ## property: %d\n", prop);
-         cd_PricesMap &prices = my_it->second;
-
-         for (cd_PricesMap::iterator itt = prices.begin(); itt != prices.end(); ++itt) {
-             // uint64_t price = it->first;
-             cd_Set &indexes = itt->second;
-
-             for (cd_Set::iterator it = indexes.begin(); it != indexes.end();) {
-
-                 if(msc_debug_contract_cancel)
-                 {
-                     std::string getstring = (it->getHash()).ToString();
-                     PrintToLog("getAddr: %s\n",it->getAddr());
-                     PrintToLog("address: %s\n",sender_addr);
-                     PrintToLog("propertyid: %d\n",it->getProperty());
-                     PrintToLog("amount for sale: %d\n",it->getAmountForSale());
-                     PrintToLog("hash: %s\n",hash);
-                     PrintToLog("getHash: %s\n",getstring);
-                 }
+         cd_Book &book = *pbook;
 
-                 if (it->getAddr() != sender_addr ||  it->getAmountForSale() == 0 || (it->getHash()).ToString() != hash) {
-                     ++it;
-                     continue;
-                 }
+         // the first order of the transaction in the book, which belongs to the sender
+         const cd_Handle* first = nullptr;
+         const std::pair<cd_TxidOrders::const_iterator, cd_TxidOrders::const_iterator> range = book.getOrders(txid);
+         for (cd_TxidOrders::const_iterator itTx = range.first; itTx != range.second; ++itTx) {
+             const cd_Handle& handle = itTx->second;
 
-                 string addr = it->getAddr();
-                 int64_t redeemed = it->getAmountReserved();
-                 int64_t amountForSale = it->getAmountForSale();
-                 int64_t amountRemaining = it->getAmountRemaining();
-                 uint32_t contractId = it->getProperty();
+             if(msc_debug_contract_cancel)
+             {
+                 std::string getstring = (handle.order->getHash()).ToString();
+                 PrintToLog("getAddr: %s\n",handle.order->getAddr());
+                 PrintToLog("address: %s\n",sender_addr);
+                 PrintToLog("propertyid: %d\n",handle.order->getProperty());
+                 PrintToLog("amount for sale: %d\n",handle.order->getAmountForSale());
+                 PrintToLog("hash: %s\n",hash);
+                 PrintToLog("getHash: %s\n",getstring);
+             }
 
-                 CDInfo::Entry cd;
-                 if(!_my_cds->getCD(contractId, cd))
-                     return rc;
+             if (handle.order->getAddr() != sender_addr || handle.order->getAmountForSale() == 0 || (handle.order->getHash()).ToString() != hash) {
+                 continue;
+             }
 
-                 uint32_t collateralCurrency = cd.collateral_currency;
+             if (!first || handle.getKey() < first->getKey()) first = &handle;
+         }
 
-                 if(msc_debug_contract_cancel)
-                 {
+         if (!first) continue;
 
-                     PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
-                     PrintToLog("amountForSale: %d\n",amountForSale);
-                     PrintToLog("amountRemaining: %d\n",amountRemaining);
-                     PrintToLog("Address: %s\n",addr);
-                 }
+         const uint8_t action = first->order->getTradingAction();
+         cd_PricesMap::iterator itt = first->level;
+         cd_Set::iterator it = first->order;
 
-                 if(msc_debug_contract_cancel) PrintToLog("redeemed: %d\n",redeemed);
+         string addr = it->getAddr();
 
-                 const int64_t orderReserve = getMPbalance(addr, collateralCurrency, CONTRACTDEX_RESERVE);
-                 const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
+         const AccountId account = it->getAccount();
+         int64_t redeemed = it->getAmountReserved();
+         int64_t amountForSale = it->getAmountForSale();
+         int64_t amountRemaining = it->getAmountRemaining();
+         uint32_t contractId = it->getProperty();
 
-                 // move from reserve to balance the collateral
-                 if (0 < newRedeemed) {
-                     update_tally_map(addr, collateralCurrency, newRedeemed, BALANCE);
-                     update_tally_map(addr, collateralCurrency, -newRedeemed, CONTRACTDEX_RESERVE);
-                 }
+         CDInfo::Entry cd;
+         if(!_my_cds->getCD(contractId, cd))
+             return rc;
 
-                 bValid = true;
-                 if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
-                 // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
-                 indexes.erase(it++);
-                 rc = 0;
-                 return rc;
-             }
+         uint32_t collateralCurrency = cd.collateral_currency;
+
+         if(msc_debug_contract_cancel)
+         {
+
+             PrintToLog("collateral currency id of contract : %d\n", collateralCurrency);
+             PrintToLog("amountForSale: %d\n",amountForSale);
+             PrintToLog("amountRemaining: %d\n",amountRemaining);
+             PrintToLog("Address: %s\n",addr);
+         }
+
+         if(msc_debug_contract_cancel) PrintToLog("redeemed: %d\n",redeemed);
+
+         const int64_t orderReserve = getMPbalance(account, collateralCurrency, CONTRACTDEX_RESERVE);
+         const int64_t newRedeemed = (redeemed <= orderReserve) ? redeemed : orderReserve;
 
+         // move from reserve to balance the collateral
+         if (0 < newRedeemed) {
+             moveBalance(account, collateralCurrency, newRedeemed, CONTRACTDEX_RESERVE, BALANCE);
          }
+
+         bValid = true;
+         if(msc_debug_contract_cancel) PrintToLog("%s(): order found!\n",__func__);
+         // p_txlistdb->recordContractDexCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountForSale
+         book.erase(itt, it);
+         book.eraseLevelIfEmpty(action, itt);
+         rc = 0;
+         return rc;
      }
 
      if (!bValid && msc_debug_contract_cancel)
@@ -2904,20 +3185,24 @@ int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int bl
       arith_uint256 iVWAP = 0;
       arith_uint256 iBankrupcyVWAP = 0;
 
-      for (cd_PropertiesMap::iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
-          uint32_t prop = my_it->first;
+      // the sign is given by the first liquidation order in the book (price, then block and index)
+      std::tuple<uint64_t, int, unsigned int> firstKey;
+      int64_t firstPosition = 0;
 
-          if (prop != contractId) continue;
+      cd_Book* const pbook = get_BookCd(contractId);
+      if (!pbook) return bValid;
 
-          PrintToLog(" ## contractId: %d\n", prop);
-          cd_PricesMap &prices = my_it->second;
+      PrintToLog(" ## contractId: %d\n", contractId);
 
+      for (const uint8_t action : {buy, sell})
+      {
+          cd_PricesMap &prices = pbook->getSide(action);
 
-          for (cd_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it)
+          for (cd_PricesMap::iterator it = prices.begin(); it != prices.end();)
           {
               const uint64_t& price = it->first;
               //PrintToLog(" ## price: %d\n", price);
-              cd_Set &indexes = it->second;
+              cd_Set &indexes = it->second.orders;
 
               for (cd_Set::iterator itt = indexes.begin(); itt != indexes.end();)
               {
@@ -2938,26 +3223,33 @@ int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int bl
                   iVWAP += ConvertTo256(itt->getAmountForSale() * itt->getEffectivePrice());
 
                   // bankruptcyVWAP calculations
-                  int64_t bankruptcyPrice = getContractRecord(itt->getAddr(), contractId, BANKRUPTCY_PRICE);
+                  int64_t bankruptcyPrice = getContractRecord(itt->getAccount(), contractId, BANKRUPTCY_PRICE);
                   iBankrupcyVWAP += ConvertTo256(itt->getAmountForSale() * bankruptcyPrice);
 
-                  const int64_t position = getContractRecord(itt->getAddr(), contractId, CONTRACT_POSITION);
+                  const int64_t position = getContractRecord(itt->getAccount(), contractId, CONTRACT_POSITION);
 
-                  // sign of liquidation orders
-                  if (!bValid && 0 < position) {
-                      sign = true;
+                  const std::tuple<uint64_t, int, unsigned int> key = std::make_tuple(price, itt->getBlock(), itt->getIdx());
+                  if (!bValid || key < firstKey) {
+                      firstKey = key;
+                      firstPosition = position;
                   }
 
                   // deleting small orders (later it's gonna add a big one)
-                  indexes.erase(itt++);
+                  itt = pbook->erase(it, itt);
 
 
                   bValid = true;
               }
 
+              pbook->eraseLevelIfEmpty(action, it++);
           }
       }
 
+      // sign of liquidation orders
+      if (bValid && 0 < firstPosition) {
+          sign = true;
+      }
+
       if (!bValid)
       {
          //PrintToLog("%s(): You DON'T have LIQUIDATION ORDERS\n",__func__);
@@ -3024,14 +3316,7 @@ bool mastercore::checkContractReserve(const std::string& address, int64_t amount
 
  }
 
-// auxiliar function
-void addLives(int64_t& totalLongs, int64_t& totalShorts, int32_t contractId, const Register& reg){
-    int64_t position = reg.getRecord(contractId, CONTRACT_POSITION);
-    (position > 0) ? totalLongs += position : totalShorts += position;
-
-}
-
- // counts the number of all contracts in every position
+// counts the number of all contracts in every position
 int64_t mastercore::getTotalLives(uint32_t contractId)
 {
     int64_t totalLongs = 0;
@@ -3039,8 +3324,12 @@ int64_t mastercore::getTotalLives(uint32_t contractId)
 
     LOCK(cs_register);
 
-    // for each tally account, we sum just contracts (all shorts, or all longs)
-    for_each(mp_register_map.begin(), mp_register_map.end(), [&totalLongs, &totalShorts, contractId](const std::pair<std::string, Register>& elem){ addLives(totalLongs, totalShorts, contractId, elem.second); });
+    // open interest is kept by update_register_map()
+    std::map<uint32_t, ContractPositions>::const_iterator it = mp_contract_positions.find(contractId);
+    if (it != mp_contract_positions.end()) {
+        totalLongs = it->second.longs;
+        totalShorts = it->second.shorts;
+    }
 
     if(msc_debug_get_total_lives) PrintToLog("%s(): totalLongs : %d, totalShorts : %d\n",__func__, totalLongs, totalShorts);
 
@@ -1,9 +1,11 @@
 #ifndef TRADELAYER_MDEX_H
 #define TRADELAYER_MDEX_H
 
+#include <tradelayer/accounts.h>
 #include <tradelayer/ce.h>
 #include <tradelayer/tx.h>
 #include <tradelayer/tradelayer_matrices.h>
+#include <tradelayer/volume.h>
 #include <uint256.h>
 
 #include <fstream>
@@ -11,6 +13,8 @@
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/multiprecision/cpp_dec_float.hpp>
@@ -30,15 +34,49 @@ typedef boost::rational<boost::multiprecision::checked_int128_t> rational_t;
 #define TRADE_CANCELLED               4
 #define TRADE_CANCELLED_PART_FILLED   5
 
-//Twap constant
-const int volumeToVWAP = 10;
-
 const int64_t globalNumPrice = 1;
 const int64_t globalDenPrice = 1;
 
 
+/** Exact unit price of an order, kept as reduced fraction of two amounts.
+ *
+ * The fraction is reduced once, when the price is created, so equal prices have
+ * equal terms, and prices are ordered by cross-multiplication of the terms, which
+ * can't overflow 128 bits.
+ */
+class MetaDExPrice
+{
+ private:
+  int64_t num;
+  int64_t den;
+
+ public:
+  MetaDExPrice() : num(0), den(1) {}
+  MetaDExPrice(int64_t n, int64_t d);
+
+  int64_t numerator() const { return num; }
+  int64_t denominator() const { return den; }
+  bool isZero() const { return 0 == num; }
+
+  /** Returns the price in terms of the other side, which is zero for a zero price. */
+  MetaDExPrice inverse() const;
+
+  rational_t toRational() const { return rational_t(num, den); }
+
+  bool operator==(const MetaDExPrice& other) const { return num == other.num && den == other.den; }
+  bool operator!=(const MetaDExPrice& other) const { return !(*this == other); }
+  bool operator<(const MetaDExPrice& other) const
+  {
+    return boost::multiprecision::int128_t(num) * other.den < boost::multiprecision::int128_t(other.num) * den;
+  }
+  bool operator>(const MetaDExPrice& other) const { return other < *this; }
+  bool operator<=(const MetaDExPrice& other) const { return !(other < *this); }
+  bool operator>=(const MetaDExPrice& other) const { return !(*this < other); }
+};
+
 /** Converts price to string. */
 std::string xToString(const rational_t& value);
+std::string xToString(const MetaDExPrice& value);
 
 std::string xToString(const uint64_t &value);
 std::string xToString(const int64_t  &price);
@@ -79,6 +117,8 @@ class CMPMetaDEx
   int64_t amount_remaining;
   uint8_t subaction;
   std::string addr;
+  mastercore::AccountId account; // id of addr, resolved once, when the order is created
+  MetaDExPrice unit_price; // amount_desired / amount_forsale
 
  public:
   uint256 getHash() const { return txid; }
@@ -97,6 +137,7 @@ class CMPMetaDEx
   uint8_t getAction() const { return subaction; }
 
   const std::string& getAddr() const { return addr; }
+  mastercore::AccountId getAccount() const { return account; }
 
   int getBlock() const { return block; }
   unsigned int getIdx() const { return idx; }
@@ -105,34 +146,34 @@ class CMPMetaDEx
 
  CMPMetaDEx()
    : block(0), idx(0), property(0), amount_forsale(0), desired_property(0), amount_desired(0),
-    amount_remaining(0), subaction(0) {}
+    amount_remaining(0), subaction(0), account(0) {}
 
  CMPMetaDEx(const std::string& addr, int b, uint32_t c, int64_t nValue, uint32_t cd, int64_t ad,
 	    const uint256& tx, uint32_t i, uint8_t suba)
    : block(b), txid(tx), idx(i), property(c), amount_forsale(nValue), desired_property(cd), amount_desired(ad),
-    amount_remaining(nValue), subaction(suba), addr(addr) {}
+    amount_remaining(nValue), subaction(suba), addr(addr), account(mastercore::InternAddress(addr)), unit_price(ad, nValue) {}
 
  CMPMetaDEx(const std::string& addr, int b, uint32_t c, int64_t nValue, uint32_t cd, int64_t ad,
 	    const uint256& tx, uint32_t i, uint8_t suba, int64_t ar)
    : block(b), txid(tx), idx(i), property(c), amount_forsale(nValue), desired_property(cd), amount_desired(ad),
-    amount_remaining(ar), subaction(suba), addr(addr) {}
+    amount_remaining(ar), subaction(suba), addr(addr), account(mastercore::InternAddress(addr)), unit_price(ad, nValue) {}
 
  CMPMetaDEx(const CMPTransaction& tx)
    : block(tx.block), txid(tx.txid), idx(tx.tx_idx), property(tx.property), amount_forsale(tx.nValue),
     desired_property(tx.desired_property), amount_desired(tx.desired_value), amount_remaining(tx.nValue),
-    subaction(tx.subaction), addr(tx.sender) {}
+    subaction(tx.subaction), addr(tx.sender), account(mastercore::InternAddress(tx.sender)), unit_price(tx.desired_value, tx.nValue) {}
 
   std::string ToString() const;
 
-  rational_t unitPrice() const;
-  rational_t inversePrice() const;
+  const MetaDExPrice& unitPrice() const { return unit_price; }
+  MetaDExPrice inversePrice() const { return unit_price.inverse(); }
 
   /** Used for display of unit prices to 8 decimal places at UI layer. */
   std::string displayUnitPrice() const;
   /** Used for display of unit prices with 50 decimal places at RPC layer. */
   std::string displayFullUnitPrice() const;
 
-  void saveOffer(std::ofstream& file, CHash256& hasher) const;
+  void saveOffer(std::ostream& file, CHash256& hasher) const;
 
   std::string GenerateConsensusString() const;
 
@@ -173,7 +214,7 @@ class CMPContractDex : public CMPMetaDEx
   std::string displayFullContractPrice() const;
   std::string ToString() const;
 
-  void saveOffer(std::ofstream& file, CHash256& hasher) const;
+  void saveOffer(std::ostream& file, CHash256& hasher) const;
 
   void setPrice(int64_t price);
 
@@ -193,6 +234,12 @@ class CMPContractDex : public CMPMetaDEx
 
 namespace mastercore
 {
+  //! Hash of a transaction id, for the indexes of the books by transaction
+  struct TxidHasher
+  {
+      size_t operator()(const uint256& txid) const { return txid.GetCheapHash(); }
+  };
+
   struct MetaDEx_compare
   {
     bool operator()(const CMPMetaDEx& lhs, const CMPMetaDEx& rhs) const;
@@ -202,14 +249,16 @@ namespace mastercore
   //! Set of objects sorted by block+idx
   typedef std::set<CMPMetaDEx, MetaDEx_compare> md_Set;
   //! Map of prices; there is a set of sorted objects for each price
-  typedef std::map<rational_t, md_Set> md_PricesMap;
-  //! Map of properties; there is a map of prices for exchange each property
-  typedef std::map<uint32_t, md_PricesMap> md_PropertiesMap;
+  typedef std::map<MetaDExPrice, md_Set> md_PricesMap;
+  //! Pair of properties of an order: property for sale, property desired
+  typedef std::pair<uint32_t, uint32_t> md_PropertyPair;
+  //! Map of property pairs; there is a map of prices for each market
+  typedef std::map<md_PropertyPair, md_PricesMap> md_PropertiesMap;
 
   /**  Global map for cumulative volume by pair of properties
    *   Block, property -> put the amount of property traded.
    */
-  extern std::map<int, std::map<uint32_t,int64_t>> metavolume;
+  extern VolumeMap metavolume;
 
   //! Global map for last contract prices
   extern std::map<uint32_t, std::map<int,std::vector<int64_t>>> cdexlastprice;
@@ -217,9 +266,13 @@ namespace mastercore
   //! Global map for price and order data
   extern md_PropertiesMap metadex;
 
-  // TODO: explore a property-pair, instead of a single priceoperty as map's key........
-  md_PricesMap* get_Prices(uint32_t prop);
-  md_Set* get_Indexes(md_PricesMap* p, rational_t price);
+  //! Position of an order in the MetaDEx: market, price, block and index, which sorts like a scan of the books
+  typedef std::tuple<md_PropertyPair, MetaDExPrice, int, unsigned int> md_OrderKey;
+  //! Orders of the MetaDEx by the transaction that placed them
+  typedef std::unordered_multimap<uint256, md_OrderKey, TxidHasher> md_TxidOrders;
+
+  md_PricesMap* get_Prices(uint32_t prop, uint32_t desprop);
+  md_Set* get_Indexes(md_PricesMap* p, const MetaDExPrice& price);
 
   uint64_t edgeOrderbook(uint32_t contractId, uint8_t tradingAction);
 
@@ -230,17 +283,126 @@ namespace mastercore
     bool operator()(const CMPContractDex &lhs, const CMPContractDex &rhs) const;
   };
 
+  //! Set of objects sorted by block+idx
   typedef std::set<CMPContractDex, ContractDex_compare> cd_Set;
-  typedef std::map<uint64_t, cd_Set> cd_PricesMap;
-  typedef std::map<uint32_t, cd_PricesMap> cd_PropertiesMap;
+
+  //! Orders resting at a single price, together with their total amount for sale
+  struct cd_Level
+  {
+      cd_Set orders;
+      int64_t amount;
+
+      cd_Level() : amount(0) {}
+  };
+
+  //! Map of prices (ascending) for one side of a contract order book
+  typedef std::map<uint64_t, cd_Level> cd_PricesMap;
+  //! Price levels of one side of a contract order book, by price
+  typedef std::unordered_map<uint64_t, cd_PricesMap::iterator> cd_LevelIndex;
+
+  //! Position of an order in a contract order book: side, price, block and index, which sorts like a scan of the book
+  typedef std::tuple<uint8_t, uint64_t, int, unsigned int> cd_OrderKey;
+
+  //! Handle of a resting order: its price level and the order itself
+  struct cd_Handle
+  {
+      cd_PricesMap::iterator level;
+      cd_Set::iterator order;
+
+      cd_OrderKey getKey() const;
+  };
+
+  //! Orders of a single address in a book
+  typedef std::map<cd_OrderKey, cd_Handle> cd_AddressOrders;
+  //! Orders of a book by the transaction that placed them
+  typedef std::unordered_multimap<uint256, cd_Handle, TxidHasher> cd_TxidOrders;
+
+  /** The order book of a single contract.
+   *
+   *  Buy and sell orders are kept in separate price ladders, so matching only
+   *  visits the opposite side. The best price of each side is cached and kept
+   *  up to date on every insert and erase, and so are the orders of each
+   *  address and of each transaction, so they can be found without a scan.
+   *  Price levels and transactions are looked up by hash, the orders of an
+   *  address stay sorted, so they are processed in the order of the book.
+   *
+   *  Each order is also listed in a global index by transaction, which leads
+   *  to the contract and price level of the order.
+   */
+  class cd_Book
+  {
+  private:
+      //! Contract of the book, which is listed in the global index by transaction
+      const uint32_t contractId;
+
+      cd_PricesMap bids;
+      cd_PricesMap asks;
+
+      cd_LevelIndex bidLevels;
+      cd_LevelIndex askLevels;
+
+      //! Best price with a non-zero amount for sale on each side (0 if none)
+      uint64_t bestBid;
+      uint64_t bestAsk;
+
+      AccountMap<cd_AddressOrders> byAddress;
+      cd_TxidOrders byTxid;
+
+      cd_LevelIndex& getLevels(uint8_t tradingAction);
+      const cd_LevelIndex& getLevels(uint8_t tradingAction) const;
+
+      void updateLevel(uint8_t tradingAction, uint64_t price, int64_t before, int64_t after);
+
+      void addHandle(const cd_Handle& handle);
+      void removeHandle(const cd_Handle& handle);
+
+  public:
+      explicit cd_Book(uint32_t contractIdIn = 0) : contractId(contractIdIn), bestBid(0), bestAsk(0) {}
+      ~cd_Book();
+
+      // handles point into the book itself, so it stays where it was constructed
+      cd_Book(const cd_Book&) = delete;
+      cd_Book& operator=(const cd_Book&) = delete;
+      cd_Book(cd_Book&&) = delete;
+      cd_Book& operator=(cd_Book&&) = delete;
+
+      uint32_t getContractId() const { return contractId; }
+
+      cd_PricesMap& getSide(uint8_t tradingAction);
+      const cd_PricesMap& getSide(uint8_t tradingAction) const;
+
+      /** Inserts an order in its price level, returns false if it already exists. */
+      bool insert(const CMPContractDex& obj);
+      /** Erases an order of the given level, returns the next order of the level. */
+      cd_Set::iterator erase(cd_PricesMap::iterator level, cd_Set::iterator it);
+      /** Replaces an order of the given level by an updated copy of it, in place, returns the next order of the level. */
+      cd_Set::iterator amend(cd_PricesMap::iterator level, cd_Set::iterator it, const CMPContractDex& replacement);
+      /** Drops the level if it has no orders left; returns the level, or the one following it when erased. */
+      cd_PricesMap::iterator eraseLevelIfEmpty(uint8_t tradingAction, cd_PricesMap::iterator level);
+
+      /** Best price of a side, 0 if there is nothing for sale there. */
+      uint64_t getBestPrice(uint8_t tradingAction) const;
+      /** Total amount for sale at a price level of a side. */
+      int64_t getAmountAtPrice(uint8_t tradingAction, uint64_t price) const;
+
+      /** Orders of an address, sorted like a scan of the book, nullptr if it has none. */
+      const cd_AddressOrders* getOrders(const std::string& address) const;
+      const cd_AddressOrders* getOrders(mastercore::AccountId account) const;
+      /** Orders placed by a transaction. */
+      std::pair<cd_TxidOrders::const_iterator, cd_TxidOrders::const_iterator> getOrders(const uint256& txid) const;
+
+      bool empty() const { return bids.empty() && asks.empty(); }
+  };
+
+  //! Map of contracts; there is an order book for each contract
+  typedef std::map<uint32_t, cd_Book> cd_PropertiesMap;
 
   extern cd_PropertiesMap contractdex;
 
-  cd_PricesMap *get_PricesCd(uint32_t prop);
-  cd_Set *get_IndexesCd(cd_PricesMap *p, uint64_t price);
+  cd_Book *get_BookCd(uint32_t prop);
 
-  void LoopBiDirectional(cd_PricesMap* const ppriceMap, uint8_t trdAction, MatchReturnType &NewReturn, CMPContractDex* const pnew, const uint32_t propertyForSale);
-  void x_TradeBidirectional(cd_Set& pofferSet, uint8_t trdAction, CMPContractDex* const pnew, const uint64_t sellerPrice, const uint32_t propertyForSale, MatchReturnType &NewReturn);
+  void LoopBiDirectional(cd_Book& book, uint8_t trdAction, MatchReturnType &NewReturn, CMPContractDex* const pnew, const uint32_t propertyForSale);
+  void x_TradeBidirectional(cd_Book& book, cd_PricesMap::iterator level, uint8_t trdAction, CMPContractDex* const pnew, const uint64_t sellerPrice, const uint32_t propertyForSale, MatchReturnType &NewReturn);
   int ContractDex_ADD(const std::string& sender_addr, uint32_t prop, int64_t amount, int block, const uint256& txid, unsigned int idx, uint64_t effective_price, uint8_t trading_action, int64_t amountToReserve);
   bool ContractDex_INSERT(const CMPContractDex &objContractDex);
   void ContractDex_debug_print(bool bShowPriceLevel, bool bDisplay);
@@ -276,6 +438,8 @@ namespace mastercore
   int MetaDEx_SHUTDOWN();
   int MetaDEx_SHUTDOWN_ALLPAIR();
   bool MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx);
+  /** Drops all orders of the MetaDEx, together with the orders of each address and transaction. */
+  void clear_metadex();
   void MetaDEx_debug_print(bool bShowPriceLevel = false, bool bDisplay = false);
   bool MetaDEx_isOpen(const uint256& txid, uint32_t propertyIdForSale = 0);
   int MetaDEx_getStatus(const uint256& txid, uint32_t propertyIdForSale, int64_t amountForSale, int64_t totalSold = -1);
@@ -1,19 +1,28 @@
 #include <tradelayer/register.h>
 #include <tradelayer/ce.h>
 #include <tradelayer/log.h>
+#include <tradelayer/statechanges.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/uint256_extensions.h>
 #include <tradelayer/externfns.h>
 
 #include <stdint.h>
+#include <algorithm>
+#include <iterator>
 #include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 using namespace mastercore;
 
 CCriticalSection cs_register;
 
-// list of all amounts for all addresses for all contracts, map is unsorted
-std::unordered_map<std::string, Register> mastercore::mp_register_map;
+// list of all amounts for all addresses for all contracts, in insertion order
+mastercore::AccountMap<Register> mastercore::mp_register_map;
+
+// addresses with an open position (or unsettled PNL) by contract, and open interest
+std::map<uint32_t, ContractPositions> mastercore::mp_contract_positions;
 
 /**
  * Creates an empty register.
@@ -67,14 +76,7 @@ int64_t Register::getPosMarkPrice(const uint32_t contractId, bool isOracle) cons
 {
     if(isOracle)
     {
-        int64_t oracleTwap = mastercore::getOracleTwap(contractId, 1);
-        int64_t oracleLag = mastercore::getOracleTwap(contractId, 3);
-
-        if(oracleLag*0.965>=oracleTwap){
-            oracleTwap = oracleLag*0.965;
-        }
-            
-        return oracleTwap;
+        return mastercore::getOracleMarkPrice(contractId);
     }
 
     // refine this: native contracts mark price
@@ -113,6 +115,39 @@ int64_t Register::getLiquidationPrice(const uint32_t contractId, const uint32_t
 }
 
 int64_t Register::getUPNL(const uint32_t contractId, const uint32_t notionalSize, bool isOracle, bool quoted)
+{
+    const int64_t iUPNL = computeUPNL(contractId, notionalSize, isOracle, quoted);
+
+    setUPNL(contractId, iUPNL);
+
+    if(msc_debug_liquidation_enginee)
+    {
+       PrintToLog("%s():UPNL(int): %d, quoted?: %d\n",__func__, iUPNL, quoted);
+    }
+
+    return iUPNL;
+}
+
+void Register::setUPNL(const uint32_t contractId, int64_t upnl)
+{
+    // updating UPNL Register
+    const int64_t oldUPNL = getRecord(contractId, UPNL);
+    PrintToLog("%s():oldUPNL: %d, iUPNL: %d\n",__func__, oldUPNL, upnl);
+
+    if(oldUPNL != upnl) {
+        updateRecord(contractId, upnl, UPNL);
+        PrintToLog("%s():updating record, contractId: %d\n",__func__, contractId);
+
+    }
+}
+
+uint64_t Register::getRevision(const uint32_t contractId) const
+{
+    RecordMap::const_iterator it = mp_record.find(contractId);
+    return (it != mp_record.end()) ? it->second.revision : 0;
+}
+
+int64_t Register::computeUPNL(const uint32_t contractId, const uint32_t notionalSize, bool isOracle, bool quoted) const
 {
 
     const int64_t position = getRecord(contractId, CONTRACT_POSITION);
@@ -156,20 +191,9 @@ int64_t Register::getUPNL(const uint32_t contractId, const uint32_t notionalSize
         iUPNL = (int64_t) uiUPNL;
     }
 
-    // updating UPNL Register
-    const int64_t oldUPNL = getRecord(contractId, UPNL);
-    PrintToLog("%s():oldUPNL: %d, iUPNL: %d\n",__func__, oldUPNL, iUPNL);
-
-    if(oldUPNL != iUPNL) {
-        updateRecord(contractId, iUPNL, UPNL);
-        PrintToLog("%s():updating record, contractId: %d\n",__func__, contractId);
-
-    }
-
     if(msc_debug_liquidation_enginee)
     {
        PrintToLog("%s(): entryPrice(int64_t): %d, exitPrice(int64_t): %d, notionalsize: %d\n",__func__, entryPrice, markPrice, notionalSize);
-       PrintToLog("%s():UPNL(int): %d, quoted?: %d\n",__func__, iUPNL, quoted);
     }
 
 
@@ -227,7 +251,9 @@ bool Register::updateRecord(uint32_t contractId, int64_t amount, RecordType ttyp
     } else {
 
         now64 += amount;
-        mp_record[contractId].balance[ttype] = (fPNL) ? amount : now64;
+        PositionRecord& record = mp_record[contractId];
+        record.balance[ttype] = (fPNL) ? amount : now64;
+        if (CONTRACT_POSITION == ttype) ++record.revision;
         fUpdated = true;
     }
 
@@ -255,11 +281,13 @@ bool Register::insertEntry(uint32_t contractId, int64_t amount, int64_t price)
         PositionRecord& record = it->second;
         Entries& entries = record.entries;
         entries.push_back(p);
+        ++record.revision;
         bRet = true;
     } else {
-         PositionRecord posRec;
+         PositionRecord posRec = PositionRecord();
          Entries& entries = posRec.entries;
          entries.push_back(p);
+         posRec.revision = 1;
          mp_record.insert(std::make_pair(contractId, posRec));
          bRet = true;
     }
@@ -481,7 +509,23 @@ int64_t mastercore::getContractRecord(const std::string& address, uint32_t contr
     }
 
     LOCK(cs_register);
-    std::unordered_map<std::string, Register>::const_iterator my_it = mp_register_map.find(address);
+    AccountMap<Register>::const_iterator my_it = mp_register_map.find(address);
+    if (my_it != mp_register_map.end()) {
+        balance = (my_it->second).getRecord(contractId, ttype);
+    }
+
+    return balance;
+}
+
+int64_t mastercore::getContractRecord(AccountId account, uint32_t contractId, RecordType ttype)
+{
+    int64_t balance = 0;
+    if (RECORD_TYPE_COUNT <= ttype) {
+        return 0;
+    }
+
+    LOCK(cs_register);
+    AccountMap<Register>::const_iterator my_it = mp_register_map.find(account);
     if (my_it != mp_register_map.end()) {
         balance = (my_it->second).getRecord(contractId, ttype);
     }
@@ -492,7 +536,7 @@ int64_t mastercore::getContractRecord(const std::string& address, uint32_t contr
 bool mastercore::getFullContractRecord(const std::string& address, uint32_t contractId, UniValue& position_obj, const CDInfo::Entry& cd)
 {
     LOCK(cs_register);
-    std::unordered_map<std::string, Register>::iterator my_it = mp_register_map.find(address);
+    AccountMap<Register>::iterator my_it = mp_register_map.find(address);
     if (my_it != mp_register_map.end()) {
         Register& reg = my_it->second;
         //entry price
@@ -509,7 +553,7 @@ bool mastercore::getFullContractRecord(const std::string& address, uint32_t cont
         const int64_t posMargin = reg.getRecord(contractId, MARGIN);
         position_obj.pushKV("position_margin", FormatDivisibleMP(posMargin));
         // upnl
-        const int64_t upnl = reg.getUPNL(contractId, cd.notional_size, cd.isOracle(), cd.isInverseQuoted());
+        const int64_t upnl = get_upnl_onmap(address, reg, contractId, cd.notional_size, cd.isOracle(), cd.isInverseQuoted());
         position_obj.pushKV("upnl", FormatDivisibleMP(upnl, true));
 
         return true;
@@ -518,36 +562,82 @@ bool mastercore::getFullContractRecord(const std::string& address, uint32_t cont
     return false;
 }
 
+void mastercore::clear_register_map()
+{
+    LOCK(cs_register);
+    mp_register_map.clear();
+    mp_contract_positions.clear();
+    MarkRegistersCleared();
+}
+
+static void updatePositionIndex(const std::string& who, uint32_t contractId, RecordType ttype, int64_t before, int64_t after)
+{
+    if (CONTRACT_POSITION != ttype && PNL != ttype && UPNL != ttype) {
+        return;
+    }
+
+    ContractPositions& positions = mastercore::mp_contract_positions[contractId];
+
+    if (CONTRACT_POSITION == ttype) {
+        (before > 0) ? positions.longs -= before : positions.shorts -= before;
+        (after > 0) ? positions.longs += after : positions.shorts += after;
+    }
+
+    ContractPositions::Accounts& addresses = (CONTRACT_POSITION == ttype) ? positions.holders :
+                                             (PNL == ttype) ? positions.unsettled : positions.marked;
+    if (0 == after) {
+        addresses.erase(who);
+    } else if (addresses.find(who) == addresses.end()) {
+        // the id is only resolved, when the address joins the index
+        addresses.insert(std::make_pair(who, mastercore::InternAddress(who)));
+    }
+
+    if (positions.holders.empty() && positions.unsettled.empty() && positions.marked.empty()) {
+        mastercore::mp_contract_positions.erase(contractId);
+    }
+}
+
 // return true if everything is ok
-bool mastercore::update_register_map(const std::string& who, uint32_t contractId, int64_t amount, RecordType ttype)
+bool mastercore::update_record_onmap(const std::string& who, Register& reg, uint32_t contractId, int64_t amount, RecordType ttype)
+{
+    AssertLockHeld(cs_register);
+
+    const int64_t before = reg.getRecord(contractId, ttype);
+    const bool bRet = reg.updateRecord(contractId, amount, ttype);
+    const int64_t after = reg.getRecord(contractId, ttype);
+
+    if (bRet && before != after) {
+        updatePositionIndex(who, contractId, ttype, before, after);
+        MarkRegistersChanged(who);
+    }
+
+    return bRet;
+}
+
+static bool isValidRegisterUpdate(const std::string& who, uint32_t contractId, int64_t amount, RecordType ttype)
 {
     if (0 == amount && ttype != PNL) {
-        PrintToLog("%s(%s, %u=0x%X, %+d, ttype=%d) ERROR: amount is zero\n", __func__, who, contractId, contractId, amount, ttype);
+        PrintToLog("update_register_map(%s, %u=0x%X, %+d, ttype=%d) ERROR: amount is zero\n", who, contractId, contractId, amount, ttype);
         return false;
     }
     if (ttype >= RECORD_TYPE_COUNT) {
-        PrintToLog("%s(%s, %u=0x%X, %+d, ttype=%d) ERROR: invalid record type\n", __func__, who, contractId, contractId, amount, ttype);
+        PrintToLog("update_register_map(%s, %u=0x%X, %+d, ttype=%d) ERROR: invalid record type\n", who, contractId, contractId, amount, ttype);
         return false;
     }
 
+    return true;
+}
+
+// Updates the register of an address, once it's resolved, requires cs_register
+static bool updateRegisterEntry(const std::string& who, Register& reg, uint32_t contractId, int64_t amount, RecordType ttype)
+{
     bool bRet = false;
     int64_t before = 0;
     int64_t after = 0;
 
-    LOCK(cs_register);
-
-    before = mastercore::getContractRecord(who, contractId, ttype);
-
-    std::unordered_map<std::string, Register>::iterator my_it = mp_register_map.find(who);
-    if (my_it == mp_register_map.end()) {
-        // insert an empty element
-        my_it = (mp_register_map.insert(std::make_pair(who, Register()))).first;
-    }
-
-    Register& reg = my_it->second;
-    bRet = reg.updateRecord(contractId, amount, ttype);
-
-    after = getContractRecord(who, contractId, ttype);
+    before = reg.getRecord(contractId, ttype);
+    bRet = update_record_onmap(who, reg, contractId, amount, ttype);
+    after = reg.getRecord(contractId, ttype);
 
     if (!bRet) {
         if(before != after){
@@ -560,33 +650,106 @@ bool mastercore::update_register_map(const std::string& who, uint32_t contractId
     return bRet;
 }
 
-// return true if everything is ok
-bool mastercore::set_bankruptcy_price_onmap(const std::string& who, const uint32_t& contractId, const uint32_t& notionalSize, const int64_t& initMargin)
+bool mastercore::update_register_map(const std::string& who, uint32_t contractId, int64_t amount, RecordType ttype)
 {
+    if (!isValidRegisterUpdate(who, contractId, amount, ttype)) {
+        return false;
+    }
 
     LOCK(cs_register);
-    std::unordered_map<std::string, Register>::iterator my_it = mp_register_map.find(who);
-    if (my_it == mp_register_map.end()) {
-        // insert an empty element
-        my_it = (mp_register_map.insert(std::make_pair(who, Register()))).first;
+
+    // the address is resolved once, an empty element is inserted, if there is none
+    return updateRegisterEntry(who, mp_register_map[who], contractId, amount, ttype);
+}
+
+bool mastercore::update_register_map(AccountId account, uint32_t contractId, int64_t amount, RecordType ttype)
+{
+    if (((0 == amount && ttype != PNL) || ttype >= RECORD_TYPE_COUNT) &&
+            !isValidRegisterUpdate(GetAccountAddress(account), contractId, amount, ttype)) {
+        return false;
     }
 
+    LOCK(cs_register);
+
+    // the entry holds the address, which is only needed for the position index and the logs
+    const AccountMap<Register>::iterator it = mp_register_map.findOrInsert(account);
+
+    return updateRegisterEntry(it->first, it->second, contractId, amount, ttype);
+}
+
+// return true if everything is ok
+bool mastercore::set_bankruptcy_price_onmap(AccountId account, const uint32_t& contractId, const uint32_t& notionalSize, const int64_t& initMargin)
+{
+
+    LOCK(cs_register);
+    // an empty element is inserted, if there is none
+    AccountMap<Register>::iterator my_it = mp_register_map.findOrInsert(account);
+
     Register& reg = my_it->second;
-    return reg.setBankruptcyPrice(contractId, notionalSize, initMargin);
+    const bool bRet = reg.setBankruptcyPrice(contractId, notionalSize, initMargin);
+    if (bRet) MarkRegistersChanged(my_it->first);
+
+    return bRet;
 
 }
 
+int64_t mastercore::get_upnl_onmap(const std::string& who, Register& reg, uint32_t contractId, uint32_t notionalSize, bool isOracle, bool quoted)
+{
+    AssertLockHeld(cs_register);
+
+    const int64_t before = reg.getRecord(contractId, UPNL);
+    const int64_t upnl = reg.getUPNL(contractId, notionalSize, isOracle, quoted);
+    const int64_t after = reg.getRecord(contractId, UPNL);
+
+    if (before != after) {
+        updatePositionIndex(who, contractId, UPNL, before, after);
+        MarkRegistersChanged(who);
+    }
+
+    return upnl;
+}
+
+void mastercore::set_upnl_onmap(const std::string& who, Register& reg, uint32_t contractId, int64_t upnl)
+{
+    AssertLockHeld(cs_register);
+
+    const int64_t before = reg.getRecord(contractId, UPNL);
+    reg.setUPNL(contractId, upnl);
+    const int64_t after = reg.getRecord(contractId, UPNL);
+
+    if (before != after) {
+        updatePositionIndex(who, contractId, UPNL, before, after);
+        MarkRegistersChanged(who);
+    }
+}
+
 bool mastercore::settlement_pnl(uint32_t contractId, uint32_t notional_size, bool isOracle, bool isInverseQuoted, uint32_t collateral_currency)
 {
     bool bRet = false;
 
     LOCK(cs_register);
 
-    for(auto my_it = mp_register_map.begin(); my_it != mp_register_map.end(); ++my_it)
+    std::map<uint32_t, ContractPositions>::const_iterator pit = mp_contract_positions.find(contractId);
+    if (pit == mp_contract_positions.end()) {
+        return bRet;
+    }
+
+    // only addresses with a position, a pending PNL or a UPNL record can have something to settle,
+    // for all others the UPNL is zero and nothing changes; copied, since the updates below change the index
+    std::vector<ContractPositions::Accounts::value_type> positioned;
+    std::set_union(pit->second.holders.begin(), pit->second.holders.end(),
+                   pit->second.unsettled.begin(), pit->second.unsettled.end(),
+                   std::back_inserter(positioned));
+    std::vector<ContractPositions::Accounts::value_type> accounts;
+    std::set_union(positioned.begin(), positioned.end(),
+                   pit->second.marked.begin(), pit->second.marked.end(),
+                   std::back_inserter(accounts));
+
+    for (const auto& account : accounts)
     {
-        const std::string& who = my_it->first;
-        Register& reg = my_it->second;
-        const int64_t upnl = reg.getUPNL(contractId, notional_size, isOracle, isInverseQuoted);
+        const std::string& who = account.first;
+        Register& reg = mp_register_map[account.second];
+        const int64_t upnl = get_upnl_onmap(who, reg, contractId, notional_size, isOracle, isInverseQuoted);
         const int64_t oldPNL = reg.getRecord(contractId, PNL);
         const int64_t newUPNL = upnl - oldPNL;
 
@@ -596,9 +759,9 @@ bool mastercore::settlement_pnl(uint32_t contractId, uint32_t notional_size, boo
         {
             PrintToLog("%s(): updating register map (because newUPNL is not zero)\n",__func__);
 
-            update_register_map(who, contractId, newUPNL, MARGIN);
-            update_register_map(who, contractId, newUPNL + oldPNL, PNL);
-            update_tally_map(who, collateral_currency, newUPNL, BALANCE);
+            update_register_map(account.second, contractId, newUPNL, MARGIN);
+            update_register_map(account.second, contractId, newUPNL + oldPNL, PNL);
+            update_tally_map(account.second, collateral_currency, newUPNL, BALANCE);
             bRet = true;
         }
     }
@@ -607,24 +770,25 @@ bool mastercore::settlement_pnl(uint32_t contractId, uint32_t notional_size, boo
 }
 
 // return true if everything is ok
-bool mastercore::reset_leverage_register(const std::string& who, uint32_t contractId)
+bool mastercore::reset_leverage_register(AccountId account, uint32_t contractId)
 {
     bool bRet = false;
 
     LOCK(cs_register);
 
-    const int64_t rleverage = mastercore::getContractRecord(who, contractId, LEVERAGE);
-
-    std::unordered_map<std::string, Register>::iterator my_it = mp_register_map.find(who);
+    AccountMap<Register>::iterator my_it = mp_register_map.find(account);
     if (my_it == mp_register_map.end()) {
-        PrintToLog("%s(): address (%s) not found for this contract(%d)\n",__func__, who, contractId);
+        PrintToLog("%s(): address (%s) not found for this contract(%d)\n",__func__, GetAccountAddress(account), contractId);
         return bRet;
     }
 
+    const std::string& who = my_it->first;
     Register& reg = my_it->second;
+    const int64_t rleverage = reg.getRecord(contractId, LEVERAGE);
 
     // cleaning
     bRet = reg.updateRecord(contractId, -rleverage, LEVERAGE);
+    if (bRet) MarkRegistersChanged(who);
 
     // // default leverage : 1
     // bRet2 = reg.updateRecord(contractId, 1, LEVERAGE);
@@ -633,29 +797,34 @@ bool mastercore::reset_leverage_register(const std::string& who, uint32_t contra
 }
 
 bool mastercore::insert_entry(const std::string& who, uint32_t contractId, int64_t amount, int64_t price)
+{
+    return insert_entry(InternAddress(who), contractId, amount, price);
+}
+
+bool mastercore::insert_entry(AccountId account, uint32_t contractId, int64_t amount, int64_t price)
 {
     bool bRet = false;
     if (0 == amount) {
-        PrintToLog("%s(%s, %u=0x%X, %+d) ERROR: amount of contracts is zero\n", __func__, who, contractId, contractId, amount);
+        PrintToLog("%s(%s, %u=0x%X, %+d) ERROR: amount of contracts is zero\n", __func__, GetAccountAddress(account), contractId, contractId, amount);
         return bRet;
     }
 
     if (0 >= price) {
-        PrintToLog("%s(%s, %u=0x%X, %+d) ERROR: price of contracts is zero or less\n", __func__, who, contractId, contractId, amount);
+        PrintToLog("%s(%s, %u=0x%X, %+d) ERROR: price of contracts is zero or less\n", __func__, GetAccountAddress(account), contractId, contractId, amount);
         return bRet;
     }
 
     LOCK(cs_register);
 
-    std::unordered_map<std::string, Register>::iterator my_it = mp_register_map.find(who);
-    if (my_it == mp_register_map.end()) {
-        // insert an empty element
-        my_it = (mp_register_map.insert(std::make_pair(who, Register()))).first;
-    }
+    // an empty element is inserted, if there is none
+    AccountMap<Register>::iterator my_it = mp_register_map.findOrInsert(account);
 
+    const std::string& who = my_it->first;
     Register& reg = my_it->second;
 
     bRet = reg.insertEntry(contractId, amount, price);
+    // entries aren't part of the consensus hash, but of the state files
+    if (bRet) MarkRegistersChanged(who);
 
     // entry price of full position
     //reg.getPosEntryPrice(contractId, who);
@@ -667,25 +836,24 @@ bool mastercore::insert_entry(const std::string& who, uint32_t contractId, int64
 
 
 
-bool mastercore::decrease_entry(const std::string& who, uint32_t contractId, int64_t amount, int64_t price, bool inverse, int64_t collateral_currency)
+bool mastercore::decrease_entry(AccountId account, uint32_t contractId, int64_t amount, int64_t price, bool inverse, int64_t collateral_currency)
 {
     bool bRet = false;
     if (0 == amount) {
-        PrintToLog("%s(%s, %u=0x%X, %+d) ERROR: amount of contracts is zero\n", __func__, who, contractId, contractId, amount);
+        PrintToLog("%s(%s, %u=0x%X, %+d) ERROR: amount of contracts is zero\n", __func__, GetAccountAddress(account), contractId, contractId, amount);
         return bRet;
     }
 
     LOCK(cs_register);
 
-    std::unordered_map<std::string, Register>::iterator my_it = mp_register_map.find(who);
-    if (my_it == mp_register_map.end()) {
-        // insert an empty element
-        my_it = (mp_register_map.insert(std::make_pair(who, Register()))).first;
-    } //look out for possible memory err risk, this seems to insulate against an overflow but what about buffer and seg-fault risk?
+    // an empty element is inserted, if there is none
+    AccountMap<Register>::iterator my_it = mp_register_map.findOrInsert(account);
 
+    const std::string& who = my_it->first;
     Register& reg = my_it->second;
 
     bRet = reg.decreasePosRecord(who,contractId, amount, price, inverse, collateral_currency);
+    MarkRegistersChanged(who);
 
     return bRet;
 }
@@ -744,6 +912,7 @@ bool Register::decreasePosRecord(const std::string& who, uint32_t contractId, in
             entries.push_back(p);
         }
 
+        ++record.revision;
         bRet = true;
 
     }
@@ -1,12 +1,15 @@
 #ifndef TRADELAYER_REGISTER_H
 #define TRADELAYER_REGISTER_H
 
+#include <tradelayer/accounts.h>
 #include <tradelayer/ce.h>
 
 #include <stdint.h>
 #include <sync.h>
 #include <map>
 #include <queue>
+#include <set>
+#include <string>
 #include <unordered_map>
 #include <univalue.h>
 
@@ -39,6 +42,8 @@ private:
     typedef struct {
         int64_t balance[RECORD_TYPE_COUNT];
         Entries entries;
+        //! Bumped whenever the position or its entries change
+        uint64_t revision;
     } PositionRecord;
 
     //! Map of position records
@@ -81,6 +86,15 @@ public:
 
     int64_t getUPNL(const uint32_t contractId, const uint32_t notionalSize, bool isOracle = false, bool quoted = false);
 
+    /** Calculates the UPNL without updating the UPNL record. */
+    int64_t computeUPNL(const uint32_t contractId, const uint32_t notionalSize, bool isOracle = false, bool quoted = false) const;
+
+    /** Updates the UPNL record with a value obtained via computeUPNL(). */
+    void setUPNL(const uint32_t contractId, int64_t upnl);
+
+    /** Returns the revision of a position, to detect changes since it was last read. */
+    uint64_t getRevision(const uint32_t contractId) const;
+
     bool setBankruptcyPrice(const uint32_t contractId, const uint32_t notionalSize, int64_t initMargin, bool isOracle = false, bool quoted = false);
     bool realizePNL(const std::string& who, uint32_t contractId, int64_t amount, int64_t price, bool isInverseQuoted, uint32_t collateral_currency);
     int64_t getLiquidationPrice(const uint32_t contractId, const uint32_t notionalSize, const uint64_t marginRequirement) const;
@@ -93,24 +107,64 @@ public:
 };
 
 
+/** Addresses holding a position in a given contract, maintained by update_register_map()
+ *  and the UPNL updates below.
+ *
+ *  The addresses are ordered by string, since they are visited in that order by
+ *  settlement and liquidation, and the account ids are carried along, so the
+ *  visits reach the registers and tallies without resolving the addresses again.
+ */
+struct ContractPositions
+{
+    typedef std::map<std::string, mastercore::AccountId> Accounts;
+
+    //! Addresses with a non-zero CONTRACT_POSITION
+    Accounts holders;
+    //! Addresses with a non-zero PNL record, still to be settled
+    Accounts unsettled;
+    //! Addresses with a non-zero UPNL record, which settlement still visits after a position is closed
+    Accounts marked;
+    //! Sum of all long positions
+    int64_t longs;
+    //! Sum of all short positions (negative)
+    int64_t shorts;
+
+    ContractPositions() : longs(0), shorts(0) {}
+};
+
 namespace mastercore
 {
-  extern std::unordered_map<std::string, Register> mp_register_map;
+  extern AccountMap<Register> mp_register_map;
+  //! Position index per contract, guarded by cs_register
+  extern std::map<uint32_t, ContractPositions> mp_contract_positions;
+
+  /** Clears all registers and the position index. */
+  void clear_register_map();
 
   int64_t getContractRecord(const std::string& address, uint32_t contractId, RecordType ttype);
+  int64_t getContractRecord(AccountId account, uint32_t contractId, RecordType ttype);
 
   bool update_register_map(const std::string& who, uint32_t contractId, int64_t amount, RecordType ttype);
+  bool update_register_map(AccountId account, uint32_t contractId, int64_t amount, RecordType ttype);
 
   bool insert_entry(const std::string& who, uint32_t contractId, int64_t amount, int64_t price);
+  bool insert_entry(AccountId account, uint32_t contractId, int64_t amount, int64_t price);
 
-  bool decrease_entry(const std::string& who, uint32_t contractId, int64_t amount, int64_t price, bool inverse, int64_t collateral_currency);
+  bool decrease_entry(AccountId account, uint32_t contractId, int64_t amount, int64_t price, bool inverse, int64_t collateral_currency);
 
   bool getFullContractRecord(const std::string& address, uint32_t contractId, UniValue& position_obj, const CDInfo::Entry& cd);
 
-  bool reset_leverage_register(const std::string& who, uint32_t contractId);
+  bool reset_leverage_register(AccountId account, uint32_t contractId);
   
+  /** Same as Register::updateRecord(), but also updating the position index; requires cs_register. */
+  bool update_record_onmap(const std::string& who, Register& reg, uint32_t contractId, int64_t amount, RecordType ttype);
+
+  /** Same as Register::getUPNL() and Register::setUPNL(), but also updating the position index; requires cs_register. */
+  int64_t get_upnl_onmap(const std::string& who, Register& reg, uint32_t contractId, uint32_t notionalSize, bool isOracle, bool quoted);
+  void set_upnl_onmap(const std::string& who, Register& reg, uint32_t contractId, int64_t upnl);
+
   bool settlement_pnl(uint32_t contractId, uint32_t notional_size, bool isOracle, bool isInverseQuoted, uint32_t collateral_currency);
-  bool set_bankruptcy_price_onmap(const std::string& who, const uint32_t& contractId, const uint32_t& notionalSize, const int64_t& initMargin);
+  bool set_bankruptcy_price_onmap(AccountId account, const uint32_t& contractId, const uint32_t& notionalSize, const int64_t& initMargin);
 }
 
 #endif // TRADELAYER_REGISTER_H
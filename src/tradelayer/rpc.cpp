@@ -463,7 +463,7 @@ UniValue mscrpc(const JSONRPCRequest& request)
             LOCK(cs_tally);
             int64_t total = 0;
             // display all balances
-            for (std::unordered_map<std::string, CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
+            for (AccountMap<CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
                 PrintToLog("%34s => ", my_it->first);
                 total += (my_it->second).print(extra2, bDivisible);
             }
@@ -490,7 +490,7 @@ UniValue mscrpc(const JSONRPCRequest& request)
             LOCK(cs_tally);
             uint32_t id = 0;
             // for each address display all currencies it holds
-            for (std::unordered_map<std::string, CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
+            for (AccountMap<CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
                 PrintToLog("%34s => ", my_it->first);
                 (my_it->second).print(extra2);
                 (my_it->second).init();
@@ -946,20 +946,12 @@ UniValue tl_getallbalancesforid(const JSONRPCRequest& request)
 
     LOCK(cs_tally);
 
-    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-        uint32_t id = 0;
-        bool includeAddress = false;
-        const std::string& address = it->first;
-        (it->second).init();
-        while (0 != (id = (it->second).next())) {
-            if (id == propertyId) {
-                includeAddress = true;
-                break;
-            }
-        }
-        if (!includeAddress) {
-            continue; // ignore this address, has never transacted in this propertyId
-        }
+    std::map<uint32_t, PropertySupply>::const_iterator it = mp_property_supply.find(propertyId);
+    if (it == mp_property_supply.end()) {
+        return response; // no address holds this propertyId
+    }
+
+    for (const std::string& address : it->second.holders) {
         UniValue balanceObj(UniValue::VOBJ);
         balanceObj.pushKV("address", address);
         bool nonEmptyBalance = BalanceToJSON(address, propertyId, balanceObj, isDivisible);
@@ -1010,10 +1002,8 @@ UniValue tl_getallbalancesforaddress(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Address not found");
     }
 
-    addressTally->init();
-
-    uint32_t propertyId = 0;
-    while (0 != (propertyId = addressTally->next())) {
+    for (const CMPTally::BalanceRecord& record : *addressTally) {
+        const uint32_t propertyId = record.propertyId;
         UniValue balanceObj(UniValue::VOBJ);
         balanceObj.pushKV("propertyid", (uint64_t) propertyId);
         bool nonEmptyBalance = BalanceToJSON(address, propertyId, balanceObj, isPropertyDivisible(propertyId));
@@ -2011,15 +2001,15 @@ UniValue tl_getorderbook(const JSONRPCRequest& request)
     std::vector<CMPMetaDEx> vecMetaDexObjects;
     {
         LOCK(cs_tally);
-        for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        // the markets of a property for sale are adjacent
+        md_PropertiesMap::const_iterator my_it = metadex.lower_bound(std::make_pair(propertyIdForSale, 0U));
+        for (; my_it != metadex.end() && my_it->first.first == propertyIdForSale; ++my_it) {
+            if (filterDesired && my_it->first.second != propertyIdDesired) continue;
             const md_PricesMap& prices = my_it->second;
             for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
                 const md_Set& indexes = it->second;
                 for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                    const CMPMetaDEx& obj = *it;
-                    if (obj.getProperty() != propertyIdForSale) continue;
-                    if (!filterDesired || obj.getDesProperty() == propertyIdDesired)
-                        vecMetaDexObjects.push_back(obj);
+                    vecMetaDexObjects.push_back(*it);
                 }
             }
         }
@@ -2072,13 +2062,14 @@ UniValue tl_getcontract_orderbook(const JSONRPCRequest& request)
       std::vector<CMPContractDex> vecContractDexObjects;
       {
         LOCK(cs_tally);
-        for (cd_PropertiesMap::const_iterator my_it = contractdex.begin(); my_it != contractdex.end(); ++my_it) {
-          const cd_PricesMap& prices = my_it->second;
+        cd_PropertiesMap::const_iterator my_it = contractdex.find(contractId);
+        if (my_it != contractdex.end()) {
+          const cd_PricesMap& prices = my_it->second.getSide(tradingaction);
           for (cd_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
-    	        const cd_Set& indexes = it->second;
+    	        const cd_Set& indexes = it->second.orders;
     	        for (cd_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
     	            const CMPContractDex& obj = *it;
-    	            if (obj.getProperty() != contractId || obj.getTradingAction() != tradingaction || obj.getAmountForSale() == 0) continue;
+    	            if (obj.getTradingAction() != tradingaction || obj.getAmountForSale() == 0) continue;
     	            vecContractDexObjects.push_back(obj);
     	        }
            }
@@ -2402,6 +2393,46 @@ UniValue tl_getmarketprice(const JSONRPCRequest& request)
   return balanceObj;
 }
 
+UniValue tl_getmarkprice(const JSONRPCRequest& request)
+{
+  if (request.fHelp || request.params.size() != 1)
+    throw runtime_error(
+			"tl_getmarkprice \"contractid\" \n"
+
+			"\nRetrieves the mark price of an oracle future contract, which is used for unrealized PNL, liquidations and settlement.\n"
+
+			"\nArguments:\n"
+			"1. contractid           (number, required) the id of future contract\n"
+
+			"\nResult:\n"
+			"  {\n"
+			"    \"markprice\" : \"n.nnnnnnnn\",       (string) the mark price of the contract\n"
+			"    \"twap\" : \"n.nnnnnnnn\",            (string) the TWAP of the oracle prices of the last block\n"
+			"    \"twaplag\" : \"n.nnnnnnnn\",         (string) the TWAP of the oracle prices of the last three blocks\n"
+			" }\n"
+
+			"\nExamples:\n"
+			+ HelpExampleCli("tl_getmarkprice", "\"4\"" )
+			+ HelpExampleRpc("tl_getmarkprice", "\"4\"")
+			);
+
+  uint32_t contractId = ParsePropertyId(request.params[0]);
+
+  RequireExistingProperty(contractId);
+  RequireOracleContract(contractId);
+
+  UniValue priceObj(UniValue::VOBJ);
+  {
+      // the oracle prices are written while holding cs_tally
+      LOCK(cs_tally);
+      priceObj.pushKV("markprice", FormatDivisibleMP(getOracleMarkPrice(contractId)));
+      priceObj.pushKV("twap", FormatDivisibleMP(getOracleTwap(contractId, 1)));
+      priceObj.pushKV("twaplag", FormatDivisibleMP(getOracleTwap(contractId, 3)));
+  }
+
+  return priceObj;
+}
+
 UniValue tl_getactivedexsells(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -2858,6 +2889,7 @@ UniValue tl_get_ltcvolume(const JSONRPCRequest& request)
             "tl_get_ltcvolume \"propertyid\" \"blockA\" \"blockB\" \n"
 
             "\nReturns the LTC volume for DEx and Trade Channels, in sort amount of blocks.\n"
+            "Volumes are kept for the last 1000 blocks only.\n"
 
             "\nArguments:\n"
             "1. property                 (number, required) property \n"
@@ -2903,6 +2935,7 @@ UniValue tl_getmdexvolume(const JSONRPCRequest& request)
             "tl_getmdexvolume \"property\" \"blockA\" \"blockB\" \n"
 
             "\nReturns the Token volume traded in sort amount of blocks.\n"
+            "Volumes are kept for the last 1000 blocks only.\n"
 
             "\nArguments:\n"
             "1. propertyid                (number, required) the property id \n"
@@ -3928,6 +3961,7 @@ static const CRPCCommand commands[] =
   { "trade layer (data retrieval)" , "tl_getreserve",                           &tl_getreserve,                        {} },
   { "trade layer (data retrieval)" , "tl_getallprice",                          &tl_getallprice,                       {} },
   { "trade layer (data retrieval)" , "tl_getmarketprice",                       &tl_getmarketprice,                    {} },
+  { "trade layer (data retrieval)" , "tl_getmarkprice",                         &tl_getmarkprice,                      {} },
   { "trade layer (data retrieval)" , "tl_getsum_upnl",                          &tl_getsum_upnl,                       {} },
   { "trade layer (data retrieval)" , "tl_check_commits",                        &tl_check_commits,                     {} },
   { "trade layer (data retrieval)" , "tl_get_channelreserve",                   &tl_get_channelreserve,                {} },
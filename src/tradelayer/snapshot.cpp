@@ -0,0 +1,299 @@
+#include <tradelayer/snapshot.h>
+
+#include <tradelayer/log.h>
+
+#include <crypto/common.h>
+#include <hash.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace bip = boost::interprocess;
+
+static const unsigned char SNAPSHOT_MAGIC[8] = {'T', 'L', 'S', 'T', 'A', 'T', 'E', 0};
+static const uint64_t HEADER_SIZE = 24;
+static const uint64_t SECTION_ENTRY_SIZE = 24;
+static const uint64_t TRAILER_SIZE = 32;
+
+static uint64_t Align8(uint64_t n)
+{
+    return (n + 7) & ~uint64_t(7);
+}
+
+SnapshotWriter::SnapshotWriter(uint32_t fileTypeIn) : fileType(fileTypeIn)
+{
+}
+
+uint32_t SnapshotWriter::addAddress(const std::string& address)
+{
+    std::unordered_map<std::string, uint32_t>::const_iterator it = addressIndex.find(address);
+    if (it != addressIndex.end()) {
+        return it->second;
+    }
+
+    Section& pool = sections[SNAPSHOT_ADDRESS_DATA];
+    pool.recordSize = 1;
+    const uint32_t offset = pool.data.size();
+    pool.data.insert(pool.data.end(), address.begin(), address.end());
+
+    unsigned char* record = addRecord(SNAPSHOT_ADDRESSES, 8);
+    WriteLE32(record, offset);
+    WriteLE32(record + 4, address.size());
+
+    const uint32_t index = getCount(SNAPSHOT_ADDRESSES) - 1;
+    addressIndex.insert(std::make_pair(address, index));
+
+    return index;
+}
+
+unsigned char* SnapshotWriter::addRecord(uint32_t sectionId, uint32_t recordSize)
+{
+    Section& section = sections[sectionId];
+    section.recordSize = recordSize;
+    section.data.resize(section.data.size() + recordSize, 0);
+
+    return &section.data[section.data.size() - recordSize];
+}
+
+uint64_t SnapshotWriter::getCount(uint32_t sectionId) const
+{
+    std::map<uint32_t, Section>::const_iterator it = sections.find(sectionId);
+    if (it == sections.end() || it->second.recordSize == 0) {
+        return 0;
+    }
+
+    return it->second.data.size() / it->second.recordSize;
+}
+
+void SnapshotWriter::serialize(std::string& buffer) const
+{
+    // layout first, so everything goes out in one buffer
+    uint64_t offset = Align8(HEADER_SIZE + SECTION_ENTRY_SIZE * sections.size());
+    uint64_t size = offset;
+    for (const auto& s : sections) {
+        size = Align8(size + s.second.data.size());
+    }
+
+    buffer.assign(size + TRAILER_SIZE, 0);
+    unsigned char* ptr = (unsigned char*) &buffer[0];
+
+    memcpy(ptr, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    WriteLE32(ptr + 8, SNAPSHOT_VERSION);
+    WriteLE32(ptr + 12, fileType);
+    WriteLE32(ptr + 16, sections.size());
+
+    unsigned char* entry = ptr + HEADER_SIZE;
+    for (const auto& s : sections)
+    {
+        const Section& section = s.second;
+        WriteLE32(entry, s.first);
+        WriteLE32(entry + 4, section.recordSize);
+        WriteLE64(entry + 8, offset);
+        WriteLE64(entry + 16, section.recordSize ? section.data.size() / section.recordSize : 0);
+        if (!section.data.empty()) memcpy(ptr + offset, section.data.data(), section.data.size());
+
+        offset = Align8(offset + section.data.size());
+        entry += SECTION_ENTRY_SIZE;
+    }
+
+    uint256 hash;
+    CHash256().Write(ptr, size).Finalize(hash.begin());
+    memcpy(ptr + size, hash.begin(), TRAILER_SIZE);
+}
+
+bool SnapshotWriter::write(const fs::path& path) const
+{
+    std::string buffer;
+    serialize(buffer);
+
+    std::ofstream file;
+    file.open(path.string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    const bool fGood = file.good();
+    file.close();
+
+    if (!fGood) {
+        PrintToLog("%s(): ERROR: failed to write %s\n", __func__, path.string());
+    }
+
+    return fGood;
+}
+
+SnapshotReader::SnapshotReader() : data(nullptr), size(0), fileType(0)
+{
+}
+
+SnapshotReader::~SnapshotReader()
+{
+}
+
+bool SnapshotReader::IsSnapshot(const fs::path& path)
+{
+    unsigned char magic[sizeof(SNAPSHOT_MAGIC)] = {};
+
+    std::ifstream file;
+    file.open(path.string().c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.read((char*) magic, sizeof(magic));
+
+    return file.gcount() == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+bool SnapshotReader::open(const fs::path& path, bool verifyHash)
+{
+    try {
+        const uint64_t fileSize = fs::file_size(path);
+        if (fileSize < HEADER_SIZE + TRAILER_SIZE) {
+            PrintToLog("%s(): ERROR: %s is truncated\n", __func__, path.string());
+            return false;
+        }
+
+        file.reset(new bip::file_mapping(path.string().c_str(), bip::read_only));
+        region.reset(new bip::mapped_region(*file, bip::read_only));
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): ERROR: failed to map %s: %s\n", __func__, path.string(), e.what());
+        return false;
+    }
+
+    data = static_cast<const unsigned char*>(region->get_address());
+    size = region->get_size() - TRAILER_SIZE;
+
+    if (memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return false;
+    }
+
+    const uint32_t version = ReadLE32(data + 8);
+    if (version > SNAPSHOT_VERSION) {
+        PrintToLog("%s(): ERROR: %s has unknown version %d\n", __func__, path.string(), version);
+        return false;
+    }
+
+    if (verifyHash) {
+        uint256 hash;
+        CHash256().Write(data, size).Finalize(hash.begin());
+        if (memcmp(hash.begin(), data + size, TRAILER_SIZE) != 0) {
+            PrintToLog("File %s loaded, but failed hash validation!\n", path.string());
+            return false;
+        }
+    }
+
+    fileType = ReadLE32(data + 12);
+    const uint64_t nSections = ReadLE32(data + 16);
+    if (HEADER_SIZE + SECTION_ENTRY_SIZE * nSections > size) {
+        return false;
+    }
+
+    sections.clear();
+    for (uint64_t i = 0; i < nSections; ++i)
+    {
+        const unsigned char* entry = data + HEADER_SIZE + SECTION_ENTRY_SIZE * i;
+        Section section;
+        const uint32_t id = ReadLE32(entry);
+        section.recordSize = ReadLE32(entry + 4);
+        section.offset = ReadLE64(entry + 8);
+        section.count = ReadLE64(entry + 16);
+
+        // records must be within the file, without overflowing the bounds check
+        if (section.offset > size || (section.recordSize != 0 && section.count > (size - section.offset) / section.recordSize)) {
+            PrintToLog("%s(): ERROR: section %d of %s is out of bounds\n", __func__, id, path.string());
+            return false;
+        }
+
+        sections[id] = section;
+    }
+
+    return true;
+}
+
+bool SnapshotReader::getRecords(uint32_t sectionId, uint32_t recordSize, const unsigned char*& records, uint64_t& count) const
+{
+    records = nullptr;
+    count = 0;
+
+    std::map<uint32_t, Section>::const_iterator it = sections.find(sectionId);
+    if (it == sections.end()) {
+        return true;
+    }
+
+    if (it->second.recordSize != recordSize) {
+        PrintToLog("%s(): ERROR: section %d has records of %d bytes, expected %d\n", __func__, sectionId, it->second.recordSize, recordSize);
+        return false;
+    }
+
+    records = data + it->second.offset;
+    count = it->second.count;
+
+    return true;
+}
+
+bool SnapshotReader::getAddress(uint32_t index, std::string& address) const
+{
+    const unsigned char* records = nullptr;
+    const unsigned char* pool = nullptr;
+    uint64_t count = 0;
+    uint64_t poolSize = 0;
+
+    if (!getRecords(SNAPSHOT_ADDRESSES, 8, records, count) || index >= count) {
+        return false;
+    }
+    if (!getRecords(SNAPSHOT_ADDRESS_DATA, 1, pool, poolSize)) {
+        return false;
+    }
+
+    const uint64_t offset = ReadLE32(records + 8 * index);
+    const uint64_t length = ReadLE32(records + 8 * index + 4);
+    if (offset + length > poolSize) {
+        return false;
+    }
+
+    address.assign((const char*) pool + offset, length);
+
+    return true;
+}
+
+//! Number of buckets of an image, so a changed bucket is a small part of the image
+static const size_t IMAGE_BUCKET_COUNT = 4096;
+
+SnapshotImage::SnapshotImage()
+{
+    clear();
+}
+
+void SnapshotImage::set(const std::string& address, const std::string& records)
+{
+    std::shared_ptr<Bucket>& bucket = buckets[std::hash<std::string>()(address) % IMAGE_BUCKET_COUNT];
+
+    // copy on write: images handed out keep the old bucket
+    if (bucket.use_count() > 1) {
+        bucket = std::make_shared<Bucket>(*bucket);
+    }
+
+    if (records.empty()) {
+        bucket->erase(address);
+    } else {
+        (*bucket)[address] = records;
+    }
+}
+
+void SnapshotImage::clear()
+{
+    buckets.clear();
+    buckets.reserve(IMAGE_BUCKET_COUNT);
+    for (size_t n = 0; n < IMAGE_BUCKET_COUNT; ++n) {
+        buckets.push_back(std::make_shared<Bucket>());
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef TRADELAYER_SNAPSHOT_H
+#define TRADELAYER_SNAPSHOT_H
+
+#include <fs.h>
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace boost { namespace interprocess { class file_mapping; class mapped_region; } }
+
+/**
+ * Binary state snapshot.
+ *
+ * Layout (all integers little endian):
+ *
+ *   header:        char[8] magic "TLSTATE\0", uint32_t version, uint32_t file type,
+ *                  uint32_t number of sections, uint32_t reserved
+ *   section table: per section uint32_t id, uint32_t record size, uint64_t offset, uint64_t count
+ *   sections:      fixed-width records, each section aligned to 8 bytes
+ *   trailer:       uint256 double SHA256 of everything before it
+ *
+ * Addresses are stored once in a string pool and referenced by index from records.
+ */
+
+//! Version of the snapshot layout written by this client
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+//! Section identifiers
+enum SnapshotSection {
+    SNAPSHOT_ADDRESSES = 1,       // uint32_t offset, uint32_t size into SNAPSHOT_ADDRESS_DATA
+    SNAPSHOT_ADDRESS_DATA = 2,    // raw characters of all addresses
+    SNAPSHOT_BALANCES = 3,
+    SNAPSHOT_REGISTERS = 4,
+    SNAPSHOT_REGISTER_ENTRIES = 5,
+};
+
+/** Collects fixed-width records and writes them as snapshot file.
+ */
+class SnapshotWriter
+{
+private:
+    struct Section {
+        uint32_t recordSize;
+        std::vector<unsigned char> data;
+    };
+
+    uint32_t fileType;
+    std::map<uint32_t, Section> sections;
+    std::unordered_map<std::string, uint32_t> addressIndex;
+
+public:
+    explicit SnapshotWriter(uint32_t fileType);
+
+    /** Returns the index of an address, adding it to the string pool if needed. */
+    uint32_t addAddress(const std::string& address);
+
+    /** Appends a new, zeroed record to a section and returns a pointer to fill it. */
+    unsigned char* addRecord(uint32_t sectionId, uint32_t recordSize);
+
+    /** Returns the number of records of a section. */
+    uint64_t getCount(uint32_t sectionId) const;
+
+    /** Renders the complete snapshot file into a buffer. */
+    void serialize(std::string& buffer) const;
+
+    /** Writes the snapshot to disk, in a single pass. */
+    bool write(const fs::path& path) const;
+};
+
+/** Memory maps a snapshot file and gives access to its sections.
+ */
+class SnapshotReader
+{
+private:
+    struct Section {
+        uint32_t recordSize;
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    std::unique_ptr<boost::interprocess::file_mapping> file;
+    std::unique_ptr<boost::interprocess::mapped_region> region;
+    const unsigned char* data;
+    uint64_t size;
+    uint32_t fileType;
+    std::map<uint32_t, Section> sections;
+
+public:
+    SnapshotReader();
+    ~SnapshotReader();
+
+    /** Returns true, if the file starts with the snapshot magic. */
+    static bool IsSnapshot(const fs::path& path);
+
+    /** Maps and validates a snapshot, optionally checking its hash. */
+    bool open(const fs::path& path, bool verifyHash);
+
+    uint32_t getFileType() const { return fileType; }
+
+    /**
+     * Provides the records of a section.
+     *
+     * A missing section is treated as empty, a different record size as error.
+     */
+    bool getRecords(uint32_t sectionId, uint32_t recordSize, const unsigned char*& records, uint64_t& count) const;
+
+    /** Resolves an address index of the string pool. */
+    bool getAddress(uint32_t index, std::string& address) const;
+};
+
+/** Encoded records of each address, which go into a snapshot.
+ *
+ * Addresses are spread over buckets, and a copy of the image only shares the
+ * buckets, so it's cheap to hand one over to another thread. A bucket is copied
+ * before it's changed, as long as another image still shares it.
+ */
+class SnapshotImage
+{
+public:
+    //! Records by address
+    typedef std::map<std::string, std::string> Bucket;
+
+private:
+    std::vector<std::shared_ptr<Bucket> > buckets;
+
+public:
+    SnapshotImage();
+
+    /** Replaces the records of an address, empty records remove it. */
+    void set(const std::string& address, const std::string& records);
+
+    /** Removes all addresses. */
+    void clear();
+
+    const std::vector<std::shared_ptr<Bucket> >& getBuckets() const { return buckets; }
+};
+
+#endif // TRADELAYER_SNAPSHOT_H
@@ -123,7 +123,7 @@ void CMPSPInfo::Entry::print() const
 		 category, subcategory, url, data);
 }
 
-CMPSPInfo::CMPSPInfo(const fs::path& path, bool fWipe)
+CMPSPInfo::CMPSPInfo(const fs::path& path, bool fWipe) : cache_hits(0), cache_misses(0), cache_generation(0)
 {
   leveldb::Status status = Open(path, fWipe);
   PrintToLog("Loading smart property database: %s\n", status.ToString());
@@ -152,13 +152,18 @@ CMPSPInfo::CMPSPInfo(const fs::path& path, bool fWipe)
 
 CMPSPInfo::~CMPSPInfo()
 {
-  if (msc_debug_persistence) PrintToLog("CMPSPInfo closed\n");
+  if (msc_debug_persistence) PrintToLog("CMPSPInfo closed (cache hits: %d, misses: %d)\n", cache_hits, cache_misses);
 }
 
 void CMPSPInfo::Clear()
 {
   // wipe database via parent class
   CDBBase::Clear();
+  {
+      LOCK(cs_cache);
+      cache.clear();
+      ++cache_generation;
+  }
   // reset "next property identifiers"
   init();
 }
@@ -215,6 +220,8 @@ bool CMPSPInfo::updateSP(uint32_t propertyId, const Entry& info)
     return false;
   }
 
+  cacheEntry(propertyId, ssSpValue);
+
   PrintToLog("%s(): updated entry for SP %d successfully\n", __func__, propertyId);
   return true;
 }
@@ -264,6 +271,8 @@ uint32_t CMPSPInfo::putSP(const Entry& info)
 
     if (!status.ok()) {
         PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, status.ToString());
+    } else {
+        cacheEntry(propertyId, ssSpValue);
     }
 
     return propertyId;
@@ -280,6 +289,19 @@ bool CMPSPInfo::getSP(uint32_t propertyId, Entry& info) const
         return true;
     }
 
+    uint64_t generation = 0;
+    {
+        LOCK(cs_cache);
+        std::map<uint32_t, Entry>::const_iterator it = cache.find(propertyId);
+        if (it != cache.end()) {
+            ++cache_hits;
+            info = it->second;
+            return true;
+        }
+        ++cache_misses;
+        generation = cache_generation;
+    }
+
     // DB key for property entry
     CDataStream ssSpKey(SER_DISK, CLIENT_VERSION);
     ssSpKey << std::make_pair('s', propertyId);
@@ -303,6 +325,12 @@ bool CMPSPInfo::getSP(uint32_t propertyId, Entry& info) const
         return false;
     }
 
+    // a rollback or an update in the meantime may have made the value stale
+    LOCK(cs_cache);
+    if (generation == cache_generation) {
+        cache.insert(std::make_pair(propertyId, info));
+    }
+
     return true;
 }
 
@@ -430,9 +458,47 @@ int64_t CMPSPInfo::popBlock(const uint256& block_hash)
         return -4;
     }
 
+    // rolled back entries are reloaded from the database on demand
+    {
+        LOCK(cs_cache);
+        cache.clear();
+        ++cache_generation;
+    }
+
     return remainingSPs;
 }
 
+void CMPSPInfo::cacheEntry(uint32_t id, CDataStream ssValue)
+{
+    // decode the persisted form, so cached and loaded entries can't differ
+    Entry info;
+    try {
+        ssValue >> info;
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): ERROR: %s\n", __func__, e.what());
+        LOCK(cs_cache);
+        cache.erase(id);
+        ++cache_generation;
+        return;
+    }
+
+    LOCK(cs_cache);
+    cache[id] = info;
+    ++cache_generation;
+}
+
+uint64_t CMPSPInfo::getCacheHits() const
+{
+    LOCK(cs_cache);
+    return cache_hits;
+}
+
+uint64_t CMPSPInfo::getCacheMisses() const
+{
+    LOCK(cs_cache);
+    return cache_misses;
+}
+
 void CMPSPInfo::setWatermark(const uint256& watermark)
 {
     leveldb::WriteBatch batch;
@@ -601,7 +667,7 @@ int mastercore::addInterestPegged(int nBlock)
     int64_t priceIndex = 0;
     int64_t nMarketPrice = 0;
 
-    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+    for (AccountMap<CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
             uint32_t id = 0;
             std::string address = it->first;
             (it->second).init();
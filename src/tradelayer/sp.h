@@ -10,6 +10,7 @@ class CHash256;
 class uint256;
 
 #include <serialize.h>
+#include <streams.h>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -135,6 +136,16 @@ public:
     Entry implied_tall;
     uint32_t next_spid;
 
+    /** Decoded entries, written through on update and dropped on rollback. */
+    mutable std::map<uint32_t, Entry> cache;
+    mutable uint64_t cache_hits;
+    mutable uint64_t cache_misses;
+    //! Bumped on every change of the cache, so entries read from the database in the meantime aren't cached
+    mutable uint64_t cache_generation;
+    mutable CCriticalSection cs_cache;
+
+    void cacheEntry(uint32_t id, CDataStream ssValue);
+
  public:
     CMPSPInfo(const fs::path& path, bool fWipe);
     virtual ~CMPSPInfo();
@@ -158,6 +169,9 @@ public:
 
     void printAll() const;
 
+    uint64_t getCacheHits() const;
+    uint64_t getCacheMisses() const;
+
 };
 
 
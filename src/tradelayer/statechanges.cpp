@@ -0,0 +1,72 @@
+#include <tradelayer/statechanges.h>
+
+#include <sync.h>
+
+#include <set>
+#include <string>
+#include <utility>
+
+namespace mastercore
+{
+//! Guards the changed addresses, which are recorded by writers holding cs_tally or cs_register
+static CCriticalSection cs_changes;
+static ChangedAddresses changedBalances[STATE_CHANGE_READER_COUNT];
+static ChangedAddresses changedRegisters[STATE_CHANGE_READER_COUNT];
+
+static void MarkChanged(ChangedAddresses* changes, const std::string& address)
+{
+    LOCK(cs_changes);
+    for (int n = 0; n < STATE_CHANGE_READER_COUNT; ++n) {
+        changes[n].addresses.insert(address);
+    }
+}
+
+static void MarkCleared(ChangedAddresses* changes)
+{
+    LOCK(cs_changes);
+    for (int n = 0; n < STATE_CHANGE_READER_COUNT; ++n) {
+        changes[n].addresses.clear();
+        changes[n].fCleared = true;
+    }
+}
+
+static ChangedAddresses TakeChanges(ChangedAddresses* changes, StateChangeReader reader)
+{
+    ChangedAddresses taken;
+
+    LOCK(cs_changes);
+    std::swap(taken, changes[reader]);
+
+    return taken;
+}
+
+void MarkBalancesChanged(const std::string& address)
+{
+    MarkChanged(changedBalances, address);
+}
+
+void MarkRegistersChanged(const std::string& address)
+{
+    MarkChanged(changedRegisters, address);
+}
+
+void MarkBalancesCleared()
+{
+    MarkCleared(changedBalances);
+}
+
+void MarkRegistersCleared()
+{
+    MarkCleared(changedRegisters);
+}
+
+ChangedAddresses TakeChangedBalances(StateChangeReader reader)
+{
+    return TakeChanges(changedBalances, reader);
+}
+
+ChangedAddresses TakeChangedRegisters(StateChangeReader reader)
+{
+    return TakeChanges(changedRegisters, reader);
+}
+}
@@ -0,0 +1,47 @@
+#ifndef TRADELAYER_STATECHANGES_H
+#define TRADELAYER_STATECHANGES_H
+
+#include <set>
+#include <string>
+
+namespace mastercore
+{
+/** Readers of the changed addresses, each one takes the changes since its last call. */
+enum StateChangeReader
+{
+    CHANGES_STATE_HASH = 0,
+    CHANGES_STATE_FILES,
+    STATE_CHANGE_READER_COUNT
+};
+
+/** Addresses, whose balances or registers changed since a reader last took them.
+ */
+struct ChangedAddresses
+{
+    std::set<std::string> addresses;
+    //! Set, once all entries were dropped, before the addresses changed
+    bool fCleared;
+
+    ChangedAddresses() : fCleared(false) {}
+};
+
+/** Records, that the balances of an address changed. */
+void MarkBalancesChanged(const std::string& address);
+
+/** Records, that the contract registers of an address changed. */
+void MarkRegistersChanged(const std::string& address);
+
+/** Records, that all balances were dropped. */
+void MarkBalancesCleared();
+
+/** Records, that all contract registers were dropped. */
+void MarkRegistersCleared();
+
+/** Returns the addresses with changed balances, and resets them for the reader. */
+ChangedAddresses TakeChangedBalances(StateChangeReader reader);
+
+/** Returns the addresses with changed registers, and resets them for the reader. */
+ChangedAddresses TakeChangedRegisters(StateChangeReader reader);
+}
+
+#endif // TRADELAYER_STATECHANGES_H
@@ -0,0 +1,161 @@
+#include <tradelayer/statewriter.h>
+
+#include <tradelayer/log.h>
+
+#include <util/system.h>
+#include <util/threadnames.h>
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mastercore
+{
+namespace
+{
+//! Files of one block, written as a whole
+struct StateBatch
+{
+    std::vector<StateFile> files;
+    std::function<void()> onComplete;
+};
+
+std::mutex cs_writer;
+std::condition_variable cond_writer;
+std::deque<StateBatch> pendingBatches;
+//! Set while the writer works on a batch, which is no longer in the queue
+bool fWriting = false;
+bool fStopWriter = false;
+std::thread writerThread;
+
+const char* const TMP_SUFFIX = ".tmp";
+
+bool WriteStateFile(StateFile& file)
+{
+    if (file.render && !file.render(file.data)) {
+        PrintToLog("%s(): ERROR: failed to render %s\n", __func__, file.path.string());
+        return false;
+    }
+    // the copy of the state isn't needed anymore
+    file.render = nullptr;
+
+    fs::path tmpPath = file.path;
+    tmpPath += TMP_SUFFIX;
+
+    FILE* stream = fsbridge::fopen(tmpPath, "wb");
+    if (!stream) {
+        PrintToLog("%s(): ERROR: failed to open %s\n", __func__, tmpPath.string());
+        return false;
+    }
+
+    bool fGood = fwrite(file.data.data(), 1, file.data.size(), stream) == file.data.size();
+    if (fGood) {
+        FileCommit(stream);
+    }
+    fclose(stream);
+
+    if (fGood) {
+        fGood = RenameOver(tmpPath, file.path);
+    }
+    if (!fGood) {
+        PrintToLog("%s(): ERROR: failed to write %s\n", __func__, file.path.string());
+        // this thread must not throw
+        boost::system::error_code ec;
+        fs::remove(tmpPath, ec);
+    }
+
+    return fGood;
+}
+
+void WriterLoop()
+{
+    util::ThreadRename("tl-statewriter");
+
+    std::unique_lock<std::mutex> lock(cs_writer);
+    while (true)
+    {
+        cond_writer.wait(lock, [] { return fStopWriter || !pendingBatches.empty(); });
+        if (pendingBatches.empty()) {
+            break; // stopped and nothing left to do
+        }
+
+        StateBatch batch = std::move(pendingBatches.front());
+        pendingBatches.pop_front();
+        fWriting = true;
+        lock.unlock();
+
+        bool fGood = true;
+        for (StateFile& file : batch.files) {
+            fGood &= WriteStateFile(file);
+        }
+
+        // an incomplete set of files must never become the most relevant state
+        if (fGood && batch.onComplete) {
+            batch.onComplete();
+        }
+        batch.files.clear();
+
+        lock.lock();
+        fWriting = false;
+        cond_writer.notify_all();
+    }
+}
+
+/** Removes temporary files of an earlier run, which was interrupted while writing. */
+void RemoveStaleFiles(const fs::path& dir)
+{
+    if (!fs::is_directory(dir)) return;
+
+    for (fs::directory_iterator it(dir), end; it != end; ++it)
+    {
+        if (it->path().extension() == TMP_SUFFIX) {
+            PrintToLog("Removing incomplete state file : %s\n", it->path().string());
+            boost::system::error_code ec;
+            fs::remove(it->path(), ec);
+        }
+    }
+}
+} // anonymous namespace
+
+void QueueStateFiles(std::vector<StateFile>& files, const std::function<void()>& onComplete)
+{
+    std::lock_guard<std::mutex> lock(cs_writer);
+
+    if (!writerThread.joinable()) {
+        if (!files.empty()) RemoveStaleFiles(files.front().path.parent_path());
+        fStopWriter = false;
+        writerThread = std::thread(WriterLoop);
+    }
+
+    StateBatch batch;
+    batch.files.swap(files);
+    batch.onComplete = onComplete;
+    pendingBatches.push_back(std::move(batch));
+
+    cond_writer.notify_all();
+}
+
+void WaitForStateFiles()
+{
+    std::unique_lock<std::mutex> lock(cs_writer);
+    cond_writer.wait(lock, [] { return pendingBatches.empty() && !fWriting; });
+}
+
+void StopStateWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_writer);
+        fStopWriter = true;
+        cond_writer.notify_all();
+    }
+
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+}
+}
@@ -0,0 +1,41 @@
+#ifndef TRADELAYER_STATEWRITER_H
+#define TRADELAYER_STATEWRITER_H
+
+#include <fs.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mastercore
+{
+/** A state file, waiting to be written to disk.
+ */
+struct StateFile
+{
+    fs::path path;
+    //! The content, rendered by the caller, or by render
+    std::string data;
+    //! Renders the content on the writer thread, if set, and returns false on failure
+    std::function<bool(std::string&)> render;
+};
+
+/**
+ * Hands the state files of a block over to the background writer.
+ *
+ * Files with a renderer are rendered on the writer thread, from a copy of the
+ * state, which the renderer owns. Each file is written under a temporary name,
+ * synced and then renamed, so a state file is either complete or absent. Once
+ * all files of the batch are on disk, onComplete is run on the writer thread,
+ * so it must only touch what is safe to use from there.
+ */
+void QueueStateFiles(std::vector<StateFile>& files, const std::function<void()>& onComplete);
+
+/** Blocks until all queued state files are written, and their callbacks are done. */
+void WaitForStateFiles();
+
+/** Writes the remaining state files and stops the background writer. */
+void StopStateWriter();
+}
+
+#endif // TRADELAYER_STATEWRITER_H
@@ -3,15 +3,17 @@
 #include <tradelayer/log.h>
 #include <tradelayer/tradelayer.h>
 
+#include <algorithm>
+#include <limits>
+#include <stddef.h>
 #include <stdint.h>
-#include <map>
+#include <vector>
 
 /**
  * Creates an empty tally.
  */
-CMPTally::CMPTally()
+CMPTally::CMPTally() : nPos(0)
 {
-    my_it = mp_token.begin();
 }
 
 /**
@@ -21,12 +23,8 @@ CMPTally::CMPTally()
  */
 uint32_t CMPTally::init()
 {
-    uint32_t propertyId = 0;
-    my_it = mp_token.begin();
-    if (my_it != mp_token.end()) {
-        propertyId = my_it->first;
-    }
-    return propertyId;
+    nPos = 0;
+    return (nPos < mp_token.size()) ? mp_token[nPos].propertyId : 0;
 }
 
 /**
@@ -36,12 +34,53 @@ uint32_t CMPTally::init()
  */
 uint32_t CMPTally::next()
 {
-    uint32_t ret = 0;
-    if (my_it != mp_token.end()) {
-        ret = my_it->first;
-        ++my_it;
+    return (nPos < mp_token.size()) ? mp_token[nPos++].propertyId : 0;
+}
+
+static bool CompareRecordId(const CMPTally::BalanceRecord& record, uint32_t propertyId)
+{
+    return record.propertyId < propertyId;
+}
+
+/**
+ * Returns the balance record of a property.
+ *
+ * @param propertyId  The identifier of the tally to lookup
+ * @return The record, or nullptr, if there is none
+ */
+const CMPTally::BalanceRecord* CMPTally::getRecord(uint32_t propertyId) const
+{
+    const_iterator it = std::lower_bound(mp_token.begin(), mp_token.end(), propertyId, CompareRecordId);
+    if (it != mp_token.end() && it->propertyId == propertyId) {
+        return &(*it);
+    }
+
+    return nullptr;
+}
+
+/**
+ * Returns the balance record of a property, an empty one is inserted, if
+ * there is none.
+ *
+ * @param propertyId  The identifier of the tally to lookup
+ * @return The record
+ */
+CMPTally::BalanceRecord& CMPTally::getOrInsertRecord(uint32_t propertyId)
+{
+    std::vector<BalanceRecord>::iterator it = std::lower_bound(mp_token.begin(), mp_token.end(), propertyId, CompareRecordId);
+    if (it != mp_token.end() && it->propertyId == propertyId) {
+        return *it;
     }
-    return ret;
+
+    // like a map iterator, the internal iterator skips records inserted before its position
+    const size_t pos = it - mp_token.begin();
+    if (pos <= nPos) ++nPos;
+
+    BalanceRecord record;
+    record.propertyId = propertyId;
+    std::fill(record.balance, record.balance + TALLY_TYPE_COUNT, 0);
+
+    return *mp_token.insert(it, record);
 }
 
 /**
@@ -74,7 +113,8 @@ bool CMPTally::updateMoney(uint32_t propertyId, int64_t amount, TallyType ttype)
         return false;
     }
     bool fUpdated = false;
-    int64_t now64 = mp_token[propertyId].balance[ttype];
+    BalanceRecord& record = getOrInsertRecord(propertyId);
+    int64_t now64 = record.balance[ttype];
 
     if (isOverflow(now64, amount)) {
         PrintToLog("%s(): ERROR: arithmetic overflow [%d + %d]\n", __func__, now64, amount);
@@ -86,12 +126,12 @@ bool CMPTally::updateMoney(uint32_t propertyId, int64_t amount, TallyType ttype)
         // Negative balances are only permitted for pending balances
         //make sure any excess uPNL that goes to negative numbers flattens to 0
         if(amount<0&&now64-(amount*-1)<0){now64=0;}
-        mp_token[propertyId].balance[ttype] = now64;
+        record.balance[ttype] = now64;
         fUpdated = true;
     } else {
 
         now64 += amount;
-        mp_token[propertyId].balance[ttype] = now64;
+        record.balance[ttype] = now64;
 
         fUpdated = true;
     }
@@ -111,15 +151,9 @@ int64_t CMPTally::getMoney(uint32_t propertyId, TallyType ttype) const
     if (TALLY_TYPE_COUNT <= ttype) {
         return 0;
     }
-    int64_t money = 0;
-    TokenMap::const_iterator it = mp_token.find(propertyId);
-
-    if (it != mp_token.end()) {
-        const BalanceRecord& record = it->second;
-        money = record.balance[ttype];
-    }
+    const BalanceRecord* record = getRecord(propertyId);
 
-    return money;
+    return (record != nullptr) ? record->balance[ttype] : 0;
 }
 
 /**
@@ -133,14 +167,13 @@ int64_t CMPTally::getMoney(uint32_t propertyId, TallyType ttype) const
  */
 int64_t CMPTally::getMoneyAvailable(uint32_t propertyId) const
 {
-    TokenMap::const_iterator it = mp_token.find(propertyId);
+    const BalanceRecord* record = getRecord(propertyId);
 
-    if (it != mp_token.end()) {
-        const BalanceRecord& record = it->second;
-        if (record.balance[PENDING] < 0) {
-            return record.balance[BALANCE] + record.balance[PENDING];
+    if (record != nullptr) {
+        if (record->balance[PENDING] < 0) {
+            return record->balance[BALANCE] + record->balance[PENDING];
         } else {
-            return record.balance[BALANCE];
+            return record->balance[BALANCE];
         }
     }
 
@@ -158,28 +191,21 @@ bool CMPTally::operator==(const CMPTally& rhs) const
     if (mp_token.size() != rhs.mp_token.size()) {
         return false;
     }
-    TokenMap::const_iterator pc1 = mp_token.begin();
-    TokenMap::const_iterator pc2 = rhs.mp_token.begin();
 
-    for (unsigned int i = 0; i < mp_token.size(); ++i) {
-        if (pc1->first != pc2->first) {
+    for (size_t i = 0; i < mp_token.size(); ++i) {
+        const BalanceRecord& record1 = mp_token[i];
+        const BalanceRecord& record2 = rhs.mp_token[i];
+
+        if (record1.propertyId != record2.propertyId) {
             return false;
         }
-        const BalanceRecord& record1 = pc1->second;
-        const BalanceRecord& record2 = pc2->second;
-
         for (int ttype = 0; ttype < TALLY_TYPE_COUNT; ++ttype) {
             if (record1.balance[ttype] != record2.balance[ttype]) {
                 return false;
             }
         }
-        ++pc1;
-        ++pc2;
     }
 
-    assert(pc1 == mp_token.end());
-    assert(pc2 == rhs.mp_token.end());
-
     return true;
 }
 
@@ -206,12 +232,11 @@ int64_t CMPTally::print(uint32_t propertyId, bool bDivisible) const
     int64_t balance = 0;
     int64_t pending = 0;
 
-    TokenMap::const_iterator it = mp_token.find(propertyId);
+    const BalanceRecord* record = getRecord(propertyId);
 
-    if (it != mp_token.end()) {
-        const BalanceRecord& record = it->second;
-        balance = record.balance[BALANCE];
-        pending = record.balance[PENDING];
+    if (record != nullptr) {
+        balance = record->balance[BALANCE];
+        pending = record->balance[PENDING];
     }
 
     if (bDivisible) {
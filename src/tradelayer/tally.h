@@ -1,8 +1,9 @@
 #ifndef TRADELAYER_TALLY_H
 #define TRADELAYER_TALLY_H
 
+#include <stddef.h>
 #include <stdint.h>
-#include <map>
+#include <vector>
 
 //! Balance record types
 enum TallyType {
@@ -20,20 +21,29 @@ enum TallyType {
 bool isOverflow(int64_t a, int64_t b);
 
 /** Balance records of a single entity.
+ *
+ * Records are kept in a vector sorted by property identifier, as most
+ * entities only hold a few properties.
  */
 class CMPTally
 {
-private:
-    typedef struct {
+public:
+    //! Balances of one property
+    struct BalanceRecord {
+        uint32_t propertyId;
         int64_t balance[TALLY_TYPE_COUNT];
-    } BalanceRecord;
+    };
+
+    typedef std::vector<BalanceRecord>::const_iterator const_iterator;
+
+private:
+    //! Balance records for different tokens, sorted by property identifier
+    std::vector<BalanceRecord> mp_token;
+    //! Position of the internal iterator
+    size_t nPos;
 
-    //! Map of balance records
-    typedef std::map<uint32_t, BalanceRecord> TokenMap;
-    //! Balance records for different tokens
-    TokenMap mp_token;
-    //! Internal iterator pointing to a balance record
-    TokenMap::iterator my_it;
+    /** Returns the record of a property, an empty one is inserted, if there is none. */
+    BalanceRecord& getOrInsertRecord(uint32_t propertyId);
 
 public:
     /** Creates an empty tally. */
@@ -45,6 +55,16 @@ public:
     /** Advances the internal iterator. */
     uint32_t next();
 
+    /** Iterates the balance records in ascending order of property identifiers. */
+    const_iterator begin() const { return mp_token.begin(); }
+    const_iterator end() const { return mp_token.end(); }
+
+    /** Returns the balance record of a property, or nullptr, if there is none. */
+    const BalanceRecord* getRecord(uint32_t propertyId) const;
+
+    /** Returns true, if the tally has a balance record for the property. */
+    bool hasProperty(uint32_t propertyId) const { return getRecord(propertyId) != nullptr; }
+
     /** Updates the number of tokens for the given tally type. */
     bool updateMoney(uint32_t propertyId, int64_t amount, TallyType ttype);
 
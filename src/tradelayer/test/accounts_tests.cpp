@@ -0,0 +1,62 @@
+#include <test/test_bitcoin.h>
+#include <tradelayer/accounts.h>
+
+#include <boost/test/unit_test.hpp>
+#include <stdint.h>
+#include <string>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_accounts_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(intern_address)
+{
+    const AccountId id = InternAddress("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG");
+    BOOST_CHECK_EQUAL(id, InternAddress("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG"));
+    BOOST_CHECK(id != InternAddress("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk"));
+
+    AccountId found = 0;
+    BOOST_CHECK(FindAccountId("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", found));
+    BOOST_CHECK_EQUAL(id, found);
+    BOOST_CHECK(!FindAccountId("QUnknownAddressxxxxxxxxxxxxxxxxxxx", found));
+
+    BOOST_CHECK_EQUAL("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", GetAccountAddress(id));
+    BOOST_CHECK_EQUAL("", GetAccountAddress(GetAccountCount()));
+}
+
+BOOST_AUTO_TEST_CASE(account_map)
+{
+    AccountMap<int64_t> balances;
+    BOOST_CHECK(balances.empty());
+    BOOST_CHECK(balances.find("QbUdXhDPFNvnWBsRXCbBpZ3eXVGyEfMoZ4") == balances.end());
+
+    balances["QbUdXhDPFNvnWBsRXCbBpZ3eXVGyEfMoZ4"] = 5;
+    balances["QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL"] += 7;
+    balances["QbUdXhDPFNvnWBsRXCbBpZ3eXVGyEfMoZ4"] += 1;
+
+    BOOST_CHECK_EQUAL(2U, balances.size());
+    BOOST_CHECK_EQUAL(1U, balances.count("QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL"));
+    BOOST_CHECK_EQUAL(6, balances.find("QbUdXhDPFNvnWBsRXCbBpZ3eXVGyEfMoZ4")->second);
+
+    AccountId id = 0;
+    BOOST_CHECK(FindAccountId("QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL", id));
+    BOOST_CHECK_EQUAL(7, balances.find(id)->second);
+
+    // existing entries are not replaced
+    BOOST_CHECK(!balances.insert(std::make_pair("QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL", 1)).second);
+    BOOST_CHECK_EQUAL(7, balances["QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL"]);
+
+    // entries are iterated in insertion order
+    AccountMap<int64_t>::const_iterator it = balances.begin();
+    BOOST_CHECK_EQUAL("QbUdXhDPFNvnWBsRXCbBpZ3eXVGyEfMoZ4", it->first);
+    BOOST_CHECK_EQUAL("QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL", (++it)->first);
+
+    balances.clear();
+    BOOST_CHECK(balances.empty());
+    BOOST_CHECK(balances.find(id) == balances.end());
+
+    // ids outlive the map
+    BOOST_CHECK(FindAccountId("QQm1vGpUDgVaDBfvLf2XnUH5aXWRZDGdzL", id));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,105 @@
+#include <test/test_bitcoin.h>
+#include <tradelayer/changeset.h>
+#include <tradelayer/register.h>
+#include <tradelayer/tally.h>
+#include <tradelayer/tradelayer.h>
+
+#include <boost/test/unit_test.hpp>
+#include <stdint.h>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_changeset_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(apply_all)
+{
+    clear_tally_map();
+    clear_register_map();
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, 100, BALANCE));
+
+    ChangeSet changes;
+    BOOST_CHECK(changes.empty());
+    changes.addTally("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, -60, BALANCE);
+    changes.addTally("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, 60, BALANCE);
+    changes.addRegister("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 1, -10, CONTRACT_POSITION);
+    BOOST_CHECK_EQUAL(2U, changes.getTallyChanges().size());
+    BOOST_CHECK_EQUAL(1U, changes.getRegisterChanges().size());
+
+    BOOST_CHECK(changes.apply());
+    BOOST_CHECK_EQUAL(40, getMPbalance("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, BALANCE));
+    BOOST_CHECK_EQUAL(60, getMPbalance("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, BALANCE));
+    BOOST_CHECK_EQUAL(-10, getContractRecord("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 1, CONTRACT_POSITION));
+
+    clear_tally_map();
+    clear_register_map();
+}
+
+BOOST_AUTO_TEST_CASE(apply_none)
+{
+    clear_tally_map();
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, 100, BALANCE));
+
+    // the last credit overflows, so nothing is moved
+    ChangeSet changes;
+    changes.addTally("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, -60, BALANCE);
+    changes.addTally("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, 60, BALANCE);
+    changes.addTally("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, INT64_MAX, BALANCE);
+    BOOST_CHECK(!changes.check());
+    BOOST_CHECK(!changes.apply());
+    BOOST_CHECK_EQUAL(100, getMPbalance("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, BALANCE));
+    BOOST_CHECK_EQUAL(0, getMPbalance("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, BALANCE));
+
+    // the second debit exceeds the balance left by the first one, so nothing is moved
+    changes.clear();
+    changes.addTally("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, -60, BALANCE);
+    changes.addTally("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, 60, BALANCE);
+    changes.addTally("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, -60, BALANCE);
+    BOOST_CHECK(!changes.apply());
+    BOOST_CHECK_EQUAL(100, getMPbalance("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, BALANCE));
+    BOOST_CHECK_EQUAL(0, getMPbalance("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", 5, BALANCE));
+
+    // zero amounts are rejected
+    changes.clear();
+    changes.addTally("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, 0, BALANCE);
+    BOOST_CHECK(!changes.apply());
+
+    clear_tally_map();
+}
+
+BOOST_AUTO_TEST_CASE(same_as_updates)
+{
+    clear_tally_map();
+    clear_register_map();
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, 100, BALANCE));
+    BOOST_CHECK(update_register_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 1, 50, PNL));
+
+    // balances can be spent down to zero, pending balances become negative
+    const AccountId account = InternAddress("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG");
+    ChangeSet changes;
+    changes.addTally(account, 5, -60, BALANCE);
+    changes.addTally("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, -40, BALANCE);
+    changes.addTally(account, 5, -60, PENDING);
+
+    // the PNL is replaced, positions may become negative
+    changes.addRegister("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 1, 30, PNL);
+    changes.addRegister("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 1, 0, PNL);
+    changes.addRegister("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 1, -10, CONTRACT_POSITION);
+    BOOST_CHECK(changes.check());
+    BOOST_CHECK(changes.apply());
+
+    BOOST_CHECK_EQUAL(0, getMPbalance("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, BALANCE));
+    BOOST_CHECK_EQUAL(-60, getMPbalance("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 5, PENDING));
+    BOOST_CHECK_EQUAL(0, getContractRecord("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 1, PNL));
+    BOOST_CHECK_EQUAL(-10, getContractRecord("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", 1, CONTRACT_POSITION));
+
+    // the indexes are maintained, too
+    BOOST_CHECK_EQUAL(0, mp_property_supply[5].totals[BALANCE]);
+    BOOST_CHECK_EQUAL(-60, mp_property_supply[5].totals[PENDING]);
+    BOOST_CHECK_EQUAL(1U, mp_contract_positions[1].holders.count("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG"));
+    BOOST_CHECK_EQUAL(0U, mp_contract_positions[1].unsettled.count("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG"));
+
+    clear_tally_map();
+    clear_register_map();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
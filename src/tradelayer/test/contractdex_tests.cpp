@@ -24,12 +24,17 @@
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
 
 using namespace mastercore;
 
+// the handles of a book point into its own containers
+static_assert(!std::is_copy_constructible<cd_Book>::value && !std::is_copy_assignable<cd_Book>::value, "cd_Book must not be copied");
+static_assert(!std::is_move_constructible<cd_Book>::value && !std::is_move_assignable<cd_Book>::value, "cd_Book must not be moved");
+
 BOOST_FIXTURE_TEST_SUITE(contractdex_tests, BasicTestingSetup)
 
 // BOOST_AUTO_TEST_CASE(edge_orderbook)
@@ -168,4 +173,181 @@ BOOST_FIXTURE_TEST_SUITE(contractdex_tests, BasicTestingSetup)
 //
 // }
 
+BOOST_AUTO_TEST_CASE(book_ladders)
+{
+    cd_Book book;
+
+    //                    address, block, contract, amount, desprop, desamount, txid, idx, subaction, price, action, reserve, liquidation
+    CMPContractDex seller1("1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH", 172, 1, 5, 0, 0, uint256S("6"), 1, 1, 500000000, sell, 0, false);
+    CMPContractDex seller2("1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 5, 0, 0, uint256S("7"), 2, 1, 600000000, sell, 0, false);
+    CMPContractDex seller3("1Nx8KWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 3, 0, 0, uint256S("8"), 3, 1, 500000000, sell, 0, false);
+    CMPContractDex buyer1("1Nx8KWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 5, 0, 0, uint256S("9"), 4, 1, 400000000, buy, 0, false);
+    CMPContractDex buyer2("1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH", 172, 1, 5, 0, 0, uint256S("10"), 5, 1, 300000000, buy, 0, false);
+
+    BOOST_CHECK_EQUAL(book.getBestPrice(buy), 0);
+    BOOST_CHECK_EQUAL(book.getBestPrice(sell), 0);
+
+    BOOST_CHECK(book.insert(seller1));
+    BOOST_CHECK(book.insert(seller2));
+    BOOST_CHECK(book.insert(seller3));
+    BOOST_CHECK(book.insert(buyer1));
+    BOOST_CHECK(book.insert(buyer2));
+    BOOST_CHECK(!book.insert(buyer2));
+
+    // each side has its own ladder
+    BOOST_CHECK_EQUAL(book.getSide(sell).size(), 2);
+    BOOST_CHECK_EQUAL(book.getSide(buy).size(), 2);
+
+    // best ask and best bid
+    BOOST_CHECK_EQUAL(book.getBestPrice(sell), 500000000);
+    BOOST_CHECK_EQUAL(book.getBestPrice(buy), 400000000);
+
+    // aggregated amount by level
+    BOOST_CHECK_EQUAL(book.getAmountAtPrice(sell, 500000000), 8);
+    BOOST_CHECK_EQUAL(book.getAmountAtPrice(sell, 600000000), 5);
+    BOOST_CHECK_EQUAL(book.getAmountAtPrice(buy, 500000000), 0);
+
+    // emptying the best ask level moves the best ask up
+    cd_PricesMap::iterator level = book.getSide(sell).find(500000000);
+    cd_Set::iterator it = level->second.orders.begin();
+    it = book.erase(level, it);
+    BOOST_CHECK_EQUAL(book.getAmountAtPrice(sell, 500000000), 3);
+    BOOST_CHECK_EQUAL(book.getBestPrice(sell), 500000000);
+
+    it = book.erase(level, it);
+    BOOST_CHECK(it == level->second.orders.end());
+    BOOST_CHECK_EQUAL(book.getBestPrice(sell), 600000000);
+
+    book.eraseLevelIfEmpty(sell, level);
+    BOOST_CHECK_EQUAL(book.getSide(sell).size(), 1);
+
+    // orders with nothing for sale don't count for the top of book
+    CMPContractDex buyer3("1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz", 173, 1, 0, 0, 0, uint256S("11"), 1, 1, 450000000, buy, 0, false);
+    BOOST_CHECK(book.insert(buyer3));
+    BOOST_CHECK_EQUAL(book.getBestPrice(buy), 400000000);
+
+    CMPContractDex buyer4("1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz", 173, 1, 2, 0, 0, uint256S("12"), 2, 1, 420000000, buy, 0, false);
+    BOOST_CHECK(book.insert(buyer4));
+    BOOST_CHECK_EQUAL(book.getBestPrice(buy), 420000000);
+
+    level = book.getSide(buy).find(420000000);
+    book.erase(level, level->second.orders.begin());
+    BOOST_CHECK_EQUAL(book.getBestPrice(buy), 400000000);
+}
+
+BOOST_AUTO_TEST_CASE(book_amend)
+{
+    cd_Book book;
+
+    CMPContractDex seller1("1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH", 172, 1, 5, 0, 0, uint256S("6"), 1, 1, 500000000, sell, 0, false);
+    CMPContractDex seller2("1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 3, 0, 0, uint256S("7"), 2, 1, 500000000, sell, 0, false);
+    CMPContractDex seller3("1Nx8KWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 4, 0, 0, uint256S("8"), 3, 1, 600000000, sell, 0, false);
+    BOOST_CHECK(book.insert(seller1));
+    BOOST_CHECK(book.insert(seller2));
+    BOOST_CHECK(book.insert(seller3));
+
+    // a partially filled order keeps its position in the level
+    cd_PricesMap::iterator level = book.getSide(sell).find(500000000);
+    CMPContractDex replacement = seller1;
+    replacement.setAmountForsale(2, "book_amend");
+    cd_Set::iterator it = book.amend(level, level->second.orders.begin(), replacement);
+    BOOST_CHECK(it->getHash() == seller2.getHash());
+    BOOST_CHECK(level->second.orders.begin()->getHash() == seller1.getHash());
+    BOOST_CHECK_EQUAL(level->second.orders.begin()->getAmountForSale(), 2);
+    BOOST_CHECK_EQUAL(book.getAmountAtPrice(sell, 500000000), 5);
+    BOOST_CHECK_EQUAL(book.getBestPrice(sell), 500000000);
+
+    // orders with nothing left for sale don't count for the top of book
+    replacement.setAmountForsale(0, "book_amend");
+    book.amend(level, level->second.orders.begin(), replacement);
+    replacement = seller2;
+    replacement.setAmountForsale(0, "book_amend");
+    book.amend(level, it, replacement);
+    BOOST_CHECK_EQUAL(level->second.orders.size(), 2);
+    BOOST_CHECK_EQUAL(book.getAmountAtPrice(sell, 500000000), 0);
+    BOOST_CHECK_EQUAL(book.getBestPrice(sell), 600000000);
+}
+
+BOOST_AUTO_TEST_CASE(book_indexes)
+{
+    cd_Book book;
+    const std::string alice = "1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH";
+    const std::string bob = "1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz";
+
+    CMPContractDex seller1(alice, 172, 1, 5, 0, 0, uint256S("6"), 1, 1, 600000000, sell, 0, false);
+    CMPContractDex seller2(bob, 172, 1, 3, 0, 0, uint256S("7"), 2, 1, 500000000, sell, 0, false);
+    CMPContractDex seller3(alice, 172, 1, 4, 0, 0, uint256S("8"), 3, 1, 500000000, sell, 0, false);
+    CMPContractDex buyer1(alice, 172, 1, 2, 0, 0, uint256S("9"), 4, 1, 400000000, buy, 0, false);
+    BOOST_CHECK(book.insert(seller1));
+    BOOST_CHECK(book.insert(seller2));
+    BOOST_CHECK(book.insert(seller3));
+    BOOST_CHECK(book.insert(buyer1));
+
+    BOOST_CHECK(book.getOrders("1Nx8KWM8mC35pBNPxV1noWFZEw7A5X6zXz") == nullptr);
+
+    // orders of an address are sorted like a scan of the book: bids, then asks by price
+    const cd_AddressOrders* orders = book.getOrders(alice);
+    BOOST_CHECK(orders != nullptr);
+    BOOST_CHECK_EQUAL(orders->size(), 3);
+    cd_AddressOrders::const_iterator it = orders->begin();
+    BOOST_CHECK(it->second.order->getHash() == buyer1.getHash());
+    BOOST_CHECK((++it)->second.order->getHash() == seller3.getHash());
+    BOOST_CHECK((++it)->second.order->getHash() == seller1.getHash());
+
+    std::pair<cd_TxidOrders::const_iterator, cd_TxidOrders::const_iterator> range = book.getOrders(seller2.getHash());
+    BOOST_CHECK(range.first != range.second);
+    BOOST_CHECK(range.first->second.order->getAddr() == bob);
+    BOOST_CHECK_EQUAL(range.first->second.level->first, 500000000);
+
+    // amended orders can still be found
+    cd_PricesMap::iterator level = book.getSide(sell).find(500000000);
+    CMPContractDex replacement = seller3;
+    replacement.setAmountForsale(1, "book_indexes");
+    book.amend(level, ++level->second.orders.begin(), replacement);
+    range = book.getOrders(seller3.getHash());
+    BOOST_CHECK(range.first != range.second);
+    BOOST_CHECK_EQUAL(range.first->second.order->getAmountForSale(), 1);
+
+    // erased orders are gone
+    book.erase(level, level->second.orders.begin());
+    range = book.getOrders(seller2.getHash());
+    BOOST_CHECK(range.first == range.second);
+    BOOST_CHECK(book.getOrders(bob) == nullptr);
+    BOOST_CHECK_EQUAL(book.getOrders(alice)->size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(book_lookups)
+{
+    contractdex.clear();
+    const std::string alice = "1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH";
+    const std::string bob = "1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz";
+
+    BOOST_CHECK(ContractDex_INSERT(CMPContractDex(alice, 172, 1, 5, 0, 0, uint256S("6"), 1, 1, 600000000, sell, 0, false)));
+    BOOST_CHECK(ContractDex_INSERT(CMPContractDex(bob, 172, 1, 3, 0, 0, uint256S("7"), 2, 1, 500000000, sell, 0, false)));
+    BOOST_CHECK(ContractDex_INSERT(CMPContractDex(alice, 172, 1, 4, 0, 0, uint256S("8"), 3, 1, 400000000, buy, 0, false)));
+
+    BOOST_CHECK(ContractDex_CHECK_ORDERS(alice, 1));
+    BOOST_CHECK(!ContractDex_CHECK_ORDERS(alice, 2));
+    BOOST_CHECK(ContractDex_RetrieveTrade(uint256S("7")) != nullptr);
+    BOOST_CHECK_EQUAL(ContractDex_RetrieveTrade(uint256S("7"))->getAddr(), bob);
+    BOOST_CHECK(ContractDex_RetrieveTrade(uint256S("5")) == nullptr);
+
+    // orders of other contracts are found through the global index
+    BOOST_CHECK(ContractDex_INSERT(CMPContractDex(bob, 172, 2, 2, 0, 0, uint256S("9"), 4, 1, 700000000, sell, 0, false)));
+    BOOST_CHECK(ContractDex_RetrieveTrade(uint256S("9")) != nullptr);
+    BOOST_CHECK_EQUAL(ContractDex_RetrieveTrade(uint256S("9"))->getProperty(), 2);
+    BOOST_CHECK_EQUAL(get_BookCd(2)->getAmountAtPrice(sell, 700000000), 2);
+
+    cd_PricesMap::iterator level = get_BookCd(2)->getSide(sell).find(700000000);
+    get_BookCd(2)->erase(level, level->second.orders.begin());
+    get_BookCd(2)->eraseLevelIfEmpty(sell, level);
+    BOOST_CHECK(ContractDex_RetrieveTrade(uint256S("9")) == nullptr);
+    BOOST_CHECK_EQUAL(get_BookCd(2)->getAmountAtPrice(sell, 700000000), 0);
+
+    // the indexes are dropped together with the books
+    contractdex.clear();
+    BOOST_CHECK(!ContractDex_CHECK_ORDERS(alice, 1));
+    BOOST_CHECK(ContractDex_RetrieveTrade(uint256S("7")) == nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include <test/test_bitcoin.h>
 #include <tradelayer/createpayload.h>
+#include <tradelayer/varint.h>
 #include <util/strencodings.h>
 
 #include <boost/test/unit_test.hpp>
@@ -378,4 +379,23 @@ BOOST_AUTO_TEST_CASE(payload_send_dex_accept)
     BOOST_CHECK_EQUAL(vch.size(), 5);
 }
 
+BOOST_AUTO_TEST_CASE(payload_varint_in_place)
+{
+    std::vector<unsigned char> vch = CreatePayload_SimpleSend(
+        static_cast<uint32_t>(1),          // property: MSC
+        static_cast<int64_t>(100000000));  // amount to transfer: 1.0 MSC (in willets)
+
+    // fields are decoded where they are stored in the payload
+    const VarIntBytes property = { &vch[2], 1 };
+    const VarIntBytes amount = { &vch[3], 4 };
+    BOOST_CHECK_EQUAL(DecompressInteger(property), 1U);
+    BOOST_CHECK_EQUAL(DecompressInteger(amount), 100000000U);
+
+    // and encoded by appending to the payload
+    std::vector<unsigned char> encoded(vch.begin(), vch.begin() + 2);
+    CompressInteger(1, encoded);
+    CompressInteger(100000000, encoded);
+    BOOST_CHECK_EQUAL(HexStr(encoded), HexStr(vch));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
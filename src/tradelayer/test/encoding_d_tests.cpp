@@ -1,7 +1,9 @@
 #include <tradelayer/encoding.h>
 
 #include <tradelayer/script.h>
+#include <tradelayer/tradelayer.h>
 
+#include <primitives/transaction.h>
 #include <script/script.h>
 #include <test/test_bitcoin.h>
 #include <util/strencodings.h>
@@ -94,5 +96,34 @@ BOOST_AUTO_TEST_CASE(class_d_with_empty_payload)
     nMaxDatacarrierBytes = nMaxDatacarrierBytesOriginal;
 }
 
+BOOST_AUTO_TEST_CASE(class_d_encoding_class)
+{
+    std::vector<std::pair<CScript, int64_t> > vecOutputs;
+    BOOST_CHECK(TradeLayer_Encode_ClassD(ParseHex("00000032"), vecOutputs));
+
+    CMutableTransaction mutableTx;
+    mutableTx.vout.push_back(CTxOut(1000, CScript() << OP_DUP << OP_HASH160 << ParseHex("7462746274627462746274627462746274627462") << OP_EQUALVERIFY << OP_CHECKSIG));
+    BOOST_CHECK_EQUAL(mastercore::GetEncodingClass(CTransaction(mutableTx), 1000), NO_MARKER);
+
+    // marker bytes, but not at the beginning of the first push
+    mutableTx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << ParseHex("007462000032")));
+    BOOST_CHECK_EQUAL(mastercore::GetEncodingClass(CTransaction(mutableTx), 1000), NO_MARKER);
+
+    mutableTx.vout.push_back(CTxOut(0, vecOutputs.front().first));
+    BOOST_CHECK_EQUAL(mastercore::GetEncodingClass(CTransaction(mutableTx), 1000), TL_CLASS_D);
+
+    // a push with OP_PUSHDATA1
+    std::vector<unsigned char> vchLong = ParseHex("7462");
+    vchLong.resize(80);
+    mutableTx.vout.clear();
+    mutableTx.vout.push_back(CTxOut(0, CScript() << OP_RETURN << vchLong));
+    BOOST_CHECK_EQUAL(mastercore::GetEncodingClass(CTransaction(mutableTx), 1000), TL_CLASS_D);
+
+    // a truncated script
+    CScript scriptBroken = CScript() << OP_RETURN << ParseHex("746200");
+    scriptBroken.push_back(OP_PUSHDATA1);
+    mutableTx.vout.back().scriptPubKey = scriptBroken;
+    BOOST_CHECK_EQUAL(mastercore::GetEncodingClass(CTransaction(mutableTx), 1000), NO_MARKER);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
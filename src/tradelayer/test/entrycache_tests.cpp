@@ -0,0 +1,118 @@
+#include <test/test_bitcoin.h>
+#include <tradelayer/ce.h>
+#include <tradelayer/sp.h>
+
+#include <fs.h>
+#include <uint256.h>
+
+#include <boost/test/unit_test.hpp>
+#include <stdint.h>
+#include <string>
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_entrycache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(property_cache)
+{
+    const fs::path path = fs::temp_directory_path() / fs::unique_path("tl_spinfo_%%%%%%%%");
+    uint32_t propertyId = 0;
+
+    {
+        CMPSPInfo spInfo(path, true);
+
+        CMPSPInfo::Entry entry;
+        entry.name = "first";
+        entry.txid = uint256S("01");
+        entry.creation_block = uint256S("a1");
+        entry.update_block = uint256S("a1");
+        propertyId = spInfo.putSP(entry);
+
+        // written through on put
+        CMPSPInfo::Entry info;
+        BOOST_CHECK(spInfo.getSP(propertyId, info));
+        BOOST_CHECK_EQUAL(info.name, "first");
+        BOOST_CHECK_EQUAL(spInfo.getCacheHits(), 1U);
+        BOOST_CHECK_EQUAL(spInfo.getCacheMisses(), 0U);
+
+        // written through on update
+        entry.name = "second";
+        entry.update_block = uint256S("a2");
+        BOOST_CHECK(spInfo.updateSP(propertyId, entry));
+        BOOST_CHECK(spInfo.getSP(propertyId, info));
+        BOOST_CHECK_EQUAL(info.name, "second");
+        BOOST_CHECK_EQUAL(spInfo.getCacheHits(), 2U);
+
+        // a rollback drops the cache, the previous entry is loaded again
+        BOOST_CHECK_EQUAL(spInfo.popBlock(uint256S("a2")), 1);
+        BOOST_CHECK(spInfo.getSP(propertyId, info));
+        BOOST_CHECK_EQUAL(info.name, "first");
+        BOOST_CHECK_EQUAL(spInfo.getCacheMisses(), 1U);
+        BOOST_CHECK(spInfo.getSP(propertyId, info));
+        BOOST_CHECK_EQUAL(spInfo.getCacheHits(), 3U);
+
+        // unknown entries are not cached
+        BOOST_CHECK(!spInfo.getSP(propertyId + 1, info));
+        BOOST_CHECK(!spInfo.getSP(propertyId + 1, info));
+        BOOST_CHECK_EQUAL(spInfo.getCacheMisses(), 3U);
+    }
+
+    // a reopened database starts with an empty cache
+    {
+        CMPSPInfo spInfo(path, false);
+
+        CMPSPInfo::Entry info;
+        BOOST_CHECK(spInfo.getSP(propertyId, info));
+        BOOST_CHECK_EQUAL(info.name, "first");
+        BOOST_CHECK_EQUAL(spInfo.getCacheHits(), 0U);
+        BOOST_CHECK_EQUAL(spInfo.getCacheMisses(), 1U);
+
+        spInfo.Clear();
+        BOOST_CHECK(!spInfo.getSP(propertyId, info));
+    }
+
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(contract_cache)
+{
+    const fs::path path = fs::temp_directory_path() / fs::unique_path("tl_cdinfo_%%%%%%%%");
+
+    CDInfo cdInfo(path, true);
+
+    CDInfo::Entry entry;
+    entry.name = "first";
+    entry.notional_size = 1;
+    entry.txid = uint256S("02");
+    entry.creation_block = uint256S("b1");
+    entry.update_block = uint256S("b1");
+    const uint32_t contractId = cdInfo.putCD(entry);
+
+    CDInfo::Entry info;
+    BOOST_CHECK(cdInfo.getCD(contractId, info));
+    BOOST_CHECK_EQUAL(info.notional_size, 1U);
+    BOOST_CHECK_EQUAL(cdInfo.getCacheHits(), 1U);
+    BOOST_CHECK_EQUAL(cdInfo.getCacheMisses(), 0U);
+
+    entry.notional_size = 2;
+    entry.update_block = uint256S("b2");
+    BOOST_CHECK(cdInfo.updateCD(contractId, entry));
+    BOOST_CHECK(cdInfo.getCD(contractId, info));
+    BOOST_CHECK_EQUAL(info.notional_size, 2U);
+
+    BOOST_CHECK_EQUAL(cdInfo.popBlock(uint256S("b2")), 1);
+    BOOST_CHECK(cdInfo.getCD(contractId, info));
+    BOOST_CHECK_EQUAL(info.notional_size, 1U);
+    BOOST_CHECK_EQUAL(cdInfo.getCacheMisses(), 1U);
+
+    // rolling back the creating block removes the entry, also from the cache
+    BOOST_CHECK_EQUAL(cdInfo.popBlock(uint256S("b1")), 0);
+    BOOST_CHECK(!cdInfo.getCD(contractId, info));
+
+    const uint32_t otherId = cdInfo.putCD(entry);
+    BOOST_CHECK(cdInfo.getCD(otherId, info));
+    cdInfo.Clear();
+    BOOST_CHECK(!cdInfo.getCD(otherId, info));
+
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -200,4 +200,35 @@ BOOST_AUTO_TEST_CASE(node_reward_object)
 
 }
 
+BOOST_AUTO_TEST_CASE(oracle_mark_price)
+{
+    const uint32_t contractId = 7;
+    const oracledata price = { 100 * COIN, 100 * COIN, 100 * COIN, contractId };
+    oraclePrices[contractId][100] = price;
+    oraclePrices[contractId][101] = price;
+    oraclePrices[contractId][102] = price;
+    invalidateOracleTwap(contractId);
+
+    BOOST_CHECK_EQUAL(getOracleTwap(contractId, 1), 100 * COIN);
+    BOOST_CHECK_EQUAL(getOracleTwap(contractId, 3), 100 * COIN);
+    BOOST_CHECK_EQUAL(getOracleMarkPrice(contractId), 100 * COIN);
+
+    // prices are cached until they are invalidated
+    const oracledata drop = { 50 * COIN, 50 * COIN, 50 * COIN, contractId };
+    oraclePrices[contractId][103] = drop;
+    BOOST_CHECK_EQUAL(getOracleTwap(contractId, 1), 100 * COIN);
+
+    invalidateOracleTwap(contractId);
+    BOOST_CHECK_EQUAL(getOracleTwap(contractId, 1), 50 * COIN);
+
+    // a sharp drop is limited by the lagging TWAP
+    const int64_t lag = getOracleTwap(contractId, 3);
+    BOOST_CHECK(getOracleMarkPrice(contractId) > 50 * COIN);
+    BOOST_CHECK(getOracleMarkPrice(contractId) < lag);
+
+    oraclePrices.erase(contractId);
+    clearOracleTwapCache();
+    BOOST_CHECK_EQUAL(getOracleMarkPrice(contractId), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 #include <tradelayer/uint256_extensions.h>
 #include <test/test_bitcoin.h>
 #include <boost/test/unit_test.hpp>
+#include <limits>
 #include <stdint.h>
 
 using namespace mastercore;
@@ -104,7 +105,7 @@ int64_t lincreaseLTCVolume(uint32_t propertyId, uint32_t propertyDesired, int aB
         // BOOST_TEST_MESSAGE("total:" << total);
 
         // increment cumulative LTC volume by tokens traded * the 12-block VWAP
-        MapLTCVolume[aBlock][propertyDesired] += total;
+        MapLTCVolume.add(aBlock, propertyDesired, total);
 
     }
 
@@ -126,10 +127,10 @@ BOOST_AUTO_TEST_CASE(getvwap_function)
     tokenvwap[propertyId][aBlock - 4].push_back(std::make_pair(2000 * COIN, 1900 * COIN));
 
     // adding some volume
-    MapLTCVolume[aBlock - 1][propertyId] += 2000 * COIN;
-    MapLTCVolume[aBlock - 2][propertyId] += 1000 * COIN;
-    MapLTCVolume[aBlock - 3][propertyId] += 3000 * COIN;
-    MapLTCVolume[aBlock - 4][propertyId] += 4000 * COIN;
+    MapLTCVolume.add(aBlock - 1, propertyId, 2000 * COIN);
+    MapLTCVolume.add(aBlock - 2, propertyId, 1000 * COIN);
+    MapLTCVolume.add(aBlock - 3, propertyId, 3000 * COIN);
+    MapLTCVolume.add(aBlock - 4, propertyId, 4000 * COIN);
 
     // checking vwap:   17000000 / 10000 = 1700
     BOOST_CHECK_EQUAL(1700 * COIN, lgetVWap(propertyId, aBlock, tokenvwap));
@@ -155,16 +156,202 @@ BOOST_AUTO_TEST_CASE(increase_ltc_volume_function)
 
 
     // adding some volume
-    MapLTCVolume[aBlock - 10][propertyId] = 2000 * COIN;
-    MapLTCVolume[aBlock - 10][propertyDesired] = 2000 * COIN;
+    MapLTCVolume.set(aBlock - 10, propertyId, 2000 * COIN);
+    MapLTCVolume.set(aBlock - 10, propertyDesired, 2000 * COIN);
 
 
     // 12-vwap * amountdesired = 3000 * 2000 = 6000000
     BOOST_CHECK_EQUAL(6000000 * COIN, lincreaseLTCVolume(propertyId, propertyDesired, aBlock));
 
+    // cleaning maps
+    tokenvwap.clear();
+    MapLTCVolume.clear();
+}
+
+BOOST_AUTO_TEST_CASE(volume_map_range)
+{
+    VolumeMap volumes;
+    volumes.add(100, 1, 10);
+    volumes.add(100, 1, 5);
+    volumes.add(150, 1, 20);
+    volumes.add(200, 1, 40);
+    volumes.add(150, 2, 1000);
+    volumes.set(300, 1, 80);
+
+    BOOST_CHECK_EQUAL(volumes.get(100, 1), 15);
+    BOOST_CHECK_EQUAL(volumes.get(100, 2), 0);
+
+    int64_t amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, 0, 999999999));
+    BOOST_CHECK_EQUAL(amount, 155);
+
+    // the range includes both ends
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, 150, 200));
+    BOOST_CHECK_EQUAL(amount, 60);
+
+    // a negative begin starts at the first block
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, -12, 150));
+    BOOST_CHECK_EQUAL(amount, 35);
+
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 3, 0, 999999999));
+    BOOST_CHECK_EQUAL(amount, 0);
+
+    // the sum stops before the block, which overflows
+    volumes.set(400, 1, std::numeric_limits<int64_t>::max());
+    amount = 0;
+    BOOST_CHECK(!volumes.sum(amount, 1, 0, 999999999));
+    BOOST_CHECK_EQUAL(amount, 155);
+}
+
+BOOST_AUTO_TEST_CASE(volume_map_older_blocks)
+{
+    VolumeMap volumes;
+    volumes.add(100, 1, 10);
+    volumes.add(300, 1, 30);
+
+    // blocks before the latest one shift the sums after them
+    volumes.add(200, 1, 20);
+    volumes.set(100, 1, 5);
+
+    int64_t amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, 0, 999999999));
+    BOOST_CHECK_EQUAL(amount, 55);
+
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, 200, 300));
+    BOOST_CHECK_EQUAL(amount, 50);
+
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, 101, 299));
+    BOOST_CHECK_EQUAL(amount, 20);
+
+    // the remaining blocks sum up as before
+    volumes.add(150, 2, 1000);
+    volumes.prune(200);
+    BOOST_CHECK_EQUAL(volumes.get(100, 1), 0);
+    BOOST_CHECK_EQUAL(volumes.get(200, 1), 20);
+
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 1, 0, 999999999));
+    BOOST_CHECK_EQUAL(amount, 50);
+
+    amount = 0;
+    BOOST_CHECK(volumes.sum(amount, 2, 0, 999999999));
+    BOOST_CHECK_EQUAL(amount, 0);
+
+    volumes.prune(400);
+    BOOST_CHECK(volumes.empty());
+}
+
+BOOST_AUTO_TEST_CASE(vwap_window)
+{
+    VWAPWindow window;
+    BOOST_CHECK_EQUAL(window.size(), 0);
+    BOOST_CHECK_EQUAL(window.getNumerator(), 0);
 
+    for (int64_t n = 1; n <= volumeToVWAP; ++n) {
+        window.add(n * 100, n);
+    }
+    BOOST_CHECK_EQUAL(window.size(), volumeToVWAP);
+    BOOST_CHECK_EQUAL(window.getNumerator(), 5500);
+    BOOST_CHECK_EQUAL(window.getDenominator(), 55);
+
+    // the oldest fill (100, 1) is replaced
+    window.add(1000, 20);
+    BOOST_CHECK_EQUAL(window.size(), volumeToVWAP);
+    BOOST_CHECK_EQUAL(window.getNumerator(), 6400);
+    BOOST_CHECK_EQUAL(window.getDenominator(), 74);
 }
 
+BOOST_AUTO_TEST_CASE(prune_token_vwap)
+{
+    const uint32_t propertyId = 3;
+    const int aBlock = 10250;
+
+    tokenvwap[propertyId][aBlock - 500].push_back(std::make_pair(1000 * COIN, 1500 * COIN));
+    tokenvwap[propertyId][aBlock - 5].push_back(std::make_pair(2000 * COIN, 1500 * COIN));
+    tokenvwap[4][aBlock - 500].push_back(std::make_pair(1000 * COIN, 1500 * COIN));
+    MapLTCVolume.add(aBlock - 5, propertyId, 1500 * COIN);
+
+    const int64_t vwap = getVWap(propertyId, aBlock, tokenvwap);
+    pruneTokenVWap(aBlock);
+
+    BOOST_CHECK_EQUAL(tokenvwap.size(), 1);
+    BOOST_CHECK_EQUAL(tokenvwap[propertyId].size(), 1);
+    BOOST_CHECK_EQUAL(vwap, getVWap(propertyId, aBlock, tokenvwap));
+
+    tokenvwap.clear();
+    MapLTCVolume.clear();
+}
+
+
+BOOST_AUTO_TEST_CASE(pair_books)
+{
+    clear_metadex();
+
+    //                  address, block, property, amount, desired property, desired amount, txid, idx, subaction
+    CMPMetaDEx seller1("1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH", 172, 1, 100, 5, 200, uint256S("6"), 1, 1);
+    CMPMetaDEx seller2("1NNQKWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 100, 6, 300, uint256S("7"), 2, 1);
+    CMPMetaDEx seller3("1Nx8KWM8mC35pBNPxV1noWFZEw7A5X6zXz", 172, 1, 100, 5, 400, uint256S("8"), 3, 1);
+
+    BOOST_CHECK(MetaDEx_INSERT(seller1));
+    BOOST_CHECK(MetaDEx_INSERT(seller2));
+    BOOST_CHECK(MetaDEx_INSERT(seller3));
+    BOOST_CHECK(!MetaDEx_INSERT(seller3));
+
+    // each market has its own book
+    BOOST_CHECK_EQUAL(metadex.size(), 2);
+    BOOST_CHECK(get_Prices(5, 1) == nullptr);
+
+    md_PricesMap* prices = get_Prices(1, 5);
+    BOOST_CHECK(prices != nullptr);
+    BOOST_CHECK_EQUAL(prices->size(), 2);
+    BOOST_CHECK(prices->begin()->first == seller1.unitPrice());
+    BOOST_CHECK_EQUAL(get_Prices(1, 6)->size(), 1);
+
+    // orders can be found by their transaction
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("7")) != nullptr);
+    BOOST_CHECK_EQUAL(MetaDEx_RetrieveTrade(uint256S("7"))->getAddr(), seller2.getAddr());
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("9")) == nullptr);
+
+    clear_metadex();
+    BOOST_CHECK(MetaDEx_RetrieveTrade(uint256S("7")) == nullptr);
+}
+
+
+BOOST_AUTO_TEST_CASE(price_keys)
+{
+    // prices are kept reduced
+    const MetaDExPrice half(50, 100);
+    BOOST_CHECK_EQUAL(half.numerator(), 1);
+    BOOST_CHECK_EQUAL(half.denominator(), 2);
+    BOOST_CHECK(half == MetaDExPrice(3, 6));
+    BOOST_CHECK(half.inverse() == MetaDExPrice(2, 1));
+
+    // a zero amount on either side is a zero price
+    BOOST_CHECK(MetaDExPrice(0, 7).isZero());
+    BOOST_CHECK(MetaDExPrice(7, 0).isZero());
+    BOOST_CHECK(MetaDExPrice().inverse().isZero());
+
+    // ordering is exact, even close to the limits of the amounts
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    BOOST_CHECK(MetaDExPrice(max - 1, max) < MetaDExPrice(max, max - 1));
+    BOOST_CHECK(MetaDExPrice(max - 2, max - 1) < MetaDExPrice(max - 1, max));
+    BOOST_CHECK(MetaDExPrice(1, 3) < half);
+    BOOST_CHECK(half <= MetaDExPrice(2, 4));
+    BOOST_CHECK(!(half < MetaDExPrice(2, 4)));
+
+    // same as the rational prices used before
+    BOOST_CHECK(MetaDExPrice(max, 3).toRational() == rational_t(max, 3));
+    BOOST_CHECK_EQUAL(xToString(MetaDExPrice(1, 4)), xToString(rational_t(1, 4)));
+
+    CMPMetaDEx order("1dexX7zmPen1yBz2H9ZF62AK5TGGqGTZH", 172, 1, 300, 5, 200, uint256S("6"), 1, 1);
+    BOOST_CHECK(order.unitPrice() == MetaDExPrice(2, 3));
+    BOOST_CHECK(order.inversePrice() == MetaDExPrice(3, 2));
+}
 
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,14 +1,25 @@
 #include <test/test_bitcoin.h>
+#include <tradelayer/dbrecord.h>
 #include <tradelayer/dex.h>
 #include <tradelayer/mdex.h>
 #include <tradelayer/register.h>
+#include <tradelayer/snapshot.h>
+#include <tradelayer/statewriter.h>
 #include <tradelayer/tally.h>
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/tx.h>
 
+#include <crypto/common.h>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
 #include <stdint.h>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace mastercore;
 
@@ -1018,4 +1029,243 @@ BOOST_FIXTURE_TEST_SUITE(tradelayer_persistence_tests, BasicTestingSetup)
 //
 // }
 
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    const fs::path path = fs::temp_directory_path() / fs::unique_path("tl_snapshot_%%%%%%%%.dat");
+
+    SnapshotWriter writer(FILETYPE_BALANCES);
+    BOOST_CHECK_EQUAL(writer.addAddress("QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS"), 0);
+    BOOST_CHECK_EQUAL(writer.addAddress("QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS"), 1);
+    BOOST_CHECK_EQUAL(writer.addAddress("QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS"), 0);
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        unsigned char* record = writer.addRecord(SNAPSHOT_BALANCES, 12);
+        WriteLE32(record, i % 2);
+        WriteLE64(record + 4, -int64_t(i) * 1000);
+    }
+    BOOST_CHECK_EQUAL(writer.getCount(SNAPSHOT_BALANCES), 3);
+    BOOST_CHECK(writer.write(path));
+
+    BOOST_CHECK(SnapshotReader::IsSnapshot(path));
+
+    {
+        SnapshotReader reader;
+        BOOST_CHECK(reader.open(path, true));
+        BOOST_CHECK_EQUAL(reader.getFileType(), FILETYPE_BALANCES);
+
+        const unsigned char* records = nullptr;
+        uint64_t count = 0;
+        BOOST_CHECK(!reader.getRecords(SNAPSHOT_BALANCES, 16, records, count));
+        BOOST_CHECK(reader.getRecords(SNAPSHOT_BALANCES, 12, records, count));
+        BOOST_CHECK_EQUAL(count, 3);
+        BOOST_CHECK_EQUAL(ReadLE32(records + 24), 0);
+        BOOST_CHECK_EQUAL((int64_t) ReadLE64(records + 28), -2000);
+
+        std::string address;
+        BOOST_CHECK(reader.getAddress(ReadLE32(records + 12), address));
+        BOOST_CHECK_EQUAL(address, "QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS");
+        BOOST_CHECK(!reader.getAddress(2, address));
+
+        // missing sections are empty
+        BOOST_CHECK(reader.getRecords(SNAPSHOT_REGISTERS, 64, records, count));
+        BOOST_CHECK_EQUAL(count, 0);
+    }
+
+    // corrupting a record breaks the hash
+    {
+        std::fstream file(path.string().c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-40, std::ios::end);
+        file.put('x');
+    }
+    {
+        SnapshotReader reader;
+        BOOST_CHECK(!reader.open(path, true));
+    }
+
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_image_copy_on_write)
+{
+    const std::string addressA = "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS";
+    const std::string addressB = "QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS";
+
+    SnapshotImage image;
+    image.set(addressA, "a1");
+    image.set(addressB, "b1");
+
+    // a copy shares all buckets, until one is changed
+    const SnapshotImage copy = image;
+    BOOST_CHECK(copy.getBuckets() == image.getBuckets());
+
+    image.set(addressA, "a2");
+    image.set(addressB, "");
+
+    size_t nShared = 0;
+    std::map<std::string, std::string> copied, current;
+    for (size_t n = 0; n < image.getBuckets().size(); ++n) {
+        if (copy.getBuckets()[n] == image.getBuckets()[n]) ++nShared;
+        copied.insert(copy.getBuckets()[n]->begin(), copy.getBuckets()[n]->end());
+        current.insert(image.getBuckets()[n]->begin(), image.getBuckets()[n]->end());
+    }
+    BOOST_CHECK(nShared >= image.getBuckets().size() - 2);
+    BOOST_CHECK_EQUAL(copied.size(), 2);
+    BOOST_CHECK_EQUAL(copied[addressA], "a1");
+    BOOST_CHECK_EQUAL(copied[addressB], "b1");
+    BOOST_CHECK_EQUAL(current.size(), 1);
+    BOOST_CHECK_EQUAL(current[addressA], "a2");
+
+    image.clear();
+    BOOST_CHECK_EQUAL(copy.getBuckets()[0].use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(background_state_writer)
+{
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path("tl_state_%%%%%%%%");
+    fs::create_directories(dir);
+
+    // leftovers of an interrupted write are removed, once the writer starts
+    std::ofstream(fs::path(dir / "balances-00.dat.tmp").string().c_str()) << "partial";
+
+    std::vector<StateFile> files(2);
+    files[0].path = dir / "globals-01.dat";
+    files[0].data = "1,2,3\n";
+    files[1].path = dir / "register-01.dat";
+    files[1].data = std::string("TLSTATE\0", 8);
+
+    // a file can also be rendered by the writer
+    files.resize(3);
+    files[2].path = dir / "balances-01.dat";
+    std::thread::id renderedBy;
+    files[2].render = [&renderedBy](std::string& data) { data = "rendered"; renderedBy = std::this_thread::get_id(); return true; };
+
+    int completed = 0;
+    std::thread::id completedBy;
+    QueueStateFiles(files, [&completed, &completedBy]() { ++completed; completedBy = std::this_thread::get_id(); });
+    BOOST_CHECK(files.empty());
+
+    // completion is reported by the writer, before waiting returns
+    WaitForStateFiles();
+    BOOST_CHECK_EQUAL(completed, 1);
+    BOOST_CHECK(completedBy != std::this_thread::get_id());
+    BOOST_CHECK(renderedBy == completedBy);
+    BOOST_CHECK(!fs::exists(dir / "balances-00.dat.tmp"));
+    BOOST_CHECK(!fs::exists(dir / "globals-01.dat.tmp"));
+    BOOST_CHECK_EQUAL(fs::file_size(dir / "globals-01.dat"), 6);
+    BOOST_CHECK_EQUAL(fs::file_size(dir / "register-01.dat"), 8);
+    BOOST_CHECK_EQUAL(fs::file_size(dir / "balances-01.dat"), 8);
+
+    // a batch with a file that can't be rendered doesn't complete
+    files.resize(1);
+    files[0].path = dir / "balances-02.dat";
+    files[0].render = [](std::string& data) { return false; };
+    QueueStateFiles(files, [&completed]() { ++completed; });
+    WaitForStateFiles();
+    BOOST_CHECK_EQUAL(completed, 1);
+    BOOST_CHECK(!fs::exists(dir / "balances-02.dat"));
+
+    // a batch with a file that can't be written doesn't complete
+    files.resize(1);
+    files[0].path = dir / "missing" / "globals-02.dat";
+    QueueStateFiles(files, [&completed]() { ++completed; });
+    StopStateWriter();
+    BOOST_CHECK_EQUAL(completed, 1);
+
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(trade_address_index)
+{
+    const fs::path path = fs::temp_directory_path() / fs::unique_path("tl_tradelist_%%%%%%%%");
+    const std::string addressA = "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS";
+    const std::string addressB = "QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS";
+
+    {
+        CMPTradeList tradeList(path, true);
+        tradeList.recordNewTrade(uint256S("11"), addressA, 3, 4, 200, 2);
+        tradeList.recordNewTrade(uint256S("12"), addressA, 5, 4, 20, 1);
+        tradeList.recordNewTrade(uint256S("13"), addressB, 3, 4, 100, 1);
+        tradeList.recordNewTrade(uint256S("14"), addressA, 3, 6, 200, 1);
+        // same layout, but not a trade
+        tradeList.recordNewTransfer(uint256S("15"), addressA, addressB, 300, 1);
+    }
+
+    // reopening keeps the index
+    {
+        CMPTradeList tradeList(path, false);
+
+        std::vector<uint256> vecTransactions;
+        tradeList.getTradesForAddress(addressA, vecTransactions);
+        BOOST_CHECK_EQUAL(vecTransactions.size(), 3);
+        if (vecTransactions.size() == 3) {
+            // in block order
+            BOOST_CHECK(vecTransactions[0] == uint256S("12"));
+            BOOST_CHECK(vecTransactions[1] == uint256S("14"));
+            BOOST_CHECK(vecTransactions[2] == uint256S("11"));
+        }
+
+        vecTransactions.clear();
+        tradeList.getTradesForAddress(addressA, vecTransactions, 3);
+        BOOST_CHECK_EQUAL(vecTransactions.size(), 2);
+
+        vecTransactions.clear();
+        tradeList.getTradesForAddress(addressB, vecTransactions);
+        BOOST_CHECK_EQUAL(vecTransactions.size(), 1);
+
+        vecTransactions.clear();
+        tradeList.getTradesForAddress(addressB.substr(0, 10), vecTransactions);
+        BOOST_CHECK(vecTransactions.empty());
+
+        // a trade mined again at another block after a reorg is listed once
+        tradeList.recordNewTrade(uint256S("13"), addressB, 3, 4, 250, 1);
+        vecTransactions.clear();
+        tradeList.getTradesForAddress(addressB, vecTransactions);
+        BOOST_CHECK_EQUAL(vecTransactions.size(), 1);
+    }
+
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(contract_trade_record)
+{
+    // text record of older clients
+    const std::string strValue = "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS:QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS:"
+        "1000000000:3:5:200:201:OpenLongPosition:OpenShortPosition:-1:4:7:"
+        "00000000000000000000000000000000000000000000000000000000000000aa:"
+        "3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a3a:3:18446744073709551615:0";
+    std::vector<std::string> vstr;
+    boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
+
+    ContractTradeRecord record;
+    BOOST_CHECK(record.parseText(vstr));
+
+    const std::string encoded = record.encode();
+    BOOST_CHECK(DBRecordReader::IsRecord(encoded));
+    BOOST_CHECK(encoded.size() < strValue.size());
+    // text scans split at ':', so binary records must never contain one
+    BOOST_CHECK(encoded.find(':') == std::string::npos);
+
+    ContractTradeRecord decoded;
+    BOOST_CHECK(decoded.decode(encoded));
+    BOOST_CHECK_EQUAL(decoded.makerAddress, "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS");
+    BOOST_CHECK_EQUAL(decoded.takerAddress, "QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS");
+    BOOST_CHECK_EQUAL(decoded.effectivePrice, 1000000000);
+    BOOST_CHECK_EQUAL(decoded.blockMaker, 200);
+    BOOST_CHECK_EQUAL(decoded.blockTaker, 201);
+    BOOST_CHECK_EQUAL(decoded.takerStatus, "OpenShortPosition");
+    BOOST_CHECK_EQUAL(decoded.makerLives, -1);
+    BOOST_CHECK_EQUAL(decoded.contractId, 7);
+    BOOST_CHECK_EQUAL(decoded.makerTxid.ToString(), vstr[12]);
+    BOOST_CHECK_EQUAL(decoded.takerTxid.ToString(), vstr[13]);
+    BOOST_CHECK_EQUAL(decoded.amountTraded, 3);
+    BOOST_CHECK_EQUAL(decoded.amountOld, std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK_EQUAL(decoded.amountNew, 0);
+
+    // truncated records and text records are rejected
+    BOOST_CHECK(!decoded.decode(encoded.substr(0, encoded.size() - 1)));
+    BOOST_CHECK(!decoded.decode(strValue));
+    vstr[11] = "x";
+    BOOST_CHECK(!record.parseText(vstr));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,8 +1,18 @@
 #include <test/test_bitcoin.h>
+#include <tradelayer/ce.h>
+#include <tradelayer/consensushash.h>
 #include <tradelayer/register.h>
+#include <tradelayer/sp.h>
+#include <tradelayer/tradelayer.h>
+#include <tradelayer/tx.h>
+
+#include <fs.h>
+#include <sync.h>
+#include <uint256.h>
 
 #include <boost/test/unit_test.hpp>
 #include <stdint.h>
+#include <string>
 
 BOOST_FIXTURE_TEST_SUITE(tradelayer_register_tests, BasicTestingSetup)
 
@@ -143,4 +153,249 @@ BOOST_AUTO_TEST_CASE(decrease_changing_position)
 }
 
 
+BOOST_AUTO_TEST_CASE(position_index)
+{
+    using namespace mastercore;
+
+    const uint32_t contractId = 5;
+    const std::string alice = "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS";
+    const std::string bob = "QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS";
+
+    clear_register_map();
+
+    BOOST_CHECK(update_register_map(alice, contractId, 100, CONTRACT_POSITION));
+    BOOST_CHECK(update_register_map(bob, contractId, -100, CONTRACT_POSITION));
+    BOOST_CHECK(update_register_map(bob, contractId, 5000, MARGIN));
+
+    BOOST_CHECK_EQUAL(mp_contract_positions.count(contractId), 1);
+    const ContractPositions& positions = mp_contract_positions[contractId];
+    BOOST_CHECK_EQUAL(positions.holders.size(), 2);
+    BOOST_CHECK_EQUAL(positions.longs, 100);
+    BOOST_CHECK_EQUAL(positions.shorts, -100);
+
+    // flipping sides
+    BOOST_CHECK(update_register_map(bob, contractId, 150, CONTRACT_POSITION));
+    BOOST_CHECK(update_register_map(alice, contractId, -150, CONTRACT_POSITION));
+    BOOST_CHECK_EQUAL(positions.longs, 50);
+    BOOST_CHECK_EQUAL(positions.shorts, -50);
+
+    // closing positions
+    BOOST_CHECK(update_register_map(alice, contractId, 50, CONTRACT_POSITION));
+    BOOST_CHECK_EQUAL(positions.holders.size(), 1);
+    BOOST_CHECK_EQUAL(positions.holders.count(bob), 1);
+
+    // unsettled PNL keeps the contract in the index
+    BOOST_CHECK(update_register_map(alice, contractId, 300, PNL));
+    BOOST_CHECK(update_register_map(bob, contractId, -50, CONTRACT_POSITION));
+    BOOST_CHECK(positions.holders.empty());
+    BOOST_CHECK_EQUAL(positions.unsettled.count(alice), 1);
+    BOOST_CHECK_EQUAL(positions.longs, 0);
+    BOOST_CHECK_EQUAL(positions.shorts, 0);
+
+    BOOST_CHECK(update_register_map(alice, contractId, 0, PNL));
+    BOOST_CHECK_EQUAL(mp_contract_positions.count(contractId), 0);
+
+    clear_register_map();
+    BOOST_CHECK(mp_register_map.empty());
+}
+
+BOOST_AUTO_TEST_CASE(account_id_updates)
+{
+    using namespace mastercore;
+
+    const uint32_t contractId = 5;
+    const std::string alice = "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS";
+    const AccountId account = InternAddress(alice);
+
+    clear_register_map();
+
+    // updates by id reach the same register as updates by address
+    BOOST_CHECK(update_register_map(account, contractId, 100, CONTRACT_POSITION));
+    BOOST_CHECK(update_register_map(alice, contractId, 20, CONTRACT_POSITION));
+    BOOST_CHECK_EQUAL(getContractRecord(alice, contractId, CONTRACT_POSITION), 120);
+    BOOST_CHECK_EQUAL(getContractRecord(account, contractId, CONTRACT_POSITION), 120);
+    BOOST_CHECK(!update_register_map(account, contractId, 0, MARGIN));
+
+    // the position index carries the id along
+    const ContractPositions& positions = mp_contract_positions[contractId];
+    BOOST_CHECK_EQUAL(positions.holders.size(), 1);
+    BOOST_CHECK(positions.holders.begin()->first == alice);
+    BOOST_CHECK_EQUAL(positions.holders.begin()->second, account);
+
+    clear_register_map();
+}
+
+BOOST_AUTO_TEST_CASE(position_revision)
+{
+    Register reg;
+    BOOST_CHECK_EQUAL(0, reg.getRevision(1));
+
+    BOOST_CHECK(reg.updateRecord(1, 5000, MARGIN));
+    BOOST_CHECK_EQUAL(0, reg.getRevision(1));
+
+    BOOST_CHECK(reg.updateRecord(1, 10, CONTRACT_POSITION));
+    BOOST_CHECK_EQUAL(1, reg.getRevision(1));
+
+    BOOST_CHECK(reg.insertEntry(1, 10, 200000000));
+    BOOST_CHECK_EQUAL(2, reg.getRevision(1));
+
+    BOOST_CHECK(reg.insertEntry(2, 10, 200000000));
+    BOOST_CHECK_EQUAL(1, reg.getRevision(2));
+    BOOST_CHECK_EQUAL(2, reg.getRevision(1));
+
+    // native contracts have no mark price yet
+    BOOST_CHECK_EQUAL(reg.computeUPNL(1, 1), reg.getUPNL(1, 1));
+    BOOST_CHECK_EQUAL(2, reg.getRevision(1));
+
+    // so does closing entries, which realizes PNL in the global state
+    BOOST_CHECK(reg.decreasePosRecord("QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS", 1, 5, 200000000, false, 1));
+    BOOST_CHECK_EQUAL(3, reg.getRevision(1));
+    mastercore::clear_register_map();
+    mastercore::clear_tally_map();
+}
+
+/** Settlement as it was done before the position index, visiting every register. */
+static void settleAllRegisters(uint32_t contractId, uint32_t notionalSize, uint32_t collateral)
+{
+    using namespace mastercore;
+
+    LOCK(cs_register);
+
+    for (auto it = mp_register_map.begin(); it != mp_register_map.end(); ++it)
+    {
+        const std::string& who = it->first;
+        Register& reg = it->second;
+        const int64_t upnl = reg.getUPNL(contractId, notionalSize, true, false);
+        const int64_t oldPNL = reg.getRecord(contractId, PNL);
+        const int64_t newUPNL = upnl - oldPNL;
+
+        if (0 != newUPNL)
+        {
+            update_register_map(who, contractId, newUPNL, MARGIN);
+            update_register_map(who, contractId, newUPNL + oldPNL, PNL);
+            update_tally_map(who, collateral, newUPNL, BALANCE);
+        }
+    }
+}
+
+/** Settles a contract twice, the second time after one of its positions was closed. */
+static uint256 settleClosedPosition(bool fIndexed)
+{
+    using namespace mastercore;
+
+    const uint32_t contractId = 1;
+    const uint32_t notionalSize = COIN;
+    const uint32_t collateral = TL_PROPERTY_ALL;
+    const std::string alice = "QPSHCSxXtuZh6Ge7JR4oEEz5XnagAvswjS";
+    const std::string bob = "QfNvPCyKs8jS5e8mj5NVi9KBmRdQxu86yS";
+
+    clear_register_map();
+    clear_tally_map();
+
+    update_tally_map(alice, collateral, 1000 * COIN, BALANCE);
+    update_tally_map(bob, collateral, 1000 * COIN, BALANCE);
+
+    update_register_map(alice, contractId, 100, CONTRACT_POSITION);
+    mastercore::insert_entry(alice, contractId, 100, 90 * COIN);
+    update_register_map(bob, contractId, -100, CONTRACT_POSITION);
+    // entries hold the traded amount, also of short positions
+    mastercore::insert_entry(bob, contractId, 100, 90 * COIN);
+
+    if (fIndexed) {
+        settlement_pnl(contractId, notionalSize, true, false, collateral);
+    } else {
+        settleAllRegisters(contractId, notionalSize, collateral);
+    }
+
+    // bob closes, but keeps the UPNL record of the last settlement
+    update_register_map(bob, contractId, 100, CONTRACT_POSITION);
+    BOOST_CHECK(getContractRecord(bob, contractId, UPNL) != 0);
+
+    if (fIndexed) {
+        BOOST_CHECK_EQUAL(mp_contract_positions[contractId].marked.count(bob), 1);
+        settlement_pnl(contractId, notionalSize, true, false, collateral);
+    } else {
+        settleAllRegisters(contractId, notionalSize, collateral);
+    }
+
+    return GetConsensusHash();
+}
+
+BOOST_AUTO_TEST_CASE(settlement_consensus_hash)
+{
+    using namespace mastercore;
+
+    const fs::path path = fs::temp_directory_path() / fs::unique_path("tl_settlement_%%%%%%%%");
+    _my_sps = new CMPSPInfo(path / "OCL_spinfo", true);
+    _my_cds = new CDInfo(path / "OCL_cdinfo", true);
+    t_tradelistdb = new CMPTradeList(path / "OCL_tradelist", true);
+
+    const oracledata price = { 100 * COIN, 100 * COIN, 100 * COIN, 1 };
+    oraclePrices[1][100] = price;
+    invalidateOracleTwap(1);
+
+    const uint256 indexed = settleClosedPosition(true);
+    const uint256 scanned = settleClosedPosition(false);
+    BOOST_CHECK_EQUAL(indexed.GetHex(), scanned.GetHex());
+
+    clear_register_map();
+    clear_tally_map();
+    oraclePrices.erase(1);
+    clearOracleTwapCache();
+
+    delete t_tradelistdb; t_tradelistdb = nullptr;
+    delete _my_cds; _my_cds = nullptr;
+    delete _my_sps; _my_sps = nullptr;
+    fs::remove_all(path);
+}
+
+BOOST_AUTO_TEST_CASE(state_hash_changes)
+{
+    using namespace mastercore;
+
+    const fs::path path = fs::temp_directory_path() / fs::unique_path("tl_statehash_%%%%%%%%");
+    _my_sps = new CMPSPInfo(path / "OCL_spinfo", true);
+    _my_cds = new CDInfo(path / "OCL_cdinfo", true);
+    t_tradelistdb = new CMPTradeList(path / "OCL_tradelist", true);
+
+    const std::string alice = "QeS6SyFBXXJYFXpuU56aK1VyGHnVhHbBpB";
+    const std::string bob = "QhqFbHRyRUdxXKfbkHj8j4VsuXYE9qHwHY";
+
+    update_tally_map(alice, 4, 100, BALANCE);
+    update_tally_map(bob, 5, 200, BALANCE);
+    update_register_map(bob, 7, 10, CONTRACT_POSITION);
+    const uint256 initial = GetStateHash();
+    BOOST_CHECK_EQUAL(GetStateHash().GetHex(), initial.GetHex());
+
+    // a changed balance or register changes the hash, and reverting it restores it
+    update_tally_map(alice, 4, 1, BALANCE);
+    const uint256 credited = GetStateHash();
+    BOOST_CHECK(credited != initial);
+    update_tally_map(alice, 4, -1, BALANCE);
+    BOOST_CHECK_EQUAL(GetStateHash().GetHex(), initial.GetHex());
+
+    update_register_map(bob, 7, -10, CONTRACT_POSITION);
+    BOOST_CHECK(GetStateHash() != initial);
+    update_register_map(bob, 7, 10, CONTRACT_POSITION);
+    BOOST_CHECK_EQUAL(GetStateHash().GetHex(), initial.GetHex());
+
+    // the same state, rebuilt in another order, has the same hash
+    const uint256 consensus = GetConsensusHash();
+    clear_register_map();
+    clear_tally_map();
+    update_register_map(bob, 7, 10, CONTRACT_POSITION);
+    update_tally_map(bob, 5, 200, BALANCE);
+    update_tally_map(alice, 4, 100, BALANCE);
+    BOOST_CHECK_EQUAL(GetStateHash().GetHex(), initial.GetHex());
+    BOOST_CHECK_EQUAL(GetConsensusHash().GetHex(), consensus.GetHex());
+
+    clear_register_map();
+    clear_tally_map();
+
+    delete t_tradelistdb; t_tradelistdb = nullptr;
+    delete _my_cds; _my_cds = nullptr;
+    delete _my_sps; _my_sps = nullptr;
+    fs::remove_all(path);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
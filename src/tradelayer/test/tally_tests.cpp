@@ -1,8 +1,10 @@
 #include <test/test_bitcoin.h>
 #include <tradelayer/tally.h>
+#include <tradelayer/tradelayer.h>
 
 #include <boost/test/unit_test.hpp>
 #include <stdint.h>
+#include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(tradelayer_tally_tests, BasicTestingSetup)
 
@@ -323,5 +325,72 @@ BOOST_AUTO_TEST_CASE(tally_overflow)
 
 }
 
+BOOST_AUTO_TEST_CASE(tally_records)
+{
+    CMPTally tally;
+    BOOST_CHECK(tally.begin() == tally.end());
+    BOOST_CHECK(tally.getRecord(3) == nullptr);
+
+    BOOST_CHECK(tally.updateMoney(7, 70, BALANCE));
+    BOOST_CHECK(tally.updateMoney(3, 30, PENDING));
+    BOOST_CHECK(tally.updateMoney(5, 50, METADEX_RESERVE));
+
+    // records are sorted by property
+    std::vector<uint32_t> ids;
+    for (const CMPTally::BalanceRecord& record : tally) {
+        ids.push_back(record.propertyId);
+    }
+    BOOST_CHECK(ids == std::vector<uint32_t>({3, 5, 7}));
+
+    BOOST_CHECK(tally.hasProperty(5));
+    BOOST_CHECK(!tally.hasProperty(4));
+    BOOST_CHECK_EQUAL(50, tally.getRecord(5)->balance[METADEX_RESERVE]);
+    BOOST_CHECK_EQUAL(0, tally.getRecord(5)->balance[BALANCE]);
+
+    // records inserted before the internal iterator are skipped, like with a map
+    BOOST_CHECK_EQUAL(3U, tally.init());
+    BOOST_CHECK_EQUAL(3U, tally.next());
+    BOOST_CHECK(tally.updateMoney(4, 40, BALANCE));
+    BOOST_CHECK(tally.updateMoney(6, 60, BALANCE));
+    BOOST_CHECK_EQUAL(5U, tally.next());
+    BOOST_CHECK_EQUAL(6U, tally.next());
+    BOOST_CHECK_EQUAL(7U, tally.next());
+    BOOST_CHECK_EQUAL(0U, tally.next());
+}
+
+BOOST_AUTO_TEST_CASE(property_supply)
+{
+    using namespace mastercore;
+
+    clear_tally_map();
+    const uint32_t propertyId = 5;
+
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", propertyId, 100, BALANCE));
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", propertyId, 40, METADEX_RESERVE));
+    BOOST_CHECK(update_tally_map("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", propertyId, -20, PENDING));
+
+    const PropertySupply& supply = mp_property_supply[propertyId];
+    BOOST_CHECK_EQUAL(100, supply.totals[BALANCE]);
+    BOOST_CHECK_EQUAL(40, supply.totals[METADEX_RESERVE]);
+    BOOST_CHECK_EQUAL(-20, supply.totals[PENDING]);
+    BOOST_CHECK_EQUAL(2U, supply.holders.size());
+    // pending balances don't count towards the supply
+    BOOST_CHECK_EQUAL(1, supply.owners);
+
+    BOOST_CHECK(update_tally_map("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", propertyId, 20, PENDING));
+    BOOST_CHECK_EQUAL(1U, supply.holders.size());
+    BOOST_CHECK_EQUAL(0, supply.totals[PENDING]);
+
+    // rejected updates don't change the index
+    BOOST_CHECK(!update_tally_map("QZgVN7xQPDqUs5TwnwpMbNUbSm8upJ7gQk", propertyId, 1, static_cast<TallyType>(TALLY_TYPE_COUNT)));
+    BOOST_CHECK_EQUAL(1U, supply.holders.size());
+
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", propertyId, -100, BALANCE));
+    BOOST_CHECK(update_tally_map("QPhPB3nr2tJcEmhFf6jkEG9gtCKCi6UWRG", propertyId, -40, METADEX_RESERVE));
+    BOOST_CHECK(mp_property_supply.find(propertyId) == mp_property_supply.end());
+
+    clear_tally_map();
+    BOOST_CHECK(mp_property_supply.empty());
+}
 
 BOOST_AUTO_TEST_SUITE_END()
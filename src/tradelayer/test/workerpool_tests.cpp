@@ -0,0 +1,45 @@
+#include <tradelayer/workerpool.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tradelayer_workerpool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(run_all_tasks)
+{
+    WorkerPool pool(3);
+    BOOST_CHECK(pool.size() <= 3);
+
+    // the same workers serve several passes
+    for (int pass = 0; pass < 10; ++pass) {
+        std::vector<size_t> results(100, 0);
+        pool.run(results.size(), [&results](size_t n) { results[n] += n; });
+
+        for (size_t n = 0; n < results.size(); ++n) {
+            BOOST_CHECK_EQUAL(results[n], n);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(run_after_stop)
+{
+    WorkerPool pool(2);
+    pool.stop();
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+
+    std::atomic<int> nRun(0);
+    pool.run(5, [&nRun](size_t n) { ++nRun; });
+    BOOST_CHECK_EQUAL(nRun, 5);
+
+    pool.run(0, [&nRun](size_t n) { ++nRun; });
+    BOOST_CHECK_EQUAL(nRun, 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,8 +6,10 @@
 
 #include <tradelayer/tradelayer.h>
 #include <tradelayer/activation.h>
+#include <tradelayer/blockprefetch.h>
 #include <tradelayer/consensushash.h>
 #include <tradelayer/convert.h>
+#include <tradelayer/dbrecord.h>
 #include <tradelayer/dex.h>
 #include <tradelayer/ce.h>
 #include <tradelayer/encoding.h>
@@ -23,7 +25,10 @@
 #include <tradelayer/register.h>
 #include <tradelayer/rules.h>
 #include <tradelayer/script.h>
+#include <tradelayer/snapshot.h>
 #include <tradelayer/sp.h>
+#include <tradelayer/statechanges.h>
+#include <tradelayer/statewriter.h>
 #include <tradelayer/fees.h>
 #include <tradelayer/tally.h>
 #include <tradelayer/tradelayer_matrices.h>
@@ -33,6 +38,7 @@
 #include <tradelayer/version.h>
 #include <tradelayer/walletcache.h>
 #include <tradelayer/wallettxs.h>
+#include <tradelayer/workerpool.h>
 #include <tradelayer/tupleutils.hpp>
 
 #include <tradelayer/insurancefund.h>
@@ -44,6 +50,7 @@
 #include <consensus/params.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <core_io.h>
 #include <init.h>
 #include <net.h> // for g_connman.get()
@@ -69,17 +76,25 @@
 #endif
 
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
 
 #include <assert.h>
+#include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <set>
+#include <sstream>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <univalue.h>
 #include <unordered_map>
 #include <vector>
@@ -140,6 +155,9 @@ static int mastercoreInitialized = 0;
 static int reorgRecoveryMode = 0;
 static int reorgRecoveryMaxHeight = 0;
 
+//! Liquidation workers, started by the first large pass and joined at shutdown
+static std::unique_ptr<WorkerPool> liquidationWorkers;
+
 int idx_expiration;
 int expirationAchieve;
 double globalPNLALL_DUSD;
@@ -166,10 +184,8 @@ blocksettlement bS;
 
 std::map<uint32_t, std::map<uint32_t, int64_t>> VWAPMap;
 std::map<uint32_t, std::map<uint32_t, int64_t>> VWAPMapSubVector;
-std::map<uint32_t, std::map<uint32_t, std::vector<int64_t>>> numVWAPVector;
-std::map<uint32_t, std::map<uint32_t, std::vector<int64_t>>> denVWAPVector;
-std::map<uint32_t, std::vector<int64_t>> mapContractAmountTimesPrice;
-std::map<uint32_t, std::vector<int64_t>> mapContractVolume;
+std::map<uint32_t, std::map<uint32_t, VWAPWindow>> tokenVWAPWindows;
+std::map<uint32_t, VWAPWindow> contractVWAPWindows;
 std::map<uint32_t, int64_t> VWAPMapContracts;
 std::vector<std::map<std::string, std::string>> path_ele;
 std::vector<std::map<std::string, std::string>> path_elef;
@@ -362,12 +378,64 @@ long int FormatShortIntegerMP(int64_t n)
     return q;
 }
 
-// this is the master list of all amounts for all addresses for all properties, map is unsorted
-std::unordered_map<std::string, CMPTally> mastercore::mp_tally_map;
+// this is the master list of all amounts for all addresses for all properties, in insertion order
+mastercore::AccountMap<CMPTally> mastercore::mp_tally_map;
+
+// holders and running supply totals by property, kept in sync with the tallies
+std::map<uint32_t, PropertySupply> mastercore::mp_property_supply;
+
+void mastercore::clear_tally_map()
+{
+    LOCK(cs_tally);
+    mp_tally_map.clear();
+    mp_property_supply.clear();
+    MarkBalancesCleared();
+}
+
+//! Sum of the tally types, which count towards the supply of a property
+static int64_t getSupplyBalance(const CMPTally::BalanceRecord* record)
+{
+    if (record == nullptr) return 0;
+
+    return record->balance[BALANCE] + record->balance[SELLOFFER_RESERVE] + record->balance[ACCEPT_RESERVE] +
+           record->balance[METADEX_RESERVE] + record->balance[CONTRACTDEX_RESERVE]; // amount in margin
+}
+
+static bool isEmptyRecord(const CMPTally::BalanceRecord* record)
+{
+    if (record == nullptr) return true;
+
+    return std::all_of(record->balance, record->balance + TALLY_TYPE_COUNT, [](int64_t balance) { return balance == 0; });
+}
+
+static void updateSupplyIndex(const std::string& who, uint32_t propertyId, TallyType ttype, int64_t before, int64_t after,
+                              bool fWasHolder, bool fWasOwner, const CMPTally::BalanceRecord* record)
+{
+    PropertySupply& supply = mp_property_supply[propertyId];
+    supply.totals[ttype] += after - before;
+
+    const bool fHolder = !isEmptyRecord(record);
+    if (fHolder != fWasHolder) {
+        if (fHolder) {
+            supply.holders.insert(who);
+        } else {
+            supply.holders.erase(who);
+        }
+    }
+
+    const bool fOwner = (getSupplyBalance(record) != 0);
+    if (fOwner != fWasOwner) {
+        supply.owners += fOwner ? 1 : -1;
+    }
+
+    if (supply.holders.empty()) {
+        mp_property_supply.erase(propertyId);
+    }
+}
 
 CMPTally* mastercore::getTally(const std::string& address)
 {
-    std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.find(address);
+    AccountMap<CMPTally>::iterator it = mp_tally_map.find(address);
     if (it != mp_tally_map.end()) return &(it->second);
     return static_cast<CMPTally*>(nullptr);
 }
@@ -381,7 +449,23 @@ int64_t getMPbalance(const std::string& address, uint32_t propertyId, TallyType
     }
 
     LOCK(cs_tally);
-    const std::unordered_map<std::string, CMPTally>::iterator my_it = mp_tally_map.find(address);
+    const AccountMap<CMPTally>::iterator my_it = mp_tally_map.find(address);
+    if (my_it != mp_tally_map.end()) {
+        balance = (my_it->second).getMoney(propertyId, ttype);
+    }
+
+    return balance;
+}
+
+int64_t getMPbalance(AccountId account, uint32_t propertyId, TallyType ttype)
+{
+    int64_t balance = 0;
+    if (TALLY_TYPE_COUNT <= ttype) {
+        return 0;
+    }
+
+    LOCK(cs_tally);
+    const AccountMap<CMPTally>::iterator my_it = mp_tally_map.find(account);
     if (my_it != mp_tally_map.end()) {
         balance = (my_it->second).getMoney(propertyId, ttype);
     }
@@ -425,7 +509,6 @@ std::string mastercore::getTokenLabel(uint32_t propertyId)
 // optionally counts the number of addresses who own that property: n_owners_total
 int64_t mastercore::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
 {
-  int64_t prev = 0;
   int64_t owners = 0;
   int64_t totalTokens = 0;
 
@@ -436,19 +519,15 @@ int64_t mastercore::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
     return 0; // property ID does not exist
   }
 
-  if (!property.fixed || n_owners_total) {
-    for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-      const CMPTally& tally = it->second;
-      totalTokens += tally.getMoney(propertyId, BALANCE);
-      totalTokens += tally.getMoney(propertyId, SELLOFFER_RESERVE);
-      totalTokens += tally.getMoney(propertyId, ACCEPT_RESERVE);
-      totalTokens += tally.getMoney(propertyId, METADEX_RESERVE);
-      totalTokens += tally.getMoney(propertyId, CONTRACTDEX_RESERVE); // amount in margin
-      if (prev != totalTokens) {
-	      prev = totalTokens;
-	      owners++;
-      }
-    }
+  std::map<uint32_t, PropertySupply>::const_iterator it = mp_property_supply.find(propertyId);
+  if (it != mp_property_supply.end()) {
+    const PropertySupply& supply = it->second;
+    totalTokens += supply.totals[BALANCE];
+    totalTokens += supply.totals[SELLOFFER_RESERVE];
+    totalTokens += supply.totals[ACCEPT_RESERVE];
+    totalTokens += supply.totals[METADEX_RESERVE];
+    totalTokens += supply.totals[CONTRACTDEX_RESERVE]; // amount in margin
+    owners = supply.owners;
   }
 
   if (property.fixed) {
@@ -461,35 +540,51 @@ int64_t mastercore::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
 }
 
 // return true if everything is ok
-bool mastercore::update_tally_map(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype)
+bool mastercore::update_money_onmap(const std::string& who, CMPTally& tally, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
+    AssertLockHeld(cs_tally);
+
+    const CMPTally::BalanceRecord* record = tally.getRecord(propertyId);
+    const bool fWasHolder = !isEmptyRecord(record);
+    const bool fWasOwner = (getSupplyBalance(record) != 0);
+
+    const int64_t before = tally.getMoney(propertyId, ttype);
+    const bool bRet = tally.updateMoney(propertyId, amount, ttype);
+    const int64_t after = tally.getMoney(propertyId, ttype);
+
+    if (before != after) {
+        updateSupplyIndex(who, propertyId, ttype, before, after, fWasHolder, fWasOwner, tally.getRecord(propertyId));
+        MarkBalancesChanged(who);
+    }
+
+    return bRet;
+}
+
+static bool isValidTallyUpdate(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype)
 {
     if (0 == amount) {
-        PrintToLog("%s(%s, %u=0x%X, %+d, ttype=%d) ERROR: amount to credit or debit is zero\n", __func__, who, propertyId, propertyId, amount, ttype);
+        PrintToLog("update_tally_map(%s, %u=0x%X, %+d, ttype=%d) ERROR: amount to credit or debit is zero\n", who, propertyId, propertyId, amount, ttype);
         return false;
     }
     if (ttype >= TALLY_TYPE_COUNT) {
-        PrintToLog("%s(%s, %u=0x%X, %+d, ttype=%d) ERROR: invalid tally type\n", __func__, who, propertyId, propertyId, amount, ttype);
+        PrintToLog("update_tally_map(%s, %u=0x%X, %+d, ttype=%d) ERROR: invalid tally type\n", who, propertyId, propertyId, amount, ttype);
         return false;
     }
 
+    return true;
+}
+
+// Updates the tally of an address, once it's resolved, requires cs_tally
+static bool updateTallyEntry(const std::string& who, CMPTally& tally, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
     bool bRet = false;
     int64_t before = 0;
     int64_t after = 0;
 
-    LOCK(cs_tally);
-
-    before = getMPbalance(who, propertyId, ttype);
-
-    std::unordered_map<std::string, CMPTally>::iterator my_it = mp_tally_map.find(who);
-    if (my_it == mp_tally_map.end()) {
-        // insert an empty element
-        my_it = (mp_tally_map.insert(std::make_pair(who, CMPTally()))).first;
-    }
-
-    CMPTally& tally = my_it->second;
-    bRet = tally.updateMoney(propertyId, amount, ttype);
+    before = tally.getMoney(propertyId, ttype);
+    bRet = update_money_onmap(who, tally, propertyId, amount, ttype);
+    after = tally.getMoney(propertyId, ttype);
 
-    after = getMPbalance(who, propertyId, ttype);
     if (!bRet) {
         assert(before == after);
         PrintToLog("%s(%s, %u=0x%X, %+d, ttype=%d) ERROR: insufficient balance (=%d)\n", __func__, who, propertyId, propertyId, amount, ttype, before);
@@ -501,6 +596,32 @@ bool mastercore::update_tally_map(const std::string& who, uint32_t propertyId, i
     return bRet;
 }
 
+bool mastercore::update_tally_map(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
+    if (!isValidTallyUpdate(who, propertyId, amount, ttype)) {
+        return false;
+    }
+
+    LOCK(cs_tally);
+
+    // the address is resolved once, an empty element is inserted, if there is none
+    return updateTallyEntry(who, mp_tally_map[who], propertyId, amount, ttype);
+}
+
+bool mastercore::update_tally_map(AccountId account, uint32_t propertyId, int64_t amount, TallyType ttype)
+{
+    if ((0 == amount || ttype >= TALLY_TYPE_COUNT) && !isValidTallyUpdate(GetAccountAddress(account), propertyId, amount, ttype)) {
+        return false;
+    }
+
+    LOCK(cs_tally);
+
+    // the entry holds the address, which is only needed for the supply index and the logs
+    const AccountMap<CMPTally>::iterator it = mp_tally_map.findOrInsert(account);
+
+    return updateTallyEntry(it->first, it->second, propertyId, amount, ttype);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 // some old TODOs
@@ -553,7 +674,7 @@ void CheckWalletUpdate(bool forceUpdate)
      global_balance_money.clear();
 
     // populate global balance totals and wallet property list - note global balances do not include additional balances from watch-only addresses
-    for (std::unordered_map<std::string, CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
+    for (AccountMap<CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
         // check if the address is a wallet address (including watched addresses)
         std::string address = my_it->first;
         int addressIsMine = IsMyAddress(address);
@@ -651,24 +772,80 @@ void creatingVestingTokens(int block)
    if (RegTest()) update_tally_map(getVestingAdmin(), ALL, totalVesting, BALANCE);
 }
 
+/**
+ * Returns true, if the marker bytes appear anywhere in the script.
+ *
+ * Used to drop non- Trade Layer transactions without decoding their outputs.
+ */
+static bool HasMarkerBytes(const CScript& script, const std::vector<unsigned char>& vchMarker)
+{
+    const unsigned char* p = script.data();
+    const unsigned char* end = p + script.size();
+    const size_t nMarker = vchMarker.size();
+
+    while (static_cast<size_t>(end - p) >= nMarker) {
+        p = static_cast<const unsigned char*>(memchr(p, vchMarker[0], (end - p) - nMarker + 1));
+        if (p == nullptr) return false;
+        if (memcmp(p, vchMarker.data(), nMarker) == 0) return true;
+        ++p;
+    }
+
+    return false;
+}
+
+/**
+ * Returns true, if the first pushed element equals, or starts with the marker.
+ *
+ * Like GetScriptPushes(), the whole script must be parsable, but the pushed
+ * data is compared in place.
+ */
+static bool StartsWithMarker(const CScript& script, const std::vector<unsigned char>& vchMarker)
+{
+    bool fFound = false;
+    bool fFirst = true;
+    CScript::const_iterator pc = script.begin();
+
+    while (pc < script.end()) {
+        CScript::const_iterator pcOp = pc;
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode)) {
+            return false;
+        }
+        if (!fFirst || opcode > OP_PUSHDATA4) {
+            continue;
+        }
+        fFirst = false;
+
+        // skip the opcode and the size of the push
+        size_t nHeader = 1;
+        if (opcode == OP_PUSHDATA1) nHeader += 1;
+        else if (opcode == OP_PUSHDATA2) nHeader += 2;
+        else if (opcode == OP_PUSHDATA4) nHeader += 4;
+        const CScript::const_iterator pcData = pcOp + nHeader;
+
+        fFound = static_cast<size_t>(pc - pcData) >= vchMarker.size() &&
+                 std::equal(vchMarker.begin(), vchMarker.end(), pcData);
+    }
+
+    return fFound;
+}
+
 /**
  * Returns the encoding class, used to embed a payload.
  *    Class D (op-return compressed)
  */
 int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
 {
+    static const std::vector<unsigned char> vchMarker = GetTLMarker();
     bool hasOpReturn = false;
 
     /* Fast Search
-     * Perform a string comparison on hex for each scriptPubKey & look directly for Trade Layer marker bytes
+     * Look directly for Trade Layer marker bytes in each scriptPubKey
      * This allows to drop non- Trade Layer transactions with less work
      */
-    std::string strClassD = "7462"; /*the tt marker*/
     bool examineClosely = false;
     for (unsigned int n = 0; n < tx.vout.size(); ++n) {
-        const CTxOut& output = tx.vout[n];
-        std::string strSPB = HexStr(output.scriptPubKey.begin(), output.scriptPubKey.end());
-        if (strSPB.find(strClassD) != std::string::npos) {
+        if (HasMarkerBytes(tx.vout[n].scriptPubKey, vchMarker)) {
             examineClosely = true;
             break;
         }
@@ -694,21 +871,9 @@ int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
 
         if (outType == TX_NULL_DATA) {
             // Ensure there is a payload, and the first pushed element equals,
-            // or starts with the "tl" marker
-            std::vector<std::string> scriptPushes;
-            if (!GetScriptPushes(output.scriptPubKey, scriptPushes)) {
-                continue;
-            }
-
-            if (!scriptPushes.empty()) {
-                std::vector<unsigned char> vchMarker = GetTLMarker();
-                std::vector<unsigned char> vchPushed = ParseHex(scriptPushes[0]);
-                if (vchPushed.size() < vchMarker.size()) {
-                    continue;
-                }
-                if (std::equal(vchMarker.begin(), vchMarker.end(), vchPushed.begin())) {
-                    hasOpReturn = true;
-                }
+            // or starts with the "tb" marker
+            if (StartsWithMarker(output.scriptPubKey, vchMarker)) {
+                hasOpReturn = true;
             }
         }
     }
@@ -722,6 +887,24 @@ int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
     return NO_MARKER;
 }
 
+/**
+ * Returns the encoding classes of all transactions of a block.
+ *
+ * @return The number of transactions with Trade Layer marker
+ */
+unsigned int mastercore::GetEncodingClasses(const CBlock& block, int nBlock, std::vector<int>& vClasses)
+{
+    unsigned int nFound = 0;
+    vClasses.resize(block.vtx.size());
+
+    for (size_t n = 0; n < block.vtx.size(); ++n) {
+        vClasses[n] = GetEncodingClass(*block.vtx[n], nBlock);
+        if (vClasses[n] != NO_MARKER) ++nFound;
+    }
+
+    return nFound;
+}
+
 // TODO: move
 CCoinsView mastercore::viewDummy;
 CCoinsViewCache mastercore::view(&viewDummy);
@@ -1149,7 +1332,7 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
     p_txlistdb->recordNewInstantLTCTrade(txid, sender, seller , buyer, property, amount_purchased, price, block, idx);
 
     // saving DEx token volume
-    MapTokenVolume[block][property] += amount_purchased;
+    MapTokenVolume.add(block, property, amount_purchased);
 
     const arith_uint256 unitPrice256 = (isPropertyDivisible(property)) ? (ConvertTo256(COIN) * amountLTC_Desired256) / amount_forsale256 : amountLTC_Desired256 / amount_forsale256;
 
@@ -1162,7 +1345,7 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
     tokenvwap[property][block].push_back(std::make_pair(unitPrice, nvalue));
 
     // adding LTC volume to map
-    MapLTCVolume[block][property] += nvalue;
+    MapLTCVolume.add(block, property, nvalue);
 
     // adding LTC to global
     globalVolumeALL_LTC += nvalue;
@@ -1301,6 +1484,11 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
      }
  };
 
+//! Default number of threads reading blocks ahead of the initial scan
+static const int64_t SCAN_MAX_THREADS = 4;
+//! Number of blocks, the initial scan may read ahead
+static const size_t SCAN_READ_AHEAD = 16;
+
 /**
  * Scans the blockchain for meta transactions.
  *
@@ -1309,6 +1497,10 @@ static bool Instant_payment(const uint256& txid, const std::string& buyer, const
  *
  * Every 30 seconds the progress of the scan is reported.
  *
+ * Blocks are read from disk, classified and their Trade Layer inputs looked up
+ * by up to "-tlscanthreads" threads ahead of time, while the state is only
+ * changed on the calling thread, one block after another.
+ *
  * In case the current block being processed is not part of the active chain, or
  * if a block could not be retrieved from the disk, then the scan stops early.
  * Likewise, global shutdown requests are honored, and stop the scan progress.
@@ -1337,6 +1529,21 @@ static int msc_initial_scan(int nFirstBlock)
     // used to print the progress to the console and notifies the UI
     ProgressReporter progressReporter(chainActive[nFirstBlock], chainActive[nLastBlock]);
 
+    std::vector<CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        for (int n = nFirstBlock; n <= nLastBlock; ++n) {
+            CBlockIndex* pblockindex = chainActive[n];
+            if (nullptr == pblockindex) break;
+            vBlocks.push_back(pblockindex);
+        }
+    }
+
+    // blocks are read and classified ahead, but processed one by one, in order
+    const size_t nCores = std::max(1u, std::thread::hardware_concurrency());
+    const size_t nThreads = gArgs.GetArg("-tlscanthreads", std::min<int64_t>(nCores, SCAN_MAX_THREADS));
+    BlockPrefetcher prefetcher(vBlocks, nThreads, SCAN_READ_AHEAD);
+
     for (nBlock = nFirstBlock; nBlock <= nLastBlock; ++nBlock)
     {
         if (ShutdownRequested()) {
@@ -1344,8 +1551,10 @@ static int msc_initial_scan(int nFirstBlock)
             break;
         }
 
-        CBlockIndex* pblockindex = chainActive[nBlock];
-        if (nullptr == pblockindex) break;
+        std::unique_ptr<PrefetchedBlock> prefetched = prefetcher.next();
+        if (!prefetched) break;
+
+        CBlockIndex* pblockindex = prefetched->pblockindex;
 
         std::string strBlockHash = pblockindex->GetBlockHash().GetHex();
 
@@ -1361,18 +1570,22 @@ static int msc_initial_scan(int nFirstBlock)
         unsigned int nTxsFoundInBlock = 0;
         mastercore_handler_block_begin(nBlock, pblockindex);
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())){
+        if (!prefetched->fRead){
                 PrintToLog("Shutdown due to consensus break");
                 break;
-        } 
+        }
+        const CBlock& block = prefetched->block;
           for(const CTransactionRef& tx : block.vtx) {
-             if (mastercore_handler_tx(*tx, nBlock, nTxNum, pblockindex, nullptr,false)) ++nTxsFoundInBlock;
+             if (mastercore_handler_tx(*tx, nBlock, nTxNum, pblockindex, prefetched->inputs,false)) ++nTxsFoundInBlock;
              ++nTxNum;
           }
           //now we uhh do it again to filter oracle set tx
-          for(const CTransactionRef& tx : block.vtx) {
-             if (mastercore_handler_tx(*tx, nBlock, nTxNum, pblockindex, nullptr,true)) ++nTxsFoundInBlock;
+          if (prefetched->nMarked > 0) {
+              for (size_t n = 0; n < block.vtx.size(); ++n) {
+                 // the first pass already handled everything else of transactions without marker
+                 if (prefetched->vClasses[n] == NO_MARKER) continue;
+                 if (mastercore_handler_tx(*block.vtx[n], nBlock, nTxNum, pblockindex, prefetched->inputs,true)) ++nTxsFoundInBlock;
+              }
           }
 
         nTxsFoundTotal += nTxsFoundInBlock;
@@ -1921,16 +2134,7 @@ static int input_mp_dexvolume_string(const std::string& s)
         return -1;
     }
 
-    auto it = MapTokenVolume.find(block);
-    if (it != MapTokenVolume.end()){
-        auto pMap = it->second;
-        pMap[propertyId] = amount;
-        return 0;
-    }
-
-    std::map<uint32_t,int64_t> pMapp;
-    pMapp[propertyId] = amount;
-    if(!MapTokenVolume.insert(std::make_pair(block, pMapp)).second) return -1;
+    MapTokenVolume.set(block, propertyId, amount);
 
     return 0;
 
@@ -1955,17 +2159,7 @@ static int input_mp_mdexvolume_string(const std::string& s)
         return -1;
     }
 
-    auto it = metavolume.find(block);
-    if (it != metavolume.end()){
-        auto pMap = it->second;
-        pMap[property] = amount;
-        return 0;
-    }
-
-    std::map<uint32_t, int64_t> pMapp;
-    pMapp[property] = amount;
-
-    if(!metavolume.insert(std::make_pair(block, pMapp)).second) return -1;
+    metavolume.set(block, property, amount);
 
     return 0;
 
@@ -1990,17 +2184,7 @@ static int input_mp_ltcvolume_string(const std::string& s)
         return -1;
     }
 
-    auto it = MapLTCVolume.find(block);
-    if (it != MapLTCVolume.end()){
-        auto pMap = it->second;
-        pMap[property] = amount;
-        return 0;
-    }
-
-    std::map<uint32_t, int64_t> pMapp;
-    pMapp[property] = amount;
-
-    if(!MapLTCVolume.insert(std::make_pair(block, pMapp)).second) return -1;
+    MapLTCVolume.set(block, property, amount);
 
     return 0;
 
@@ -2184,7 +2368,9 @@ static int input_node_reward(const std::string& s)
 
 }
 
-static int msc_file_load(const string &filename, int what, bool verifyHash = false)
+static int msc_snapshot_load(const std::string& filename, int what, bool verifyHash);
+
+int msc_file_load(const string &filename, int what, bool verifyHash)
 {
   int lines = 0;
   int (*inputLineFunc)(const string &) = nullptr;
@@ -2193,7 +2379,7 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
   switch (what)
   {
     case FILETYPE_BALANCES:
-        mp_tally_map.clear();
+        clear_tally_map();
         inputLineFunc = input_msc_balances_string;
         break;
 
@@ -2220,7 +2406,7 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         // memory leak ... gotta unallocate inner layers first....
         // TODO
         // ...
-        metadex.clear();
+        clear_metadex();
         inputLineFunc = input_mp_mdexorder_string;
         break;
 
@@ -2286,7 +2472,7 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         break;
 
     case FILE_TYPE_REGISTER:
-        mp_register_map.clear();
+        clear_register_map();
         inputLineFunc = input_register_string;
         break;
 
@@ -2306,6 +2492,11 @@ static int msc_file_load(const string &filename, int what, bool verifyHash = fal
         PrintToLog("%s(%s), line %d, file: %s\n", __FUNCTION__, filename, __LINE__, __FILE__);
     }
 
+    // text files written by older clients are still accepted, and replaced by the next save
+    if (SnapshotReader::IsSnapshot(filename)) {
+        return msc_snapshot_load(filename, what, verifyHash);
+    }
+
     std::ifstream file;
     file.open(filename.c_str());
     if (!file.is_open())
@@ -2394,6 +2585,9 @@ static char const * const statePrefix[NUM_FILETYPES] = {
 static int load_most_relevant_state()
 {
   int res = -1;
+  // state files and watermark must be complete, before they are inspected
+  WaitForStateFiles();
+
   // check the SP  databases and roll it back to its latest valid state
   // according to the active chain
   uint256 spWatermark;
@@ -2575,58 +2769,106 @@ static int load_most_relevant_state()
   return res;
 }
 
-static int write_msc_balances(std::ofstream& file, CHash256& hasher)
+//! Size of a balance record: address, property, then the seven tally types as written below
+static const uint32_t SNAPSHOT_BALANCE_SIZE = 64;
+
+//! Size of a balance record of the image, which lacks the address index
+static const uint32_t IMAGE_BALANCE_SIZE = SNAPSHOT_BALANCE_SIZE - 4;
+
+//! Balances and registers encoded for the state files, updated for changed addresses only
+static SnapshotImage balancesImage;
+static SnapshotImage registersImage;
+
+// Encodes the balances of an address, without the empty ones
+static std::string encode_msc_balances(const CMPTally& tally)
+{
+    std::string records;
+    for (const CMPTally::BalanceRecord& balanceRecord : tally) {
+        const uint32_t propertyId = balanceRecord.propertyId;
+        const int64_t balance = balanceRecord.balance[BALANCE];
+        const int64_t sellReserved = balanceRecord.balance[SELLOFFER_RESERVE];
+        const int64_t acceptReserved = balanceRecord.balance[ACCEPT_RESERVE];
+        const int64_t pending = balanceRecord.balance[PENDING];
+        const int64_t metadexReserved = balanceRecord.balance[METADEX_RESERVE];
+        const int64_t contractdexReserved = balanceRecord.balance[CONTRACTDEX_RESERVE];
+        const int64_t unvested = balanceRecord.balance[UNVESTED];
+
+        // we don't allow 0 balances to read in, so if we don't write them
+        // it makes things match up better between persisted state and processed state
+        if (0 == balance && 0 == sellReserved && 0 == acceptReserved && 0 == pending && 0 == metadexReserved && contractdexReserved == 0 && unvested == 0) {
+            continue;
+        }
+
+        unsigned char record[IMAGE_BALANCE_SIZE];
+        WriteLE32(record, propertyId);
+        WriteLE64(record + 4, balance);
+        WriteLE64(record + 12, sellReserved);
+        WriteLE64(record + 20, acceptReserved);
+        WriteLE64(record + 28, pending);
+        WriteLE64(record + 36, metadexReserved);
+        WriteLE64(record + 44, contractdexReserved);
+        WriteLE64(record + 52, unvested);
+        records.append((const char*) record, sizeof(record));
+    }
+
+    return records;
+}
+
+static int write_msc_balances(SnapshotWriter& writer, const SnapshotImage& image)
 {
-    std::unordered_map<std::string, CMPTally>::iterator iter;
-    for (iter = mp_tally_map.begin(); iter != mp_tally_map.end(); ++iter)
+    for (const auto& bucket : image.getBuckets())
     {
-        bool emptyWallet = true;
-        std::string lineOut = (*iter).first;
-        lineOut.append("=");
-        CMPTally& curAddr = (*iter).second;
-        curAddr.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = curAddr.next())) {
-            const int64_t balance = (*iter).second.getMoney(propertyId, BALANCE);
-            const int64_t sellReserved = (*iter).second.getMoney(propertyId, SELLOFFER_RESERVE);
-            const int64_t acceptReserved = (*iter).second.getMoney(propertyId, ACCEPT_RESERVE);
-            const int64_t pending = (*iter).second.getMoney(propertyId, PENDING);
-            const int64_t metadexReserved = (*iter).second.getMoney(propertyId, METADEX_RESERVE);
-            const int64_t contractdexReserved = (*iter).second.getMoney(propertyId, CONTRACTDEX_RESERVE);
-            const int64_t unvested = (*iter).second.getMoney(propertyId, UNVESTED);
-
-            // we don't allow 0 balances to read in, so if we don't write them
-            // it makes things match up better between persisted state and processed state
-            if (0 == balance && 0 == sellReserved && 0 == acceptReserved && 0 == pending && 0 == metadexReserved && contractdexReserved == 0 && unvested == 0) {
-                continue;
+        for (const auto& p : *bucket)
+        {
+            const uint32_t addressIndex = writer.addAddress(p.first);
+            for (size_t offset = 0; offset < p.second.size(); offset += IMAGE_BALANCE_SIZE) {
+                unsigned char* record = writer.addRecord(SNAPSHOT_BALANCES, SNAPSHOT_BALANCE_SIZE);
+                WriteLE32(record, addressIndex);
+                memcpy(record + 4, p.second.data() + offset, IMAGE_BALANCE_SIZE);
             }
-
-            emptyWallet = false;
-
-            lineOut.append(strprintf("%d:%d,%d,%d,%d,%d,%d,%d;",
-                    propertyId,
-                    balance,
-                    sellReserved,
-                    acceptReserved,
-                    pending,
-                    metadexReserved,
-                    contractdexReserved,
-                    unvested));
         }
+    }
+
+    return 0;
+}
 
-        if (!emptyWallet) {
-            // add the line to the hash
-            hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
+static int input_msc_balances(const SnapshotReader& reader)
+{
+    const unsigned char* records = nullptr;
+    uint64_t count = 0;
+    if (!reader.getRecords(SNAPSHOT_BALANCES, SNAPSHOT_BALANCE_SIZE, records, count)) {
+        return -1;
+    }
 
-            // write the line
-            file << lineOut << std::endl;
+    std::string strAddress;
+    for (const unsigned char* record = records; record != records + count * SNAPSHOT_BALANCE_SIZE; record += SNAPSHOT_BALANCE_SIZE)
+    {
+        if (!reader.getAddress(ReadLE32(record), strAddress)) {
+            return -1;
         }
+
+        const uint32_t propertyId = ReadLE32(record + 4);
+        const int64_t balance = ReadLE64(record + 8);
+        const int64_t sellReserved = ReadLE64(record + 16);
+        const int64_t acceptReserved = ReadLE64(record + 24);
+        const int64_t pending = ReadLE64(record + 32);
+        const int64_t metadexReserved = ReadLE64(record + 40);
+        const int64_t contractdexReserved = ReadLE64(record + 48);
+        const int64_t unvested = ReadLE64(record + 56);
+
+        if (balance) update_tally_map(strAddress, propertyId, balance, BALANCE);
+        if (sellReserved) update_tally_map(strAddress, propertyId, sellReserved, SELLOFFER_RESERVE);
+        if (acceptReserved) update_tally_map(strAddress, propertyId, acceptReserved, ACCEPT_RESERVE);
+        if (pending) update_tally_map(strAddress, propertyId, pending, PENDING);
+        if (metadexReserved) update_tally_map(strAddress, propertyId, metadexReserved, METADEX_RESERVE);
+        if (contractdexReserved) update_tally_map(strAddress, propertyId, contractdexReserved, CONTRACTDEX_RESERVE);
+        if (unvested) update_tally_map(strAddress, propertyId, unvested, UNVESTED);
     }
 
     return 0;
 }
 
-static int write_globals_state(ofstream &file, CHash256& hasher)
+static int write_globals_state(std::ostream& file, CHash256& hasher)
 {
     unsigned int nextSPID = _my_sps->peekNextSPID();
     const std::string lineOut = strprintf("%d", nextSPID);
@@ -2641,7 +2883,7 @@ static int write_globals_state(ofstream &file, CHash256& hasher)
 }
 
 
-static int write_contract_globals_state(ofstream &file, CHash256& hasher)
+static int write_contract_globals_state(std::ostream& file, CHash256& hasher)
 {
     unsigned int nextCDID = _my_cds->peekNextContractID();
     const std::string lineOut = strprintf("%d", nextCDID);
@@ -2654,21 +2896,23 @@ static int write_contract_globals_state(ofstream &file, CHash256& hasher)
     return 0;
 }
 
-static int write_mp_contractdex(ofstream &file, CHash256& hasher)
+static int write_mp_contractdex(std::ostream& file, CHash256& hasher)
 {
-    for (const auto con : contractdex)
+    for (const auto& con : contractdex)
     {
-        const cd_PricesMap &prices = con.second;
-
-        for (const auto p : prices)
+        for (const uint8_t action : {buy, sell})
         {
-            const cd_Set &indexes = p.second;
+            const cd_PricesMap &prices = con.second.getSide(action);
 
-            for (const auto in : indexes)
+            for (const auto& p : prices)
             {
+                const cd_Set &indexes = p.second.orders;
 
-                const CMPContractDex& contract = in;
-                contract.saveOffer(file, hasher);
+                for (const auto& in : indexes)
+                {
+                    const CMPContractDex& contract = in;
+                    contract.saveOffer(file, hasher);
+                }
             }
         }
     }
@@ -2676,7 +2920,7 @@ static int write_mp_contractdex(ofstream &file, CHash256& hasher)
     return 0;
 }
 
-static int write_global_vars(ofstream &file, CHash256& hasher)
+static int write_global_vars(std::ostream& file, CHash256& hasher)
 {
     const int64_t lastVolume = globalVolumeALL_LTC;
     std::string lineOut = strprintf("%d", lastVolume);
@@ -2691,7 +2935,7 @@ static int write_global_vars(ofstream &file, CHash256& hasher)
 
 
 
-static int write_mp_metadex(ofstream &file, CHash256& hasher)
+static int write_mp_metadex(std::ostream& file, CHash256& hasher)
 {
     for (const auto my_it : metadex)
     {
@@ -2712,7 +2956,7 @@ static int write_mp_metadex(ofstream &file, CHash256& hasher)
     return 0;
 }
 
-static int write_mp_offers(ofstream &file, CHash256& hasher)
+static int write_mp_offers(std::ostream& file, CHash256& hasher)
 {
     for (const auto of : my_offers)
     {
@@ -2726,7 +2970,7 @@ static int write_mp_offers(ofstream &file, CHash256& hasher)
     return 0;
 }
 
-static int write_mp_accepts(std::ofstream& file,  CHash256& hasher)
+static int write_mp_accepts(std::ostream& file,  CHash256& hasher)
 {
     for (const auto acc : my_accepts)
     {
@@ -2740,7 +2984,7 @@ static int write_mp_accepts(std::ofstream& file,  CHash256& hasher)
     return 0;
 }
 
-static int write_mp_token_ltc_prices(std::ofstream& file, CHash256& hasher)
+static int write_mp_token_ltc_prices(std::ostream& file, CHash256& hasher)
 {
     for (const auto &p : lastPrice)
     {
@@ -2757,7 +3001,7 @@ static int write_mp_token_ltc_prices(std::ofstream& file, CHash256& hasher)
     return 0;
 }
 
-static int write_mp_cachefees(std::ofstream& file, CHash256& hasher)
+static int write_mp_cachefees(std::ostream& file, CHash256& hasher)
 {
     std::set<uint32_t> keys;
     boost::copy(g_fees->native_fees | boost::adaptors::map_keys, std::inserter(keys, keys.begin()));
@@ -2779,7 +3023,7 @@ static int write_mp_cachefees(std::ofstream& file, CHash256& hasher)
     return 0;
 }
 
-static void savingLine(const withdrawalAccepted&  w, const std::string chnAddr, std::ofstream& file,  CHash256& hasher)
+static void savingLine(const withdrawalAccepted&  w, const std::string chnAddr, std::ostream& file,  CHash256& hasher)
 {
     const std::string lineOut = strprintf("%s,%s,%d,%d,%d,%s", chnAddr, w.address, w.deadline_block, w.propertyId, w.amount, (w.txid).ToString());
     hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
@@ -2788,7 +3032,7 @@ static void savingLine(const withdrawalAccepted&  w, const std::string chnAddr,
 }
 
 /** Saving pending withdrawals **/
-static int write_mp_withdrawals(std::ofstream& file, CHash256& hasher)
+static int write_mp_withdrawals(std::ostream& file, CHash256& hasher)
 {
     for (const auto w : withdrawal_Map)
     {
@@ -2833,7 +3077,7 @@ void addBalances(const std::map<std::string,map<uint32_t, int64_t>>& balances, s
 
 }
 
-static int write_mp_tokenvwap(std::ofstream& file, CHash256& hasher)
+static int write_mp_tokenvwap(std::ostream& file, CHash256& hasher)
 {
     for (const auto &mp : tokenvwap)
     {
@@ -2870,7 +3114,7 @@ static int write_mp_tokenvwap(std::ofstream& file, CHash256& hasher)
 }
 
 /**Saving map of active channels**/
-static int write_mp_active_channels(std::ofstream& file, CHash256& hasher)
+static int write_mp_active_channels(std::ostream& file, CHash256& hasher)
 {
     for (const auto &chn : channels_Map)
     {
@@ -2891,37 +3135,26 @@ static int write_mp_active_channels(std::ofstream& file, CHash256& hasher)
     return 0;
 }
 
-static int write_mp_nodeaddresses(ofstream &file, CHash256& hasher)
+static int write_mp_nodeaddresses(std::ostream& file, CHash256& hasher)
 {
     nR.saveNodeReward(file, hasher);
 
     return 0;
 }
 
-static void iterWrite(std::ofstream& file, CHash256& hasher, const std::map<int, std::map<uint32_t,int64_t>>& aMap)
+static void iterWrite(std::ostream& file, CHash256& hasher, const VolumeMap& aMap)
 {
-    for(const auto &m : aMap)
-    {
-       // decompose the key for address
-       const uint32_t& block = m.first;
-       const auto &pMap = m.second;
-
-       for(const auto &p : pMap)
-       {
-           const uint32_t& propertyId = p.first;
-           const int64_t& amount = p.second;
-           const std::string lineOut = strprintf("%d,%d,%d", block, propertyId, amount);
-           // add the line to the hash
-           hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
-           // write the line
-           file << lineOut << std::endl;
-       }
-    }
-
+    aMap.visit([&file, &hasher](int block, uint32_t propertyId, int64_t amount) {
+        const std::string lineOut = strprintf("%d,%d,%d", block, propertyId, amount);
+        // add the line to the hash
+        hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
+        // write the line
+        file << lineOut << std::endl;
+    });
 }
 
 /** Saving DexMap volume **/
-static int write_mp_dexvolume(std::ofstream& file, CHash256& hasher)
+static int write_mp_dexvolume(std::ostream& file, CHash256& hasher)
 {
     iterWrite(file, hasher, MapTokenVolume);
     return 0;
@@ -2929,20 +3162,20 @@ static int write_mp_dexvolume(std::ofstream& file, CHash256& hasher)
 
 
 /** Saving DEx and Channel LTC volume **/
-static int write_mp_ltcvolume(std::ofstream& file, CHash256& hasher)
+static int write_mp_ltcvolume(std::ostream& file, CHash256& hasher)
 {
     iterWrite(file, hasher, MapLTCVolume);
     return 0;
 }
 
 /** Saving MDEx Map volume **/
-static int write_mp_mdexvolume(std::ofstream& file, CHash256& hasher)
+static int write_mp_mdexvolume(std::ostream& file, CHash256& hasher)
 {
     iterWrite(file, hasher, metavolume);
     return 0;
 }
 
-static void savingLine(const std::string& address, std::ofstream& file, CHash256& hasher)
+static void savingLine(const std::string& address, std::ostream& file, CHash256& hasher)
 {
     const std::string lineOut = strprintf("%s",address);
     // add the line to the hash
@@ -2953,109 +3186,247 @@ static void savingLine(const std::string& address, std::ofstream& file, CHash256
 }
 
 /** Saving vesting token addresses **/
-static int write_mp_vesting_addresses(std::ofstream& file,  CHash256& hasher)
+static int write_mp_vesting_addresses(std::ostream& file,  CHash256& hasher)
 {
     for_each(vestingAddresses.begin(), vestingAddresses.end(), [&file, &hasher] (const std::string& address) { savingLine(address, file, hasher);});
 
     return 0;
 }
 
+//! Size of a register record: address, contract, six records and the range of its entries
+static const uint32_t SNAPSHOT_REGISTER_SIZE = 64;
+//! Size of a register entry: amount and price
+static const uint32_t SNAPSHOT_ENTRY_SIZE = 16;
+
+//! Size of a register record of the image: contract, six records and the number of entries, which follow it
+static const uint32_t IMAGE_REGISTER_SIZE = 56;
+
+// Encodes the records and entries of an address, without the empty records
+static std::string encode_mp_register(Register& reg)
+{
+    std::string records;
+    reg.init();
+    uint32_t contractId = 0;
+    while (0 != (contractId = reg.next()))
+    {
+        const int64_t entryPrice = reg.getRecord(contractId, ENTRY_CPRICE);
+        const int64_t position = reg.getRecord(contractId, CONTRACT_POSITION);
+        const int64_t liquidationPrice = reg.getRecord(contractId, BANKRUPTCY_PRICE);
+        const int64_t upnl = reg.getRecord(contractId, UPNL);
+        const int64_t margin = reg.getRecord(contractId, MARGIN);
+        const int64_t leverage = reg.getRecord(contractId, LEVERAGE);
+
+        // we don't allow 0 balances to read in, so if we don't write them
+        // it makes things match up better between persisted state and processed state
+        if (0 == entryPrice && 0 == position && 0 == liquidationPrice && 0 == upnl && 0 == margin && leverage == 0) {
+            continue;
+        }
+
+        const Entries* entries = reg.getEntries(contractId);
+
+        unsigned char record[IMAGE_REGISTER_SIZE];
+        WriteLE32(record, contractId);
+        WriteLE64(record + 4, entryPrice);
+        WriteLE64(record + 12, position);
+        WriteLE64(record + 20, liquidationPrice);
+        WriteLE64(record + 28, upnl);
+        WriteLE64(record + 36, margin);
+        WriteLE64(record + 44, leverage);
+        WriteLE32(record + 52, (entries != nullptr) ? entries->size() : 0);
+        records.append((const char*) record, sizeof(record));
+
+        // saving now the entries (contracts, price)
+        if (entries != nullptr)
+        {
+            for (const auto& e : *entries)
+            {
+                unsigned char entry[SNAPSHOT_ENTRY_SIZE];
+                WriteLE64(entry, e.first);
+                WriteLE64(entry + 8, e.second);
+                records.append((const char*) entry, sizeof(entry));
+            }
+        }
+    }
+
+    return records;
+}
+
 /** Saving contract position data **/
-static int write_mp_register(std::ofstream& file,  CHash256& hasher)
+static int write_mp_register(SnapshotWriter& writer, const SnapshotImage& image)
 {
-  for (auto iter = mp_register_map.begin(); iter != mp_register_map.end(); ++iter)
+  for (const auto& bucket : image.getBuckets())
   {
-      bool emptyWallet = true;
-      int count = 0;
-      std::string lineOut = iter->first;
-      lineOut.append("=");
-      Register& reg = iter->second;
-      reg.init();
-      uint32_t contractId = 0;
-      while (0 != (contractId = reg.next()))
+      for (const auto& p : *bucket)
       {
+          const uint32_t addressIndex = writer.addAddress(p.first);
+          const unsigned char* data = (const unsigned char*) p.second.data();
+          const unsigned char* end = data + p.second.size();
+          while (data != end)
+          {
+              const uint32_t entryCount = ReadLE32(data + 52);
+              const uint64_t firstEntry = writer.getCount(SNAPSHOT_REGISTER_ENTRIES);
+              for (uint32_t n = 0; n < entryCount; ++n) {
+                  unsigned char* entry = writer.addRecord(SNAPSHOT_REGISTER_ENTRIES, SNAPSHOT_ENTRY_SIZE);
+                  memcpy(entry, data + IMAGE_REGISTER_SIZE + n * SNAPSHOT_ENTRY_SIZE, SNAPSHOT_ENTRY_SIZE);
+              }
 
-          if (count > 0) lineOut.append(strprintf("#"));
-
-          const int64_t entryPrice = reg.getRecord(contractId, ENTRY_CPRICE);
-          const int64_t position = reg.getRecord(contractId, CONTRACT_POSITION);
-          const int64_t liquidationPrice = reg.getRecord(contractId, BANKRUPTCY_PRICE);
-          const int64_t upnl = reg.getRecord(contractId, UPNL);
-          const int64_t margin = reg.getRecord(contractId, MARGIN);
-          const int64_t leverage = reg.getRecord(contractId, LEVERAGE);
+              unsigned char* record = writer.addRecord(SNAPSHOT_REGISTERS, SNAPSHOT_REGISTER_SIZE);
+              WriteLE32(record, addressIndex);
+              memcpy(record + 4, data, IMAGE_REGISTER_SIZE - 4);
+              WriteLE32(record + 56, firstEntry);
+              WriteLE32(record + 60, entryCount);
 
-          // we don't allow 0 balances to read in, so if we don't write them
-          // it makes things match up better between persisted state and processed state
-          if (0 == entryPrice && 0 == position && 0 == liquidationPrice && 0 == upnl && 0 == margin && leverage == 0) {
-              continue;
+              data += IMAGE_REGISTER_SIZE + entryCount * SNAPSHOT_ENTRY_SIZE;
           }
+      }
+  }
 
-          emptyWallet = false;
+  return 0;
+}
 
-          count++;
+static int input_register(const SnapshotReader& reader)
+{
+    const unsigned char* records = nullptr;
+    const unsigned char* entries = nullptr;
+    uint64_t count = 0;
+    uint64_t nEntries = 0;
+    if (!reader.getRecords(SNAPSHOT_REGISTERS, SNAPSHOT_REGISTER_SIZE, records, count) ||
+            !reader.getRecords(SNAPSHOT_REGISTER_ENTRIES, SNAPSHOT_ENTRY_SIZE, entries, nEntries)) {
+        return -1;
+    }
 
-          // saving each record
-          lineOut.append(strprintf("%d:%d,%d,%d,%d,%d,%d",
-                  contractId,
-                  entryPrice,
-                  position,
-                  liquidationPrice,
-                  upnl,
-                  margin,
-                  leverage));
+    std::string strAddress;
+    for (const unsigned char* record = records; record != records + count * SNAPSHOT_REGISTER_SIZE; record += SNAPSHOT_REGISTER_SIZE)
+    {
+        if (!reader.getAddress(ReadLE32(record), strAddress)) {
+            return -1;
+        }
 
-          // saving now the entries (contracts, price)
-          const Entries* entry = reg.getEntries(contractId);
+        const uint32_t contractId = ReadLE32(record + 4);
+        const int64_t entryPrice = ReadLE64(record + 8);
+        const int64_t position = ReadLE64(record + 16);
+        const int64_t liquidationPrice = ReadLE64(record + 24);
+        const int64_t upnl = ReadLE64(record + 32);
+        const int64_t margin = ReadLE64(record + 40);
+        const int64_t leverage = ReadLE64(record + 48);
+        const uint64_t firstEntry = ReadLE32(record + 56);
+        const uint64_t entryCount = ReadLE32(record + 60);
+
+        if (firstEntry + entryCount > nEntries) {
+            PrintToLog("%s(): entries of %s out of range\n",__func__, strAddress);
+            return -1;
+        }
 
-          if(entry != nullptr)
-          {
-              for (Entries::const_iterator it = entry->begin(); it != entry->end(); ++it)
-              {
-                  if (it == entry->begin()) lineOut.append(strprintf(";"));
+        if (entryPrice > 0) update_register_map(strAddress, contractId, entryPrice, ENTRY_CPRICE);
+        if (position != 0) update_register_map(strAddress, contractId, position, CONTRACT_POSITION);
+        if (liquidationPrice > 0) update_register_map(strAddress, contractId, liquidationPrice, BANKRUPTCY_PRICE);
+        if (upnl != 0) update_register_map(strAddress, contractId, upnl, UPNL);
+        if (margin > 0) update_register_map(strAddress, contractId, margin, MARGIN);
+        if (leverage >= 1) update_register_map(strAddress, contractId, leverage, LEVERAGE);
 
-                  const std::pair<int64_t,int64_t>& pair = *it;
-                  const int64_t& amount = pair.first;
-                  const int64_t& price = pair.second;
-                  lineOut.append(strprintf("%d,%d", amount, price));
+        for (const unsigned char* entry = entries + firstEntry * SNAPSHOT_ENTRY_SIZE; entry != entries + (firstEntry + entryCount) * SNAPSHOT_ENTRY_SIZE; entry += SNAPSHOT_ENTRY_SIZE)
+        {
+            insert_entry(strAddress, contractId, ReadLE64(entry), ReadLE64(entry + 8));
+        }
+    }
 
-                  if (it != std::prev(entry->end())) {
-                      lineOut.append(strprintf("|"));
-                  }
-               }
-           }
+    return 0;
+}
 
-       }
+/**
+ * Loads a binary snapshot, which replaced the text format of the biggest state files.
+ *
+ * Maps are cleared by the caller.
+ */
+static int msc_snapshot_load(const std::string& filename, int what, bool verifyHash)
+{
+    SnapshotReader reader;
+    if (!reader.open(filename, verifyHash)) {
+        return -1;
+    }
 
-       if (!emptyWallet) {
-          // add the line to the hash
-          hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
+    if (reader.getFileType() != (uint32_t) what) {
+        PrintToLog("%s(): %s has file type %d, expected %d\n", __func__, filename, reader.getFileType(), what);
+        return -1;
+    }
 
-          // write the line
-          file << lineOut << std::endl;
-        }
+    int res = -1;
+    switch (what)
+    {
+    case FILETYPE_BALANCES:
+        res = input_msc_balances(reader);
+        break;
 
+    case FILE_TYPE_REGISTER:
+        res = input_register(reader);
+        break;
     }
 
-    return 0;
+    if (msc_debug_persistence) PrintToLog("%s(%s), res= %d\n", __func__, filename, res);
+
+    return res;
+}
+
+static bool is_snapshot_file(int what)
+{
+    return FILETYPE_BALANCES == what || FILE_TYPE_REGISTER == what;
+}
+
+// Encodes the balances and registers of the addresses changed since the last call, requires cs_tally
+static void refresh_state_images()
+{
+    const ChangedAddresses balances = TakeChangedBalances(CHANGES_STATE_FILES);
+    if (balances.fCleared) balancesImage.clear();
+    for (const std::string& address : balances.addresses) {
+        const auto it = mp_tally_map.find(address);
+        balancesImage.set(address, (it != mp_tally_map.end()) ? encode_msc_balances(it->second) : std::string());
+    }
+
+    const ChangedAddresses registers = TakeChangedRegisters(CHANGES_STATE_FILES);
+    if (registers.fCleared) registersImage.clear();
+    for (const std::string& address : registers.addresses) {
+        const auto it = mp_register_map.find(address);
+        registersImage.set(address, (it != mp_register_map.end()) ? encode_mp_register(it->second) : std::string());
+    }
+}
+
+/** Renders a state file kept as binary snapshot from an image, which needs no lock. */
+static int render_state_snapshot(std::string& data, int what, const SnapshotImage& image)
+{
+    SnapshotWriter writer(what);
+    const int result = (FILETYPE_BALANCES == what) ? write_msc_balances(writer, image) : write_mp_register(writer, image);
+    writer.serialize(data);
+
+    return result;
+}
+
+/** Renders the state files kept as binary snapshot, returns 1 for the ones still written as text. */
+static int write_state_snapshot(std::string& data, int what)
+{
+    if (!is_snapshot_file(what)) {
+        return 1;
+    }
+
+    refresh_state_images();
+
+    return render_state_snapshot(data, what, (FILETYPE_BALANCES == what) ? balancesImage : registersImage);
 }
 
-static int write_state_file(CBlockIndex const *pBlockIndex, int what)
+/** Renders a state file in memory, to be written by the background writer. */
+int write_state_file(int what, std::string& data)
 {
-    fs::path path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[what], pBlockIndex->GetBlockHash().ToString());
-    const std::string strFile = path.string();
+    const int snapshotResult = write_state_snapshot(data, what);
+    if (snapshotResult <= 0) {
+        return snapshotResult;
+    }
 
-    std::ofstream file;
-    file.open(strFile.c_str());
+    std::ostringstream file;
 
     CHash256 hasher;
 
     int result = 0;
 
     switch(what) {
-    case FILETYPE_BALANCES:
-        result = write_msc_balances(file, hasher);
-        break;
-
     case FILETYPE_GLOBALS:
         result = write_globals_state(file, hasher);
         break;
@@ -3124,10 +3495,6 @@ static int write_state_file(CBlockIndex const *pBlockIndex, int what)
         result = write_mp_tokenvwap(file, hasher);
         break;
 
-    case FILE_TYPE_REGISTER:
-        result = write_mp_register(file, hasher);
-        break;
-
     case FILE_TYPE_NODE_ADDRESSES:
         result = write_mp_nodeaddresses(file, hasher);
         break;
@@ -3139,8 +3506,7 @@ static int write_state_file(CBlockIndex const *pBlockIndex, int what)
     hasher.Finalize(hash.begin());
     file << "!" << hash.ToString() << std::endl;
 
-    file.flush();
-    file.close();
+    data = file.str();
 
     return result;
 }
@@ -3172,6 +3538,11 @@ static void prune_state_files(CBlockIndex const *topIndex)
             continue;
         }
 
+        if (dIter->path().extension() == ".tmp") {
+            // still being written by the background writer
+            continue;
+        }
+
         std::vector<std::string> vstr;
         boost::split(vstr, fName, boost::is_any_of("-."), token_compress_on);
         if (vstr.size() == 3 && is_state_prefix(vstr[0]) && boost::equals(vstr[2], "dat"))
@@ -3218,32 +3589,56 @@ static void prune_state_files(CBlockIndex const *topIndex)
 
 int mastercore_save_state(CBlockIndex const *pBlockIndex)
 {
-    // write the new state as of the given block
-    write_state_file(pBlockIndex, FILETYPE_BALANCES);
-    write_state_file(pBlockIndex, FILETYPE_GLOBALS);
-    write_state_file(pBlockIndex, FILETYPE_CDEXORDERS);
-    write_state_file(pBlockIndex, FILETYPE_MDEXORDERS);
-    write_state_file(pBlockIndex, FILETYPE_OFFERS);
-    write_state_file(pBlockIndex, FILETYPE_ACCEPTS);
-    write_state_file(pBlockIndex, FILETYPE_CACHEFEES);
-    //write_state_file(pBlockIndex, FILETYPE_CACHEFEES_ORACLES);
-    write_state_file(pBlockIndex, FILETYPE_WITHDRAWALS);
-    write_state_file(pBlockIndex, FILETYPE_ACTIVE_CHANNELS);
-    write_state_file(pBlockIndex, FILETYPE_DEX_VOLUME);
-    write_state_file(pBlockIndex, FILETYPE_MDEX_VOLUME);
-    write_state_file(pBlockIndex, FILETYPE_GLOBAL_VARS);
-    write_state_file(pBlockIndex, FILE_TYPE_VESTING_ADDRESSES);
-    write_state_file(pBlockIndex, FILE_TYPE_LTC_VOLUME);
-    write_state_file(pBlockIndex, FILE_TYPE_TOKEN_LTC_PRICE);
-    write_state_file(pBlockIndex, FILE_TYPE_TOKEN_VWAP);
-    write_state_file(pBlockIndex, FILE_TYPE_REGISTER);
-    write_state_file(pBlockIndex, FILETYPE_CONTRACT_GLOBALS);
-    write_state_file(pBlockIndex, FILE_TYPE_NODE_ADDRESSES);
+    static const int stateFiles[] = {
+        FILETYPE_BALANCES,
+        FILETYPE_GLOBALS,
+        FILETYPE_CDEXORDERS,
+        FILETYPE_MDEXORDERS,
+        FILETYPE_OFFERS,
+        FILETYPE_ACCEPTS,
+        FILETYPE_CACHEFEES,
+        //FILETYPE_CACHEFEES_ORACLES,
+        FILETYPE_WITHDRAWALS,
+        FILETYPE_ACTIVE_CHANNELS,
+        FILETYPE_DEX_VOLUME,
+        FILETYPE_MDEX_VOLUME,
+        FILETYPE_GLOBAL_VARS,
+        FILE_TYPE_VESTING_ADDRESSES,
+        FILE_TYPE_LTC_VOLUME,
+        FILE_TYPE_TOKEN_LTC_PRICE,
+        FILE_TYPE_TOKEN_VWAP,
+        FILE_TYPE_REGISTER,
+        FILETYPE_CONTRACT_GLOBALS,
+        FILE_TYPE_NODE_ADDRESSES,
+    };
+
+    // only balances and registers of changed addresses are encoded again
+    refresh_state_images();
+
+    std::vector<StateFile> files(sizeof(stateFiles) / sizeof(stateFiles[0]));
+    for (size_t i = 0; i < files.size(); ++i) {
+        const int what = stateFiles[i];
+        files[i].path = MPPersistencePath / strprintf("%s-%s.dat", statePrefix[what], pBlockIndex->GetBlockHash().ToString());
+
+        if (is_snapshot_file(what)) {
+            // rendered on the writer thread, from a copy, which only shares the buckets of the image
+            const SnapshotImage image = (FILETYPE_BALANCES == what) ? balancesImage : registersImage;
+            files[i].render = [what, image](std::string& data) { return render_state_snapshot(data, what, image) == 0; };
+        } else {
+            // the other files follow orders, offers and volumes, not holders, and are rendered right away
+            write_state_file(what, files[i].data);
+        }
+    }
 
     // clean-up the directory
     prune_state_files(pBlockIndex);
 
-    _my_sps->setWatermark(pBlockIndex->GetBlockHash());
+    // writing and syncing happens in the background, the watermark
+    // moves on the writer thread, once all files of the block are complete
+    const uint256 blockHash = pBlockIndex->GetBlockHash();
+    QueueStateFiles(files, [blockHash]() {
+        _my_sps->setWatermark(blockHash);
+    });
 
     return 0;
 }
@@ -3253,16 +3648,20 @@ int mastercore_save_state(CBlockIndex const *pBlockIndex)
  */
 void clear_all_state()
 {
+    // the background writer may still move the watermark
+    WaitForStateFiles();
+
     LOCK2(cs_tally, cs_pending);
 
     // Memory based storage
     g_fees->native_fees.clear();
     g_fees->oracle_fees.clear();
-    mp_tally_map.clear();
+    clearOracleTwapCache();
+    clear_tally_map();
     my_pending.clear();
     my_offers.clear();
     my_accepts.clear();
-    metadex.clear();
+    clear_metadex();
     my_pending.clear();
     contractdex.clear();
     channels_Map.clear();
@@ -3273,7 +3672,7 @@ void clear_all_state()
     vestingAddresses.clear();
     lastPrice.clear();
     tokenvwap.clear();
-    mp_register_map.clear();
+    clear_register_map();
 
     ResetConsensusParams();
     ClearActivations();
@@ -3417,6 +3816,14 @@ int mastercore_init()
  */
 int mastercore_shutdown()
 {
+    // finish writing the last state, before the watermark can't be set anymore
+    StopStateWriter();
+
+    if (liquidationWorkers) {
+        liquidationWorkers->stop();
+        liquidationWorkers.reset();
+    }
+
     LOCK(cs_tally);
 
     if (p_txlistdb) {
@@ -3449,6 +3856,8 @@ int mastercore_shutdown()
     PrintToLog("\nTrade Layer shutdown completed\n");
     PrintToLog("Shutdown time: %s\n", FormatISO8601Date(GetTime()));
 
+    StopDebugLog();
+
     return 0;
 }
 
@@ -3567,10 +3976,8 @@ if (nBlockNow%BlockS == 0 && nBlockNow != 0 && path_elef.size() != 0 && lastBloc
       market_priceMap.clear();
       VWAPMap.clear();
       VWAPMapSubVector.clear();
-      numVWAPVector.clear();
-      denVWAPVector.clear();
-      mapContractAmountTimesPrice.clear();
-      mapContractVolume.clear();
+      tokenVWAPWindows.clear();
+      contractVWAPWindows.clear();
       VWAPMapContracts.clear();
       cdextwap_vec.clear();
 
@@ -3829,8 +4236,9 @@ bool mastercore_handler_tx(const CTransaction& tx, int nBlock, unsigned int idx,
 
     LOCK(cs_tally);
     if (fFoundTx && msc_debug_consensus_hash_every_transaction) {
-        const uint256 consensusHash = GetConsensusHash();
-        if(msc_debug_handler_tx) PrintToLog("Consensus hash for transaction %s: %s\n", tx.GetHash().GetHex(), consensusHash.GetHex());
+        // only balances and registers changed by the transaction are hashed again
+        const uint256 stateHash = GetStateHash();
+        if(msc_debug_handler_tx) PrintToLog("State hash for transaction %s: %s\n", tx.GetHash().GetHex(), stateHash.GetHex());
     }
 
     return fFoundTx;
@@ -3848,7 +4256,7 @@ void nodeReward::addWinner(const std::string& address, int64_t amount)
 }
 
 
-void nodeReward::saveNodeReward(ofstream &file, CHash256& hasher)
+void nodeReward::saveNodeReward(std::ostream& file, CHash256& hasher)
 {
     const std::string lineOut = strprintf("%d+%d", p_Reward, p_lastBlock);
     hasher.Write((unsigned char*)lineOut.c_str(), lineOut.length());
@@ -4807,6 +5215,9 @@ int mastercore_handler_block_begin(int nBlockPrev, CBlockIndex const * pBlockInd
 {
     LOCK(cs_tally);
 
+    // TWAPs are computed once per block
+    clearOracleTwapCache();
+
     const int& nHeight = pBlockIndex->nHeight;
 
     bool bRecoveryMode{false};
@@ -4934,6 +5345,10 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
            bS.makeSettlement();
        }
 
+       // only the latest blocks are needed for the VWAP and the volumes
+       pruneTokenVWap(nBlockNow);
+       pruneVolumes(nBlockNow);
+
        // deleting Expired DEx accepts
        const unsigned int how_many_erased = eraseExpiredAccepts(nBlockNow);
 
@@ -4948,10 +5363,10 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
        // transactions were found in the block, signal the UI accordingly
        if (countMP > 0) CheckWalletUpdate(true);
 
-       // calculate and print a consensus hash if required
+       // calculate and print a state hash if required, the full consensus hash is built for checkpoints only
        if (msc_debug_consensus_hash_every_block) {
-           const uint256 consensusHash = GetConsensusHash();
-           PrintToLog("Consensus hash for block %d: %s\n", nBlockNow, consensusHash.GetHex());
+           const uint256 stateHash = GetStateHash();
+           PrintToLog("State hash for block %d: %s\n", nBlockNow, stateHash.GetHex());
        }
 
        // request checkpoint verification
@@ -4986,55 +5401,234 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
       return 0;
 }
 
-int mastercore_handler_disc_begin(int nBlockNow, CBlockIndex const * pBlockIndex)
-{
-    LOCK(cs_tally);
+int mastercore_handler_disc_begin(int nBlockNow, CBlockIndex const * pBlockIndex)
+{
+    LOCK(cs_tally);
+
+    reorgRecoveryMode = 1;
+    reorgRecoveryMaxHeight = (pBlockIndex->nHeight > reorgRecoveryMaxHeight) ? pBlockIndex->nHeight: reorgRecoveryMaxHeight;
+    clearOracleTwapCache();
+    return 0;
+}
+
+int mastercore_handler_disc_end(int nBlockNow, CBlockIndex const * pBlockIndex)
+{
+    LOCK(cs_tally);
+
+    return 0;
+}
+
+// obtains a vector of txids where the supplied address participated in a trade (needed for gettradehistory_MP)
+// optional property ID parameter will filter on propertyId transacted if supplied
+// sorted by block then index
+/**
+ * Secondary indexes of the trade database.
+ *
+ * Index entries are keyed by index type, scope and block, so a range can be read
+ * in block order, and hold the key of the indexed record as value. As the value
+ * contains no ':', the scans over all records skip them.
+ */
+static const std::string TRADE_INDEX_MARKER = "!tradeindex";
+//! Set, once text records of older clients are converted into binary records
+static const std::string TRADE_FORMAT_MARKER = "!tradeformat";
+static const char INDEX_ADDRESS = 'a';   // new MetaDEx trades, by address
+static const char INDEX_PAIR = 'p';      // MetaDEx matches, by property pair
+static const char INDEX_CONTRACT = 'c';  // contract matches, by contract
+static const char INDEX_CHANNEL = 'h';   // instant trades, by channel
+//! Number of index entries written at once, when building the indexes
+static const int TRADE_INDEX_BATCH_SIZE = 10000;
+
+static std::string TradeIndexPrefix(char type, const std::string& scope)
+{
+    return strprintf("%c:%s:", type, scope);
+}
+
+static std::string TradeIndexKey(char type, const std::string& scope, int block, const std::string& suffix)
+{
+    return TradeIndexPrefix(type, scope) + strprintf("%010d:", block) + suffix;
+}
+
+/** Returns the keys of the index entries of a trade record. */
+static std::vector<std::string> GetTradeIndexKeys(const std::string& key, const std::string& value)
+{
+    std::vector<std::string> vIndexKeys;
+
+    if (DBRecordReader::IsRecord(value)) {
+        ContractTradeRecord record;
+        if (!record.decode(value)) return vIndexKeys;
+        // ordered by the block of the taker, like the record itself
+        vIndexKeys.push_back(TradeIndexKey(INDEX_CONTRACT, strprintf("%d", record.contractId), record.blockTaker, key));
+        return vIndexKeys;
+    }
+
+    std::vector<std::string> vstr;
+    boost::split(vstr, value, boost::is_any_of(":"), token_compress_on);
+
+    uint32_t propertyIdForSale = 0, propertyIdDesired = 0;
+    int32_t block = 0, blockIndex = 0;
+
+    if (vstr.size() == 5 && key.size() == 64) {
+        // transfers and pegged currency notifications share the layout, but not the numbers
+        if (!ParseUInt32(vstr[1], &propertyIdForSale) || !ParseUInt32(vstr[2], &propertyIdDesired) ||
+                !ParseInt32(vstr[3], &block) || !ParseInt32(vstr[4], &blockIndex)) {
+            return vIndexKeys;
+        }
+        vIndexKeys.push_back(TradeIndexKey(INDEX_ADDRESS, vstr[0], block, strprintf("%010d:%s", blockIndex, key)));
+        return vIndexKeys;
+    }
+
+    if (vstr.size() == 8 && key.size() == 129) {
+        if (!ParseInt32(vstr[6], &block)) return vIndexKeys;
+        vIndexKeys.push_back(TradeIndexKey(INDEX_PAIR, vstr[2] + "-" + vstr[3], block, key));
+        vIndexKeys.push_back(TradeIndexKey(INDEX_PAIR, vstr[3] + "-" + vstr[2], block, key));
+        return vIndexKeys;
+    }
+
+
+    if (vstr.size() == 10 && vstr[9] == TYPE_INSTANT_TRADE) {
+        if (!ParseInt32(vstr[7], &block)) return vIndexKeys;
+        vIndexKeys.push_back(TradeIndexKey(INDEX_CHANNEL, vstr[0], block, key));
+        return vIndexKeys;
+    }
+
+    return vIndexKeys;
+}
+
+/** Adds the index entries of a trade record, returns the number of entries added. */
+static int AddTradeIndexes(leveldb::WriteBatch& batch, const std::string& key, const std::string& value)
+{
+    const std::vector<std::string> vIndexKeys = GetTradeIndexKeys(key, value);
+    for (const std::string& indexKey : vIndexKeys) {
+        batch.Put(indexKey, key);
+    }
+
+    return vIndexKeys.size();
+}
+
+leveldb::Status CMPTradeList::writeIndexed(const std::string& key, const std::string& value)
+{
+    leveldb::WriteBatch batch;
+
+    // a record, which is written again, e.g. at another block after a reorg, drops its old index entries
+    std::string oldValue;
+    if (pdb->Get(readoptions, key, &oldValue).ok()) {
+        const std::vector<std::string> vNewKeys = GetTradeIndexKeys(key, value);
+        for (const std::string& indexKey : GetTradeIndexKeys(key, oldValue)) {
+            if (std::find(vNewKeys.begin(), vNewKeys.end(), indexKey) == vNewKeys.end()) {
+                batch.Delete(indexKey);
+            }
+        }
+    }
+
+    batch.Put(key, value);
+    AddTradeIndexes(batch, key, value);
+
+    return pdb->Write(writeoptions, &batch);
+}
+
+void CMPTradeList::upgradeRecords()
+{
+    std::string strFormat;
+    if (pdb->Get(readoptions, TRADE_FORMAT_MARKER, &strFormat).ok()) return;
+
+    int64_t nStart = GetTimeMillis();
+    int nRecords = 0;
+    int nPending = 0;
+    std::vector<std::string> vstr;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        const std::string strValue = it->value().ToString();
+        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
+
+        ContractTradeRecord record;
+        if (!record.parseText(vstr)) continue;
+
+        batch.Put(it->key(), record.encode());
+        if (++nPending >= TRADE_INDEX_BATCH_SIZE) {
+            pdb->Write(writeoptions, &batch);
+            batch.Clear();
+            nRecords += nPending;
+            nPending = 0;
+        }
+    }
+    delete it;
+
+    nRecords += nPending;
+    batch.Put(TRADE_FORMAT_MARKER, strprintf("%d", (int) ContractTradeRecord::VERSION));
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
+
+    PrintToLog("%s(): %d records converted in %d ms: %s\n", __func__, nRecords, GetTimeMillis() - nStart, status.ToString());
+}
+
+void CMPTradeList::buildIndexes()
+{
+    std::string strMarker;
+    if (pdb->Get(readoptions, TRADE_INDEX_MARKER, &strMarker).ok()) return;
+
+    int64_t nStart = GetTimeMillis();
+    int nEntries = 0;
+    int nPending = 0;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        nPending += AddTradeIndexes(batch, it->key().ToString(), it->value().ToString());
+        if (nPending >= TRADE_INDEX_BATCH_SIZE) {
+            pdb->Write(writeoptions, &batch);
+            batch.Clear();
+            nEntries += nPending;
+            nPending = 0;
+        }
+    }
+    delete it;
+
+    nEntries += nPending;
+    batch.Put(TRADE_INDEX_MARKER, "1");
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
 
-    reorgRecoveryMode = 1;
-    reorgRecoveryMaxHeight = (pBlockIndex->nHeight > reorgRecoveryMaxHeight) ? pBlockIndex->nHeight: reorgRecoveryMaxHeight;
-    return 0;
+    PrintToLog("%s(): %d index entries built in %d ms: %s\n", __func__, nEntries, GetTimeMillis() - nStart, status.ToString());
 }
 
-int mastercore_handler_disc_end(int nBlockNow, CBlockIndex const * pBlockIndex)
+void CMPTradeList::visitIndex(const std::string& prefix, bool fReverse, const std::function<bool(const std::string&, const std::string&)>& visitor) const
 {
-    LOCK(cs_tally);
+    leveldb::Iterator* it = NewIterator();
+    if (fReverse) {
+        // prefixes end with ':', which is followed by ';'
+        it->Seek(prefix.substr(0, prefix.size() - 1) + ";");
+        if (it->Valid()) {
+            it->Prev();
+        } else {
+            it->SeekToLast();
+        }
+    } else {
+        it->Seek(prefix);
+    }
 
-    return 0;
+    for (; it->Valid() && it->key().starts_with(prefix); fReverse ? it->Prev() : it->Next()) {
+        const std::string strKey = it->value().ToString();
+        std::string strValue;
+        if (!pdb->Get(readoptions, strKey, &strValue).ok()) continue;
+        // skip entries left behind by a record, which was written again with other values
+        const std::vector<std::string> vIndexKeys = GetTradeIndexKeys(strKey, strValue);
+        if (std::find(vIndexKeys.begin(), vIndexKeys.end(), it->key().ToString()) == vIndexKeys.end()) continue;
+        if (!visitor(strKey, strValue)) break;
+    }
+    delete it;
 }
 
-// obtains a vector of txids where the supplied address participated in a trade (needed for gettradehistory_MP)
-// optional property ID parameter will filter on propertyId transacted if supplied
-// sorted by block then index
 void CMPTradeList::getTradesForAddress(std::string address, std::vector<uint256>& vecTransactions, uint32_t propertyIdFilter)
 {
     if (!pdb) return;
-    std::map<std::string,uint256> mapTrades;
-    leveldb::Iterator* it = NewIterator();
-    for(it->SeekToFirst(); it->Valid(); it->Next()) {
-        const std::string strKey = it->key().ToString();
-        const std::string strValue = it->value().ToString();
+    visitIndex(TradeIndexPrefix(INDEX_ADDRESS, address), false, [&](const std::string& strKey, const std::string& strValue) {
         std::vector<std::string> vecValues;
-        if (strKey.size() != 64) continue; // only interested in trades
-        const uint256 txid = uint256S(strKey);
-        const size_t addressMatch = strValue.find(address);
-        if (addressMatch == std::string::npos) continue;
         boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vecValues.size() != 5) {
-            // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
-        }
+        if (vecValues.size() != 5) return true;
         const uint32_t propertyIdForSale = boost::lexical_cast<uint32_t>(vecValues[1]);
         const uint32_t propertyIdDesired = boost::lexical_cast<uint32_t>(vecValues[2]);
-        const int64_t blockNum = boost::lexical_cast<uint32_t>(vecValues[3]);
-        const int64_t txIndex = boost::lexical_cast<uint32_t>(vecValues[4]);
-        if (propertyIdFilter != 0 && propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) continue;
-        std::string sortKey = strprintf("%06d%010d", blockNum, txIndex);
-        mapTrades.insert(std::make_pair(sortKey, txid));
-    }
-    delete it;
-    for (const auto &m : mapTrades) {
-        vecTransactions.push_back(m.second);
-    }
+        if (propertyIdFilter != 0 && propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) return true;
+        vecTransactions.push_back(uint256S(strKey));
+        return true;
+    });
 }
 
 static bool CompareTradePair(const std::pair<int64_t, UniValue>& firstJSONObj, const std::pair<int64_t, UniValue>& secondJSONObj)
@@ -5046,24 +5640,22 @@ static bool CompareTradePair(const std::pair<int64_t, UniValue>& firstJSONObj, c
 void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyIdSideB, UniValue& responseArray, uint64_t count)
 {
     if (!pdb) return;
-    leveldb::Iterator* it = NewIterator();
-    std::vector<std::pair<int64_t, UniValue> > vecResponse;
+    std::vector<UniValue> vecResponse;
     bool propertyIdSideAIsDivisible = isPropertyDivisible(propertyIdSideA);
     bool propertyIdSideBIsDivisible = isPropertyDivisible(propertyIdSideB);
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        const std::string strKey = it->key().ToString();
-        const std::string strValue = it->value().ToString();
+    const std::string prefix = TradeIndexPrefix(INDEX_PAIR, strprintf("%d-%d", propertyIdSideA, propertyIdSideB));
+    visitIndex(prefix, true, [&](const std::string& strKey, const std::string& strValue) {
+        if (vecResponse.size() >= count) return false;
         std::vector<std::string> vecKeys;
         std::vector<std::string> vecValues;
         uint256 sellerTxid, matchingTxid;
         std::string sellerAddress, matchingAddress;
         int64_t amountReceived = 0, amountSold = 0;
-        if (strKey.size() != 129) continue; // only interested in matches
         boost::split(vecKeys, strKey, boost::is_any_of("+"), boost::token_compress_on);
         boost::split(vecValues, strValue, boost::is_any_of(":"), boost::token_compress_on);
         if (vecKeys.size() != 2 || vecValues.size() != 8) {
             // PrintToLog("TRADEDB error - unexpected number of tokens (%s:%s)\n", strKey, strValue);
-            continue;
+            return true;
         }
 
         const uint32_t tradePropertyIdSideA = boost::lexical_cast<uint32_t>(vecValues[2]);
@@ -5084,7 +5676,7 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
             matchingAddress = vecValues[1];
             amountReceived = boost::lexical_cast<int64_t>(vecValues[4]);
         } else {
-            continue;
+            return true;
         }
 
         rational_t unitPrice(amountReceived, amountSold);
@@ -5114,22 +5706,14 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
         }
         trade.pushKV("matchingtxid", matchingTxid.GetHex());
         trade.pushKV("matchingaddress", matchingAddress);
-        vecResponse.push_back(std::make_pair(blockNum, trade));
-    }
-
-    // sort the response most recent first before adding to the array
-    std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-
-    uint64_t elements = 0;
-    std::vector<std::pair<int64_t, UniValue>> aux;
-    for_each(vecResponse.begin(), vecResponse.end(), [&aux, &elements, &count] (const std::pair<int64_t, UniValue> p) { if(elements < count) aux.push_back(p); elements++; });
+        vecResponse.push_back(trade);
+        return true;
+    });
 
-    //reversing vector and pushing back
-    for (std::vector<std::pair<int64_t, UniValue>>::reverse_iterator it = aux.rbegin(); it != aux.rend(); it++){
-        responseArray.push_back(it->second);
+    // the most recent trades were visited first, but are listed in block order
+    for (std::vector<UniValue>::reverse_iterator it = vecResponse.rbegin(); it != vecResponse.rend(); it++){
+        responseArray.push_back(*it);
     }
-
-    delete it;
 }
 
 // obtains an array of trades in DEx
@@ -5275,13 +5859,10 @@ void CMPTxList::getChannelTrades(const std::string& address, const std::string&
 void CMPTradeList::getTokenChannelTrades(const std::string& address, const std::string& channel, uint32_t propertyId, UniValue& responseArray, uint64_t count)
 {
   if (!pdb) return;
-  leveldb::Iterator* it = NewIterator();
-  std::vector<std::pair<int64_t, UniValue> > vecResponse;
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      const std::string strKey = it->key().ToString();
-      const std::string strValue = it->value().ToString();
+  std::vector<UniValue> vecResponse;
+  visitIndex(TradeIndexPrefix(INDEX_CHANNEL, channel), true, [&](const std::string& strKey, const std::string& strValue) {
+      if (vecResponse.size() >= count) return false;
       std::vector<std::string> vecValues;
-      if (strKey.size() < 64) continue;
 
       int pos = strKey.find("+");
       const std::string strtxid = strKey.substr(pos + 1);
@@ -5289,21 +5870,22 @@ void CMPTradeList::getTokenChannelTrades(const std::string& address, const std::
       boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
       if (vecValues.size() != 10) {
           // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-          continue;
+          return true;
       }
 
       const std::string& type  = vecValues[9];
 
       // NOTE: improve this type string here (better: int)
-      if(type != TYPE_INSTANT_TRADE) continue;
+      if(type != TYPE_INSTANT_TRADE) return true;
 
       const uint32_t prop1 = boost::lexical_cast<uint32_t>(vecValues[3]);
       const uint32_t prop2 = boost::lexical_cast<uint32_t>(vecValues[5]);
-      if (propertyId != 0 && propertyId != prop1 && propertyId != prop2) continue;
+      if (propertyId != 0 && propertyId != prop1 && propertyId != prop2) return true;
 
-      const std::string& channel = vecValues[0];
       const std::string& buyer = vecValues[1];
       const std::string& seller = vecValues[2];
+      if (address != buyer && address != seller) return true;
+
       const uint64_t amountForSale = boost::lexical_cast<uint64_t>(vecValues[4]);
       const uint64_t amountDesired = boost::lexical_cast<uint64_t>(vecValues[6]);
       const int blockNum = boost::lexical_cast<int>(vecValues[7]);
@@ -5324,34 +5906,23 @@ void CMPTradeList::getTokenChannelTrades(const std::string& address, const std::
       trade.pushKV("amountdesired", FormatMP(prop2, amountDesired));
       trade.pushKV("unitprice", unitPriceStr);
 
-      vecResponse.push_back(std::make_pair(blockNum, trade));
-  }
-
-  // sort the response most recent first before adding to the array
-  std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-
-  uint64_t elements = 0;
-  std::vector<std::pair<int64_t, UniValue>> aux;
-  for_each(vecResponse.begin(), vecResponse.end(), [&aux, &elements, &count] (const std::pair<int64_t, UniValue> p) { if(elements < count) aux.push_back(p); elements++; });
+      vecResponse.push_back(trade);
+      return true;
+  });
 
-  //reversing vector and pushing back
-  for (std::vector<std::pair<int64_t, UniValue>>::reverse_iterator it = aux.rbegin(); it != aux.rend(); it++){
-      responseArray.push_back(it->second);
+  // the most recent trades were visited first, but are listed in block order
+  for (std::vector<UniValue>::reverse_iterator it = vecResponse.rbegin(); it != vecResponse.rend(); it++){
+      responseArray.push_back(*it);
   }
-
-  delete it;
 }
 
 void CMPTradeList::getChannelTradesForPair(const std::string& channel, uint32_t propertyIdA, uint32_t propertyIdB, UniValue& responseArray, uint64_t count)
 {
   if (!pdb) return;
-  leveldb::Iterator* it = NewIterator();
-  std::vector<std::pair<int64_t, UniValue> > vecResponse;
-  for(it->SeekToFirst(); it->Valid(); it->Next()) {
-      const std::string strKey = it->key().ToString();
-      const std::string strValue = it->value().ToString();
+  std::vector<UniValue> vecResponse;
+  visitIndex(TradeIndexPrefix(INDEX_CHANNEL, channel), true, [&](const std::string& strKey, const std::string& strValue) {
+      if (vecResponse.size() >= count) return false;
       std::vector<std::string> vecValues;
-      if (strKey.size() < 64) continue;
 
       int pos = strKey.find("+");
       const std::string strtxid = strKey.substr(pos + 1);
@@ -5359,24 +5930,23 @@ void CMPTradeList::getChannelTradesForPair(const std::string& channel, uint32_t
       boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
       if (vecValues.size() != 10) {
           // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-          continue;
+          return true;
       }
 
       const std::string& type  = vecValues[9];
 
       // NOTE: improve this type string here (better: int)
-      if(type != TYPE_INSTANT_TRADE) continue;
+      if(type != TYPE_INSTANT_TRADE) return true;
 
       const uint32_t prop1 = boost::lexical_cast<uint32_t>(vecValues[3]);
       const uint32_t prop2 = boost::lexical_cast<uint32_t>(vecValues[5]);
 
       //checking first property
-      if (propertyIdA != 0 && propertyIdA != prop1 && propertyIdA != prop2) continue;
+      if (propertyIdA != 0 && propertyIdA != prop1 && propertyIdA != prop2) return true;
       //checking second property
-      if (propertyIdB != 0 && propertyIdB != prop1 && propertyIdB != prop2) continue;
+      if (propertyIdB != 0 && propertyIdB != prop1 && propertyIdB != prop2) return true;
 
 
-      const std::string& channel = vecValues[0];
       const std::string& buyer = vecValues[1];
       const std::string& seller = vecValues[2];
       const uint64_t amountForSale = boost::lexical_cast<uint64_t>(vecValues[4]);
@@ -5399,29 +5969,21 @@ void CMPTradeList::getChannelTradesForPair(const std::string& channel, uint32_t
       trade.pushKV("amountdesired", FormatMP(prop2, amountDesired));
       trade.pushKV("unitprice", unitPriceStr);
 
-      vecResponse.push_back(std::make_pair(blockNum, trade));
-  }
-
-  // sort the response most recent first before adding to the array
-  std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-
-  uint64_t elements = 0;
-  std::vector<std::pair<int64_t, UniValue>> aux;
-  for_each(vecResponse.begin(), vecResponse.end(), [&aux, &elements, &count] (const std::pair<int64_t, UniValue> p) { if(elements < count) aux.push_back(p); elements++; });
+      vecResponse.push_back(trade);
+      return true;
+  });
 
-  //reversing vector and pushing back
-  for (std::vector<std::pair<int64_t, UniValue>>::reverse_iterator it = aux.rbegin(); it != aux.rend(); it++){
-      responseArray.push_back(it->second);
+  // the most recent trades were visited first, but are listed in block order
+  for (std::vector<UniValue>::reverse_iterator it = vecResponse.rbegin(); it != vecResponse.rend(); it++){
+      responseArray.push_back(*it);
   }
-
-  delete it;
 }
 
 void CMPTradeList::recordNewTrade(const uint256& txid, const std::string& address, uint32_t propertyIdForSale, uint32_t propertyIdDesired, int blockNum, int blockIndex)
 {
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%d:%d:%d:%d", address, propertyIdForSale, propertyIdDesired, blockNum, blockIndex);
-    Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+    Status status = writeIndexed(txid.ToString(), strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
 }
@@ -5451,7 +6013,7 @@ void CMPTradeList::recordNewInstantTrade(const uint256& txid, const std::string&
     if (!pdb) return;
     const std::string strValue = strprintf("%s:%s:%s:%d:%d:%d:%d:%d:%d:%s", channelAddr, first, second, propertyIdForSale, amount_forsale, propertyIdDesired, amount_desired, blockNum, blockIndex, TYPE_INSTANT_TRADE);
     const string key = to_string(blockNum) + "+" + txid.ToString(); // order by blockNum
-    Status status = pdb->Put(writeoptions, key, strValue);
+    Status status = writeIndexed(key, strValue);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __func__, status.ToString());
 }
@@ -6026,7 +6588,7 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
       Status status;
       if (pdb)
       {
-          status = pdb->Put(writeoptions, key, value);
+          status = writeIndexed(key, value);
           ++nWritten;
           if (msc_debug_tradedb) PrintToLog("%s(): %s\n", __FUNCTION__, status.ToString());
       }
@@ -6046,7 +6608,25 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
   // double UPNL1 = 0, UPNL2 = 0;
   /********************************************************************/
   const string key =  sblockNum2 + "+" + txid1.ToString() + "+" + txid2.ToString(); //order with block of taker.
-  const string value = strprintf("%s:%s:%lu:%lu:%lu:%d:%d:%s:%s:%d:%d:%d:%s:%s:%d:%d:%d", address1, address2, effective_price, amount_maker, amount_taker, blockNum1, blockNum2, s_maker0, s_taker0, lives_s0, lives_b0, property_traded, txid1.ToString(), txid2.ToString(), nCouldBuy0,amountpold, amountpnew);
+  ContractTradeRecord record;
+  record.makerAddress = address1;
+  record.takerAddress = address2;
+  record.effectivePrice = effective_price;
+  record.amountMaker = amount_maker;
+  record.amountTaker = amount_taker;
+  record.blockMaker = blockNum1;
+  record.blockTaker = blockNum2;
+  record.makerStatus = s_maker0;
+  record.takerStatus = s_taker0;
+  record.makerLives = lives_s0;
+  record.takerLives = lives_b0;
+  record.contractId = property_traded;
+  record.makerTxid = txid1;
+  record.takerTxid = txid2;
+  record.amountTraded = nCouldBuy0;
+  record.amountOld = amountpold;
+  record.amountNew = amountpnew;
+  const string value = record.encode();
 
   // const string line0 = gettingLineOut(address1, s_maker0, lives_s0, address2, s_taker0, lives_b0, nCouldBuy0, effective_price);
   // const string line1 = gettingLineOut(address1, s_maker1, lives_s1, address2, s_taker1, lives_b1, nCouldBuy1, effective_price);
@@ -6215,7 +6795,7 @@ void CMPTradeList::recordMatchedTrade(const uint256 txid1, const uint256 txid2,
   Status status;
   if (pdb)
     {
-      status = pdb->Put(writeoptions, key, value);
+      status = writeIndexed(key, value);
       ++nWritten;
     }
 
@@ -6484,37 +7064,28 @@ bool CMPTradeList::getMatchingTrades(uint32_t propertyId, UniValue& tradeArray)
 {
     if (!pdb) return false;
     int count = 0;
-    std::vector<std::string> vstr;
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
-
-    for(it->SeekToLast(); it->Valid(); it->Prev())
-    {
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
+    visitIndex(TradeIndexPrefix(INDEX_CONTRACT, strprintf("%d", propertyId)), true, [&](const std::string& strKey, const std::string& strValue) {
+        if (tradeArray.size() > 9) return false;
 
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vstr.size() != 17) {
-            //PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
+        ContractTradeRecord record;
+        if (!record.decode(strValue)) {
+            return true;
         }
 
-        // decode the details from the value string
-        const uint32_t prop1 = boost::lexical_cast<uint32_t>(vstr[11]);
-        const std::string& address1 = vstr[0];
-        const std::string& address2 = vstr[1];
-        int64_t amount1 = boost::lexical_cast<int64_t>(vstr[15]);
-        int64_t amount2 = boost::lexical_cast<int64_t>(vstr[16]);
-        const int block = boost::lexical_cast<int>(vstr[6]);
-        const int64_t price = boost::lexical_cast<int64_t>(vstr[2]);
-        const int64_t amount_traded = boost::lexical_cast<int64_t>(vstr[14]);
-        const std::string& txidmaker = vstr[12];
-        const std::string& txidtaker = vstr[13];
+        const uint32_t prop1 = record.contractId;
+        const std::string& address1 = record.makerAddress;
+        const std::string& address2 = record.takerAddress;
+        const int64_t amount1 = record.amountOld;
+        const int64_t amount2 = record.amountNew;
+        const int block = record.blockTaker;
+        const int64_t price = record.effectivePrice;
+        const int64_t amount_traded = record.amountTraded;
+        const std::string txidmaker = record.makerTxid.ToString();
+        const std::string txidtaker = record.takerTxid.ToString();
 
         // populate trade object and add to the trade array, correcting for orientation of trade
         if (prop1 != propertyId) {
-           continue;
+           return true;
         }
 
         UniValue trade(UniValue::VOBJ);
@@ -6532,9 +7103,8 @@ bool CMPTradeList::getMatchingTrades(uint32_t propertyId, UniValue& tradeArray)
             tradeArray.push_back(trade);
             ++count;
         }
-    }
-    // clean up
-    delete it; // Desallocation proccess
+        return true;
+    });
     if (count) { return true; } else { return false; }
 }
 
@@ -6543,37 +7113,29 @@ bool CMPTradeList::getMatchingTradesUnfiltered(uint32_t propertyId, UniValue& tr
 {
     if (!pdb) return false;
     int count = 0;
-    std::vector<std::string> vstr;
-    leveldb::Iterator* it = NewIterator(); // Allocation proccess
-
-    for(it->SeekToLast(); it->Valid(); it->Prev()) {
-        // search key to see if this is a matching trade
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
+    visitIndex(TradeIndexPrefix(INDEX_CONTRACT, strprintf("%d", propertyId)), true, [&](const std::string& strKey, const std::string& strValue) {
+        if (tradeArray.size() > 10000) return false;
 
-        // ensure correct amount of tokens in value string
-        boost::split(vstr, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vstr.size() != 17)
-            continue;
+        ContractTradeRecord record;
+        if (!record.decode(strValue)) {
+            return true;
+        }
 
-        // decode the details from the value string
-        // const string value = strprintf("%s:%s:%lu:%lu:%lu:%d:%d:%s:%s:%d:%d:%d:%s:%s:%d", address1, address2, effective_price, amount_maker, amount_taker, blockNum1,
-        // blockNum2, s_maker0, s_taker0, lives_s0, lives_b0, property_traded, txid1.ToString(), txid2.ToString(), nCouldBuy0);
-        const uint32_t prop1 = boost::lexical_cast<uint32_t>(vstr[11]);
-        const std::string& address1 = vstr[0];
-        const std::string& address2 = vstr[1];
-        const int64_t amount1 = boost::lexical_cast<int64_t>(vstr[15]);
-        const int64_t amount2 = boost::lexical_cast<int64_t>(vstr[16]);
-        int block = boost::lexical_cast<int>(vstr[6]);
-        const int64_t price = boost::lexical_cast<int64_t>(vstr[2]);
-        const int64_t amount_traded = boost::lexical_cast<int64_t>(vstr[14]);
-        const std::string& txidmaker = vstr[12];
-        const std::string& txidtaker = vstr[13];
+        const uint32_t prop1 = record.contractId;
+        const std::string& address1 = record.makerAddress;
+        const std::string& address2 = record.takerAddress;
+        const int64_t amount1 = record.amountOld;
+        const int64_t amount2 = record.amountNew;
+        const int block = record.blockTaker;
+        const int64_t price = record.effectivePrice;
+        const int64_t amount_traded = record.amountTraded;
+        const std::string txidmaker = record.makerTxid.ToString();
+        const std::string txidtaker = record.takerTxid.ToString();
 
         // populate trade object and add to the trade array, correcting for orientation of trade
 
         if (prop1 != propertyId) {
-            continue;
+            return true;
         }
 
         UniValue trade(UniValue::VOBJ);
@@ -6592,9 +7154,8 @@ bool CMPTradeList::getMatchingTradesUnfiltered(uint32_t propertyId, UniValue& tr
             tradeArray.push_back(trade);
             ++count;
         }
-    }
-    // clean up
-    delete it; // Desallocation proccess
+        return true;
+    });
     if (count) { return true; } else { return false; }
 }
 
@@ -6864,30 +7425,73 @@ int64_t getMinMargin(const uint32_t contractId, const int64_t& position, uint64_
       return margin;
 }
 
-//check position for a given address of this contractId
-bool checkContractPositions(int Block, const std::string &address, const uint32_t contractId, const CDInfo::Entry& sp, Register& reg)
+//! Positions evaluated by each liquidation worker; smaller passes run on the calling thread
+static const size_t LIQUIDATION_POSITIONS_PER_THREAD = 64;
+
+/** Margin figures of a single position, as seen by the liquidation engine.
+ */
+struct PositionCheck
+{
+    std::string address;
+    AccountId account;
+    uint32_t contractId;
+    const CDInfo::Entry* cd;
+    const Register* reg;
+    int64_t position;
+    int64_t reserve;
+    uint64_t revision;
+    int64_t upnl;
+    bool evaluated;
+};
+
+//! Phase one of the liquidation pass: only reads the register, safe to run in parallel
+static void evaluatePosition(PositionCheck& check)
 {
-    if(msc_debug_liquidation_enginee)
-    {
-        //PrintToLog("%s(): inside checkContractPositions \n",__func__);
+    try {
+        check.upnl = check.reg->computeUPNL(check.contractId, check.cd->notional_size, check.cd->isOracle(), check.cd->isInverseQuoted());
+        check.evaluated = true;
+    } catch (const std::exception& e) {
+        // left to the serial path
+        check.evaluated = false;
     }
+}
 
-    int64_t position =  reg.getRecord(contractId, CONTRACT_POSITION);
-
-    // we need an active position
-    if (0 == position) return false;
+static void evaluatePositions(std::vector<PositionCheck>& checks)
+{
+    const size_t nChunks = checks.size() / LIQUIDATION_POSITIONS_PER_THREAD;
 
-    const int64_t reserve = getMPbalance(address, sp.collateral_currency, CONTRACTDEX_RESERVE);
+    if (nChunks <= 1) {
+        for_each(checks.begin(), checks.end(), evaluatePosition);
+        return;
+    }
 
-    if(msc_debug_liquidation_enginee)
-    {
-        PrintToLog("%s(): contractdex reserve for address (%s): %d\n",__func__, address, reserve);
+    if (!liquidationWorkers) {
+        // the calling thread takes part in every pass
+        const size_t nCores = std::max(1u, std::thread::hardware_concurrency());
+        liquidationWorkers.reset(new WorkerPool(nCores - 1));
     }
 
-    const int64_t upnl = reg.getUPNL(contractId, sp.notional_size, sp.isOracle(), sp.isInverseQuoted());
+    const size_t nTasks = std::min(nChunks, liquidationWorkers->size() + 1);
+    const size_t chunk = (checks.size() + nTasks - 1) / nTasks;
+
+    liquidationWorkers->run(nTasks, [&checks, chunk](size_t n) {
+        const size_t begin = std::min(n * chunk, checks.size());
+        const size_t end = std::min(begin + chunk, checks.size());
+        for_each(checks.begin() + begin, checks.begin() + end, evaluatePosition);
+    });
+}
+
+//! Phase two of the liquidation pass: margin test and liquidation orders
+static bool submitLiquidation(int Block, const PositionCheck& check)
+{
+    const std::string& address = check.address;
+    const uint32_t contractId = check.contractId;
+    const CDInfo::Entry& sp = *check.cd;
+    const int64_t reserve = check.reserve;
+    const int64_t upnl = check.upnl;
 
     // absolute value needed
-    position = abs(position);
+    const int64_t position = abs(check.position);
 
     const int64_t min_margin = getMinMargin(contractId, position, sp.margin_requirement); //(min margin: 50% requirements for position)
 
@@ -6947,6 +7551,34 @@ bool checkContractPositions(int Block, const std::string &address, const uint32_
 }
 
 
+//check position for a given address of this contractId
+bool checkContractPositions(int Block, const std::string &address, AccountId account, const uint32_t contractId, const CDInfo::Entry& sp, Register& reg)
+{
+    PositionCheck check;
+    check.address = address;
+    check.account = account;
+    check.contractId = contractId;
+    check.cd = &sp;
+    check.reg = &reg;
+    check.position = reg.getRecord(contractId, CONTRACT_POSITION);
+
+    // we need an active position
+    if (0 == check.position) return false;
+
+    check.reserve = getMPbalance(account, sp.collateral_currency, CONTRACTDEX_RESERVE);
+
+    if(msc_debug_liquidation_enginee)
+    {
+        PrintToLog("%s(): contractdex reserve for address (%s): %d\n",__func__, address, check.reserve);
+    }
+
+    check.revision = reg.getRevision(contractId);
+    check.upnl = get_upnl_onmap(address, reg, contractId, sp.notional_size, sp.isOracle(), sp.isInverseQuoted());
+    check.evaluated = true;
+
+    return submitLiquidation(Block, check);
+}
+
 bool mastercore::LiquidationEngine(int Block)
 {
 
@@ -6954,6 +7586,13 @@ bool mastercore::LiquidationEngine(int Block)
 
     if(msc_debug_liquidation_enginee) PrintToLog("%s(): inside LiquidationEngine, nextCDID: %d\n",__func__, nextCDID);
 
+    // referenced by the checks below
+    std::map<uint32_t, CDInfo::Entry> contracts;
+    std::vector<PositionCheck> checks;
+
+    LOCK(cs_register);
+
+    // snapshot of every active position, by contract id and then address
     for (uint32_t contractId = 1; contractId < nextCDID; contractId++)
     {
          CDInfo::Entry sp;
@@ -6964,12 +7603,55 @@ bool mastercore::LiquidationEngine(int Block)
 
          if(msc_debug_liquidation_enginee) PrintToLog("%s(): contractId: %d\n",__func__, contractId);
 
-         // we check each position for this contract Id
-         LOCK(cs_register);
+         std::map<uint32_t, ContractPositions>::const_iterator it = mp_contract_positions.find(contractId);
+         if (it == mp_contract_positions.end()) {
+             continue;
+         }
+
+         const CDInfo::Entry& cd = (contracts[contractId] = sp);
+
+         for (const auto& holder : it->second.holders)
+         {
+             const Register& reg = mp_register_map[holder.second];
+
+             PositionCheck check;
+             check.address = holder.first;
+             check.account = holder.second;
+             check.contractId = contractId;
+             check.cd = &cd;
+             check.reg = &reg;
+             check.position = reg.getRecord(contractId, CONTRACT_POSITION);
+             check.reserve = getMPbalance(holder.second, cd.collateral_currency, CONTRACTDEX_RESERVE);
+             check.revision = reg.getRevision(contractId);
+             check.upnl = 0;
+             check.evaluated = false;
+
+             checks.push_back(check);
+         }
+    }
+
+    evaluatePositions(checks);
 
-         for_each(mp_register_map.begin(),mp_register_map.end(), [contractId, Block, &sp](std::unordered_map<std::string, Register>::value_type& unmap){ checkContractPositions(Block, unmap.first, contractId, sp, unmap.second);});
+    // orders are submitted one by one, so earlier liquidations may change later positions
+    for (const auto& check : checks)
+    {
+         Register& reg = mp_register_map[check.account];
 
-   }
+         if (!check.evaluated || check.revision != reg.getRevision(check.contractId) ||
+                 check.reserve != getMPbalance(check.account, check.cd->collateral_currency, CONTRACTDEX_RESERVE))
+         {
+             checkContractPositions(Block, check.address, check.account, check.contractId, *check.cd, reg);
+             continue;
+         }
+
+         if(msc_debug_liquidation_enginee)
+         {
+             PrintToLog("%s(): contractdex reserve for address (%s): %d\n",__func__, check.address, check.reserve);
+         }
+
+         set_upnl_onmap(check.address, reg, check.contractId, check.upnl);
+         submitLiquidation(Block, check);
+    }
 
    return true;
 
@@ -7802,31 +8484,12 @@ bool mastercore::Instant_x_Trade(const uint256& txid, uint8_t tradingAction, con
     return true;
 }
 
-void mastercore::iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const std::map<int, std::map<uint32_t,int64_t>>& aMap)
+void mastercore::iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const VolumeMap& aMap)
 {
-    for(const auto &m : aMap)
-    {
-        const int& blk = m.first;
-        if(blk < fblock && fblock != 0){
-            continue;
-        } else if(sblock < blk){
-            break;
-        }
-
-        const auto &blockMap = m.second;
-        auto itt = blockMap.find(propertyId);
-        if (itt != blockMap.end()){
-            const int64_t& newAmount = itt->second;
-            // overflows?
-            if(isOverflow(amount, newAmount)){
-                PrintToLog("%s() something is wrong with amount (Overflow) \n",__func__);
-                return;
-            }
-            amount += newAmount;
-        }
-
+    // overflows?
+    if (!aMap.sum(amount, propertyId, fblock, sblock)) {
+        PrintToLog("%s() something is wrong with amount (Overflow) \n",__func__);
     }
-
 }
 
 
@@ -7891,11 +8554,14 @@ int64_t mastercore::lastVolume(uint32_t propertyId, bool tokens)
 
 }
 
-int64_t mastercore::getOracleTwap(uint32_t contractId, int nBlocks)
+//! Cached TWAPs of the oracle prices, by contract and number of blocks
+static std::map<std::pair<uint32_t, int>, int64_t> oracleTwapCache;
+static CCriticalSection cs_oracle_twap;
+
+static int64_t calculateOracleTwap(uint32_t contractId, int nBlocks)
 {
      int64_t sum = 0;
      auto it = oraclePrices.find(contractId);
-     if(nBlocks==0){nBlocks=3;}
 
      if (it != oraclePrices.end())
      {
@@ -7924,6 +8590,49 @@ int64_t mastercore::getOracleTwap(uint32_t contractId, int nBlocks)
      return sum;
 }
 
+int64_t mastercore::getOracleTwap(uint32_t contractId, int nBlocks)
+{
+     if(nBlocks==0){nBlocks=3;}
+
+     LOCK(cs_oracle_twap);
+
+     const std::pair<uint32_t, int> key = std::make_pair(contractId, nBlocks);
+     std::map<std::pair<uint32_t, int>, int64_t>::const_iterator it = oracleTwapCache.find(key);
+     if (it != oracleTwapCache.end()) return it->second;
+
+     const int64_t twap = calculateOracleTwap(contractId, nBlocks);
+     oracleTwapCache.insert(std::make_pair(key, twap));
+
+     return twap;
+}
+
+int64_t mastercore::getOracleMarkPrice(uint32_t contractId)
+{
+     int64_t oracleTwap = getOracleTwap(contractId, 1);
+     const int64_t oracleLag = getOracleTwap(contractId, 3);
+
+     if(oracleLag*0.965>=oracleTwap){
+         oracleTwap = oracleLag*0.965;
+     }
+
+     return oracleTwap;
+}
+
+void mastercore::invalidateOracleTwap(uint32_t contractId)
+{
+     LOCK(cs_oracle_twap);
+
+     oracleTwapCache.erase(oracleTwapCache.lower_bound(std::make_pair(contractId, std::numeric_limits<int>::min())),
+                           oracleTwapCache.upper_bound(std::make_pair(contractId, std::numeric_limits<int>::max())));
+}
+
+void mastercore::clearOracleTwapCache()
+{
+     LOCK(cs_oracle_twap);
+
+     oracleTwapCache.clear();
+}
+
 
 int64_t mastercore::getContractTradesVWAP(uint32_t contractId, int nBlocks)
 {
@@ -8067,32 +8776,33 @@ void CMPTradeList::getUpnInfo(const std::string& address, uint32_t contractId, U
 
     for(it->SeekToFirst(); it->Valid(); it->Next())
     {
-        const std::string& strKey = it->key().ToString();
-        const std::string& strValue = it->value().ToString();
-        std::vector<std::string> vecValues;
-
-        boost::split(vecValues, strValue, boost::is_any_of(":"), token_compress_on);
-        if (vecValues.size() != 17) {
-            // PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
+        const leveldb::Slice value = it->value();
+        if (!DBRecordReader::IsRecord(value)) continue;
+
+        // the addresses come first, so other trades are skipped without decoding them
+        DBRecordReader reader(value);
+        if (reader.getType() != DB_RECORD_CONTRACT_TRADE) continue;
+        const leveldb::Slice maker = reader.readString();
+        const leveldb::Slice taker = reader.readString();
+        if (!reader.good() || (maker != address && taker != address)) {
             continue;
         }
 
-        const std::string& address1 = vecValues[0];
-        const std::string& address2 = vecValues[1];
+        ContractTradeRecord record;
+        if (!record.decode(value)) continue;
+
+        const std::string& address1 = record.makerAddress;
+        const std::string& address2 = record.takerAddress;
 
         bool first = (address1 != address);
         bool second = (address2 != address);
 
-        if(first && second){
-            continue;
-        }
-
         count++;
 
         if(msc_debug_get_upn_info) PrintToLog("%s(): searching for address: %s\n",__func__, address);
 
-        const std::string& status1  = vecValues[7];
-        const std::string& status2  = vecValues[8];
+        const std::string& status1  = record.makerStatus;
+        const std::string& status2  = record.takerStatus;
 
         PrintToLog("%s(): status1: %s, status2: %s\n",__func__, status1, status2);
 
@@ -8104,14 +8814,14 @@ void CMPTradeList::getUpnInfo(const std::string& address, uint32_t contractId, U
         if (msc_debug_get_upn_info)
         {
             PrintToLog("%s(): first: %d\n",__func__, (first) ? 1 : 0);
-            PrintToLog("%s(): strValue: %s\n",__func__, strValue);
+            PrintToLog("%s(): trade: %s\n",__func__, it->key().ToString());
             PrintToLog("%s(): position bool: %d\n",__func__, args.second);
             PrintToLog("%s(): address matched: %d\n",__func__, args.first);
         }
 
-        const uint64_t price = boost::lexical_cast<uint64_t>(vecValues[2]);
-        const uint64_t amount = boost::lexical_cast<uint64_t>(vecValues[14]);
-        const uint64_t blockNum = boost::lexical_cast<uint64_t>(vecValues[6]);
+        const uint64_t price = record.effectivePrice;
+        const uint64_t amount = record.amountTraded;
+        const uint64_t blockNum = record.blockTaker;
 
         // partial upnl
         calculateUPNL(sumUpnl, price, amount, exitPrice, args.second, sp.isInverseQuoted());
@@ -8250,6 +8960,36 @@ bool mastercore::channelSanityChecks(const std::string& sender, const std::strin
 
 }
 
+//! Number of blocks, token VWAP entries are kept (the VWAP uses the last 12 blocks)
+static const int VWAP_RETENTION_BLOCKS = 100;
+
+//! Number of blocks, whose LTC volume counts for the volume of a MetaDEx trade
+static const int LTC_VOLUME_BLOCKS = 1000;
+
+//! Number of blocks, traded volumes are kept: the widest window is the one of LTC_VOLUME_BLOCKS
+static const int VOLUME_RETENTION_BLOCKS = (LTC_VOLUME_BLOCKS > dayblocks) ? LTC_VOLUME_BLOCKS : dayblocks;
+
+void mastercore::pruneVolumes(int nBlock)
+{
+    const int firstBlock = nBlock - VOLUME_RETENTION_BLOCKS;
+
+    MapLTCVolume.prune(firstBlock);
+    MapTokenVolume.prune(firstBlock);
+    metavolume.prune(firstBlock);
+}
+
+void mastercore::pruneTokenVWap(int nBlock)
+{
+    const int firstBlock = nBlock - VWAP_RETENTION_BLOCKS;
+
+    for (auto it = tokenvwap.begin(); it != tokenvwap.end(); )
+    {
+        auto& vmap = it->second;
+        vmap.erase(vmap.begin(), vmap.lower_bound(firstBlock));
+        it = vmap.empty() ? tokenvwap.erase(it) : std::next(it);
+    }
+}
+
 int64_t mastercore::getVWap(uint32_t propertyId, int aBlock, const std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>>& aMap)
 {
     int64_t volume = 0;
@@ -8259,7 +8999,7 @@ int64_t mastercore::getVWap(uint32_t propertyId, int aBlock, const std::map<uint
     if (it != aMap.end())
     {
         auto &vmap = it->second;
-        auto itt = (rollback > 0) ? find_if(vmap.begin(), vmap.end(), [&rollback] (const std::pair<int,std::vector<std::pair<int64_t,int64_t>>>& int_arith_pair) { return (int_arith_pair.first >= rollback);}) : vmap.begin();
+        auto itt = (rollback > 0) ? vmap.lower_bound(rollback) : vmap.begin();
         if (itt != vmap.end())
         {
             for ( ; itt != vmap.end(); ++itt)
@@ -8283,7 +9023,7 @@ int64_t mastercore::getVWap(uint32_t propertyId, int aBlock, const std::map<uint
 int64_t mastercore::increaseLTCVolume(uint32_t propertyId, uint32_t propertyDesired, int aBlock)
 {
     int64_t total = 0, propertyAmount = 0, propertyDesiredAmount = 0;
-    const int rollback = aBlock - 1000;
+    const int rollback = aBlock - LTC_VOLUME_BLOCKS;
     iterVolume(propertyAmount, propertyId, rollback, aBlock, MapLTCVolume);
     iterVolume(propertyDesiredAmount, propertyDesired, rollback, aBlock, MapLTCVolume);
 
@@ -8295,7 +9035,7 @@ int64_t mastercore::increaseLTCVolume(uint32_t propertyId, uint32_t propertyDesi
         total = ConvertTo64(aTotal);
 
         // increment cumulative LTC volume by tokens traded * the 12-block VWAP
-        if (total > 0) MapLTCVolume[aBlock][propertyDesired] += total;
+        if (total > 0) MapLTCVolume.add(aBlock, propertyDesired, total);
 
     }
 
@@ -8386,12 +9126,7 @@ int64_t blocksettlement::getTotalLoss(const uint32_t& contractId, const uint32_t
         return 0;
     }
 
-     int64_t oracleTwap = mastercore::getOracleTwap(contractId, 1);
-     int64_t oracleLag = mastercore::getOracleTwap(contractId, 3);
-
-    if(oracleLag*0.965>=oracleTwap){
-        oracleTwap = oracleLag*0.965;
-    }
+    const int64_t oracleTwap = mastercore::getOracleMarkPrice(contractId);
 
     //! Systemic Loss in a Block = the volume-weighted avg. price of bankruptcy (for each position we need the bankruptcy price, and the volume of liquidation) for unfilled liquidations
     // * the sign of the liquidated contracts * their notional value (this depends of contract denomination) * the # of contracts (number of contract in liquidation) * (Liq. VWAP - Mark Price)
@@ -8406,45 +9141,29 @@ int64_t blocksettlement::getTotalLoss(const uint32_t& contractId, const uint32_t
 
 void blocksettlement::lossSocialization(const uint32_t& contractId, const uint32_t& collateral, int64_t fullAmount)
 {
-    int count = 0;
     LOCK(cs_register);
-    std::vector<std::string> zeroposition;
-
-    for(const auto& p : mp_register_map)
-    {
-        const Register& reg = p.second;
-        const int64_t position = reg.getRecord(contractId, CONTRACT_POSITION);
 
-        //PrintToLog("%s(): position: %d, contractId: %d \n",__func__, position, contractId);
-        // not counting these addresses
-        if (0 == position) {
-            zeroposition.push_back(p.first);
-        } else {
-            count++;
-        }
-    }
-
-    if (count == 0) {
+    std::map<uint32_t, ContractPositions>::const_iterator it = mp_contract_positions.find(contractId);
+    if (it == mp_contract_positions.end() || it->second.holders.empty()) {
         return;
     }
 
+    // not counting addresses without position
+    const ContractPositions::Accounts& holders = it->second.holders;
+    const int count = holders.size();
+
     const int64_t fraction = fullAmount / count;
 
     PrintToLog("%s(): fraction: %d, fullAmount: %d, count : %d\n",__func__, fraction, fullAmount, count);
 
-    for(auto& q : mp_register_map)
+    for(const auto& holder : holders)
     {
-        auto it = find (zeroposition.begin(), zeroposition.end(), q.first);
-        if (it == zeroposition.end()) {
-            // Register& reg = q.second;
-            const int64_t available = getMPbalance(q.first, collateral, BALANCE);
-            const int64_t amount = (available >= fraction) ? fraction : available;
-            PrintToLog("%s(): available: %d, amount: %d, collateralId : %d\n",__func__, available, amount, collateral);
-            // reg.updateRecord(contractId, amount, MARGIN);
-            if (amount > 0)
-                update_tally_map(q.first, collateral, amount, BALANCE);
-        }
-
+        const int64_t available = getMPbalance(holder.second, collateral, BALANCE);
+        const int64_t amount = (available >= fraction) ? fraction : available;
+        PrintToLog("%s(): available: %d, amount: %d, collateralId : %d\n",__func__, available, amount, collateral);
+        // reg.updateRecord(contractId, amount, MARGIN);
+        if (amount > 0)
+            update_tally_map(holder.second, collateral, amount, BALANCE);
     }
 
 
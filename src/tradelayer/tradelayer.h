@@ -1,10 +1,12 @@
 #ifndef TRADELAYER_TL_H
 #define TRADELAYER_TL_H
 
+#include <tradelayer/accounts.h>
 #include <tradelayer/log.h>
 #include <tradelayer/persistence.h>
 #include <tradelayer/tally.h>
 #include <tradelayer/tradelayer_matrices.h>
+#include <tradelayer/volume.h>
 
 #include <arith_uint256.h>
 #include <chain.h>
@@ -18,6 +20,8 @@
 #include <leveldb/status.h>
 #include <openssl/sha.h>
 
+#include <algorithm>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -409,7 +413,7 @@ class nodeReward
     void updateAddressStatus(const std::string& address, bool newStatus);
     bool isAddressIncluded(const std::string& address);
 
-    void saveNodeReward(ofstream &file, CHash256& hasher);
+    void saveNodeReward(std::ostream& file, CHash256& hasher);
     void clearNodeRewardMap() { nodeRewardsAddrs.clear(); }
     const std::map<string, int64_t>& getWinners() const { return winners; }
     void addWinner(const std::string& address, int64_t amount);
@@ -535,11 +539,31 @@ public:
  */
 class CMPTradeList : public CDBBase
 {
+ private:
+  /** Writes a record together with its secondary index entries. */
+  leveldb::Status writeIndexed(const std::string& key, const std::string& value);
+
+  /** Converts text records of older clients into binary records. */
+  void upgradeRecords();
+
+  /** Builds the secondary indexes of databases, which were created without them. */
+  void buildIndexes();
+
+  /**
+   * Visits the records referenced by a range of index entries in block order, or
+   * most recent first, until the visitor returns false.
+   */
+  void visitIndex(const std::string& prefix, bool fReverse, const std::function<bool(const std::string&, const std::string&)>& visitor) const;
+
  public:
   CMPTradeList(const fs::path& path, bool fWipe)
     {
       leveldb::Status status = Open(path, fWipe);
       if (msc_debug_persistence) PrintToLog("Loading trades database: %s\n", status.ToString());
+      if (status.ok()) {
+          upgradeRecords();
+          buildIndexes();
+      }
     }
 
   virtual ~CMPTradeList()
@@ -650,13 +674,13 @@ extern std::map<uint32_t, int64_t> lastPrice;
 extern std::map<uint32_t, std::map<uint32_t, int64_t>> market_priceMap;
 extern std::map<uint32_t, std::map<std::string, double>> addrs_upnlc;
 extern std::map<uint32_t, int64_t> VWAPMapContracts;
-extern std::map<uint32_t, std::vector<int64_t>> mapContractVolume;
-extern std::map<uint32_t, std::vector<int64_t>> mapContractAmountTimesPrice;
+//! Latest fills of each contract, for its VWAP
+extern std::map<uint32_t, mastercore::VWAPWindow> contractVWAPWindows;
 
 extern std::map<uint32_t, std::map<uint32_t, int64_t>> VWAPMap;
 extern std::map<uint32_t, std::map<uint32_t, int64_t>> VWAPMapSubVector;
-extern std::map<uint32_t, std::map<uint32_t, std::vector<int64_t>>> numVWAPVector;
-extern std::map<uint32_t, std::map<uint32_t, std::vector<int64_t>>> denVWAPVector;
+//! Latest fills of each pair of tokens, for its VWAP
+extern std::map<uint32_t, std::map<uint32_t, mastercore::VWAPWindow>> tokenVWAPWindows;
 
 extern std::vector<std::map<std::string, std::string>> path_ele;
 extern std::vector<std::map<std::string, std::string>> path_elef;
@@ -664,6 +688,8 @@ extern std::vector<std::map<std::string, std::string>> path_elef;
 extern nodeReward nR;
 
 int64_t getMPbalance(const std::string& address, uint32_t propertyId, TallyType ttype);
+/** Same as above, for an account id, which was resolved by the caller. */
+int64_t getMPbalance(mastercore::AccountId account, uint32_t propertyId, TallyType ttype);
 int64_t getUserAvailableMPbalance(const std::string& address, uint32_t propertyId);
 int64_t getUserReserveMPbalance(const std::string& address, uint32_t propertyId);
 
@@ -684,6 +710,10 @@ int mastercore_handler_block_begin(int nBlockNow, CBlockIndex const *pBlockIndex
 int mastercore_handler_block_end(int nBlockNow, CBlockIndex const *pBlockIndex, unsigned int);
 bool mastercore_handler_tx(const CTransaction& tx, int nBlock, unsigned int idx, const CBlockIndex *pBlockIndex, std::shared_ptr<std::map<COutPoint, Coin>> removedCoin, bool setOracle);
 int mastercore_save_state( CBlockIndex const *pBlockIndex );
+/** Renders the state file of the given type, as it is written by mastercore_save_state(). */
+int write_state_file(int what, std::string& data);
+/** Loads a state file of the given type, and replaces the state it holds. */
+int msc_file_load(const std::string& filename, int what, bool verifyHash = false);
 void creatingVestingTokens(int block);
 void lookingin_globalvector_pastlivesperpetuals(std::vector<std::map<std::string, std::string>> &lives_g, MatrixTLS M_file, std::vector<std::string> addrs_vg, std::vector<std::map<std::string, std::string>> &lives_h);
 void lookingaddrs_inside_M_file(std::string addrs, MatrixTLS M_file, std::vector<std::map<std::string, std::string>> &lives_g, std::vector<std::map<std::string, std::string>> &lives_h);
@@ -697,9 +727,28 @@ inline int64_t clamp_function(int64_t diff, int64_t nclamp);
 bool TxValidNodeReward(std::string ConsensusHash, std::string Tx);
 double getAccumVesting(const int64_t xAxis);
 
+/** Holders and supply of a single property.
+ */
+struct PropertySupply
+{
+    //! Addresses with a non-zero balance of any tally type
+    std::set<std::string> holders;
+    //! Number of addresses, whose tokens count towards the supply
+    int64_t owners;
+    //! Sum of the balances of all addresses by tally type
+    int64_t totals[TALLY_TYPE_COUNT];
+
+    PropertySupply() : owners(0)
+    {
+        std::fill(totals, totals + TALLY_TYPE_COUNT, 0);
+    }
+};
+
 namespace mastercore
 {
-  extern std::unordered_map<std::string, CMPTally> mp_tally_map;
+  extern AccountMap<CMPTally> mp_tally_map;
+  //! Holders and supply by property, guarded by cs_tally
+  extern std::map<uint32_t, PropertySupply> mp_property_supply;
   extern CMPTxList *p_txlistdb;
   extern CtlTransactionDB *p_TradeTXDB;
   extern CMPTradeList *t_tradelistdb;
@@ -729,6 +778,9 @@ namespace mastercore
 
   CMPTally* getTally(const std::string& address);
 
+  /** Clears all tallies and the supply index. */
+  void clear_tally_map();
+
   int64_t getTotalTokens(uint32_t propertyId, int64_t* n_owners_total = nullptr);
 
   std::string strTransactionType(unsigned int txType);
@@ -736,6 +788,9 @@ namespace mastercore
   /** Returns the encoding class, used to embed a payload. */
   int GetEncodingClass(const CTransaction& tx, int nBlock);
 
+  /** Returns the encoding classes of all transactions of a block, and the number of Trade Layer transactions. */
+  unsigned int GetEncodingClasses(const CBlock& block, int nBlock, std::vector<int>& vClasses);
+
   /** Determines, whether it is valid to use a Class D transaction for a given payload size. */
   bool UseEncodingClassD(size_t nDataSize);
 
@@ -743,6 +798,12 @@ namespace mastercore
 
   bool update_tally_map(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype);
 
+  /** Same as above, for an account id, which was resolved by the caller. */
+  bool update_tally_map(AccountId account, uint32_t propertyId, int64_t amount, TallyType ttype);
+
+  /** Same as CMPTally::updateMoney(), but also updating the supply index; requires cs_tally. */
+  bool update_money_onmap(const std::string& who, CMPTally& tally, uint32_t propertyId, int64_t amount, TallyType ttype);
+
   std::string getTokenLabel(uint32_t propertyId);
 
   bool marginMain(int Block);
@@ -774,8 +835,18 @@ namespace mastercore
 
   void twapForLiquidation(uint32_t contractId, int blocks);
 
+  /** TWAP of the oracle prices of the last blocks, cached until the oracle prices change, or a block is connected or disconnected. */
   int64_t getOracleTwap(uint32_t contractId, int nBlocks);
 
+  /** Mark price of an oracle contract: the TWAP of the last block, but no less than 96.5 % of the TWAP of the last three blocks. */
+  int64_t getOracleMarkPrice(uint32_t contractId);
+
+  /** Drops the cached TWAPs of a contract, after its oracle prices changed. */
+  void invalidateOracleTwap(uint32_t contractId);
+
+  /** Drops the cached TWAPs of all contracts. */
+  void clearOracleTwapCache();
+
   int64_t getContractTradesVWAP(uint32_t contractId, int nBlocks);
 
   // check for vesting
@@ -803,7 +874,12 @@ namespace mastercore
 
   int64_t getVWap(uint32_t propertyId, int aBlock, const std::map<uint32_t,std::map<int,std::vector<std::pair<int64_t,int64_t>>>>& aMap);
 
-  void iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const std::map<int, std::map<uint32_t,int64_t>>& aMap);
+  /** Drops token VWAP entries, which are too old to be used for the 12-block VWAP anymore. */
+  void pruneTokenVWap(int nBlock);
+  /** Drops the traded volumes of blocks, which are older than the widest volume window. */
+  void pruneVolumes(int nBlock);
+
+  void iterVolume(int64_t& amount, uint32_t propertyId, const int& fblock, const int& sblock, const VolumeMap& aMap);
 
   bool Token_LTC_Fees(int64_t& buyer_amountGot, uint32_t propertyId);
 
@@ -4,6 +4,7 @@
 
 #include <tradelayer/activation.h>
 #include <tradelayer/ce.h>
+#include <tradelayer/changeset.h>
 #include <tradelayer/convert.h>
 #include <tradelayer/dex.h>
 #include <tradelayer/externfns.h>
@@ -134,19 +135,19 @@ static std::string intToClass(int encodingClass)
     return "-";
 }
 
-/** Obtains the next varint from a payload. */
-std::vector<uint8_t> CMPTransaction::GetNextVarIntBytes(int &i) {
-    std::vector<uint8_t> vecBytes;
+/** Obtains the next varint from a payload, the returned bytes point into the payload. */
+VarIntBytes CMPTransaction::GetNextVarIntBytes(int &i) {
+    VarIntBytes bytes = { &pkt[i], 0 };
 
     do {
-        vecBytes.push_back(pkt[i]);
+        bytes.size++;
         if (!IsMSBSet(&pkt[i])) break;
         i++;
     } while (i < pkt_size);
 
     i++;
 
-    return vecBytes;
+    return bytes;
 }
 
 
@@ -325,8 +326,8 @@ bool CMPTransaction::interpret_TransactionType()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
 
     if (!vecVersionBytes.empty()) {
         version = DecompressInteger(vecVersionBytes);
@@ -352,10 +353,10 @@ bool CMPTransaction::interpret_SimpleSend()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     if (!vecPropIdBytes.empty()) {
         property = DecompressInteger(vecPropIdBytes);
@@ -379,8 +380,8 @@ bool CMPTransaction::interpret_SendMany()
 {
     int i = 0;
 
-    auto vecVersionBytes = GetNextVarIntBytes(i);
-    auto vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
     auto vecPropIdBytes = GetNextVarIntBytes(i);
 
     if (type != 1 || vecPropIdBytes.empty()) return false;
@@ -412,9 +413,9 @@ bool CMPTransaction::interpret_SendVestingTokens()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
+  VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
   if (!vecAmountBytes.empty()) {
     nValue = DecompressInteger(vecAmountBytes);
@@ -434,8 +435,8 @@ bool CMPTransaction::interpret_SendAll()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
 
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
         PrintToLog("\t       inside interpret \n");
@@ -449,10 +450,10 @@ bool CMPTransaction::interpret_CreatePropertyFixed()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPrevPropIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPrevPropIdBytes = GetNextVarIntBytes(i);
 
     const char* p = i + (char*) &pkt;
     std::vector<std::string> spstr;
@@ -472,11 +473,11 @@ bool CMPTransaction::interpret_CreatePropertyFixed()
     memcpy(data, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(data)-1)); j++;
     i = i + strlen(name) + strlen(url) + strlen(data) + 3; // data sizes + 3 null terminators
 
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     do
     {
-        std::vector<uint8_t> vecKyc = GetNextVarIntBytes(i);
+        VarIntBytes vecKyc = GetNextVarIntBytes(i);
         if (!vecKyc.empty())
         {
             const int64_t num = static_cast<int64_t>(DecompressInteger(vecKyc));
@@ -515,10 +516,10 @@ bool CMPTransaction::interpret_CreatePropertyManaged()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPrevPropIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPrevPropIdBytes = GetNextVarIntBytes(i);
 
     const char* p = i + (char*) &pkt;
     std::vector<std::string> spstr;
@@ -540,7 +541,7 @@ bool CMPTransaction::interpret_CreatePropertyManaged()
 
     do
     {
-        std::vector<uint8_t> vecKyc = GetNextVarIntBytes(i);
+        VarIntBytes vecKyc = GetNextVarIntBytes(i);
         if (!vecKyc.empty())
         {
             const int64_t num = static_cast<int64_t>(DecompressInteger(vecKyc));
@@ -573,10 +574,10 @@ bool CMPTransaction::interpret_GrantTokens()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     if (!vecPropIdBytes.empty()) {
       property = DecompressInteger(vecPropIdBytes);
@@ -600,10 +601,10 @@ bool CMPTransaction::interpret_RevokeTokens()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     if (!vecPropIdBytes.empty()) {
         property = DecompressInteger(vecPropIdBytes);
@@ -627,9 +628,9 @@ bool CMPTransaction::interpret_ChangeIssuer()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropIdBytes = GetNextVarIntBytes(i);
 
     if (!vecPropIdBytes.empty()) {
         property = DecompressInteger(vecPropIdBytes);
@@ -647,9 +648,9 @@ bool CMPTransaction::interpret_Deactivation()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecFeatureIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecFeatureIdBytes = GetNextVarIntBytes(i);
 
     if (!vecFeatureIdBytes.empty()) {
         feature_id = DecompressInteger(vecFeatureIdBytes);
@@ -667,11 +668,11 @@ bool CMPTransaction::interpret_Activation()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecFeatureIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecActivationBlockBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecMinClientBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecFeatureIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecActivationBlockBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecMinClientBytes = GetNextVarIntBytes(i);
 
     if (!vecFeatureIdBytes.empty()) {
         feature_id = DecompressInteger(vecFeatureIdBytes);
@@ -699,10 +700,10 @@ bool CMPTransaction::interpret_Alert()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAlertTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAlertExpiryBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecAlertTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAlertExpiryBytes = GetNextVarIntBytes(i);
 
     const char* p = i + (char*) &pkt;
     std::string spstr(p);
@@ -735,14 +736,14 @@ bool CMPTransaction::interpret_DExSell()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountDesiredBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTimeLimitBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecMinFeeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecSubActionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountForSaleBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountDesiredBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTimeLimitBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecMinFeeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecSubActionBytes = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
         type = DecompressInteger(vecTypeBytes);
@@ -797,14 +798,14 @@ bool CMPTransaction::interpret_DExBuy()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPriceBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTimeLimitBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecMinFeeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecSubActionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountForSaleBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPriceBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTimeLimitBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecMinFeeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecSubActionBytes = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
         type = DecompressInteger(vecTypeBytes);
@@ -857,10 +858,10 @@ bool CMPTransaction::interpret_DExBuy()
 bool CMPTransaction::interpret_AcceptOfferBTC()
 {
   int i = 0;
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyIdForSaleBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyIdForSaleBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecAmountForSaleBytes = GetNextVarIntBytes(i);
 
   if (!vecTypeBytes.empty()) {
     type = DecompressInteger(vecTypeBytes);
@@ -894,12 +895,12 @@ bool CMPTransaction::interpret_MetaDExTrade()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdForSaleBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdDesiredBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountDesiredBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdForSaleBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountForSaleBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdDesiredBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountDesiredBytes = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
         type = DecompressInteger(vecTypeBytes);
@@ -943,10 +944,10 @@ bool CMPTransaction::interpret_MetaDExTrade()
 bool CMPTransaction::interpret_CreateContractDex()
 {
   int i = 0;
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecNum = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecDen = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecNum = GetNextVarIntBytes(i);
+  VarIntBytes vecDen = GetNextVarIntBytes(i);
   const char* p = i + (char*) &pkt;
   std::vector<std::string> spstr;
   for (int j = 0; j < 1; j++) {
@@ -963,15 +964,15 @@ bool CMPTransaction::interpret_CreateContractDex()
   memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
   i = i + strlen(name) + 1; // data sizes + 1 null terminators
 
-  std::vector<uint8_t> vecBlocksUntilExpiration = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecNotionalSize = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecCollateralCurrency = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecMarginRequirement = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecInverse = GetNextVarIntBytes(i);
+  VarIntBytes vecBlocksUntilExpiration = GetNextVarIntBytes(i);
+  VarIntBytes vecNotionalSize = GetNextVarIntBytes(i);
+  VarIntBytes vecCollateralCurrency = GetNextVarIntBytes(i);
+  VarIntBytes vecMarginRequirement = GetNextVarIntBytes(i);
+  VarIntBytes vecInverse = GetNextVarIntBytes(i);
 
   do
   {
-      std::vector<uint8_t> vecKyc = GetNextVarIntBytes(i);
+      VarIntBytes vecKyc = GetNextVarIntBytes(i);
       if (!vecKyc.empty())
       {
           const int64_t num = static_cast<int64_t>(DecompressInteger(vecKyc));
@@ -1042,8 +1043,8 @@ bool CMPTransaction::interpret_CreateContractDex()
 bool CMPTransaction::interpret_ContractDexTrade()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
 
     const char* p = i + (char*) &pkt;
     std::vector<std::string> spstr;
@@ -1063,10 +1064,10 @@ bool CMPTransaction::interpret_ContractDexTrade()
     memcpy(name_traded, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name_traded)-1)); j++;
     i = i + strlen(name_traded) + 1;
 
-    std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecEffectivePriceBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTradingActionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecLeverage = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountForSaleBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecEffectivePriceBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTradingActionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecLeverage = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
       type = DecompressInteger(vecTypeBytes);
@@ -1109,8 +1110,8 @@ bool CMPTransaction::interpret_ContractDexTrade()
 bool CMPTransaction::interpret_ContractDExCancel()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
 
     const char* p = i + (char*) &pkt;
     std::vector<std::string> spstr;
@@ -1154,9 +1155,9 @@ bool CMPTransaction::interpret_ContractDExCancel()
 bool CMPTransaction::interpret_ContractDexCancelEcosystem()
 {
   int i = 0;
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecContractIdBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecContractIdBytes = GetNextVarIntBytes(i);
 
   if (!vecTypeBytes.empty()) {
     type = DecompressInteger(vecTypeBytes);
@@ -1186,9 +1187,9 @@ bool CMPTransaction::interpret_ContractDexClosePosition()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecContractIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecContractIdBytes = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
         type = DecompressInteger(vecTypeBytes);
@@ -1217,10 +1218,10 @@ bool CMPTransaction::interpret_ContractDex_Cancel_Orders_By_Block()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecBlockBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecIdxBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecBlockBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecIdxBytes = GetNextVarIntBytes(i);
 
     if (!vecVersionBytes.empty()) {
         version = DecompressInteger(vecVersionBytes);
@@ -1253,8 +1254,8 @@ bool CMPTransaction::interpret_ContractDex_Cancel_Orders_By_Block()
 bool CMPTransaction::interpret_MetaDExCancel()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
 
     const char* p = i + (char*) &pkt;
     std::vector<std::string> spstr;
@@ -1298,10 +1299,10 @@ bool CMPTransaction::interpret_MetaDExCancel()
 bool CMPTransaction::interpret_MetaDExCancel_ByPair()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdForSale = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdDesired = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdForSale = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdDesired = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
         type = DecompressInteger(vecTypeBytes);
@@ -1335,12 +1336,12 @@ bool CMPTransaction::interpret_MetaDExCancel_ByPair()
 bool CMPTransaction::interpret_MetaDExCancel_ByPrice()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdForSale = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountForSale = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdDesired = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountDesired = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdForSale = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountForSale = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdDesired = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountDesired = GetNextVarIntBytes(i);
 
     if (!vecTypeBytes.empty()) {
         type = DecompressInteger(vecTypeBytes);
@@ -1384,10 +1385,10 @@ bool CMPTransaction::interpret_CreatePeggedCurrency()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPrevPropIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPrevPropIdBytes = GetNextVarIntBytes(i);
     const char* p = i + (char*) &pkt;
     std::vector<std::string> spstr;
     spstr.push_back(std::string(p));
@@ -1402,9 +1403,9 @@ bool CMPTransaction::interpret_CreatePeggedCurrency()
 
     memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
     i = i + strlen(name) + 1; // data sizes + 3 null terminators
-    std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecContractIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecContractIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     if (!vecPropTypeBytes.empty()) {
         prop_type = DecompressInteger(vecPropTypeBytes);
@@ -1451,10 +1452,10 @@ bool CMPTransaction::interpret_SendPeggedCurrency()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecMessageVerBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecMessageTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecMessageVerBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecMessageTypeBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecPropertyIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     if (!vecMessageVerBytes.empty()) {
         version = DecompressInteger(vecMessageVerBytes);
@@ -1487,11 +1488,11 @@ bool CMPTransaction::interpret_RedemptionPegged()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecMessageVerBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecMessageTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecContractIdBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecMessageVerBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecMessageTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyIdBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecContractIdBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
   if (!vecMessageVerBytes.empty()) {
     version = DecompressInteger(vecMessageVerBytes);
@@ -1530,8 +1531,8 @@ bool CMPTransaction::interpret_CreateOracleContract()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
   const char* p = i + (char*) &pkt;
   std::vector<std::string> spstr;
   spstr.push_back(std::string(p));
@@ -1546,11 +1547,11 @@ bool CMPTransaction::interpret_CreateOracleContract()
   memcpy(name, spstr[j].c_str(), std::min(spstr[j].length(), sizeof(name)-1)); j++;
   i = i + strlen(name) + 1; // data sizes + 2 null terminators
 
-  std::vector<uint8_t> vecBlocksUntilExpiration = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecNotionalSize = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecCollateralCurrency = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecMarginRequirement = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecInverse = GetNextVarIntBytes(i);
+  VarIntBytes vecBlocksUntilExpiration = GetNextVarIntBytes(i);
+  VarIntBytes vecNotionalSize = GetNextVarIntBytes(i);
+  VarIntBytes vecCollateralCurrency = GetNextVarIntBytes(i);
+  VarIntBytes vecMarginRequirement = GetNextVarIntBytes(i);
+  VarIntBytes vecInverse = GetNextVarIntBytes(i);
 
 
   if (!vecVersionBytes.empty()) {
@@ -1590,7 +1591,7 @@ bool CMPTransaction::interpret_CreateOracleContract()
 
   do
   {
-      std::vector<uint8_t> vecKyc = GetNextVarIntBytes(i);
+      VarIntBytes vecKyc = GetNextVarIntBytes(i);
       if (!vecKyc.empty())
       {
           const int64_t num = static_cast<int64_t>(DecompressInteger(vecKyc));
@@ -1624,9 +1625,9 @@ bool CMPTransaction::interpret_Change_OracleAdm()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecContIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecContIdBytes = GetNextVarIntBytes(i);
 
     if (!vecContIdBytes.empty()) {
         contractId = DecompressInteger(vecContIdBytes);
@@ -1647,12 +1648,12 @@ bool CMPTransaction::interpret_Set_Oracle()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecContIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecHighBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecLowBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecCloseBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecContIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecHighBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecLowBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecCloseBytes = GetNextVarIntBytes(i);
 
     if (!vecContIdBytes.empty()) {
         contractId = DecompressInteger(vecContIdBytes);
@@ -1687,9 +1688,9 @@ bool CMPTransaction::interpret_OracleBackup()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecContIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecContIdBytes = GetNextVarIntBytes(i);
 
     if (!vecContIdBytes.empty()) {
         contractId = DecompressInteger(vecContIdBytes);
@@ -1709,9 +1710,9 @@ bool CMPTransaction::interpret_CloseOracle()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecContIdBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecContIdBytes = GetNextVarIntBytes(i);
 
     if (!vecContIdBytes.empty()) {
         contractId = DecompressInteger(vecContIdBytes);
@@ -1731,12 +1732,12 @@ bool CMPTransaction::interpret_CommitChannel()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
 
-    std::vector<uint8_t> vecContIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecVoutBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecContIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // vout, not used
 
     if (!vecContIdBytes.empty()) {
         propertyId = DecompressInteger(vecContIdBytes);
@@ -1763,12 +1764,12 @@ bool CMPTransaction::interpret_Withdrawal_FromChannel()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
 
-    std::vector<uint8_t> vecContIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecVoutBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecContIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // vout, not used
 
     if (!vecContIdBytes.empty()) {
         propertyId = DecompressInteger(vecContIdBytes);
@@ -1794,13 +1795,13 @@ bool CMPTransaction::interpret_Instant_Trade()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyIdForSaleBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountForSaleBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecBlock = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyIdDesiredBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountDesiredBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyIdForSaleBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecAmountForSaleBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecBlock = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyIdDesiredBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecAmountDesiredBytes = GetNextVarIntBytes(i);
 
   if (!vecTypeBytes.empty()) {
       type = DecompressInteger(vecTypeBytes);
@@ -1851,13 +1852,13 @@ bool CMPTransaction::interpret_Update_PNL()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyId = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmount = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecBlock = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecVoutBef = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecVoutPay = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyId = GetNextVarIntBytes(i);
+  VarIntBytes vecAmount = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // block, not used
+  GetNextVarIntBytes(i); // vout before, not used
+  GetNextVarIntBytes(i); // vout of payment, not used
 
   if (!vecTypeBytes.empty()) {
       type = DecompressInteger(vecTypeBytes);
@@ -1894,11 +1895,11 @@ bool CMPTransaction::interpret_Transfer()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecOptionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyIdBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecOptionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyIdBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
   if (!vecTypeBytes.empty()) {
       type = DecompressInteger(vecTypeBytes);
@@ -1937,12 +1938,12 @@ bool CMPTransaction::interpret_Instant_LTC_Trade()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPropertyId = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmountForSale = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPrice = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecBlock = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecPropertyId = GetNextVarIntBytes(i);
+  VarIntBytes vecAmountForSale = GetNextVarIntBytes(i);
+  VarIntBytes vecPrice = GetNextVarIntBytes(i);
+  VarIntBytes vecBlock = GetNextVarIntBytes(i);
 
   if (!vecTypeBytes.empty()) {
       type = DecompressInteger(vecTypeBytes);
@@ -1988,14 +1989,14 @@ bool CMPTransaction::interpret_Contract_Instant()
 
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecContractId = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecAmount = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecBlock = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecPrice = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTrading = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecLeverage = GetNextVarIntBytes(i);
+  VarIntBytes vecVersionBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecTypeBytes = GetNextVarIntBytes(i);
+  VarIntBytes vecContractId = GetNextVarIntBytes(i);
+  VarIntBytes vecAmount = GetNextVarIntBytes(i);
+  VarIntBytes vecBlock = GetNextVarIntBytes(i);
+  VarIntBytes vecPrice = GetNextVarIntBytes(i);
+  VarIntBytes vecTrading = GetNextVarIntBytes(i);
+  VarIntBytes vecLeverage = GetNextVarIntBytes(i);
 
 
   if (!vecTypeBytes.empty()) {
@@ -2050,8 +2051,8 @@ bool CMPTransaction::interpret_New_Id_Registration()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
 
   const char* p = i + (char*) &pkt;
   std::vector<std::string> spstr;
@@ -2088,8 +2089,8 @@ bool CMPTransaction::interpret_Update_Id_Registration()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
 
 
   return true;
@@ -2100,8 +2101,8 @@ bool CMPTransaction::interpret_DEx_Payment()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
 
 
   if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly)
@@ -2118,8 +2119,8 @@ bool CMPTransaction::interpret_Attestation()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
 
   const char* p = i + (char*) &pkt;
   std::vector<std::string> spstr;
@@ -2150,8 +2151,8 @@ bool CMPTransaction::interpret_Revoke_Attestation()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
 
   if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly)
   {
@@ -2168,8 +2169,8 @@ bool CMPTransaction::interpret_MetaDExCancelAll()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
 
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
         PrintToLog("\t  %s(): inside interpret \n",__func__);
@@ -2183,8 +2184,8 @@ bool CMPTransaction::interpret_Close_Channel()
 {
   int i = 0;
 
-  std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-  std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+  GetNextVarIntBytes(i); // version, not used
+  GetNextVarIntBytes(i); // type, not used
 
   if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
       PrintToLog("\t  %s(): inside interpret \n",__func__);
@@ -2197,8 +2198,8 @@ bool CMPTransaction::interpret_Close_Channel()
 bool CMPTransaction::interpret_SubmitNodeAddr()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
 
 
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
@@ -2212,8 +2213,8 @@ bool CMPTransaction::interpret_SubmitNodeAddr()
 bool CMPTransaction::interpret_ClaimNodeReward()
 {
     int i = 0;
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
 
 
     if ((!rpcOnly && msc_debug_packets) || msc_debug_packets_readonly) {
@@ -2228,10 +2229,10 @@ bool CMPTransaction::interpret_SendDonation()
 {
     int i = 0;
 
-    std::vector<uint8_t> vecVersionBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecTypeBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecPropIdBytes = GetNextVarIntBytes(i);
-    std::vector<uint8_t> vecAmountBytes = GetNextVarIntBytes(i);
+    GetNextVarIntBytes(i); // version, not used
+    GetNextVarIntBytes(i); // type, not used
+    VarIntBytes vecPropIdBytes = GetNextVarIntBytes(i);
+    VarIntBytes vecAmountBytes = GetNextVarIntBytes(i);
 
     if (!vecPropIdBytes.empty()) {
         property = DecompressInteger(vecPropIdBytes);
@@ -2503,9 +2504,14 @@ int CMPTransaction::logicMath_SimpleSend()
     }
 
     // Move the tokens
-    update_tally_map(sender, property, -nValue, BALANCE);
-    update_tally_map(receiver, property, nValue, BALANCE);
+    ChangeSet changes;
+    changes.addTally(sender, property, -nValue, BALANCE);
+    changes.addTally(receiver, property, nValue, BALANCE);
 
+    if (!changes.apply()) {
+        PrintToLog("%s(): rejected: tokens of property %d can't be moved\n", __func__, property);
+        return (PKT_ERROR_SEND -25);
+    }
 
     return 0;
 }
@@ -2614,15 +2620,21 @@ int CMPTransaction::logicMath_SendMany()
     }
 
     // Move the tokens
+    ChangeSet changes;
     for (size_t i=0; i <recipients.size(); ++i) {
         auto v = values[i];
 				if (v > 0) {
-				    update_tally_map(sender, property, -v, BALANCE);
-					  update_tally_map(recipients[i], property, v, BALANCE);
+				    changes.addTally(sender, property, -v, BALANCE);
+					  changes.addTally(recipients[i], property, v, BALANCE);
 				}
 
     }
 
+    if (!changes.apply()) {
+        PrintToLog("%s(): rejected: tokens of property %d can't be moved\n", __func__, property);
+        return (PKT_ERROR_SEND -25);
+    }
+
     return 0;
 }
 
@@ -2660,16 +2672,23 @@ int CMPTransaction::logicMath_SendVestingTokens()
       return (PKT_ERROR_SEND -25);
   }
 
-  update_tally_map(sender, TL_PROPERTY_VESTING, -nValue, BALANCE);
-  update_tally_map(receiver, TL_PROPERTY_VESTING, nValue, BALANCE);
+  ChangeSet changes;
+  changes.addTally(sender, TL_PROPERTY_VESTING, -nValue, BALANCE);
+  changes.addTally(receiver, TL_PROPERTY_VESTING, nValue, BALANCE);
 
 	const int64_t unVested = getMPbalance(sender, ALL, UNVESTED);
 
 	if(0 < unVested) {
-	    update_tally_map(sender, ALL, -nValue, UNVESTED);
-	    update_tally_map(receiver, ALL, nValue, UNVESTED);
+	    // the unvested amount of the sender is cleared, if it's smaller, while the receiver gets the full amount
+	    changes.addTally(sender, ALL, -std::min(unVested, (int64_t) nValue), UNVESTED);
+	    changes.addTally(receiver, ALL, nValue, UNVESTED);
 	}
 
+  if (!changes.apply()) {
+      PrintToLog("%s(): rejected: vesting tokens can't be moved\n", __func__);
+      return (PKT_ERROR_SEND -25);
+  }
+
   vestingAddresses.insert(receiver);
 
   return 0;
@@ -2707,6 +2726,8 @@ int CMPTransaction::logicMath_SendAll()
 
     uint32_t propertyId = ptally->init();
     int numberOfPropertiesSent = 0;
+    // nothing is moved, unless all properties can be moved
+    ChangeSet changes;
 
     while (0 != (propertyId = ptally->next())) {
 
@@ -2741,10 +2762,8 @@ int CMPTransaction::logicMath_SendAll()
             }
 
             if (moneyAvailable > 0) {
-                update_tally_map(sender, propertyId, -moneyAvailable, BALANCE);
-                update_tally_map(receiver, propertyId, moneyAvailable, BALANCE);
-                p_txlistdb->recordSendAllSubRecord(txid, numberOfPropertiesSent, propertyId, moneyAvailable);
-
+                changes.addTally(sender, propertyId, -moneyAvailable, BALANCE);
+                changes.addTally(receiver, propertyId, moneyAvailable, BALANCE);
             }
         }
     }
@@ -2754,6 +2773,17 @@ int CMPTransaction::logicMath_SendAll()
         return (PKT_ERROR_SEND_ALL -55);
     }
 
+    if (!changes.apply()) {
+        PrintToLog("%s(): rejected: tokens of sender %s can't be moved\n", __func__, sender);
+        return (PKT_ERROR_SEND_ALL -55);
+    }
+
+    // every other change is the credit of the receiver
+    const std::vector<ChangeSet::TallyChange>& moved = changes.getTallyChanges();
+    for (size_t i = 1; i < moved.size(); i += 2) {
+        p_txlistdb->recordSendAllSubRecord(txid, (i + 1) / 2, moved[i].propertyId, moved[i].amount);
+    }
+
     nNewValue = numberOfPropertiesSent;
 
     return 0;
@@ -3442,10 +3472,13 @@ int CMPTransaction::logicMath_ContractDexTrade()
 
   PrintToLog("%s(): Leverage in register: %d, position: %d \n", __func__, rleverage, position);
 
+  // the leverage and the reserve are only updated, once the order passed all checks
+  ChangeSet changes;
+
   if (position == 0 && rleverage == 0) {
       //setting leverage
       PrintToLog("%s(): setting leverage: %d \n", __func__, leverage);
-      update_register_map(sender, contractId, leverage, LEVERAGE);
+      if (leverage != 0) changes.addRegister(sender, contractId, leverage, LEVERAGE);
 
   } else if(rleverage != leverage &&  0 < position) {
       PrintToLog("%s(): ERROR: Bad leverage \n", __func__);
@@ -3468,12 +3501,17 @@ int CMPTransaction::logicMath_ContractDexTrade()
       if (amountToReserve > 0)
 	    {
            //NOTE: this amount is transfered to position margin when exist matches in x_TradeBidirectional function
-	        update_tally_map(sender, colateralh, -amountToReserve, BALANCE);
-	        update_tally_map(sender, colateralh,  amountToReserve, CONTRACTDEX_RESERVE);
+	        changes.addTally(sender, colateralh, -amountToReserve, BALANCE);
+	        changes.addTally(sender, colateralh,  amountToReserve, CONTRACTDEX_RESERVE);
 	    }
 
   }
 
+  if (!changes.empty() && !changes.apply()) {
+      PrintToLog("%s(): rejected: reserve of sender %s can't be updated\n", __func__, sender);
+      return (PKT_ERROR_SEND -25);
+  }
+
   /*********************************************/
   /**Logic for Node Reward**/
   // const CConsensusParams &params = ConsensusParams();
@@ -3731,6 +3769,22 @@ int CMPTransaction::logicMath_CreatePeggedCurrency()
         return (PKT_ERROR_CONTRACTDEX -23);
     }
 
+    //putting into reserve contracts and collateral currency, checked before the property is created
+    ChangeSet changes;
+    if (contracts != 0) {
+        changes.addRegister(sender, contractId, contracts, CONTRACT_POSITION);
+        changes.addRegister(sender, contractId, contracts, CONTRACT_RESERVE);
+    }
+    if (amount != 0) {
+        changes.addTally(sender, propertyId, -amount, BALANCE);
+        changes.addTally(sender, propertyId, amount, CONTRACTDEX_RESERVE);
+    }
+
+    if (!changes.check()) {
+        PrintToLog("%s(): rejected: collateral of sender %s can't be reserved\n", __func__, sender);
+        return (PKT_ERROR_CONTRACTDEX -23);
+    }
+
 
     {
         LOCK(cs_tally);
@@ -3785,7 +3839,13 @@ int CMPTransaction::logicMath_CreatePeggedCurrency()
     _my_sps->getSP(npropertyId, SP);
 
     // synthetic tokens update
-    update_tally_map(sender, npropertyId, amount, BALANCE);
+    if (amount != 0) changes.addTally(sender, npropertyId, amount, BALANCE);
+
+    // the other changes were checked, only the credit of the synthetic tokens may still overflow
+    if (!changes.empty() && !changes.apply()) {
+        PrintToLog("%s(): ERROR: synthetic tokens of property %d not credited\n", __func__, npropertyId);
+        return (PKT_ERROR_CONTRACTDEX -23);
+    }
     // t_tradelistdb->NotifyPeggedCurrency(txid, sender, npropertyId, amount,SP.series); //TODO: Watch this function!
 
     // Adding the element to map of pegged currency owners
@@ -3799,12 +3859,6 @@ int CMPTransaction::logicMath_CreatePeggedCurrency()
     }
 
 
-    //putting into reserve contracts and collateral currency
-    update_register_map(sender, contractId, contracts, CONTRACT_POSITION);
-    update_register_map(sender, contractId, contracts, CONTRACT_RESERVE);
-    update_tally_map(sender, propertyId, -amount, BALANCE);
-    update_tally_map(sender, propertyId, amount, CONTRACTDEX_RESERVE);
-
     return 0;
 }
 
@@ -3853,9 +3907,14 @@ int CMPTransaction::logicMath_SendPeggedCurrency()
     }
 
     // Move the tokensss
+    ChangeSet changes;
+    changes.addTally(sender, propertyId, -amount, BALANCE);
+    changes.addTally(receiver, propertyId, amount, BALANCE);
 
-    update_tally_map(sender, propertyId, -amount, BALANCE);
-    update_tally_map(receiver, propertyId, amount, BALANCE);
+    if (!changes.apply()) {
+        PrintToLog("%s(): rejected: tokens of property %d can't be moved\n", __func__, propertyId);
+        return (PKT_ERROR_SEND -25);
+    }
 
     // Adding the element to map of pegged currency owners
     peggedIssuers.insert (std::pair<std::string,uint32_t>(receiver,propertyId));
@@ -3927,15 +3986,20 @@ int CMPTransaction::logicMath_RedemptionPegged()
 
     if (contractsNeeded != 0 && amount > 0)
     {
+       ChangeSet changes;
        // Delete the tokens
-       update_tally_map(sender, propertyId, -amount, BALANCE);
+       changes.addTally(sender, propertyId, -amount, BALANCE);
        // delete contracts in reserve
-       update_register_map(sender, contractId, -contractsNeeded, CONTRACT_RESERVE);
+       changes.addRegister(sender, contractId, -contractsNeeded, CONTRACT_RESERVE);
        // getting back short position
-       update_register_map(sender, contractId, -contractsNeeded, CONTRACT_POSITION);
+       changes.addRegister(sender, contractId, -contractsNeeded, CONTRACT_POSITION);
        // getting back the collateral
-       update_tally_map(sender, collateralId, amount, BALANCE);
+       changes.addTally(sender, collateralId, amount, BALANCE);
 
+       if (!changes.apply()) {
+           PrintToLog("%s(): rejected: pegged currency of sender %s can't be redeemed\n", __func__, sender);
+           return (PKT_ERROR_SEND -25);
+       }
 
     } else {
         PrintToLog("amount redeemed must be equal at least to value of 1 future contract \n");
@@ -4310,6 +4374,7 @@ int CMPTransaction::logicMath_Set_Oracle()
     Ol.close = oracle_close;
 
     oraclePrices[contractId][block] = Ol;
+    invalidateOracleTwap(contractId);
 
     // PrintToLog("%s():Ol element:,high:%d, low:%d, close:%d\n",__func__, Ol.high, Ol.low, Ol.close);
 
@@ -4648,17 +4713,23 @@ int CMPTransaction::logicMath_Instant_Trade()
 
   if (property > LTC && desired_property > LTC)
   {
-      t_tradelistdb->recordNewInstantTrade(txid, chn.getMultisig(), chn.getFirst(), chn.getSecond(), property, amount_forsale, desired_property, desired_value, block, tx_idx);
-
       PrintToLog("%s(): sender: %s, receiver: %s, special: %s, multisig: %s, first: %s, second: %s,  property: %d, amount_forsale: %d, desired_property: %d, desired_value: %d, block: %d\n",__func__, sender, receiver, special, chn.getMultisig(), chn.getFirst(), chn.getSecond(), property, amount_forsale, desired_property, desired_value, block);
 
+      ChangeSet changes;
+      changes.addTally(special, desired_property, desired_value, BALANCE);
+      changes.addTally(receiver, property, amount_forsale, BALANCE);
+
+      if (!changes.apply()) {
+          PrintToLog("%s(): rejected: traded tokens can't be credited\n", __func__);
+          return (PKT_ERROR_CHANNELS -19);
+      }
+
+      t_tradelistdb->recordNewInstantTrade(txid, chn.getMultisig(), chn.getFirst(), chn.getSecond(), property, amount_forsale, desired_property, desired_value, block, tx_idx);
+
       // updating channel balance for each address
       chn.updateChannelBal(special, property, -amount_forsale);
       chn.updateChannelBal(receiver, desired_property, -desired_value);
 
-      update_tally_map(special, desired_property, desired_value, BALANCE);
-      update_tally_map(receiver, property, amount_forsale, BALANCE);
-
   }
 
   return rc;
@@ -4869,10 +4940,14 @@ int CMPTransaction::logicMath_Contract_Instant()
             return 0;
         }
 
-        update_tally_map(chn.getFirst(), sp.collateral_currency, amountToReserve, CONTRACTDEX_RESERVE);
-        if (msc_debug_contract_instant_trade) PrintToLog("%s(): first address reserve done\n", __func__);
-        update_tally_map(chn.getSecond(), sp.collateral_currency, amountToReserve, CONTRACTDEX_RESERVE);
-        if (msc_debug_contract_instant_trade) PrintToLog("%s(): second address reserve done\n", __func__);
+        ChangeSet changes;
+        changes.addTally(chn.getFirst(), sp.collateral_currency, amountToReserve, CONTRACTDEX_RESERVE);
+        changes.addTally(chn.getSecond(), sp.collateral_currency, amountToReserve, CONTRACTDEX_RESERVE);
+        if (!changes.apply()) {
+            PrintToLog("%s(): reserves of the channel addresses can't be updated\n", __func__);
+            return 0;
+        }
+        if (msc_debug_contract_instant_trade) PrintToLog("%s(): reserves of both addresses done\n", __func__);
 
         mastercore::Instant_x_Trade(txid, itrading_action, chn.getMultisig(), chn.getFirst(), chn.getSecond(), contractId, instant_amount, price, sp.collateral_currency, sp.prop_type, block, tx_idx);
 
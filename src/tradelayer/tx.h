@@ -7,6 +7,7 @@ class CTransaction;
 class CMPContractDex;
 
 #include <tradelayer/tradelayer.h>
+#include <tradelayer/varint.h>
 
 #include <uint256.h>
 #include <util/strencodings.h>
@@ -163,7 +164,7 @@ private:
     /**
      * Variable Integers
      */
-    std::vector<uint8_t> GetNextVarIntBytes(int &i);
+    VarIntBytes GetNextVarIntBytes(int &i);
 
     /**
      * Payload parsing
@@ -17,6 +17,12 @@ bool IsMSBSet(unsigned char* byte) {
 // Compresses an integer with variable length encoding
 std::vector<uint8_t> CompressInteger(uint64_t value) {
     std::vector<uint8_t> compressedBytes;
+    CompressInteger(value, compressedBytes);
+    return compressedBytes;
+}
+
+// Compresses an integer with variable length encoding, and appends it to the given bytes
+void CompressInteger(uint64_t value, std::vector<uint8_t>& compressedBytes) {
     // Loop while there are still >7 bits remaining
     while (value > 127) {
         // Set the MSB with Bitwise OR | 128 (128 = bits 100000000)
@@ -25,20 +31,22 @@ std::vector<uint8_t> CompressInteger(uint64_t value) {
         value >>= 7;
     }
     compressedBytes.push_back(value);
-    return compressedBytes;
 }
 
 // Decompresses an integer with variable length encoding
 // TODO - exploitable in any way? any potential overruns or other gotchas with byte shifting?
-uint64_t DecompressInteger(std::vector<uint8_t> compressedBytes) {
-    std::vector<uint8_t>::const_iterator it;
+uint64_t DecompressInteger(const std::vector<uint8_t>& compressedBytes) {
+    const VarIntBytes bytes = { compressedBytes.data(), compressedBytes.size() };
+    return DecompressInteger(bytes);
+}
+
+// Decompresses an integer with variable length encoding, in place
+uint64_t DecompressInteger(const VarIntBytes& compressedBytes) {
     uint64_t value = 0;
-    int byteCount = 0;
     // Iterate over the bytes adding the 7 least significant bits from each and bitshifting accordingly
-    for (it = compressedBytes.begin(); it != compressedBytes.end(); it++) {
-        uint8_t byte = *it;
+    for (size_t byteCount = 0; byteCount < compressedBytes.size; byteCount++) {
+        const uint8_t byte = compressedBytes.data[byteCount];
         value |= (uint64_t)(byte & 127) << (7 * byteCount);
-        byteCount++;
     }
     return value;
 }
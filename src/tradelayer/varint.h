@@ -1,16 +1,32 @@
 #ifndef TRADELAYER_VARINT_H
 #define TRADELAYER_VARINT_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
+/** Bytes of one variable length integer, which point into the buffer they were read from. */
+struct VarIntBytes
+{
+    const uint8_t* data;
+    size_t size;
+
+    bool empty() const { return size == 0; }
+};
+
 // Returns true if a byte has the MSB set
 bool IsMSBSet(unsigned char* byte);
 
-// Compresses an integer with variable length encoding
-uint64_t DecompressInteger(std::vector<uint8_t> compressedBytes);
-
 // Decompresses an integer with variable length encoding
+uint64_t DecompressInteger(const std::vector<uint8_t>& compressedBytes);
+
+// Decompresses an integer with variable length encoding, in place
+uint64_t DecompressInteger(const VarIntBytes& compressedBytes);
+
+// Compresses an integer with variable length encoding
 std::vector<uint8_t> CompressInteger(uint64_t value);
 
+// Compresses an integer with variable length encoding, and appends it to the given bytes
+void CompressInteger(uint64_t value, std::vector<uint8_t>& compressedBytes);
+
 #endif // TRADELAYER_VARINT_H
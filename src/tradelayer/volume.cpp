@@ -0,0 +1,143 @@
+#include <tradelayer/volume.h>
+
+#include <tradelayer/tally.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdint.h>
+
+namespace mastercore
+{
+void VolumeMap::update(int block, uint32_t propertyId, int64_t amount, bool replace)
+{
+    PropertyVolumes& p = volumes[propertyId];
+
+    // the common case: a volume of the latest block
+    if (p.blocks.empty() || p.blocks.back() < block) {
+        const sum_t before = p.sums.empty() ? sum_t(0) : p.sums.back();
+        p.blocks.push_back(block);
+        p.volumes.push_back(amount);
+        p.sums.push_back(before + amount);
+        return;
+    }
+
+    const size_t n = std::lower_bound(p.blocks.begin(), p.blocks.end(), block) - p.blocks.begin();
+    if (p.blocks[n] != block) {
+        // a block before the latest one, the running sums after it are shifted
+        const sum_t before = (n > 0) ? p.sums[n - 1] : sum_t(0);
+        p.blocks.insert(p.blocks.begin() + n, block);
+        p.volumes.insert(p.volumes.begin() + n, 0);
+        p.sums.insert(p.sums.begin() + n, before);
+    }
+
+    const int64_t delta = replace ? amount - p.volumes[n] : amount;
+    p.volumes[n] += delta;
+    for (size_t i = n; i < p.sums.size(); ++i) {
+        p.sums[i] += delta;
+    }
+}
+
+void VolumeMap::add(int block, uint32_t propertyId, int64_t amount)
+{
+    update(block, propertyId, amount, false);
+}
+
+void VolumeMap::set(int block, uint32_t propertyId, int64_t amount)
+{
+    update(block, propertyId, amount, true);
+}
+
+int64_t VolumeMap::get(int block, uint32_t propertyId) const
+{
+    auto it = volumes.find(propertyId);
+    if (it == volumes.end()) return 0;
+
+    const PropertyVolumes& p = it->second;
+    auto itBlock = std::lower_bound(p.blocks.begin(), p.blocks.end(), block);
+
+    return (itBlock != p.blocks.end() && *itBlock == block) ? p.volumes[itBlock - p.blocks.begin()] : 0;
+}
+
+bool VolumeMap::sum(int64_t& amount, uint32_t propertyId, int fblock, int sblock) const
+{
+    auto it = volumes.find(propertyId);
+    if (it == volumes.end()) return true;
+
+    const PropertyVolumes& p = it->second;
+    const size_t first = (fblock != 0) ? std::lower_bound(p.blocks.begin(), p.blocks.end(), fblock) - p.blocks.begin() : 0;
+    const size_t last = std::upper_bound(p.blocks.begin(), p.blocks.end(), sblock) - p.blocks.begin();
+    if (first >= last) return true;
+
+    const sum_t total = p.sums[last - 1] - p.sums[first] + p.volumes[first];
+    if (std::numeric_limits<int64_t>::min() <= total && total <= std::numeric_limits<int64_t>::max() &&
+            !isOverflow(amount, static_cast<int64_t>(total))) {
+        amount += static_cast<int64_t>(total);
+        return true;
+    }
+
+    // find the block, which overflows
+    for (size_t n = first; n < last; ++n)
+    {
+        if (isOverflow(amount, p.volumes[n])) {
+            return false;
+        }
+        amount += p.volumes[n];
+    }
+
+    return true;
+}
+
+void VolumeMap::prune(int firstBlock)
+{
+    for (auto it = volumes.begin(); it != volumes.end(); )
+    {
+        PropertyVolumes& p = it->second;
+        // the running sums of the remaining blocks stay as they are
+        while (!p.blocks.empty() && p.blocks.front() < firstBlock) {
+            p.blocks.pop_front();
+            p.volumes.pop_front();
+            p.sums.pop_front();
+        }
+        it = p.blocks.empty() ? volumes.erase(it) : std::next(it);
+    }
+}
+
+void VolumeMap::visit(const std::function<void(int, uint32_t, int64_t)>& visitor) const
+{
+    for (const auto& p : volumes) {
+        for (size_t n = 0; n < p.second.blocks.size(); ++n) {
+            visitor(p.second.blocks[n], p.first, p.second.volumes[n]);
+        }
+    }
+}
+
+VWAPWindow::VWAPWindow() : nFills(0), numeratorSum(0), denominatorSum(0)
+{
+    numerators.fill(0);
+    denominators.fill(0);
+}
+
+void VWAPWindow::add(int64_t numerator, int64_t denominator)
+{
+    const size_t slot = nFills % volumeToVWAP;
+
+    // drop the oldest fill first, so the sums never exceed the ones of a full window
+    numeratorSum -= numerators[slot];
+    denominatorSum -= denominators[slot];
+
+    numerators[slot] = numerator;
+    denominators[slot] = denominator;
+    numeratorSum += numerator;
+    denominatorSum += denominator;
+
+    ++nFills;
+}
+
+size_t VWAPWindow::size() const
+{
+    return std::min<size_t>(nFills, volumeToVWAP);
+}
+}
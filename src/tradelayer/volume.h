@@ -0,0 +1,103 @@
+#ifndef TRADELAYER_VOLUME_H
+#define TRADELAYER_VOLUME_H
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <boost/multiprecision/cpp_int.hpp>
+
+//Twap constant
+const int volumeToVWAP = 10;
+
+namespace mastercore
+{
+/** Traded volumes by property and block.
+ *
+ * The volumes of each property are kept in block order, together with their
+ * running sum, so the sum over a range of blocks is the difference of two
+ * running sums, found by binary search. New blocks are appended at the end,
+ * only a change of an older block updates the running sums after it.
+ */
+class VolumeMap
+{
+private:
+    typedef boost::multiprecision::int128_t sum_t;
+
+    //! Volumes of one property, ascending by block
+    struct PropertyVolumes
+    {
+        std::deque<int> blocks;
+        std::deque<int64_t> volumes;
+        //! Sum of the volumes up to and including each block, since the first one ever added
+        std::deque<sum_t> sums;
+    };
+
+    //! Volumes by property
+    std::map<uint32_t, PropertyVolumes> volumes;
+
+    /** Adds amount to the volume of a property in a block, or replaces the volume by it. */
+    void update(int block, uint32_t propertyId, int64_t amount, bool replace);
+
+public:
+    /** Adds to the volume of a property in a block. */
+    void add(int block, uint32_t propertyId, int64_t amount);
+
+    /** Replaces the volume of a property in a block. */
+    void set(int block, uint32_t propertyId, int64_t amount);
+
+    /** Returns the volume of a property in a block. */
+    int64_t get(int block, uint32_t propertyId) const;
+
+    /**
+     * Adds the volumes of a property from fblock (0 for the first block) to
+     * sblock to amount.
+     *
+     * @return False, if the sum overflows, amount then holds the sum up to the block before
+     */
+    bool sum(int64_t& amount, uint32_t propertyId, int fblock, int sblock) const;
+
+    /** Drops the volumes of all blocks before firstBlock. */
+    void prune(int firstBlock);
+
+    /** Calls the visitor for each volume, ordered by property and block. */
+    void visit(const std::function<void(int, uint32_t, int64_t)>& visitor) const;
+
+    void clear() { volumes.clear(); }
+    bool empty() const { return volumes.empty(); }
+};
+
+/** The latest volumeToVWAP fills of a market, for its VWAP.
+ *
+ * Older fills are overwritten, and the sums of the window are kept up to date,
+ * so both adding a fill and reading the sums take constant time.
+ */
+class VWAPWindow
+{
+private:
+    //! Price times volume, and volume of each fill, by slot
+    std::array<int64_t, volumeToVWAP> numerators;
+    std::array<int64_t, volumeToVWAP> denominators;
+    //! Number of fills ever added
+    size_t nFills;
+    int64_t numeratorSum;
+    int64_t denominatorSum;
+
+public:
+    VWAPWindow();
+
+    /** Adds a fill, replacing the oldest one, once the window is full. */
+    void add(int64_t numerator, int64_t denominator);
+
+    int64_t getNumerator() const { return numeratorSum; }
+    int64_t getDenominator() const { return denominatorSum; }
+
+    /** Returns the number of fills in the window. */
+    size_t size() const;
+};
+}
+
+#endif // TRADELAYER_VOLUME_H
@@ -94,7 +94,7 @@ int WalletCacheUpdate()
 
     LOCK(cs_tally);
 
-    for (std::unordered_map<string, CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
+    for (AccountMap<CMPTally>::iterator my_it = mp_tally_map.begin(); my_it != mp_tally_map.end(); ++my_it) {
         const std::string& address = my_it->first;
 
         // determine if this address is in the wallet
@@ -0,0 +1,101 @@
+#include <tradelayer/workerpool.h>
+
+#include <tradelayer/log.h>
+
+#include <util/threadnames.h>
+
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace mastercore
+{
+WorkerPool::WorkerPool(size_t nThreads) : pTask(nullptr), nTasks(0), nNext(0), nDone(0), fStop(false)
+{
+    workers.reserve(nThreads);
+
+    for (size_t n = 0; n < nThreads; ++n) {
+        try {
+            workers.emplace_back(&WorkerPool::workerLoop, this);
+        } catch (const std::system_error& e) {
+            // the pool works with fewer threads, down to none
+            PrintToLog("%s(): started %d of %d workers: %s\n", __func__, workers.size(), nThreads, e.what());
+            break;
+        }
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_pool);
+        fStop = true;
+        cond_tasks.notify_all();
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void WorkerPool::runTasks(std::unique_lock<std::mutex>& lock)
+{
+    while (nNext < nTasks)
+    {
+        const size_t n = nNext++;
+        const std::function<void(size_t)>& task = *pTask;
+
+        lock.unlock();
+        task(n);
+        lock.lock();
+
+        if (++nDone == nTasks) {
+            cond_done.notify_all();
+        }
+    }
+}
+
+void WorkerPool::workerLoop()
+{
+    util::ThreadRename("tl-worker");
+
+    std::unique_lock<std::mutex> lock(cs_pool);
+    while (true)
+    {
+        cond_tasks.wait(lock, [this] { return fStop || nNext < nTasks; });
+        if (fStop) break;
+
+        runTasks(lock);
+    }
+}
+
+void WorkerPool::run(size_t nTasksIn, const std::function<void(size_t)>& task)
+{
+    if (nTasksIn == 0) return;
+
+    std::unique_lock<std::mutex> lock(cs_pool);
+    pTask = &task;
+    nTasks = nTasksIn;
+    nNext = 0;
+    nDone = 0;
+    cond_tasks.notify_all();
+
+    // the caller takes part, and runs everything, if there are no workers
+    runTasks(lock);
+    cond_done.wait(lock, [this] { return nDone == nTasks; });
+
+    // nothing is handed out, until the next pass
+    pTask = nullptr;
+    nTasks = 0;
+    nNext = 0;
+    nDone = 0;
+}
+}
@@ -0,0 +1,65 @@
+#ifndef TRADELAYER_WORKERPOOL_H
+#define TRADELAYER_WORKERPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+namespace mastercore
+{
+/**
+ * Threads, which are started once and run the tasks of many passes.
+ *
+ * Each call of run() hands out the tasks to the workers and to the calling
+ * thread, and returns once all of them are done. Only one pass runs at a time.
+ */
+class WorkerPool
+{
+private:
+    std::mutex cs_pool;
+    //! Wakes the workers, once there are tasks, or once they are stopped
+    std::condition_variable cond_tasks;
+    //! Wakes the caller of run(), once all tasks are done
+    std::condition_variable cond_done;
+
+    //! The task of the current pass, guarded by cs_pool
+    const std::function<void(size_t)>* pTask;
+    //! Number of tasks, of handed out ones and of finished ones, guarded by cs_pool
+    size_t nTasks;
+    size_t nNext;
+    size_t nDone;
+    bool fStop;
+
+    std::vector<std::thread> workers;
+
+    void workerLoop();
+
+    /** Runs tasks, until none is left to be handed out; requires cs_pool. */
+    void runTasks(std::unique_lock<std::mutex>& lock);
+
+public:
+    /** Starts up to nThreads workers, fewer, if no more threads can be started. */
+    explicit WorkerPool(size_t nThreads);
+
+    /** Stops and joins the workers. */
+    ~WorkerPool();
+
+    /** Number of workers, which were started. */
+    size_t size() const { return workers.size(); }
+
+    /**
+     * Runs task(0) to task(nTasks - 1), and returns, once all of them are done.
+     *
+     * Tasks must not throw. Without workers, the tasks run on the calling thread.
+     */
+    void run(size_t nTasks, const std::function<void(size_t)>& task);
+
+    /** Stops and joins the workers, later passes run on the calling thread. */
+    void stop();
+};
+}
+
+#endif // TRADELAYER_WORKERPOOL_H